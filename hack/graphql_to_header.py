@@ -1,27 +1,672 @@
+"""Generates C sources from a GraphQL query.
+
+Usage: graphql_to_header.py <query.graphql> <header.h> <name> [<source.c>]
+
+The header always declares the query text as `name`. When a source file is
+requested and the query's directory has a schema.graphql describing the types
+it selects, the generator also emits a struct for every selection set and a
+single-pass decoder that reads a response straight into them:
+
+    int name_decode(const char *json, size_t len, struct name_data *out);
+    void name_data_free(struct name_data *data);
+
+Object keys are matched by their FNV-1a hash, computed here at build time.
+"""
+
+import os
+import re
 import sys
 from pathlib import Path
 
-input_path = Path(sys.argv[1])
-output_path = Path(sys.argv[2])
-var_name = sys.argv[3]
+FNV_BASIS = 2166136261
+FNV_PRIME = 16777619
+
+# GraphQL scalars that don't map to strings
+SCALARS = {
+    'Boolean': ('int', 'json_read_bool', 'a boolean'),
+    'Int': ('long long', 'json_read_int', 'a number'),
+    'Float': ('double', 'json_read_double', 'a number'),
+}
+STRING = ('char *', 'json_read_string', 'a string')
+
+
+class GraphQLError(Exception):
+    pass
+
+
+def tokenize(text):
+    token_re = re.compile(r'''
+        (?P<ws>[\s,﻿]+|\#[^\n]*)
+      | (?P<block>"""(?:\\"""|[^"]|"(?!""))*""")
+      | (?P<string>"(?:\\.|[^"\\\n])*")
+      | (?P<spread>\.\.\.)
+      | (?P<punct>[!$&()\[\]{}:=@|])
+      | (?P<name>[_A-Za-z][_0-9A-Za-z]*)
+      | (?P<number>-?\d+(?:\.\d+)?(?:[eE][+-]?\d+)?)
+    ''', re.VERBOSE)
+    pos = 0
+    tokens = []
+    while pos < len(text):
+        m = token_re.match(text, pos)
+        if not m:
+            raise GraphQLError(f'unexpected character {text[pos]!r}')
+        pos = m.end()
+        if m.lastgroup != 'ws':
+            tokens.append(m.group())
+    return tokens
+
+
+class Parser:
+    def __init__(self, text):
+        self.tokens = tokenize(text)
+        self.pos = 0
+
+    def peek(self):
+        return self.tokens[self.pos] if self.pos < len(self.tokens) else None
+
+    def take(self, expected=None):
+        tok = self.peek()
+        if tok is None or (expected is not None and tok != expected):
+            raise GraphQLError(f'expected {expected or "token"}, got {tok}')
+        self.pos += 1
+        return tok
+
+    def skip_balanced(self, open_tok, close_tok):
+        depth = 0
+        while True:
+            tok = self.take()
+            if tok == open_tok:
+                depth += 1
+            elif tok == close_tok:
+                depth -= 1
+                if depth == 0:
+                    return
+
+    def skip_directives(self):
+        while self.peek() == '@':
+            self.take()
+            self.take()
+            if self.peek() == '(':
+                self.skip_balanced('(', ')')
+
+    # Schema
+
+    def type_ref(self):
+        if self.peek() == '[':
+            self.take('[')
+            inner = self.type_ref()
+            self.take(']')
+            ref = {'list': inner}
+        else:
+            ref = {'name': self.take()}
+        ref['non_null'] = self.peek() == '!'
+        if ref['non_null']:
+            self.take('!')
+        return ref
+
+    def schema(self):
+        types = {}
+        while self.peek() is not None:
+            if self.peek().startswith('"'):
+                self.take()
+                continue
+            kind = self.take()
+            if kind == 'extend':
+                kind = self.take()
+            if kind == 'schema':
+                self.skip_directives()
+                self.skip_balanced('{', '}')
+                continue
+            name = self.take()
+            if kind == 'scalar':
+                self.skip_directives()
+                types[name] = {'kind': 'scalar'}
+            elif kind == 'enum':
+                self.skip_directives()
+                self.skip_balanced('{', '}')
+                types[name] = {'kind': 'scalar'}
+            elif kind == 'union':
+                raise GraphQLError(f'union {name} is not supported')
+            elif kind in ('type', 'interface', 'input'):
+                while self.peek() not in ('{', None):
+                    self.take()
+                types[name] = {'kind': kind, 'fields': self.fields()}
+            else:
+                raise GraphQLError(f'unexpected {kind} in schema')
+        return types
+
+    def fields(self):
+        fields = {}
+        self.take('{')
+        while self.peek() != '}':
+            if self.peek().startswith('"'):
+                self.take()
+                continue
+            name = self.take()
+            if self.peek() == '(':
+                self.skip_balanced('(', ')')
+            self.take(':')
+            fields[name] = self.type_ref()
+            if self.peek() == '=':
+                self.take('=')
+                self.take()
+            self.skip_directives()
+        self.take('}')
+        return fields
+
+    # Query
+
+    def query(self):
+        self.take('query')
+        if self.peek() not in ('(', '{'):
+            self.take()
+        if self.peek() == '(':
+            self.skip_balanced('(', ')')
+        self.skip_directives()
+        return self.selection_set()
+
+    def selection_set(self):
+        selections = []
+        self.take('{')
+        while self.peek() != '}':
+            if self.peek() == '...':
+                raise GraphQLError('fragments are not supported')
+            alias = name = self.take()
+            if self.peek() == ':':
+                self.take(':')
+                name = self.take()
+            if self.peek() == '(':
+                self.skip_balanced('(', ')')
+            self.skip_directives()
+            children = None
+            if self.peek() == '{':
+                children = self.selection_set()
+            selections.append((alias, name, children))
+        self.take('}')
+        return selections
+
+
+def snake_case(name):
+    return re.sub(r'(?<=[a-z0-9])([A-Z])', r'_\1', name).lower()
+
+
+def fnv1a(key):
+    h = FNV_BASIS
+    for b in key.encode():
+        h = ((h ^ b) * FNV_PRIME) & 0xffffffff
+    return h
+
+
+class Field:
+    def __init__(self, key, c_name, ref, obj):
+        self.key = key
+        self.c_name = c_name
+        self.ref = ref
+        # Struct of the selection set, None for scalars
+        self.obj = obj
+        self.is_list = 'list' in ref
+        elem = ref['list'] if self.is_list else ref
+        if 'list' in elem:
+            raise GraphQLError(f'{key}: nested lists are not supported')
+        self.elem_name = elem['name']
+        self.elem_non_null = elem['non_null']
+        self.non_null = ref['non_null']
+
+    def graphql_type(self):
+        def fmt(ref):
+            s = f'[{fmt(ref["list"])}]' if 'list' in ref else ref['name']
+            return s + ('!' if ref['non_null'] else '')
+        return fmt(self.ref)
+
+
+class Struct:
+    def __init__(self, name, fields):
+        self.name = name
+        self.fields = fields
+
+
+def struct_name(var_name, path, structs):
+    """Names the struct of a selection set after the shortest suffix of its
+    field path that no other struct uses."""
+    taken = {s.name for s in structs}
+    for i in range(len(path) - 1, -1, -1):
+        name = '_'.join([var_name] + path[i:])
+        if name not in taken:
+            return name
+    raise GraphQLError(f'no unique name for {".".join(path)}')
+
 
-with input_path.open() as f:
-    lines = f.readlines()
+def resolve(selections, type_name, var_name, path, types, structs):
+    """Builds the struct of a selection set and of all nested ones, innermost
+    first."""
+    gql_type = types.get(type_name)
+    if not gql_type or 'fields' not in gql_type:
+        raise GraphQLError(f'type {type_name} is not in the schema')
+    fields = []
+    for alias, name, children in selections:
+        if name == '__typename':
+            ref = {'name': 'String', 'non_null': True}
+        elif name in gql_type['fields']:
+            ref = gql_type['fields'][name]
+        else:
+            raise GraphQLError(f'{type_name} has no field {name}')
+        elem = ref['list'] if 'list' in ref else ref
+        is_scalar = 'name' in elem and (
+            elem['name'] in SCALARS or elem['name'] == 'String' or
+            types.get(elem['name'], {}).get('kind') == 'scalar')
+        c_name = snake_case(alias)
+        obj = None
+        if children is not None:
+            if is_scalar:
+                raise GraphQLError(f'{name} is a scalar')
+            obj = resolve(children, elem.get('name'), var_name,
+                          path + [c_name], types, structs)
+        elif not is_scalar:
+            raise GraphQLError(f'{name} needs a selection set')
+        fields.append(Field(alias, c_name, ref, obj))
+    if len(fields) > 64:
+        raise GraphQLError(f'{type_name} selects more than 64 fields')
+    name = struct_name(var_name, path, structs) if path else f'{var_name}_data'
+    struct = Struct(name, fields)
+    structs.append(struct)
+    return struct
 
-output_path.parent.mkdir(parents=True, exist_ok=True)
-with output_path.open("w") as f:
-    f.write(
-        f'''#ifndef QUERIES_{var_name.upper()}_H
-#define QUERIES_{var_name.upper()}_H
 
+def scalar_info(field):
+    return SCALARS.get(field.elem_name, STRING)
+
+
+def emit_struct(struct):
+    lines = [f'struct {struct.name} {{']
+    for f in struct.fields:
+        lines.append(f'\t/// {f.key}: {f.graphql_type()}')
+        if f.obj:
+            elem = f'struct {f.obj.name} '
+        else:
+            elem = scalar_info(f)[0]
+            elem += '' if elem.endswith('*') else ' '
+        if f.is_list:
+            lines.append(f'\t{elem}*{f.c_name};')
+            lines.append(f'\tsize_t {f.c_name}_len;')
+        elif f.obj and not f.non_null:
+            lines.append(f'\t{elem}*{f.c_name};')
+        else:
+            lines.append(f'\t{elem}{f.c_name};')
+    lines.append('};')
+    return '\n'.join(lines)
+
+
+def emit_free(struct):
+    lines = [f'static void free_{struct.name}(struct {struct.name} *v)', '{']
+    for f in struct.fields:
+        if f.is_list:
+            if f.obj or scalar_info(f) == STRING:
+                lines.append(
+                    f'\tfor (size_t i = 0; i < v->{f.c_name}_len; i++)')
+                lines.append(f'\t\tfree_{f.obj.name}(&v->{f.c_name}[i]);'
+                             if f.obj else f'\t\tgfree(v->{f.c_name}[i]);')
+            lines.append(f'\tgfree(v->{f.c_name});')
+        elif f.obj and not f.non_null:
+            lines.append(f'\tif (v->{f.c_name})')
+            lines.append(f'\t\tfree_{f.obj.name}(v->{f.c_name});')
+            lines.append(f'\tgfree(v->{f.c_name});')
+        elif f.obj:
+            lines.append(f'\tfree_{f.obj.name}(&v->{f.c_name});')
+        elif scalar_info(f) == STRING:
+            lines.append(f'\tgfree(v->{f.c_name});')
+    if len(lines) == 2:
+        lines.append('\t(void) v;')
+    lines.append('}')
+    return '\n'.join(lines)
+
+
+def emit_value(f, target, indent, var='ret'):
+    """Emits code reading one value of the field into target, setting var to
+    1 if it was read and 0 if it was null."""
+    t = '\t' * indent
+    decl = 'const int ' if var != 'ret' else ''
+    if f.obj:
+        return [f'{t}{decl}{var} = decode_{f.obj.name}(r, {target});',
+                f'{t}if ({var} < 0)',
+                f'{t}\treturn -1;']
+    reader, what = scalar_info(f)[1:]
+    return [f'{t}{decl}{var} = {reader}(r, {target});',
+            f'{t}if ({var} < 0) {{',
+            f'{t}\tfprintf(stderr, "Error: {f.key} is not {what}\\n");',
+            f'{t}\treturn -1;',
+            f'{t}}}']
+
+
+def emit_member(f):
+    """Emits code reading the value of a matched object member."""
+    lines = []
+    if f.is_list:
+        elem = f'struct {f.obj.name}' if f.obj else scalar_info(f)[0]
+        lines += [
+            '\t\tret = json_array_begin(r);',
+            '\t\tif (ret < 0) {',
+            f'\t\t\tfprintf(stderr, "Error: {f.key} is not an array\\n");',
+            '\t\t\treturn -1;',
+            '\t\t}',
+            '\t\tsize_t cap = 0;',
+            '\t\twhile (ret == 1 && (ret = json_array_next(r)) == 1) {',
+            f'\t\t\tif (out->{f.c_name}_len == cap) {{',
+            '\t\t\t\tcap = cap ? cap * 2 : 16;',
+            f'\t\t\t\t{elem} *items = grealloc(out->{f.c_name},',
+            '\t\t\t\t\t\t\tsizeof(*items) * cap);',
+            '\t\t\t\tif (!items)',
+            '\t\t\t\t\treturn -1;',
+            f'\t\t\t\tout->{f.c_name} = items;',
+            '\t\t\t}',
+            f'\t\t\t{elem} *item = &out->{f.c_name}[out->{f.c_name}_len];',
+        ]
+        if f.obj:
+            lines.append('\t\t\tmemset(item, 0, sizeof(*item));')
+        if f.obj:
+            # The item only joins the list once it is complete
+            lines += [
+                f'\t\t\tconst int item_ret = decode_{f.obj.name}(r, item);',
+                '\t\t\tif (item_ret < 0) {',
+                f'\t\t\t\tfree_{f.obj.name}(item);',
+                '\t\t\t\treturn -1;',
+                '\t\t\t}',
+            ]
+        else:
+            lines += emit_value(f, 'item', 3, 'item_ret')
+        lines += [
+            '\t\t\t// Null elements are dropped',
+            '\t\t\tif (item_ret == 1)',
+            f'\t\t\t\tout->{f.c_name}_len++;',
+            '\t\t}',
+            '\t\tif (ret < 0)',
+            '\t\t\treturn -1;',
+        ]
+        return lines
+    if f.obj and not f.non_null:
+        lines += [
+            f'\t\tif (json_read_null(r))',
+            '\t\t\tbreak;',
+            f'\t\tout->{f.c_name} = gcalloc(1, sizeof(*out->{f.c_name}));',
+            f'\t\tif (!out->{f.c_name})',
+            '\t\t\treturn -1;',
+        ]
+        lines += emit_value(f, f'out->{f.c_name}', 2)
+    else:
+        lines += emit_value(f, f'&out->{f.c_name}', 2)
+    if f.non_null:
+        lines += ['\t\tif (ret == 0) {',
+                  f'\t\t\tfprintf(stderr, "Error: {f.key} is null\\n");',
+                  '\t\t\treturn -1;',
+                  '\t\t}']
+    return lines
+
+
+def emit_decoder(struct):
+    lines = [
+        '/**',
+        f' * Decodes an object into struct {struct.name}.',
+        ' * @return 1 if an object was decoded, 0 if the value is null, -1 on',
+        ' * error',
+        ' */',
+        f'static int decode_{struct.name}(struct json_reader *r,',
+        f'\t\tstruct {struct.name} *out)',
+        '{',
+        '\tconst char *key;',
+        '\tsize_t key_len;',
+        '\tuint32_t hash;',
+        '\tuint64_t seen = 0;',
+        '\tint ret = json_object_begin(r);',
+        '\tif (ret <= 0)',
+        '\t\treturn ret;',
+        '',
+        '\twhile ((ret = json_object_next(r, &key, &key_len, &hash)) == 1) {',
+        '\t\tint field = -1;',
+        '\t\tswitch (hash) {',
+    ]
+    by_hash = {}
+    for i, f in enumerate(struct.fields):
+        by_hash.setdefault(fnv1a(f.key), []).append((i, f))
+    for h, group in sorted(by_hash.items()):
+        lines.append(f'\t\tcase 0x{h:08x}u:')
+        for i, f in group:
+            klen = len(f.key.encode())
+            lines += [
+                f'\t\t\tif (key_len == {klen} && '
+                f'!memcmp(key, "{f.key}", {klen}))',
+                f'\t\t\t\tfield = {i};',
+            ]
+        lines.append('\t\t\tbreak;')
+    lines += [
+        '\t\tdefault:',
+        '\t\t\tbreak;',
+        '\t\t}',
+        '',
+        '\t\t// Unknown and repeated keys are skipped',
+        '\t\tif (field < 0 || seen & UINT64_C(1) << field) {',
+        '\t\t\tif (json_skip(r) < 0)',
+        '\t\t\t\treturn -1;',
+        '\t\t\tcontinue;',
+        '\t\t}',
+        '\t\tseen |= UINT64_C(1) << field;',
+        '',
+        '\t\tswitch (field) {',
+    ]
+    for i, f in enumerate(struct.fields):
+        lines.append(f'\t\tcase {i}: {{ // {f.key}')
+        lines += ['\t' + line for line in emit_member(f)]
+        lines += ['\t\t\tbreak;', '\t\t}']
+    lines += [
+        '\t\t}',
+        '\t}',
+        '\tif (ret < 0)',
+        '\t\treturn -1;',
+    ]
+    for i, f in enumerate(struct.fields):
+        if f.non_null:
+            lines += [
+                f'\tif (!(seen & UINT64_C(1) << {i})) {{',
+                f'\t\tfprintf(stderr, "Error: {f.key} not found\\n");',
+                '\t\treturn -1;',
+                '\t}',
+            ]
+    lines += ['\treturn 1;', '}']
+    return '\n'.join(lines)
+
+
+def emit_entry_points(name):
+    return f'''/**
+ * Prints the messages of a GraphQL errors array.
+ * @return 0 on success, -1 on error
+ */
+static int read_errors(struct json_reader *r)
+{{
+	int ret = json_array_begin(r);
+	while (ret == 1 && (ret = json_array_next(r)) == 1) {{
+		const char *key;
+		size_t key_len;
+		uint32_t hash;
+		char *message = NULL;
+
+		ret = json_object_begin(r);
+		while (ret == 1 &&
+		       (ret = json_object_next(r, &key, &key_len, &hash)) == 1) {{
+			if (key_len == 7 && !memcmp(key, "message", 7) &&
+			    !message)
+				ret = json_read_string(r, &message) < 0 ? -1 : 1;
+			else
+				ret = json_skip(r) < 0 ? -1 : 1;
+		}}
+		fprintf(stderr, "Github Error: %s\\n",
+			message ? message : "Unknown error");
+		gfree(message);
+		if (ret < 0)
+			return -1;
+		ret = 1;
+	}}
+	return ret < 0 ? -1 : 0;
+}}
+
+int {name}_decode(const char *json, size_t len, struct {name}_data *out)
+{{
+	struct json_reader r;
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	int has_data = 0, has_errors = 0;
+
+	memset(out, 0, sizeof(*out));
+	json_reader_init(&r, json, len);
+
+	int ret = json_object_begin(&r);
+	while (ret == 1 &&
+	       (ret = json_object_next(&r, &key, &key_len, &hash)) == 1) {{
+		if (key_len == 4 && !memcmp(key, "data", 4) && !has_data) {{
+			ret = decode_{name}_data(&r, out);
+			has_data = ret == 1;
+			ret = ret < 0 ? -1 : 1;
+		}} else if (key_len == 6 && !memcmp(key, "errors", 6)) {{
+			has_errors = 1;
+			ret = read_errors(&r) < 0 ? -1 : 1;
+		}} else {{
+			ret = json_skip(&r) < 0 ? -1 : 1;
+		}}
+	}}
+
+	if (ret < 0)
+		fprintf(stderr, "Error: malformed response\\n");
+	else if (!has_errors && !has_data)
+		fprintf(stderr, "Error: data object not found\\n");
+	if (ret < 0 || has_errors || !has_data) {{
+		{name}_data_free(out);
+		return -1;
+	}}
+	return 0;
+}}
+
+void {name}_data_free(struct {name}_data *data)
+{{
+	free_{name}_data(data);
+	memset(data, 0, sizeof(*data));
+}}
 '''
-    )
-    f.write(f'const char *{var_name} =\n')
+
+
+def emit_string(lines):
+    out = []
     for line in lines:
         escaped = line.rstrip('\n').replace('\\', '\\\\').replace('"', '\\"')
-        f.write(f'    "{escaped}\\n"\n')
-    f.write(';\n')
-    f.write(
-        f'''
-#endif // QUERIES_{var_name.upper()}_H
+        out.append(f'    "{escaped}\\n"')
+    return '\n'.join(out)
+
+
+def minify(text):
+    """Drops comments, commas and all whitespace that doesn't separate two
+    names or numbers."""
+    out = ''
+    for tok in tokenize(text):
+        if out and re.match(r'[_0-9A-Za-z]', tok[0]) and \
+                re.match(r'[_0-9A-Za-z]', out[-1]):
+            out += ' '
+        out += tok
+    return out
+
+
+def emit_body(text):
+    """Emits the start of a request body, up to the variables object."""
+    query = minify(text)
+    escaped = query.replace('\\', '\\\\').replace('"', '\\"')
+    escaped = escaped.replace('\n', '\\n')
+    body = '{"query":"' + escaped + '","variables":'
+    body = body.replace('\\', '\\\\').replace('"', '\\"')
+    # Keep the lines of the generated source short
+    chunks = [body[i:i + 72] for i in range(0, len(body), 72)]
+    # Don't split an escape sequence
+    for i in range(len(chunks) - 1):
+        while re.search(r'(?<!\\)(\\\\)*\\$', chunks[i]):
+            chunks[i + 1] = chunks[i][-1] + chunks[i + 1]
+            chunks[i] = chunks[i][:-1]
+    return '\n'.join(f'    "{c}"' for c in chunks)
+
+
+def include_path(target, source_file):
+    return os.path.relpath(target, source_file.parent)
+
+
+def main():
+    input_path = Path(sys.argv[1])
+    output_path = Path(sys.argv[2])
+    var_name = sys.argv[3]
+    source_path = Path(sys.argv[4]) if len(sys.argv) > 4 else None
+
+    with input_path.open() as f:
+        lines = f.readlines()
+
+    structs = []
+    schema_path = input_path.parent / 'schema.graphql'
+    if source_path and schema_path.exists():
+        try:
+            types = Parser(schema_path.read_text()).schema()
+            selections = Parser(''.join(lines)).query()
+            resolve(selections, 'Query', var_name, [], types, structs)
+        except GraphQLError as e:
+            sys.exit(f'{input_path}: {e}')
+
+    guard = f'QUERIES_{var_name.upper()}_H'
+    output_path.parent.mkdir(parents=True, exist_ok=True)
+    with output_path.open('w') as f:
+        f.write(f'#ifndef {guard}\n#define {guard}\n\n')
+        if not source_path:
+            f.write(f'const char *{var_name} =\n{emit_string(lines)};\n')
+            f.write(f'\n#endif // {guard}\n')
+            return
+        f.write('#include <stddef.h>\n\n')
+        f.write('/// Minified request body up to the value of "variables"\n')
+        f.write(f'extern const char {var_name}[];\n')
+        for struct in structs:
+            f.write(f'\n{emit_struct(struct)}\n')
+        if structs:
+            f.write(f'''
+/**
+ * Decodes a response to the {var_name} query. GraphQL errors in the response
+ * are printed and fail the decoding.
+ * @param json Response body
+ * @param len Length of the response body
+ * @param out Set to the decoded data, to be freed with {var_name}_data_free()
+ * @return 0 on success, -1 on error
+ */
+int {var_name}_decode(const char *json, size_t len,
+\t\tstruct {var_name}_data *out);
+
+void {var_name}_data_free(struct {var_name}_data *data);
 ''')
+        f.write(f'\n#endif // {guard}\n')
+
+    root = input_path.resolve().parent.parent.parent
+    source_path.parent.mkdir(parents=True, exist_ok=True)
+    with source_path.open('w') as f:
+        f.write(f'// Generated from {input_path.name}, do not edit.\n\n')
+        if structs:
+            f.write('#define ALLOC_SUBSYSTEM alloc_decoder\n\n')
+        f.write(f'#include "{output_path.name}"\n\n')
+        if structs:
+            f.write('#include <stdint.h>\n#include <stdio.h>\n'
+                    '#include <string.h>\n\n')
+            for header in ('alloc.h', 'json.h'):
+                rel = include_path(root / 'src' / header, source_path.resolve())
+                f.write(f'#include "{rel}"\n')
+            f.write('\n')
+        f.write(f'const char {var_name}[] =\n{emit_body("".join(lines))};\n')
+        if structs:
+            for struct in structs:
+                f.write(f'\nstatic int decode_{struct.name}('
+                        f'struct json_reader *r,\n\t\tstruct {struct.name} *out);')
+            f.write('\n')
+            for struct in structs:
+                f.write(f'\n{emit_free(struct)}\n')
+            for struct in structs:
+                f.write(f'\n{emit_decoder(struct)}\n')
+            f.write(f'\n{emit_entry_points(var_name)}')
+
+
+if __name__ == '__main__':
+    main()
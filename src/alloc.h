@@ -5,17 +5,29 @@
 #ifndef ALLOC_H
 #define ALLOC_H
 
+#include <string.h>
+
 #ifdef TEST_ALLOC
 #include <setjmp.h>
 #include <stdarg.h>
 #include <stddef.h>
-#include <stdint.h>
 
 #include <cmocka.h>
 #define gmalloc(size) test_malloc(size)
 #define gcalloc(num, size) test_calloc(num, size)
 #define grealloc(ptr, size) test_realloc(ptr, size)
 #define gfree(ptr) test_free(ptr)
+#elif defined(ALLOC_STATS)
+#include "alloc_stats.h"
+
+// Translation units define ALLOC_SUBSYSTEM before any include
+#ifndef ALLOC_SUBSYSTEM
+#define ALLOC_SUBSYSTEM alloc_other
+#endif
+#define gmalloc(size) alloc_stats_malloc(ALLOC_SUBSYSTEM, size)
+#define gcalloc(num, size) alloc_stats_calloc(ALLOC_SUBSYSTEM, num, size)
+#define grealloc(ptr, size) alloc_stats_realloc(ALLOC_SUBSYSTEM, ptr, size)
+#define gfree(ptr) alloc_stats_free(ALLOC_SUBSYSTEM, ptr)
 #else
 #include <stdlib.h>
 #define gmalloc(size) malloc(size)
@@ -24,4 +36,20 @@
 #define gfree(ptr) free(ptr)
 #endif
 
+/// Copies len bytes of a string through gmalloc and terminates the copy
+static inline char *gstrcopy(const char *s, size_t len)
+{
+	char *copy = gmalloc(len + 1);
+	if (copy) {
+		memcpy(copy, s, len);
+		copy[len] = '\0';
+	}
+	return copy;
+}
+
+/// strdup() through gmalloc, the copy must be released with gfree
+#define gstrdup(s) gstrcopy(s, strlen(s))
+/// strndup() through gmalloc, the copy must be released with gfree
+#define gstrndup(s, n) gstrcopy(s, strnlen(s, n))
+
 #endif // ALLOC_H
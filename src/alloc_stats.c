@@ -0,0 +1,214 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "alloc_stats.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __APPLE__
+#include <malloc/malloc.h>
+#define usable_size(ptr) malloc_size(ptr)
+#else
+#include <malloc.h>
+#define usable_size(ptr) malloc_usable_size(ptr)
+#endif
+
+struct alloc_counters {
+	/// Calls that allocated or resized memory
+	_Atomic long long calls;
+	/// Bytes allocated over the whole run
+	_Atomic long long total;
+	/// Bytes currently allocated, and the most ever allocated at once
+	_Atomic long long bytes;
+	_Atomic long long peak;
+	/// Blocks currently allocated, and the most ever allocated at once
+	_Atomic long long blocks;
+	_Atomic long long peak_blocks;
+};
+
+static struct alloc_counters counters[alloc_subsystem_count_];
+
+/// Header in front of every block, keeping the alignment malloc guarantees
+union alloc_header {
+	/// Subsystem that allocated the block, which its memory counts against
+	enum alloc_subsystem owner;
+	max_align_t align;
+};
+
+#define HEADER sizeof(union alloc_header)
+
+/// Finds the header of a block
+static union alloc_header *header(void *ptr)
+{
+	return (union alloc_header *) ptr - 1;
+}
+
+/// Usable size of a block, without its header
+static long long block_size(union alloc_header *h)
+{
+	return (long long) (usable_size(h) - HEADER);
+}
+
+static const char *const names[alloc_subsystem_count_] = {
+		[alloc_other] = "other",     [alloc_config] = "config",
+		[alloc_client] = "client",   [alloc_decoder] = "decoder",
+		[alloc_git] = "git",	     [alloc_buffer] = "buffer",
+		[alloc_sched] = "sched",     [alloc_state] = "state",
+		[alloc_report] = "report",
+};
+
+/// Raises a peak to at least the given value
+static void raise_peak(_Atomic long long *peak, long long v)
+{
+	long long cur = atomic_load_explicit(peak, memory_order_relaxed);
+	while (cur < v && !atomic_compare_exchange_weak_explicit(
+				  peak, &cur, v, memory_order_relaxed,
+				  memory_order_relaxed)) {
+	}
+}
+
+/**
+ * Counts a change of the memory of a subsystem.
+ * @param sub Subsystem
+ * @param bytes Bytes allocated, negative if freed
+ * @param blocks Blocks allocated, negative if freed
+ */
+static void count(enum alloc_subsystem sub, long long bytes, long long blocks)
+{
+	struct alloc_counters *c = &counters[sub];
+	if (bytes > 0)
+		atomic_fetch_add_explicit(&c->total, bytes,
+					  memory_order_relaxed);
+	long long now = atomic_fetch_add_explicit(&c->bytes, bytes,
+						  memory_order_relaxed);
+	raise_peak(&c->peak, now + bytes);
+	long long n = atomic_fetch_add_explicit(&c->blocks, blocks,
+						memory_order_relaxed);
+	raise_peak(&c->peak_blocks, n + blocks);
+}
+
+/**
+ * Counts a new block against the subsystem allocating it.
+ * @return The memory after the header, or NULL if raw is NULL
+ */
+static void *claim(enum alloc_subsystem sub, union alloc_header *raw)
+{
+	atomic_fetch_add_explicit(&counters[sub].calls, 1,
+				  memory_order_relaxed);
+	if (!raw)
+		return NULL;
+	raw->owner = sub;
+	count(sub, block_size(raw), 1);
+	return raw + 1;
+}
+
+void *alloc_stats_malloc(enum alloc_subsystem sub, size_t size)
+{
+	if (size > SIZE_MAX - HEADER)
+		return claim(sub, NULL);
+	return claim(sub, malloc(HEADER + size));
+}
+
+void *alloc_stats_calloc(enum alloc_subsystem sub, size_t num, size_t size)
+{
+	if (size && num > (SIZE_MAX - HEADER) / size)
+		return claim(sub, NULL);
+	return claim(sub, calloc(1, HEADER + num * size));
+}
+
+void *alloc_stats_realloc(enum alloc_subsystem sub, void *ptr, size_t size)
+{
+	if (!ptr)
+		return alloc_stats_malloc(sub, size);
+	if (size == 0) {
+		// Whether realloc frees here is implementation-defined
+		alloc_stats_free(sub, ptr);
+		return NULL;
+	}
+
+	atomic_fetch_add_explicit(&counters[sub].calls, 1,
+				  memory_order_relaxed);
+	if (size > SIZE_MAX - HEADER)
+		return NULL;
+	// The block stays with the subsystem that allocated it
+	union alloc_header *h = header(ptr);
+	const enum alloc_subsystem owner = h->owner;
+	const long long old = block_size(h);
+	union alloc_header *new = realloc(h, HEADER + size);
+	if (!new)
+		return NULL;
+	count(owner, block_size(new) - old, 0);
+	return new + 1;
+}
+
+void alloc_stats_free(enum alloc_subsystem sub, void *ptr)
+{
+	(void) sub;
+	if (!ptr)
+		return;
+	union alloc_header *h = header(ptr);
+	count(h->owner, -block_size(h), -1);
+	free(h);
+}
+
+/// Reads a counter
+static long long get(const _Atomic long long *v)
+{
+	return atomic_load_explicit(v, memory_order_relaxed);
+}
+
+void alloc_stats_print(FILE *f)
+{
+	fprintf(f, "%-10s %12s %14s %12s %12s %10s %10s\n", "SUBSYSTEM",
+		"CALLS", "ALLOCATED", "CURRENT", "PEAK", "BLOCKS",
+		"PEAK-BLOCKS");
+	for (size_t i = 0; i < alloc_subsystem_count_; i++) {
+		const struct alloc_counters *c = &counters[i];
+		fprintf(f, "%-10s %12lld %14lld %12lld %12lld %10lld %10lld\n",
+			names[i], get(&c->calls), get(&c->total),
+			get(&c->bytes), get(&c->peak), get(&c->blocks),
+			get(&c->peak_blocks));
+	}
+}
+
+/**
+ * Writes one metric with a series per subsystem.
+ * @param f Stream to write to
+ * @param name Name of the metric
+ * @param type Prometheus type of the metric
+ * @param help Description of the metric
+ * @param offset Offset of the counter in struct alloc_counters
+ */
+static void write_metric(FILE *f, const char *name, const char *type,
+			 const char *help, size_t offset)
+{
+	fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+	for (size_t i = 0; i < alloc_subsystem_count_; i++) {
+		const char *c = (const char *) &counters[i] + offset;
+		fprintf(f, "%s{subsystem=\"%s\"} %lld\n", name, names[i],
+			get((const _Atomic long long *) c));
+	}
+}
+
+void alloc_stats_write_metrics(FILE *f)
+{
+	write_metric(f, "github_mirror_alloc_calls_total", "counter",
+		     "Allocation calls, by subsystem",
+		     offsetof(struct alloc_counters, calls));
+	write_metric(f, "github_mirror_alloc_bytes_total", "counter",
+		     "Bytes allocated, by subsystem",
+		     offsetof(struct alloc_counters, total));
+	write_metric(f, "github_mirror_alloc_bytes", "gauge",
+		     "Bytes allocated and not freed at the end of the run, "
+		     "by subsystem",
+		     offsetof(struct alloc_counters, bytes));
+	write_metric(f, "github_mirror_alloc_peak_bytes", "gauge",
+		     "Most bytes allocated at once, by subsystem",
+		     offsetof(struct alloc_counters, peak));
+	write_metric(f, "github_mirror_alloc_peak_blocks", "gauge",
+		     "Most blocks allocated at once, by subsystem",
+		     offsetof(struct alloc_counters, peak_blocks));
+}
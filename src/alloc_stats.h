@@ -0,0 +1,60 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef ALLOC_STATS_H
+#define ALLOC_STATS_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/// Parts of the program allocations through alloc.h are counted against
+enum alloc_subsystem {
+	/// Translation units without an ALLOC_SUBSYSTEM
+	alloc_other,
+	/// Config file and filter rules
+	alloc_config,
+	/// API clients and the repository lists they return
+	alloc_client,
+	/// JSON decoders of API responses
+	alloc_decoder,
+	/// Mirror paths, URLs and git arguments
+	alloc_git,
+	/// Growable buffers, such as API responses and git output
+	alloc_buffer,
+	/// Job queue and its worker threads
+	alloc_sched,
+	/// State database, checkpoint journal and index of the base directory
+	alloc_state,
+	/// Changed mirrors passed to the hooks and the failure summary
+	alloc_report,
+	alloc_subsystem_count_,
+};
+
+void *alloc_stats_malloc(enum alloc_subsystem sub, size_t size);
+void *alloc_stats_calloc(enum alloc_subsystem sub, size_t num, size_t size);
+void *alloc_stats_realloc(enum alloc_subsystem sub, void *ptr, size_t size);
+/**
+ * Frees a block allocated by any of the functions above, and only those.
+ * @param sub Subsystem freeing the block, which doesn't matter
+ * @param ptr Block to free, or NULL
+ */
+void alloc_stats_free(enum alloc_subsystem sub, void *ptr);
+
+/**
+ * Prints the allocation counters of every subsystem as a table. Bytes are
+ * usable sizes as reported by the allocator, without the header in front of
+ * every block that records the subsystem that allocated it. Memory counts
+ * against that subsystem even if another one resizes or frees it. Calls count
+ * against the subsystem making them.
+ * @param f Stream to print to
+ */
+void alloc_stats_print(FILE *f);
+
+/**
+ * Writes the allocation counters in the Prometheus text exposition format.
+ * @param f Stream to write to
+ */
+void alloc_stats_write_metrics(FILE *f);
+
+#endif // ALLOC_STATS_H
@@ -2,6 +2,8 @@
 // Created by Anshul Gupta on 4/4/25.
 //
 
+#define ALLOC_SUBSYSTEM alloc_buffer
+
 #include "buffer.h"
 
 #include <assert.h>
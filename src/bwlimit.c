@@ -0,0 +1,162 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "bwlimit.h"
+
+#include <pthread.h>
+#include <time.h>
+
+/// Smallest and largest amount a transfer moves between calls to take
+#define CHUNK_MIN 1024
+#define CHUNK_MAX (64 * 1024)
+/// Fraction of a second of the limit all transfers move between calls
+#define CHUNKS_PER_SEC 8
+
+static struct {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	struct bandwidth_cfg cfg;
+	/// Limit in effect, 0 for unlimited
+	long long rate;
+	/// Minute of the day the limit was last looked up for, -1 if never
+	int rate_minute;
+	/// Bytes that may be moved without waiting, negative when in debt
+	double tokens;
+	/// Time of the last refill in seconds
+	double last;
+	/// Ticket of the next caller and of the caller being served
+	unsigned long next_ticket;
+	unsigned long serving;
+	/// Number of registered transfers
+	unsigned flows;
+} bw = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.rate_minute = -1,
+};
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+long long bwlimit_rate_at(const struct bandwidth_cfg *cfg, int minute)
+{
+	for (size_t i = 0; i < cfg->windows_len; i++) {
+		const struct bw_window *w = &cfg->windows[i];
+		const int in = w->start < w->end
+				       ? minute >= w->start && minute < w->end
+				       : minute >= w->start || minute < w->end;
+		if (in)
+			return w->rate;
+	}
+	return cfg->rate;
+}
+
+int bwlimit_init(const struct bandwidth_cfg *cfg)
+{
+	pthread_mutex_lock(&bw.lock);
+	bw.cfg = *cfg;
+	bw.rate_minute = -1;
+	bw.tokens = 0;
+	bw.last = now_sec();
+	pthread_mutex_unlock(&bw.lock);
+
+	if (cfg->rate > 0)
+		return 1;
+	for (size_t i = 0; i < cfg->windows_len; i++) {
+		if (cfg->windows[i].rate > 0)
+			return 1;
+	}
+	return 0;
+}
+
+/// Looks up the limit for the current time of day, with the lock held
+static void update_rate(void)
+{
+	const time_t t = time(NULL);
+	struct tm tm;
+	localtime_r(&t, &tm);
+	const int minute = tm.tm_hour * 60 + tm.tm_min;
+	if (minute == bw.rate_minute)
+		return;
+	bw.rate_minute = minute;
+	bw.rate = bwlimit_rate_at(&bw.cfg, minute);
+}
+
+/// Adds the tokens earned since the last refill, with the lock held
+static void refill(void)
+{
+	const double now = now_sec();
+	update_rate();
+	if (bw.rate > 0) {
+		bw.tokens += (now - bw.last) * (double) bw.rate;
+		// Allow a burst of at most one second
+		if (bw.tokens > (double) bw.rate)
+			bw.tokens = (double) bw.rate;
+	}
+	bw.last = now;
+}
+
+void bwlimit_flow_begin(void)
+{
+	pthread_mutex_lock(&bw.lock);
+	bw.flows++;
+	pthread_mutex_unlock(&bw.lock);
+}
+
+void bwlimit_flow_end(void)
+{
+	pthread_mutex_lock(&bw.lock);
+	bw.flows--;
+	pthread_mutex_unlock(&bw.lock);
+}
+
+size_t bwlimit_chunk(void)
+{
+	pthread_mutex_lock(&bw.lock);
+	update_rate();
+	const long long rate = bw.rate;
+	const unsigned flows = bw.flows ? bw.flows : 1;
+	pthread_mutex_unlock(&bw.lock);
+
+	if (rate == 0)
+		return CHUNK_MAX;
+	const long long chunk = rate / CHUNKS_PER_SEC / flows;
+	if (chunk < CHUNK_MIN)
+		return CHUNK_MIN;
+	if (chunk > CHUNK_MAX)
+		return CHUNK_MAX;
+	return (size_t) chunk;
+}
+
+void bwlimit_take(size_t bytes)
+{
+	pthread_mutex_lock(&bw.lock);
+	const unsigned long ticket = bw.next_ticket++;
+	while (bw.serving != ticket)
+		pthread_cond_wait(&bw.cond, &bw.lock);
+
+	refill();
+	if (bw.rate > 0) {
+		bw.tokens -= (double) bytes;
+		// Later callers queue behind while this one pays off its debt
+		while (bw.tokens < 0 && bw.rate > 0) {
+			const double wait = -bw.tokens / (double) bw.rate;
+			struct timespec ts;
+			ts.tv_sec = (time_t) wait;
+			ts.tv_nsec = (long) ((wait - (double) ts.tv_sec) * 1e9);
+			pthread_mutex_unlock(&bw.lock);
+			nanosleep(&ts, NULL);
+			pthread_mutex_lock(&bw.lock);
+			refill();
+		}
+	}
+
+	bw.serving++;
+	pthread_cond_broadcast(&bw.cond);
+	pthread_mutex_unlock(&bw.lock);
+}
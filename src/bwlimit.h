@@ -0,0 +1,48 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef BWLIMIT_H
+#define BWLIMIT_H
+
+#include <stddef.h>
+
+#include "config.h"
+
+/**
+ * Sets up the global bandwidth limit shared by all transfers.
+ * @param cfg Bandwidth limit, copied
+ * @return 1 if any limit is configured, 0 if bandwidth is unlimited at all
+ * times
+ */
+int bwlimit_init(const struct bandwidth_cfg *cfg);
+
+/**
+ * Returns the limit that applies at a time of day.
+ * @param cfg Bandwidth limit
+ * @param minute Minutes since local midnight
+ * @return Bytes per second, 0 for unlimited
+ */
+long long bwlimit_rate_at(const struct bandwidth_cfg *cfg, int minute);
+
+/// Registers a transfer sharing the limit
+void bwlimit_flow_begin(void);
+
+/// Unregisters a transfer
+void bwlimit_flow_end(void);
+
+/**
+ * Returns how many bytes a transfer should move before calling
+ * bwlimit_take() again. The size shrinks with the number of transfers, so
+ * that each gets a fair share of the limit.
+ */
+size_t bwlimit_chunk(void);
+
+/**
+ * Accounts for bytes moved by a transfer, blocking until the limit allows
+ * them. Transfers are served in the order they ask, so none of them starves.
+ * @param bytes Number of bytes moved
+ */
+void bwlimit_take(size_t bytes);
+
+#endif // BWLIMIT_H
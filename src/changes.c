@@ -0,0 +1,597 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_report
+
+#include "changes.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "shutdown.h"
+#include "spawn.h"
+#include "summary.h"
+
+/// A mirror whose refs changed during the run
+struct changed {
+	/// "owner/name"
+	char *repo;
+	char *path;
+	/// Change lines
+	char *lines;
+	size_t lines_len;
+};
+
+static FILE *journal;
+/// Path of the record of the last hooks, see CHANGES_HOOKED_FILE
+static char *hooked_path;
+static int porcelain;
+static struct changed *changed;
+static size_t changed_len;
+static size_t changed_cap;
+/// Mirrors at the start of changed that were replayed from the journal
+static size_t replayed;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Checks the output of git version for version 2.41 or later
+static int detect_porcelain(void)
+{
+	spawn_lock();
+	FILE *p = popen("git version", "r");
+	spawn_unlock();
+	if (!p)
+		return 0;
+	unsigned major = 0, minor = 0;
+	const int n = fscanf(p, "git version %u.%u", &major, &minor);
+	pclose(p);
+	return n == 2 && (major > 2 || (major == 2 && minor >= 41));
+}
+
+/**
+ * Remembers the change lines of a mirror for the hooks, with the lock held.
+ * The lines of a mirror that was replayed from the journal are added to it.
+ * @param repo "owner/name" of the mirror
+ * @param path Full path to the mirror
+ * @param lines Change lines
+ * @param len Length of the lines
+ * @return 0 on success, -1 on error
+ */
+static int remember(const char *repo, const char *path, const char *lines,
+		    size_t len)
+{
+	for (size_t i = 0; i < replayed; i++) {
+		struct changed *c = &changed[i];
+		if (strcmp(c->repo, repo) != 0)
+			continue;
+		char *grown = grealloc(c->lines, c->lines_len + len);
+		if (!grown) {
+			perror("realloc");
+			return -1;
+		}
+		memcpy(grown + c->lines_len, lines, len);
+		c->lines = grown;
+		c->lines_len += len;
+		return 0;
+	}
+
+	if (changed_len == changed_cap) {
+		const size_t cap = changed_cap ? changed_cap * 2 : 64;
+		struct changed *c = grealloc(changed, sizeof(*c) * cap);
+		if (!c) {
+			perror("realloc");
+			return -1;
+		}
+		changed = c;
+		changed_cap = cap;
+	}
+
+	struct changed *c = &changed[changed_len];
+	c->repo = gstrdup(repo);
+	c->path = gstrdup(path);
+	c->lines = gmalloc(len);
+	if (!c->repo || !c->path || !c->lines) {
+		perror("malloc");
+		gfree(c->repo);
+		gfree(c->path);
+		gfree(c->lines);
+		return -1;
+	}
+	memcpy(c->lines, lines, len);
+	c->lines_len = len;
+	changed_len++;
+	return 0;
+}
+
+/**
+ * Records that the hooks saw every change journaled so far.
+ * @return 0 on success, -1 on error
+ */
+static int mark_hooked(void)
+{
+	struct stat st;
+	if (fflush(journal) != 0 || fstat(fileno(journal), &st) == -1) {
+		perror("Error reading change journal");
+		return -1;
+	}
+
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", hooked_path);
+	FILE *f = spawn_fopen(tmp, "w");
+	if (!f) {
+		perror("Error writing hook record");
+		return -1;
+	}
+	fprintf(f, "%llu %lld\n", (unsigned long long) st.st_ino,
+		(long long) st.st_size);
+	if (fclose(f) != 0 || rename(tmp, hooked_path) == -1) {
+		perror("Error writing hook record");
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Remembers the changes journaled since the hooks last ran, by interrupted
+ * runs, for the hooks of this run. Without a record of the last hooks, as on
+ * the first run, there are none.
+ * @param git_base Base path of the git mirrors
+ * @param path Path to the journal
+ * @return 0 on success, -1 on error
+ */
+static int replay(const char *git_base, const char *path)
+{
+	unsigned long long ino;
+	long long from;
+	int n = 0;
+	FILE *f = fopen(hooked_path, "r");
+	if (f) {
+		n = fscanf(f, "%llu %lld", &ino, &from);
+		fclose(f);
+	}
+	if (n != 2)
+		return mark_hooked();
+
+	struct stat st;
+	if (fstat(fileno(journal), &st) == -1) {
+		perror("Error reading change journal");
+		return -1;
+	}
+	// The hooks saw nothing of a journal rotated since
+	if (ino != (unsigned long long) st.st_ino || from > st.st_size)
+		from = 0;
+	if (from == st.st_size)
+		return 0;
+
+	FILE *in = spawn_fopen(path, "r");
+	if (!in || fseeko(in, from, SEEK_SET) == -1) {
+		perror("Error reading change journal");
+		if (in)
+			fclose(in);
+		return -1;
+	}
+	int ret = 0;
+	char *line = NULL;
+	size_t cap = 0;
+	ssize_t len;
+	while ((len = getline(&line, &cap, in)) > 0) {
+		// "<time> <owner>/<name> <old> <new> <ref>\n", the last one
+		// may be cut short
+		char *repo = strchr(line, ' ');
+		char *lines = repo ? strchr(repo + 1, ' ') : NULL;
+		if (!lines || line[len - 1] != '\n')
+			continue;
+		*lines++ = '\0';
+		repo++;
+		// As get_git_path() names mirrors
+		char mirror[4096];
+		snprintf(mirror, sizeof(mirror), "%s/%s.git", git_base, repo);
+		if (remember(repo, mirror, lines, line + len - lines) < 0) {
+			ret = -1;
+			break;
+		}
+		replayed = changed_len;
+	}
+	free(line); // Allocated by getline()
+	fclose(in);
+	return ret;
+}
+
+int changes_open(const char *git_base)
+{
+	const size_t len = strlen(git_base) + sizeof(CHANGES_HOOKED_FILE) + 1;
+	char *path = gmalloc(len);
+	hooked_path = gmalloc(len);
+	if (!path || !hooked_path) {
+		gfree(path);
+		changes_close();
+		return -1;
+	}
+	snprintf(path, len, "%s/%s", git_base, CHANGES_FILE);
+	snprintf(hooked_path, len, "%s/%s", git_base, CHANGES_HOOKED_FILE);
+
+	journal = spawn_fopen(path, "a");
+	if (!journal) {
+		perror("Error opening change journal");
+		gfree(path);
+		changes_close();
+		return -1;
+	}
+	const int ret = replay(git_base, path);
+	gfree(path);
+	if (ret < 0) {
+		changes_close();
+		return -1;
+	}
+	porcelain = detect_porcelain();
+	return 0;
+}
+
+int changes_porcelain(void) { return porcelain; }
+
+/// Appends a change line, keeping the zero ID as long as the other
+static void append_change(buffer_t *lines, const char *old, size_t old_len,
+			  const char *new, size_t new_len, const char *ref,
+			  size_t ref_len)
+{
+	static const char zeros[] = "000000000000000000000000000000000000000000"
+				    "0000000000000000000000";
+	if (!old) {
+		old = zeros;
+		old_len = new_len;
+	}
+	if (!new) {
+		new = zeros;
+		new_len = old_len;
+	}
+
+	buffer_append(lines, old, old_len);
+	buffer_append(lines, " ", 1);
+	buffer_append(lines, new, new_len);
+	buffer_append(lines, " ", 1);
+	buffer_append(lines, ref, ref_len);
+	buffer_append(lines, "\n", 1);
+}
+
+void changes_parse_porcelain(const char *out, size_t len, buffer_t *lines)
+{
+	const char *end = out + len;
+	while (out < end) {
+		const char *eol = memchr(out, '\n', end - out);
+		if (!eol)
+			eol = end;
+		const char *line = out;
+		out = eol + 1;
+
+		// "<flag> <old> <new> <ref>", "=" is up to date, "!" rejected
+		if (eol - line < 2 || line[1] != ' ' || line[0] == '=' ||
+		    line[0] == '!')
+			continue;
+		const char *old = line + 2;
+		const char *old_end = memchr(old, ' ', eol - old);
+		if (!old_end)
+			continue;
+		const char *new = old_end + 1;
+		const char *new_end = memchr(new, ' ', eol - new);
+		if (!new_end || new_end + 1 >= eol)
+			continue;
+		append_change(lines, old, old_end - old, new, new_end - new,
+			      new_end + 1, eol - new_end - 1);
+	}
+}
+
+/// Cursor over a ref snapshot
+struct snapshot {
+	const char *p;
+	const char *end;
+	const char *oid;
+	size_t oid_len;
+	const char *ref;
+	size_t ref_len;
+};
+
+static void snapshot_init(struct snapshot *s, const buffer_t *buf)
+{
+	// An empty buffer may not be allocated
+	s->p = buf->len ? (const char *) buf->data : "";
+	s->end = s->p + buf->len;
+}
+
+/// Moves to the next well-formed line of a snapshot
+static int snapshot_next(struct snapshot *s)
+{
+	while (s->p < s->end) {
+		const char *eol = memchr(s->p, '\n', s->end - s->p);
+		if (!eol)
+			eol = s->end;
+		const char *sp = memchr(s->p, ' ', eol - s->p);
+		const char *line = s->p;
+		s->p = eol + 1;
+		if (!sp || sp == line || sp + 1 >= eol)
+			continue;
+		s->oid = line;
+		s->oid_len = sp - line;
+		s->ref = sp + 1;
+		s->ref_len = eol - sp - 1;
+		return 1;
+	}
+	return 0;
+}
+
+/// Compares the current refs of two snapshots
+static int ref_cmp(const struct snapshot *a, const struct snapshot *b)
+{
+	const size_t n = a->ref_len < b->ref_len ? a->ref_len : b->ref_len;
+	const int c = memcmp(a->ref, b->ref, n);
+	if (c != 0)
+		return c;
+	return (a->ref_len > b->ref_len) - (a->ref_len < b->ref_len);
+}
+
+void changes_diff(const buffer_t *before, const buffer_t *after,
+		  buffer_t *lines)
+{
+	struct snapshot a, b;
+	snapshot_init(&a, before);
+	snapshot_init(&b, after);
+	int has_a = snapshot_next(&a), has_b = snapshot_next(&b);
+
+	// Both snapshots are sorted by ref, so merge them
+	while (has_a || has_b) {
+		const int c = !has_a ? 1 : !has_b ? -1 : ref_cmp(&a, &b);
+		if (c < 0) {
+			append_change(lines, a.oid, a.oid_len, NULL, 0, a.ref,
+				      a.ref_len);
+			has_a = snapshot_next(&a);
+		} else if (c > 0) {
+			append_change(lines, NULL, 0, b.oid, b.oid_len, b.ref,
+				      b.ref_len);
+			has_b = snapshot_next(&b);
+		} else {
+			if (a.oid_len != b.oid_len ||
+			    memcmp(a.oid, b.oid, a.oid_len) != 0)
+				append_change(lines, a.oid, a.oid_len, b.oid,
+					      b.oid_len, b.ref, b.ref_len);
+			has_a = snapshot_next(&a);
+			has_b = snapshot_next(&b);
+		}
+	}
+}
+
+int changes_record(const char *owner, const char *name, const char *path,
+		   const buffer_t *lines)
+{
+	if (!journal || lines->len == 0)
+		return 0;
+
+	int ret = -1;
+	pthread_mutex_lock(&lock);
+
+	// One line per ref, prefixed with the time and the repository
+	const long long now = (long long) time(NULL);
+	const char *p = (const char *) lines->data;
+	const char *end = p + lines->len;
+	while (p < end) {
+		const char *eol = memchr(p, '\n', end - p);
+		const int n = (int) ((eol ? eol : end) - p);
+		fprintf(journal, "%lld %s/%s %.*s\n", now, owner, name, n, p);
+		p += n + 1;
+	}
+	if (fflush(journal) != 0) {
+		perror("Error writing change journal");
+		goto end;
+	}
+
+	char repo[512];
+	snprintf(repo, sizeof(repo), "%s/%s", owner, name);
+	ret = remember(repo, path, (const char *) lines->data, lines->len);
+
+end:
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+/// A hook process
+struct hook_run {
+	pid_t pid;
+	const char *command;
+};
+
+/**
+ * Starts a hook for a batch of changed mirrors.
+ * @param command Shell command of the hook
+ * @param first Index of the first mirror of the batch
+ * @param n Number of mirrors in the batch
+ * @return Process ID of the hook, or -1 on error
+ */
+static pid_t start_hook(const char *command, size_t first, size_t n)
+{
+	// The journal lines of the batch are passed on stdin through a file,
+	// so that a hook that doesn't read them can't block
+	FILE *in = spawn_tmpfile();
+	if (!in) {
+		perror("tmpfile");
+		return -1;
+	}
+	for (size_t i = first; i < first + n; i++) {
+		const char *p = changed[i].lines;
+		const char *end = p + changed[i].lines_len;
+		while (p < end) {
+			const char *eol = memchr(p, '\n', end - p);
+			const int len = (int) ((eol ? eol : end) - p);
+			fprintf(in, "%s %.*s\n", changed[i].repo, len, p);
+			p += len + 1;
+		}
+	}
+	if (fflush(in) != 0 || fseek(in, 0, SEEK_SET) != 0) {
+		perror("Error writing hook input");
+		fclose(in);
+		return -1;
+	}
+
+	// sh -c <command> sh <paths...>, so that the paths are "$@"
+	char **args = gmalloc(sizeof(*args) * (n + 5));
+	if (!args) {
+		fclose(in);
+		return -1;
+	}
+	args[0] = "sh";
+	args[1] = "-c";
+	args[2] = (char *) command;
+	args[3] = "sh";
+	for (size_t i = 0; i < n; i++)
+		args[4 + i] = changed[first + i].path;
+	args[4 + n] = NULL;
+
+	const pid_t pid = spawn_fork();
+	if (pid == 0) {
+		// Child process
+		shutdown_detach_child();
+		if (dup2(fileno(in), STDIN_FILENO) == -1) {
+			perror("dup2");
+			_exit(127);
+		}
+		execv("/bin/sh", args);
+		perror("execv");
+		_exit(127); // execv only returns on error
+	}
+	gfree(args);
+	fclose(in);
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	shutdown_child_started(pid);
+	return pid;
+}
+
+/**
+ * Waits for one of the running hooks to exit.
+ * @param runs Running hooks
+ * @param len Number of running hooks, decremented
+ * @return 0 if the hook succeeded, -1 otherwise
+ */
+static int wait_hook(struct hook_run *runs, size_t *len)
+{
+	for (;;) {
+		int status;
+		const pid_t pid = waitpid(-1, &status, 0);
+		if (pid == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("waitpid");
+			*len = 0;
+			return -1;
+		}
+
+		size_t i = 0;
+		while (i < *len && runs[i].pid != pid)
+			i++;
+		if (i == *len)
+			continue; // Not a hook
+		shutdown_child_exited(pid);
+		const char *command = runs[i].command;
+		runs[i] = runs[--*len];
+
+		if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+			return 0;
+		char reason[64];
+		if (WIFEXITED(status))
+			snprintf(reason, sizeof(reason),
+				 "hook exited with status %d",
+				 WEXITSTATUS(status));
+		else
+			snprintf(reason, sizeof(reason),
+				 "hook killed by signal %d", WTERMSIG(status));
+		fprintf(stderr, "Error: %s: %s\n", command, reason);
+		summary_add(command, reason);
+		return -1;
+	}
+}
+
+/**
+ * Runs every hook for the changed mirrors.
+ * @return 0 if all hooks succeeded, -1 otherwise
+ */
+static int run_hooks(const struct hooks_cfg *hooks, int quiet)
+{
+	struct hook_run *runs = gmalloc(sizeof(*runs) * hooks->jobs);
+	if (!runs)
+		return -1;
+	size_t running = 0;
+	int status = 0;
+
+	for (size_t h = 0; h < hooks->commands_len; h++) {
+		const char *command = hooks->commands[h];
+		for (size_t i = 0; i < changed_len; i += hooks->batch) {
+			size_t n = changed_len - i;
+			if (n > (size_t) hooks->batch)
+				n = hooks->batch;
+			while (running == (size_t) hooks->jobs) {
+				if (wait_hook(runs, &running) < 0)
+					status = -1;
+			}
+
+			if (!quiet)
+				printf("Running hook for %zu mirror%s: %s\n",
+				       n, n == 1 ? "" : "s", command);
+			const pid_t pid = start_hook(command, i, n);
+			if (pid < 0) {
+				summary_add(command, "hook failed to start");
+				status = -1;
+				continue;
+			}
+			runs[running].pid = pid;
+			runs[running].command = command;
+			running++;
+		}
+	}
+	while (running > 0) {
+		if (wait_hook(runs, &running) < 0)
+			status = -1;
+	}
+
+	gfree(runs);
+	return status;
+}
+
+int changes_run_hooks(const struct hooks_cfg *hooks, int quiet)
+{
+	if (!journal)
+		return 0;
+
+	int status = 0;
+	if (changed_len > 0 && hooks->commands_len > 0)
+		status = run_hooks(hooks, quiet);
+	// Failed hooks are not run again, they are in the summary
+	if (mark_hooked() < 0)
+		status = -1;
+	return status;
+}
+
+void changes_close(void)
+{
+	for (size_t i = 0; i < changed_len; i++) {
+		gfree(changed[i].repo);
+		gfree(changed[i].path);
+		gfree(changed[i].lines);
+	}
+	gfree(changed);
+	changed = NULL;
+	changed_len = changed_cap = replayed = 0;
+
+	if (journal)
+		fclose(journal);
+	journal = NULL;
+	gfree(hooked_path);
+	hooked_path = NULL;
+}
@@ -0,0 +1,83 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef CHANGES_H
+#define CHANGES_H
+
+#include "buffer.h"
+#include "config.h"
+
+/// Name of the changed-ref journal inside the git base directory
+#define CHANGES_FILE ".github-mirror-changes"
+/// Name of the file recording where the journal ended when hooks last ran
+#define CHANGES_HOOKED_FILE ".github-mirror-changes-hooked"
+
+/**
+ * Opens the changed-ref journal in the git base directory for appending and
+ * checks whether git can report ref updates with fetch --porcelain. Until
+ * this is called, changes are neither journaled nor passed to hooks.
+ * Changes journaled since the hooks last ran, by interrupted runs, are passed
+ * to the hooks of this run too.
+ * Must be called before any threads are started.
+ * @param git_base Base path of the git mirrors
+ * @return 0 on success, -1 on error
+ */
+int changes_open(const char *git_base);
+
+/**
+ * Checks whether git fetch supports --porcelain, which needs git 2.41.
+ * @return 1 if it does, 0 if not
+ */
+int changes_porcelain(void);
+
+/**
+ * Converts the output of git fetch --porcelain to change lines of the form
+ * "<old> <new> <ref>\n". Refs that were up to date or rejected are skipped.
+ * @param out Output of git fetch
+ * @param len Length of the output
+ * @param lines Buffer to append the change lines to
+ */
+void changes_parse_porcelain(const char *out, size_t len, buffer_t *lines);
+
+/**
+ * Computes change lines from snapshots of a mirror's refs taken before and
+ * after a fetch, for git versions without fetch --porcelain. Snapshots are
+ * lines of "<oid> <ref>" sorted by ref, as printed by git for-each-ref.
+ * Created refs have an all-zero old ID, deleted refs an all-zero new ID.
+ * @param before Snapshot before the fetch, empty for a new mirror
+ * @param after Snapshot after the fetch
+ * @param lines Buffer to append the change lines to
+ */
+void changes_diff(const buffer_t *before, const buffer_t *after,
+		  buffer_t *lines);
+
+/**
+ * Appends the changed refs of a mirror to the journal and remembers the
+ * mirror for the hooks. Does nothing if no refs changed. Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @param path Full path to the mirror
+ * @param lines Change lines
+ * @return 0 on success, -1 on error
+ */
+int changes_record(const char *owner, const char *name, const char *path,
+		   const buffer_t *lines);
+
+/**
+ * Runs every hook for the mirrors whose refs changed since the hooks last ran.
+ * Each hook runs through sh -c with the paths of up to batch mirrors as
+ * arguments and their journal lines on stdin, with up to jobs hooks at once.
+ * Failures are added to the summary. Afterward, the end of the journal is
+ * recorded in CHANGES_HOOKED_FILE, so that skipping this for an interrupted
+ * run leaves its changes to the next one.
+ * @param hooks Hook settings
+ * @param quiet Suppress output if non-zero
+ * @return 0 if all hooks succeeded, -1 otherwise
+ */
+int changes_run_hooks(const struct hooks_cfg *hooks, int quiet);
+
+/// Closes the journal and forgets the changed mirrors
+void changes_close(void);
+
+#endif // CHANGES_H
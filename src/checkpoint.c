@@ -0,0 +1,391 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_state
+
+#include "checkpoint.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "shard.h"
+#include "spawn.h"
+
+/*
+ * The journal is append-only, one record per line:
+ *   shard <i>/<N>            shard the sweep runs for, always first
+ *   repo <owner>/<name>      repository mirrored successfully
+ *   cursor <remote> <cursor> pages before this cursor are done, empty for
+ *                            the first page
+ *   remote <remote>          every repository of the remote is done
+ * Fields are separated by tabs. Later cursor records override earlier ones.
+ */
+
+struct ckpt_page {
+	/// Cursor the page was requested with, NULL for the first page
+	char *cursor;
+	/// Queued repositories of the page that are not done yet
+	size_t pending;
+};
+
+struct ckpt_remote {
+	char *key;
+	/// Cursor to resume listing from, loaded from the journal
+	char *resume;
+	/// Every repository of the remote is done
+	int finished;
+	struct ckpt_page *pages;
+	size_t pages_len;
+	size_t pages_cap;
+	/// First page with pending repositories
+	size_t first;
+	/// All pages were listed
+	int listed;
+	struct ckpt_remote *next;
+};
+
+struct ckpt_repo {
+	/// "owner/name"
+	char *key;
+	int done;
+	/// Remote and page the repository was queued from, NULL if not queued
+	struct ckpt_remote *remote;
+	size_t page;
+	struct ckpt_repo *next;
+};
+
+#define CHECKPOINT_BUCKETS 4096
+
+static FILE *journal;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static struct ckpt_repo *buckets[CHECKPOINT_BUCKETS];
+static struct ckpt_remote *remotes;
+
+static char *checkpoint_path(const char *git_base)
+{
+	const size_t len = strlen(git_base) + strlen(CHECKPOINT_FILE) + 2;
+	char *path = gmalloc(len);
+	if (path)
+		snprintf(path, len, "%s/%s", git_base, CHECKPOINT_FILE);
+	return path;
+}
+
+static void journal_write(const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(journal, fmt, ap);
+	va_end(ap);
+	if (fflush(journal) != 0)
+		perror("Error writing checkpoint");
+}
+
+static int key_equal(const char *key, const char *owner, const char *name)
+{
+	const size_t owner_len = strlen(owner);
+	return !strncmp(key, owner, owner_len) && key[owner_len] == '/' &&
+	       !strcmp(key + owner_len + 1, name);
+}
+
+static struct ckpt_repo *find_repo(const char *owner, const char *name,
+				   int create)
+{
+	const size_t b = shard_key(owner, name) % CHECKPOINT_BUCKETS;
+	struct ckpt_repo *r = buckets[b];
+	while (r && !key_equal(r->key, owner, name))
+		r = r->next;
+	if (r || !create)
+		return r;
+
+	r = gcalloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	const size_t len = strlen(owner) + strlen(name) + 2;
+	r->key = gmalloc(len);
+	if (!r->key) {
+		gfree(r);
+		return NULL;
+	}
+	snprintf(r->key, len, "%s/%s", owner, name);
+	r->next = buckets[b];
+	buckets[b] = r;
+	return r;
+}
+
+static struct ckpt_remote *find_remote(const char *key, int create)
+{
+	struct ckpt_remote *r = remotes;
+	while (r && strcmp(r->key, key) != 0)
+		r = r->next;
+	if (r || !create)
+		return r;
+
+	r = gcalloc(1, sizeof(*r));
+	if (!r)
+		return NULL;
+	r->key = gstrdup(key);
+	if (!r->key) {
+		gfree(r);
+		return NULL;
+	}
+	r->next = remotes;
+	remotes = r;
+	return r;
+}
+
+/**
+ * Moves the remote's resume point past its leading completed pages and
+ * journals it if it changed.
+ */
+static void advance(struct ckpt_remote *r)
+{
+	const size_t first = r->first;
+	while (r->first < r->pages_len && r->pages[r->first].pending == 0)
+		r->first++;
+
+	if (r->first < r->pages_len) {
+		if (r->first != first) {
+			const char *cursor = r->pages[r->first].cursor;
+			journal_write("cursor\t%s\t%s\n", r->key,
+				      cursor ? cursor : "");
+		}
+	} else if (r->listed && !r->finished) {
+		r->finished = 1;
+		journal_write("remote\t%s\n", r->key);
+	}
+}
+
+/**
+ * Applies one journal record.
+ * @return 0 on success, -1 if the record is malformed
+ */
+static int load_record(char *line)
+{
+	char *arg = strchr(line, '\t');
+	if (!arg)
+		return -1;
+	*arg++ = '\0';
+
+	if (!strcmp(line, "repo")) {
+		char *slash = strchr(arg, '/');
+		if (!slash)
+			return -1;
+		*slash = '\0';
+		struct ckpt_repo *r = find_repo(arg, slash + 1, 1);
+		if (!r)
+			return -1;
+		r->done = 1;
+	} else if (!strcmp(line, "cursor")) {
+		char *cursor = strchr(arg, '\t');
+		if (!cursor)
+			return -1;
+		*cursor++ = '\0';
+		struct ckpt_remote *r = find_remote(arg, 1);
+		if (!r)
+			return -1;
+		gfree(r->resume);
+		r->resume = *cursor ? gstrdup(cursor) : NULL;
+	} else if (!strcmp(line, "remote")) {
+		struct ckpt_remote *r = find_remote(arg, 1);
+		if (!r)
+			return -1;
+		r->finished = 1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/**
+ * Loads the journal of an interrupted sweep for the given shard.
+ * @return 1 if a journal was loaded, 0 if there is none to resume
+ */
+static int load_journal(const char *path, unsigned shard, unsigned shards)
+{
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return 0;
+
+	char line[4096];
+	unsigned i, n;
+	if (!fgets(line, sizeof(line), f) ||
+	    sscanf(line, "shard\t%u/%u", &i, &n) != 2 || i != shard + 1 ||
+	    n != shards) {
+		fclose(f);
+		return 0;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *nl = strchr(line, '\n');
+		if (!nl)
+			break; // Torn last record
+		*nl = '\0';
+		if (load_record(line) == -1)
+			fprintf(stderr, "Ignoring checkpoint record: %s\n",
+				line);
+	}
+	fclose(f);
+	return 1;
+}
+
+int checkpoint_open(const char *git_base, unsigned shard, unsigned shards)
+{
+	char *path = checkpoint_path(git_base);
+	if (!path)
+		return -1;
+
+	const int resumed = load_journal(path, shard, shards);
+	journal = spawn_fopen(path, resumed ? "a" : "w");
+	gfree(path);
+	if (!journal) {
+		perror("Error opening checkpoint");
+		return -1;
+	}
+	if (!resumed)
+		journal_write("shard\t%u/%u\n", shard + 1, shards);
+	return resumed;
+}
+
+int checkpoint_resume(const char *remote, const char **cursor)
+{
+	*cursor = NULL;
+	if (!journal)
+		return 0;
+
+	const struct ckpt_remote *r = find_remote(remote, 0);
+	if (!r)
+		return 0;
+	*cursor = r->resume;
+	return r->finished;
+}
+
+int checkpoint_page(const char *remote, const char *cursor)
+{
+	if (!journal)
+		return 0;
+
+	struct ckpt_remote *r = find_remote(remote, 1);
+	if (!r)
+		return -1;
+	if (r->pages_len == r->pages_cap) {
+		const size_t cap = r->pages_cap ? r->pages_cap * 2 : 16;
+		struct ckpt_page *pages =
+				grealloc(r->pages, sizeof(*pages) * cap);
+		if (!pages)
+			return -1;
+		r->pages = pages;
+		r->pages_cap = cap;
+	}
+
+	struct ckpt_page *page = &r->pages[r->pages_len];
+	page->cursor = cursor ? gstrdup(cursor) : NULL;
+	page->pending = 0;
+	if (cursor && !page->cursor)
+		return -1;
+	r->pages_len++;
+	return 0;
+}
+
+int checkpoint_queue(const char *remote, const char *owner, const char *name)
+{
+	if (!journal)
+		return 0;
+
+	struct ckpt_remote *r = find_remote(remote, 0);
+	struct ckpt_repo *repo = find_repo(owner, name, 1);
+	if (!r || !r->pages_len || !repo)
+		return -1;
+	repo->remote = r;
+	repo->page = r->pages_len - 1;
+	r->pages[repo->page].pending++;
+	return 0;
+}
+
+void checkpoint_listed(const char *remote)
+{
+	if (!journal)
+		return;
+
+	struct ckpt_remote *r = find_remote(remote, 0);
+	if (!r)
+		return;
+	r->listed = 1;
+	advance(r);
+}
+
+int checkpoint_is_done(const char *owner, const char *name)
+{
+	if (!journal)
+		return 0;
+
+	const struct ckpt_repo *r = find_repo(owner, name, 0);
+	return r && r->done;
+}
+
+void checkpoint_done(const char *owner, const char *name)
+{
+	if (!journal)
+		return;
+
+	pthread_mutex_lock(&lock);
+	struct ckpt_repo *r = find_repo(owner, name, 1);
+	if (r && !r->done) {
+		r->done = 1;
+		journal_write("repo\t%s\n", r->key);
+		if (r->remote) {
+			r->remote->pages[r->page].pending--;
+			advance(r->remote);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+int checkpoint_close(const char *git_base, int complete)
+{
+	if (!journal)
+		return 0;
+
+	int ret = 0;
+	if (fclose(journal) != 0) {
+		perror("Error writing checkpoint");
+		ret = -1;
+	}
+	journal = NULL;
+
+	if (complete) {
+		char *path = checkpoint_path(git_base);
+		if (!path || unlink(path) == -1) {
+			perror("Error removing checkpoint");
+			ret = -1;
+		}
+		gfree(path);
+	}
+
+	for (size_t i = 0; i < CHECKPOINT_BUCKETS; i++) {
+		struct ckpt_repo *r = buckets[i];
+		while (r) {
+			struct ckpt_repo *next = r->next;
+			gfree(r->key);
+			gfree(r);
+			r = next;
+		}
+		buckets[i] = NULL;
+	}
+	while (remotes) {
+		struct ckpt_remote *next = remotes->next;
+		for (size_t i = 0; i < remotes->pages_len; i++)
+			gfree(remotes->pages[i].cursor);
+		gfree(remotes->pages);
+		gfree(remotes->resume);
+		gfree(remotes->key);
+		gfree(remotes);
+		remotes = next;
+	}
+	return ret;
+}
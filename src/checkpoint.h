@@ -0,0 +1,84 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/// Name of the checkpoint journal inside the git base directory
+#define CHECKPOINT_FILE ".github-mirror-checkpoint"
+
+/**
+ * Opens the checkpoint journal in the git base directory, loading the
+ * progress of an interrupted sweep if there is one. A journal written for a
+ * different shard is discarded. Until this is called, all other checkpoint
+ * functions do nothing.
+ * @param git_base Base path of the git mirrors
+ * @param shard Shard of this node, 0-based
+ * @param shards Total number of shards
+ * @return 1 if resuming an interrupted sweep, 0 if starting a new one,
+ * -1 on error
+ */
+int checkpoint_open(const char *git_base, unsigned shard, unsigned shards);
+
+/**
+ * Looks up where to resume listing a remote.
+ * @param remote Key identifying the remote
+ * @param cursor Set to the pagination cursor to resume from, or NULL to start
+ * at the first page
+ * @return 1 if every repository of the remote was already mirrored in this
+ * sweep, 0 otherwise
+ */
+int checkpoint_resume(const char *remote, const char **cursor);
+
+/**
+ * Records that a new page of a remote is being listed. Repositories queued
+ * afterwards belong to this page.
+ * @param remote Key identifying the remote
+ * @param cursor Pagination cursor the page was requested with, or NULL for the
+ * first page
+ * @return 0 on success, -1 on error
+ */
+int checkpoint_page(const char *remote, const char *cursor);
+
+/**
+ * Records that a repository of the current page of a remote was queued.
+ * @param remote Key identifying the remote
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @return 0 on success, -1 on error
+ */
+int checkpoint_queue(const char *remote, const char *owner, const char *name);
+
+/**
+ * Records that all pages of a remote were listed.
+ * @param remote Key identifying the remote
+ */
+void checkpoint_listed(const char *remote);
+
+/**
+ * Checks whether a repository was already mirrored in this sweep.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @return 1 if it was mirrored, 0 if not
+ */
+int checkpoint_is_done(const char *owner, const char *name);
+
+/**
+ * Journals that a repository was mirrored successfully. Once every repository
+ * of a page is done, the remote's resume cursor moves past it. Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ */
+void checkpoint_done(const char *owner, const char *name);
+
+/**
+ * Closes the checkpoint journal and frees its state.
+ * @param git_base Base path of the git mirrors
+ * @param complete Non-zero if the sweep ran to completion, in which case the
+ * journal is removed so the next run starts a new sweep
+ * @return 0 on success, -1 on error
+ */
+int checkpoint_close(const char *git_base, int complete);
+
+#endif // CHECKPOINT_H
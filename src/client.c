@@ -2,26 +2,47 @@
 // Created by Anshul Gupta on 6/10/25.
 //
 
+#define ALLOC_SUBSYSTEM alloc_client
+
 #include "client.h"
 
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+
+#include "alloc.h"
+#include "retry.h"
+#include "shutdown.h"
+
+/// Delay bound of the first retry and the largest delay bound
+#define RETRY_BASE_MS 1000
+#define RETRY_MAX_MS 30000
+/// Longest Retry-After honoured, in seconds
+#define RETRY_AFTER_MAX 300
 
 struct gql_impl {
 	struct gql_ctx ctx;
 	CURL *curl;
+	/// Request body, reused across requests
+	buffer_t body;
+	/// Host of the endpoint, for its circuit breaker
+	char host[RETRY_HOST_MAX];
 };
 
 gql_client *gql_client_new(struct gql_ctx ctx)
 {
-	struct gql_impl *c = malloc(sizeof(*c));
+	struct gql_impl *c = gmalloc(sizeof(*c));
 	if (!c)
 		return NULL;
 
-	c->ctx.endpoint = strdup(ctx.endpoint);
-	c->ctx.token = strdup(ctx.token);
-	c->ctx.user_agent = strdup(ctx.user_agent);
+	c->ctx.endpoint = gstrdup(ctx.endpoint);
+	c->ctx.token = gstrdup(ctx.token);
+	c->ctx.user_agent = gstrdup(ctx.user_agent);
+	c->ctx.retries = ctx.retries;
 	c->curl = curl_easy_init();
+	c->body = buffer_new(1024);
+	if (retry_host(ctx.endpoint, c->host, sizeof(c->host)) < 0)
+		c->host[0] = '\0';
 	return c;
 }
 
@@ -31,14 +52,17 @@ gql_client *gql_client_dup(gql_client *client)
 	if (!c)
 		return NULL;
 
-	struct gql_impl *dup = malloc(sizeof(*dup));
+	struct gql_impl *dup = gmalloc(sizeof(*dup));
 	if (!dup)
 		return NULL;
 
-	dup->ctx.endpoint = strdup(c->ctx.endpoint);
-	dup->ctx.token = strdup(c->ctx.token);
-	dup->ctx.user_agent = strdup(c->ctx.user_agent);
+	dup->ctx.endpoint = gstrdup(c->ctx.endpoint);
+	dup->ctx.token = gstrdup(c->ctx.token);
+	dup->ctx.user_agent = gstrdup(c->ctx.user_agent);
+	dup->ctx.retries = c->ctx.retries;
 	dup->curl = curl_easy_duphandle(c->curl);
+	dup->body = buffer_new(1024);
+	memcpy(dup->host, c->host, sizeof(dup->host));
 	return dup;
 }
 
@@ -48,43 +72,59 @@ void gql_client_free(gql_client *client)
 	if (!c)
 		return;
 	curl_easy_cleanup(c->curl);
-	free((char *) c->ctx.endpoint);
-	free((char *) c->ctx.token);
-	free((char *) c->ctx.user_agent);
-	free(c);
+	buffer_free(c->body);
+	gfree((char *) c->ctx.endpoint);
+	gfree((char *) c->ctx.token);
+	gfree((char *) c->ctx.user_agent);
+	gfree(c);
 }
 
 /**
- * Wraps the query in a JSON object with a "query" key and an optional
- * "variables" key
- * @param query GraphQL query
- * @param args GraphQL arguments
- * @return JSON string
+ * Appends a string to the buffer as a JSON string literal.
  */
-static char *wrap_query(const char *query, cJSON *args)
+static void append_json_string(buffer_t *buf, const char *str)
 {
-	cJSON *root = NULL, *query_str = NULL;
-	char *str = NULL;
-
-	root = cJSON_CreateObject();
-	if (!root)
-		return NULL;
-
-	query_str = cJSON_CreateString(query);
-	if (!query_str)
-		goto end;
-
-	// Transfer ownership of the string to root
-	cJSON_AddItemToObject(root, "query", query_str);
-
-	// Add the args object if it exists
-	if (args)
-		cJSON_AddItemToObject(root, "variables", args);
+	static const char hex[] = "0123456789abcdef";
+	const char *run = str;
+
+	buffer_append(buf, "\"", 1);
+	for (const char *p = str; *p; p++) {
+		const unsigned char ch = *p;
+		if (ch >= 0x20 && ch != '"' && ch != '\\')
+			continue;
+		// Copy the unescaped run before this character
+		buffer_append(buf, run, p - run);
+		run = p + 1;
+		if (ch == '"' || ch == '\\') {
+			const char esc[2] = {'\\', (char) ch};
+			buffer_append(buf, esc, 2);
+		} else {
+			const char esc[6] = {'\\', 'u', '0', '0', hex[ch >> 4],
+					     hex[ch & 0xf]};
+			buffer_append(buf, esc, 6);
+		}
+	}
+	buffer_append(buf, run, strlen(run));
+	buffer_append(buf, "\"", 1);
+}
 
-	str = cJSON_Print(root);
-end:
-	cJSON_Delete(root);
-	return str;
+void gql_build_body(buffer_t *body, const char *prefix,
+		    const struct gql_var *vars, size_t vars_len)
+{
+	body->len = 0;
+	buffer_append(body, prefix, strlen(prefix));
+	buffer_append(body, "{", 1);
+	for (size_t i = 0; i < vars_len; i++) {
+		if (i > 0)
+			buffer_append(body, ",", 1);
+		append_json_string(body, vars[i].name);
+		buffer_append(body, ":", 1);
+		if (vars[i].value)
+			append_json_string(body, vars[i].value);
+		else
+			buffer_append(body, "null", 4);
+	}
+	buffer_append(body, "}}", 2);
 }
 
 static size_t write_data(const void *ptr, const size_t size, size_t nmemb,
@@ -97,8 +137,196 @@ static size_t write_data(const void *ptr, const size_t size, size_t nmemb,
 	return nmemb;
 }
 
+/**
+ * Classifies the outcome of a request.
+ * @param ret Result of the transfer
+ * @param code HTTP status, 0 if none was received
+ * @param retry_after Seconds the server asked to wait, -1 if it didn't
+ * @return 1 if the request may succeed when retried, 0 if not
+ */
+static int is_transient(CURLcode ret, long code, long retry_after)
+{
+	switch (ret) {
+	case CURLE_OK:
+		return 0;
+	case CURLE_COULDNT_RESOLVE_HOST:
+	case CURLE_COULDNT_CONNECT:
+	case CURLE_OPERATION_TIMEDOUT:
+	case CURLE_SEND_ERROR:
+	case CURLE_RECV_ERROR:
+	case CURLE_GOT_NOTHING:
+	case CURLE_PARTIAL_FILE:
+	case CURLE_SSL_CONNECT_ERROR:
+		return 1;
+	case CURLE_HTTP_RETURNED_ERROR:
+		// Secondary rate limits are a 403 with Retry-After
+		return code == 408 || code == 429 || code >= 500 ||
+		       (code == 403 && retry_after >= 0);
+	default:
+		return 0;
+	}
+}
+
+/**
+ * Reads the value of a response header with the given name.
+ * @param line Header line, not NUL-terminated
+ * @param len Length of the line
+ * @param name Lowercase name of the header, with the colon
+ * @param out Buffer to copy the value to, without surrounding whitespace
+ * @param out_len Size of the buffer
+ */
+static void read_header(const char *line, size_t len, const char *name,
+			char *out, size_t out_len)
+{
+	const size_t name_len = strlen(name);
+	if (len < name_len || strncasecmp(line, name, name_len) != 0)
+		return;
+	const char *v = line + name_len;
+	const char *end = line + len;
+	while (v < end && (*v == ' ' || *v == '\t'))
+		v++;
+	while (end > v && (end[-1] == '\r' || end[-1] == '\n' ||
+			   end[-1] == ' '))
+		end--;
+	if ((size_t) (end - v) >= out_len)
+		return; // Truncated values are of no use
+	memcpy(out, v, end - v);
+	out[end - v] = '\0';
+}
+
+/**
+ * Finds the URL of the next page in a Link header.
+ * @param link Value of the Link header
+ * @param out Buffer to copy the URL to, emptied if there is no next page
+ * @param out_len Size of the buffer
+ */
+static void next_link(const char *link, char *out, size_t out_len)
+{
+	out[0] = '\0';
+	// <https://...?page=2>; rel="next", <https://...?page=5>; rel="last"
+	for (const char *p = link; (p = strchr(p, '<'));) {
+		const char *close = strchr(p, '>');
+		if (!close)
+			return;
+		const char *comma = strchr(close, ',');
+		const char *rel = strstr(close, "rel=\"next\"");
+		if (rel && (!comma || rel < comma)) {
+			const size_t len = close - p - 1;
+			if (len < out_len) {
+				memcpy(out, p + 1, len);
+				out[len] = '\0';
+			}
+			return;
+		}
+		p = close;
+	}
+}
+
+void rest_read_header(const char *line, size_t len,
+		      struct rest_headers *headers)
+{
+	char link[4096] = "";
+	read_header(line, len, "etag:", headers->etag, sizeof(headers->etag));
+	read_header(line, len, "link:", link, sizeof(link));
+	if (link[0])
+		next_link(link, headers->next, sizeof(headers->next));
+}
+
+static size_t write_header(const char *ptr, size_t size, size_t nmemb,
+			   void *stream)
+{
+	(void) size; // unused
+
+	rest_read_header(ptr, nmemb, stream);
+	return nmemb;
+}
+
+/**
+ * Performs the request set up on the client's handle, retrying transient
+ * failures.
+ * @param c Client
+ * @param buf Buffer to append the NUL-terminated response to
+ * @param headers Headers to reset before every attempt, or NULL
+ * @return CURLE_OK on success, CURLE_HTTP_RETURNED_ERROR on an HTTP error
+ * status, another curl error otherwise
+ */
+static CURLcode perform(struct gql_impl *c, buffer_t *buf,
+			struct rest_headers *headers)
+{
+	const size_t start = buf->len;
+	CURLcode ret;
+	for (unsigned attempt = 1;; attempt++) {
+		const long wait = c->host[0] ? breaker_check(c->host) : 0;
+		if (wait != 0) {
+			fprintf(stderr,
+				"Error: too many failures from %s, not "
+				"sending request\n",
+				c->host);
+			ret = CURLE_COULDNT_CONNECT;
+			break;
+		}
+
+		// Perform the request
+		buf->len = start;
+		if (headers)
+			*headers = (struct rest_headers) {0};
+		ret = curl_easy_perform(c->curl);
+
+		long code = 0, retry_after = -1;
+		if (ret == CURLE_OK) {
+			curl_easy_getinfo(c->curl, CURLINFO_RESPONSE_CODE,
+					  &code);
+			// Only conditional requests are answered with 304
+			if ((code < 200 || code > 299) &&
+			    !(headers && code == 304))
+				ret = CURLE_HTTP_RETURNED_ERROR;
+			if (headers)
+				headers->status = code;
+#if LIBCURL_VERSION_NUM >= 0x074200
+			curl_off_t after = -1;
+			if (curl_easy_getinfo(c->curl, CURLINFO_RETRY_AFTER,
+					      &after) == CURLE_OK &&
+			    after > 0)
+				retry_after = after > RETRY_AFTER_MAX
+						      ? RETRY_AFTER_MAX
+						      : (long) after;
+#endif
+		}
+		const int transient = is_transient(ret, code, retry_after);
+		if (c->host[0])
+			breaker_report(c->host, !transient);
+		if (ret == CURLE_OK)
+			break;
+
+		if (code)
+			fprintf(stderr, "Error: %s returned HTTP %ld\n",
+				c->ctx.endpoint, code);
+		else
+			fprintf(stderr, "Error: request to %s failed: %s\n",
+				c->ctx.endpoint, curl_easy_strerror(ret));
+		if (!transient || attempt > c->ctx.retries ||
+		    shutdown_requested())
+			break;
+
+		long delay = retry_delay_ms(attempt, RETRY_BASE_MS,
+					    RETRY_MAX_MS);
+		if (retry_after >= 0)
+			delay = retry_after * 1000;
+		fprintf(stderr, "Retrying in %.1fs (%u of %u)\n",
+			(double) delay / 1000, attempt, c->ctx.retries);
+		if (retry_sleep(delay) < 0)
+			break;
+	}
+
+	// Append null terminator to the buffer
+	if (ret == CURLE_OK)
+		buffer_append(buf, "\0", 1);
+	return ret;
+}
+
 CURLcode gql_client_send(const gql_client *client, const char *query,
-			 cJSON *args, buffer_t *buf)
+			 const struct gql_var *vars, size_t vars_len,
+			 buffer_t *buf)
 {
 	struct gql_impl *c = (struct gql_impl *) client;
 	struct curl_slist *headers = NULL;
@@ -121,59 +349,55 @@ CURLcode gql_client_send(const gql_client *client, const char *query,
 	curl_easy_setopt(c->curl, CURLOPT_CUSTOMREQUEST, "POST");
 
 	// Prepare request body
-	char *wrapped_query = wrap_query(query, args);
+	gql_build_body(&c->body, query, vars, vars_len);
 
 	// Set the request body
-	curl_easy_setopt(c->curl, CURLOPT_POSTFIELDS, wrapped_query);
-	curl_easy_setopt(c->curl, CURLOPT_POSTFIELDSIZE, strlen(wrapped_query));
+	curl_easy_setopt(c->curl, CURLOPT_POSTFIELDS, c->body.data);
+	curl_easy_setopt(c->curl, CURLOPT_POSTFIELDSIZE, (long) c->body.len);
 
 	// Set the write function to capture the response
 	curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, write_data);
 	curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, (void *) buf);
+	curl_easy_setopt(c->curl, CURLOPT_HEADERFUNCTION, NULL);
 
-	// Perform the request
-	const CURLcode ret = curl_easy_perform(c->curl);
-
-	// Append null terminator to the buffer
-	if (ret == CURLE_OK)
-		buffer_append(buf, "\0", 1);
+	const CURLcode ret = perform(c, buf, NULL);
 
 	// Cleanup
-	free(wrapped_query);
 	curl_slist_free_all(headers);
 
 	return ret;
 }
 
-/**
- * Handle errors in the response.
- * Will check for the "errors" key in the response and print the error messages.
- * Returns failure if any errors are found.
- * @param root Parsed JSON response
- * @return 0 on success (no errors), -1 on failure
- */
-int gql_handle_error(const cJSON *root)
+CURLcode gql_client_get(const gql_client *client, const char *url,
+			const char *etag, buffer_t *buf,
+			struct rest_headers *headers)
 {
-	// Check for errors
-	cJSON *errors = cJSON_GetObjectItemCaseSensitive(root, "errors");
-	if (!errors || !cJSON_IsArray(errors)) {
-		// No errors
-		return 0;
-	}
+	struct gql_impl *c = (struct gql_impl *) client;
+	struct curl_slist *list = NULL;
+	char line[1024];
 
-	cJSON *err;
-	cJSON_ArrayForEach(err, errors)
-	{
-		// Get the error message
-		cJSON *message = cJSON_GetObjectItemCaseSensitive(err,
-								  "message");
-		if (message && cJSON_IsString(message)) {
-			fprintf(stderr, "Github Error: %s\n",
-				message->valuestring);
-		} else {
-			fprintf(stderr, "Github Error: Unknown error\n");
-		}
+	curl_easy_setopt(c->curl, CURLOPT_URL, url);
+
+	snprintf(line, sizeof(line), "Authorization: Bearer %s", c->ctx.token);
+	list = curl_slist_append(list, line);
+	list = curl_slist_append(list, "Accept: application/vnd.github+json");
+	if (etag) {
+		snprintf(line, sizeof(line), "If-None-Match: %s", etag);
+		list = curl_slist_append(list, line);
 	}
+	curl_easy_setopt(c->curl, CURLOPT_HTTPHEADER, list);
+	curl_easy_setopt(c->curl, CURLOPT_USERAGENT, c->ctx.user_agent);
 
-	return -1;
+	curl_easy_setopt(c->curl, CURLOPT_CUSTOMREQUEST, NULL);
+	curl_easy_setopt(c->curl, CURLOPT_HTTPGET, 1L);
+
+	curl_easy_setopt(c->curl, CURLOPT_WRITEFUNCTION, write_data);
+	curl_easy_setopt(c->curl, CURLOPT_WRITEDATA, (void *) buf);
+	curl_easy_setopt(c->curl, CURLOPT_HEADERFUNCTION, write_header);
+	curl_easy_setopt(c->curl, CURLOPT_HEADERDATA, (void *) headers);
+
+	const CURLcode ret = perform(c, buf, headers);
+
+	curl_slist_free_all(list);
+	return ret;
 }
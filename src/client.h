@@ -5,7 +5,6 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
-#include <cjson/cJSON.h>
 #include <curl/curl.h>
 
 #include "buffer.h"
@@ -16,15 +15,88 @@ struct gql_ctx {
 	const char *endpoint;
 	const char *token;
 	const char *user_agent;
+	/// Times a request is retried after a transient failure
+	unsigned retries;
 };
 
 gql_client *gql_client_new(struct gql_ctx ctx);
 gql_client *gql_client_dup(gql_client *client);
 void gql_client_free(gql_client *client);
 
+/// A string variable of a GraphQL request
+struct gql_var {
+	const char *name;
+	/// Value of the variable, NULL for null
+	const char *value;
+};
+
+/**
+ * Builds a GraphQL request body from the query's prebuilt body prefix and the
+ * variables, escaping their names and values as JSON strings. Bytes of 0x80
+ * and above are copied unchanged. The body is not NUL-terminated.
+ * @param body Buffer to build the body in, cleared first
+ * @param prefix Prebuilt body up to the value of "variables"
+ * @param vars Variables
+ * @param vars_len Number of variables
+ */
+void gql_build_body(buffer_t *body, const char *prefix,
+		    const struct gql_var *vars, size_t vars_len);
+
+/**
+ * Sends a GraphQL request.
+ * Transient failures (network errors, HTTP 408, 429 and 5xx, and rate limits)
+ * are retried with jittered exponential backoff, honouring Retry-After, and
+ * count against the endpoint host's circuit breaker. While the breaker is
+ * open, requests fail without being sent.
+ * @param client GraphQL client
+ * @param query Prebuilt request body of the query, up to the value of
+ * "variables", as generated from the .graphql files
+ * @param vars Variables of the request
+ * @param vars_len Number of variables
+ * @param buf Buffer to append the NUL-terminated response to
+ * @return CURLE_OK on success, CURLE_HTTP_RETURNED_ERROR on an HTTP error
+ * status, another curl error otherwise
+ */
 CURLcode gql_client_send(const gql_client *client, const char *query,
-			 cJSON *args, buffer_t *buf);
+			 const struct gql_var *vars, size_t vars_len,
+			 buffer_t *buf);
+
+/// Status and headers of a REST response
+struct rest_headers {
+	/// HTTP status
+	long status;
+	/// ETag of the response, empty if none
+	char etag[256];
+	/// URL of the next page from the Link header, empty if none
+	char next[2048];
+};
+
+/**
+ * Reads the headers of a REST response that the client keeps from one header
+ * line. Other headers, and values too long to keep, are ignored.
+ * @param line Header line as received, not NUL-terminated
+ * @param len Length of the line
+ * @param headers Headers to set
+ */
+void rest_read_header(const char *line, size_t len,
+		      struct rest_headers *headers);
 
-int gql_handle_error(const cJSON *root);
+/**
+ * Sends a GET request to a REST endpoint of the same API, with the client's
+ * token, user agent, retries and circuit breaker.
+ * @param client Client
+ * @param url Full URL to request
+ * @param etag ETag of a cached copy of the response, sent as If-None-Match,
+ * or NULL
+ * @param buf Buffer to append the NUL-terminated response to, the response
+ * is empty on a 304
+ * @param headers Set to the status and headers of the response
+ * @return CURLE_OK on success, including a 304 Not Modified,
+ * CURLE_HTTP_RETURNED_ERROR on an HTTP error status, another curl error
+ * otherwise
+ */
+CURLcode gql_client_get(const gql_client *client, const char *url,
+			const char *etag, buffer_t *buf,
+			struct rest_headers *headers);
 
 #endif // CLIENT_H
@@ -2,11 +2,14 @@
 // Created by Anshul Gupta on 4/6/25.
 //
 
+#define ALLOC_SUBSYSTEM alloc_config
+
 #include "config.h"
 
 #include <ctype.h>
 #include <fcntl.h>
 #include <grp.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -15,6 +18,9 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include "alloc.h"
+#include "sshmux.h"
+
 const char *config_locations[] = {
 		"config.ini",
 		"github-mirror.conf",
@@ -112,12 +118,12 @@ static char *parse_token(char *value, enum remote_type tp)
 			return NULL;
 		}
 		// Not a file, token check
-		token = strdup(value);
+		token = gstrdup(value);
 		goto token_check;
 	}
 
 	// Read the file
-	token = malloc(1024);
+	token = gmalloc(1024);
 	if (!token) {
 		perror("Error allocating token buffer");
 		close(fd);
@@ -128,15 +134,15 @@ static char *parse_token(char *value, enum remote_type tp)
 	const ssize_t bytes_read = read(fd, token, 1024);
 	if (bytes_read < 0) {
 		perror("Error reading token file");
-		free(token);
+		gfree(token);
 		close(fd);
 		return NULL;
 	}
 	token[bytes_read] = '\0';
 
 	// Trim whitespace
-	char *tmp = strdup(trim(token, token + bytes_read));
-	free(token);
+	char *tmp = gstrdup(trim(token, token + bytes_read));
+	gfree(token);
 	if (!tmp) {
 		perror("Error allocating token buffer");
 		close(fd);
@@ -155,7 +161,7 @@ token_check:
 		return token;
 	}
 	fprintf(stderr, "Error: invalid token format: %s\n", token);
-	free(token);
+	gfree(token);
 	return NULL;
 }
 
@@ -174,6 +180,110 @@ static int parse_bool(const char *value, int *out)
 	return -1;
 }
 
+/**
+ * Parse a non-negative decimal integer value.
+ * @param value integer value
+ * @param out parsed integer
+ * @return 0 on success, -1 on error
+ */
+static int parse_long(const char *value, long *out)
+{
+	char *end;
+
+	errno = 0;
+	const long v = strtol(value, &end, 10);
+	if (errno || end == value || *end != '\0' || v < 0)
+		return -1;
+	*out = v;
+	return 0;
+}
+
+/**
+ * Parse a size value with an optional K, M, G or T suffix (powers of 1024).
+ * @param value size value
+ * @param out parsed size in bytes
+ * @return 0 on success, -1 on error
+ */
+static int parse_size(const char *value, long long *out)
+{
+	char *end;
+
+	errno = 0;
+	long long v = strtoll(value, &end, 10);
+	if (errno || end == value || v < 0)
+		return -1;
+
+	int shift = 0;
+	switch (*end) {
+	case 'T':
+	case 't':
+		shift += 10;
+		// fallthrough
+	case 'G':
+	case 'g':
+		shift += 10;
+		// fallthrough
+	case 'M':
+	case 'm':
+		shift += 10;
+		// fallthrough
+	case 'K':
+	case 'k':
+		shift += 10;
+		end++;
+		break;
+	case '\0':
+		break;
+	default:
+		return -1;
+	}
+	if (*end != '\0' || v > (LLONG_MAX >> shift))
+		return -1;
+	*out = v << shift;
+	return 0;
+}
+
+/**
+ * Parse a time of day of the form HH:MM.
+ * @param value time of day
+ * @param out minutes since midnight
+ * @return 0 on success, -1 on error
+ */
+static int parse_time_of_day(const char *value, int *out)
+{
+	int h, m, n = 0;
+	if (sscanf(value, "%2d:%2d%n", &h, &m, &n) != 2 ||
+	    value[n] != '\0' || h < 0 || h > 24 || m < 0 || m > 59 ||
+	    (h == 24 && m != 0))
+		return -1;
+	*out = h * 60 + m;
+	return 0;
+}
+
+/**
+ * Parse a bandwidth window of the form "HH:MM-HH:MM <rate>".
+ * @param value bandwidth window
+ * @param out parsed window
+ * @return 0 on success, -1 on error
+ */
+static int parse_bw_window(char *value, struct bw_window *out)
+{
+	char *dash = strchr(value, '-');
+	char *space = strchr(value, ' ');
+	if (!dash || !space || dash > space)
+		return -1;
+	*dash = '\0';
+	*space = '\0';
+	char *rate = space + 1;
+	while (*rate == ' ')
+		rate++;
+	if (parse_time_of_day(value, &out->start) < 0 ||
+	    parse_time_of_day(dash + 1, &out->end) < 0 ||
+	    out->start == out->end || parse_size(rate, &out->rate) < 0)
+		return -1;
+	return 0;
+}
+
 static int parse_line_inner(struct config *cfg, enum config_section section,
 			    char *key, char *value)
 {
@@ -186,7 +296,21 @@ static int parse_line_inner(struct config *cfg, enum config_section section,
 	case section_github:
 		if (!strcmp(key, "endpoint"))
 			cfg->head->gh.endpoint = value;
-		else if (!strcmp(key, "token")) {
+		else if (!strcmp(key, "rest-endpoint"))
+			cfg->head->gh.rest_endpoint = value;
+		else if (!strcmp(key, "listing")) {
+			if (!strcmp(value, "graphql"))
+				cfg->head->gh.listing = gh_listing_graphql;
+			else if (!strcmp(value, "rest"))
+				cfg->head->gh.listing = gh_listing_rest;
+			else {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for listing: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "token")) {
 			cfg->head->gh.token =
 					parse_token(value, cfg->head->type);
 		} else if (!strcmp(key, "user_agent"))
@@ -210,7 +334,59 @@ static int parse_line_inner(struct config *cfg, enum config_section section,
 					value);
 				return -1;
 			}
-		} else if (!strcmp(key, "transport")) {
+		} else if (!strcmp(key, "fork-alternates")) {
+			if (parse_bool(value, &cfg->head->gh.fork_alternates) <
+			    0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for fork-alternates: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "partial-size")) {
+			if (parse_size(value, &cfg->head->gh.partial_size) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for partial-size: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "partial-mode")) {
+			if (!strcmp(value, "filter"))
+				cfg->head->gh.partial_mode = partial_mode_filter;
+			else if (!strcmp(value, "refs"))
+				cfg->head->gh.partial_mode = partial_mode_refs;
+			else {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for partial-mode: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "refs")) {
+			if (!strcmp(value, "all"))
+				cfg->head->gh.refs = ref_policy_all;
+			else if (!strcmp(value, "no-pull"))
+				cfg->head->gh.refs = ref_policy_no_pull;
+			else if (!strcmp(value, "heads-tags"))
+				cfg->head->gh.refs = ref_policy_heads_tags;
+			else {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for refs: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "partial-filter"))
+			cfg->head->gh.partial_filter = value;
+		else if (!strcmp(key, "partial-repos"))
+			cfg->head->gh.partial_repos = value;
+		else if (!strcmp(key, "include") || !strcmp(key, "exclude")) {
+			if (filter_add(&cfg->head->gh.filter, value,
+				       !strcmp(key, "exclude")) < 0)
+				return -1;
+		}
+		else if (!strcmp(key, "transport")) {
 			if (!strcmp(value, "ssh"))
 				cfg->head->gh.transport = git_transport_ssh;
 			else if (!strcmp(value, "https"))
@@ -239,6 +415,10 @@ static int parse_line_inner(struct config *cfg, enum config_section section,
 			cfg->head->srht.user_agent = value;
 		} else if (!strcmp(key, "owner")) {
 			cfg->head->srht.owner = value;
+		} else if (!strcmp(key, "include") || !strcmp(key, "exclude")) {
+			if (filter_add(&cfg->head->srht.filter, value,
+				       !strcmp(key, "exclude")) < 0)
+				return -1;
 		} else {
 			fprintf(stderr,
 				"Error parsing config file: unknown key: %s\n",
@@ -249,7 +429,270 @@ static int parse_line_inner(struct config *cfg, enum config_section section,
 	case section_git:
 		if (!strcmp(key, "base"))
 			cfg->git_base = value;
-		else {
+		else if (!strcmp(key, "jobs")) {
+			// Either a fixed count or a range to adapt within
+			char *end, *max_str;
+			errno = 0;
+			long min = strtol(value, &end, 10), max = min;
+			if (end == value)
+				min = 0;
+			while (isspace(*end))
+				end++;
+			if (*end == '-') {
+				max_str = end + 1;
+				max = strtol(max_str, &end, 10);
+				if (end == max_str)
+					max = 0;
+			}
+			if (errno || *end != '\0')
+				min = 0;
+			if (min < 1 || max < min || max > 1024) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for jobs: %s\n",
+					value);
+				return -1;
+			}
+			cfg->jobs_min = (int) min;
+			cfg->jobs = (int) max;
+		} else if (!strcmp(key, "backend")) {
+			if (!strcmp(value, "cli"))
+				cfg->backend = git_backend_cli;
+			else if (!strcmp(value, "libgit2")) {
+#ifdef HAVE_LIBGIT2
+				cfg->backend = git_backend_libgit2;
+#else
+				fprintf(stderr, "Error parsing config file: "
+						"built without libgit2\n");
+				return -1;
+#endif
+			} else {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for backend: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "shutdown-timeout")) {
+			long timeout;
+			if (parse_long(value, &timeout) < 0 || timeout < 0 ||
+			    timeout > 86400) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for shutdown-timeout: "
+					"%s\n",
+					value);
+				return -1;
+			}
+			cfg->shutdown_timeout = (unsigned) timeout;
+		} else if (!strcmp(key, "retries")) {
+			long retries;
+			if (parse_long(value, &retries) < 0 || retries < 0 ||
+			    retries > 10) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for retries: %s\n",
+					value);
+				return -1;
+			}
+			cfg->retries = (unsigned) retries;
+		} else if (!strcmp(key, "bandwidth")) {
+			if (parse_size(value, &cfg->bandwidth.rate) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for bandwidth: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "bandwidth-window")) {
+			struct bandwidth_cfg *bw = &cfg->bandwidth;
+			struct bw_window *w = &bw->windows[bw->windows_len];
+			if (bw->windows_len == BW_MAX_WINDOWS) {
+				fprintf(stderr,
+					"Error parsing config file: more than "
+					"%d bandwidth windows\n",
+					BW_MAX_WINDOWS);
+				return -1;
+			}
+			if (parse_bw_window(value, w) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for bandwidth-window: %s\n",
+					value);
+				return -1;
+			}
+			bw->windows_len++;
+		} else if (!strcmp(key, "hook")) {
+			struct hooks_cfg *hooks = &cfg->hooks;
+			if (hooks->commands_len == HOOKS_MAX) {
+				fprintf(stderr,
+					"Error parsing config file: more than "
+					"%d hooks\n",
+					HOOKS_MAX);
+				return -1;
+			}
+			hooks->commands[hooks->commands_len++] = value;
+		} else if (!strcmp(key, "hook-batch")) {
+			if (parse_long(value, &cfg->hooks.batch) < 0 ||
+			    cfg->hooks.batch < 1 || cfg->hooks.batch > 10000) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for hook-batch: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "hook-jobs")) {
+			long jobs;
+			if (parse_long(value, &jobs) < 0 || jobs < 1 ||
+			    jobs > 64) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for hook-jobs: %s\n",
+					value);
+				return -1;
+			}
+			cfg->hooks.jobs = (int) jobs;
+		} else if (!strcmp(key, "bundle-dir"))
+			cfg->bundle.dir = value;
+		else if (!strcmp(key, "bundle-uri"))
+			cfg->bundle.uri = value;
+		else if (!strcmp(key, "maintenance")) {
+			if (parse_bool(value, &cfg->maint.enabled) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for maintenance: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "maintenance-packs")) {
+			if (parse_long(value, &cfg->maint.pack_threshold) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for maintenance-packs: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "maintenance-loose")) {
+			if (parse_long(value, &cfg->maint.loose_threshold) <
+			    0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for maintenance-loose: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "maintenance-cpu")) {
+			if (parse_long(value, &cfg->maint.cpu_budget) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for maintenance-cpu: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "lfs")) {
+			if (parse_bool(value, &cfg->lfs.enabled) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for lfs: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "lfs-jobs")) {
+			long jobs;
+			if (parse_long(value, &jobs) < 0 || jobs < 1 ||
+			    jobs > 256) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for lfs-jobs: %s\n",
+					value);
+				return -1;
+			}
+			cfg->lfs.jobs = (int) jobs;
+		} else if (!strcmp(key, "nice")) {
+			long nice;
+			if (parse_long(value, &nice) < 0 || nice > 19) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for nice: %s\n",
+					value);
+				return -1;
+			}
+			cfg->profile.nice = (int) nice;
+		} else if (!strcmp(key, "io-class")) {
+			if (!strcmp(value, "none"))
+				cfg->profile.io_class = io_class_none;
+			else if (!strcmp(value, "best-effort"))
+				cfg->profile.io_class = io_class_best_effort;
+			else if (!strcmp(value, "idle"))
+				cfg->profile.io_class = io_class_idle;
+			else {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for io-class: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "memory")) {
+			if (parse_size(value, &cfg->profile.memory) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for memory: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "pack-threads")) {
+			if (parse_long(value, &cfg->profile.pack_threads) < 0 ||
+			    cfg->profile.pack_threads > 1024) {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for pack-threads: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "cgroup"))
+			cfg->profile.cgroup = value;
+		else if (!strcmp(key, "negotiation")) {
+			if (!strcmp(value, "default"))
+				cfg->profile.negotiation = NULL;
+			else if (!strcmp(value, "consecutive") ||
+				 !strcmp(value, "skipping") ||
+				 !strcmp(value, "noop"))
+				cfg->profile.negotiation = value;
+			else {
+				fprintf(stderr,
+					"Error parsing config file: "
+					"invalid value for negotiation: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "ssh-multiplex")) {
+			if (parse_bool(value, &cfg->ssh_multiplex) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for ssh-multiplex: %s\n",
+					value);
+				return -1;
+			}
+		} else if (!strcmp(key, "ssh-masters")) {
+			long masters;
+			if (parse_long(value, &masters) < 0 || masters < 0 ||
+			    masters > SSHMUX_MASTERS_MAX) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for ssh-masters: %s\n",
+					value);
+				return -1;
+			}
+			cfg->ssh_masters = (unsigned) masters;
+		} else if (!strcmp(key, "maintenance-io")) {
+			if (parse_size(value, &cfg->maint.io_budget) < 0) {
+				fprintf(stderr,
+					"Error parsing config file: invalid "
+					"value for maintenance-io: %s\n",
+					value);
+				return -1;
+			}
+		} else {
 			fprintf(stderr,
 				"Error parsing config file: unknown key: %s\n",
 				key);
@@ -285,22 +728,27 @@ static int parse_line(struct config *cfg, char *line,
 			*section = section_github;
 
 			// Add the new remote to the list
-			struct remote_cfg *remote = calloc(1, sizeof(*remote));
+			struct remote_cfg *remote = gcalloc(1, sizeof(*remote));
 			if (!remote) {
 				perror("Error allocating owner");
 				return -1;
 			}
 			remote->type = remote_type_github;
 			remote->gh.endpoint = GH_DEFAULT_ENDPOINT;
+			remote->gh.rest_endpoint = GH_DEFAULT_REST_ENDPOINT;
+			remote->gh.listing = gh_listing_graphql;
 			remote->gh.user_agent = DEFAULT_USER_AGENT;
 			remote->gh.transport = git_transport_https;
+			remote->gh.partial_mode = partial_mode_filter;
+			remote->gh.partial_filter = GH_DEFAULT_PARTIAL_FILTER;
+			remote->gh.refs = ref_policy_all;
 			remote->next = cfg->head;
 			cfg->head = remote;
 		} else if (!strcmp(section_name, "srht")) {
 			*section = section_srht;
 
 			// Add the new remote to the list
-			struct remote_cfg *remote = calloc(1, sizeof(*remote));
+			struct remote_cfg *remote = gcalloc(1, sizeof(*remote));
 			if (!remote) {
 				perror("Error allocating owner");
 				return -1;
@@ -377,6 +825,27 @@ static void config_defaults(struct config *cfg)
 {
 	cfg->quiet = 0;
 	cfg->git_base = "/srv/git";
+	cfg->jobs = 1;
+	cfg->jobs_min = 1;
+	cfg->shards = 1;
+	cfg->shutdown_timeout = 60;
+	cfg->retries = 2;
+	cfg->ssh_multiplex = 1;
+	cfg->ssh_masters = 0;
+	cfg->hooks.batch = 100;
+	cfg->hooks.jobs = 1;
+	cfg->lfs.enabled = 0;
+	cfg->lfs.jobs = 16;
+	cfg->maint.enabled = 0;
+	cfg->maint.pack_threshold = 16;
+	cfg->maint.loose_threshold = 2000;
+	cfg->maint.cpu_budget = 0;
+	cfg->maint.io_budget = 0;
+	cfg->profile.nice = 10;
+	cfg->profile.io_class = io_class_best_effort;
+	cfg->profile.memory = 0;
+	cfg->profile.pack_threads = 0;
+	cfg->profile.negotiation = "skipping";
 }
 
 static int github_cfg_validate(const struct github_cfg *cfg)
@@ -432,7 +901,7 @@ static int config_validate(const struct config *cfg)
 
 struct config *config_read(const char *path)
 {
-	struct config *cfg = calloc(1, sizeof(*cfg));
+	struct config *cfg = gcalloc(1, sizeof(*cfg));
 	if (!cfg) {
 		perror("error allocating config");
 		return NULL;
@@ -455,9 +924,10 @@ struct config *config_read(const char *path)
 	return cfg;
 
 fail2:
-	munmap(cfg->contents, cfg->contents_len);
+	config_free(cfg);
+	return NULL;
 fail:
-	free(cfg);
+	gfree(cfg);
 	return NULL;
 }
 
@@ -465,10 +935,12 @@ static void remote_cfg_free(struct remote_cfg *remote)
 {
 	switch (remote->type) {
 	case remote_type_github:
-		free((char *) remote->gh.token);
+		gfree((char *) remote->gh.token);
+		filter_free(&remote->gh.filter);
 		break;
 	case remote_type_srht:
-		free((char *) remote->srht.token);
+		gfree((char *) remote->srht.token);
+		filter_free(&remote->srht.filter);
 		break;
 	}
 }
@@ -484,9 +956,9 @@ void config_free(struct config *config)
 	while (owner) {
 		struct remote_cfg *next = owner->next;
 		remote_cfg_free(owner);
-		free(owner);
+		gfree(owner);
 		owner = next;
 	}
 
-	free(config);
+	gfree(config);
 }
@@ -7,8 +7,12 @@
 
 #include <stdlib.h>
 
+#include "filter.h"
+
 #define GH_DEFAULT_ENDPOINT "https://api.github.com/graphql"
+#define GH_DEFAULT_REST_ENDPOINT "https://api.github.com"
 #define SRHT_DEFAULT_ENDPOINT "https://git.sr.ht/query"
+#define GH_DEFAULT_PARTIAL_FILTER "blob:limit=1m"
 #define DEFAULT_USER_AGENT "github-mirror/" GITHUB_MIRROR_VERSION
 
 extern const char *config_locations[];
@@ -18,17 +22,64 @@ enum git_transport {
 	git_transport_ssh,
 };
 
+enum partial_mode {
+	/// Partial clone with a blob filter
+	partial_mode_filter,
+	/// Mirror only branches and tags
+	partial_mode_refs,
+};
+
+enum ref_policy {
+	/// Every ref, like git clone --mirror
+	ref_policy_all,
+	/// Every ref but GitHub's pull request refs
+	ref_policy_no_pull,
+	/// Only branches and tags
+	ref_policy_heads_tags,
+};
+
+enum gh_listing {
+	/// List repositories through the GraphQL API
+	gh_listing_graphql,
+	/// List repositories through the REST API, with cached pages
+	gh_listing_rest,
+};
+
+enum git_backend {
+	/// Run the git command line tool
+	git_backend_cli,
+	/// Transfer in-process with libgit2
+	git_backend_libgit2,
+};
+
 struct github_cfg {
 	/// Whether to skip mirroring fork repositories
 	int skip_forks;
 	/// Whether to skip mirroring private repositories
 	int skip_private;
+	/// Whether to share objects between forks and their mirrored parents
+	int fork_alternates;
 	/// Transport protocol to use for mirroring
 	enum git_transport transport;
+	/// Mirror repositories at least this many bytes large partially,
+	/// 0 to disable
+	long long partial_size;
+	/// How to mirror huge repositories partially
+	enum partial_mode partial_mode;
+	/// Which refs mirrors track
+	enum ref_policy refs;
+	/// Which API repositories are listed through
+	enum gh_listing listing;
 
 	// Borrowed
+	/// Object filter for partial mirrors
+	const char *partial_filter;
+	/// Comma-separated repositories to always mirror partially
+	const char *partial_repos;
 	/// Github graphql API endpoint
 	const char *endpoint;
+	/// Github REST API endpoint
+	const char *rest_endpoint;
 	/// Client user agent
 	const char *user_agent;
 	/// The owner of the repositories
@@ -37,6 +88,8 @@ struct github_cfg {
 	// Owned
 	/// Github auth token
 	const char *token;
+	/// Include/exclude rules for listed repositories
+	struct repo_filter filter;
 };
 
 struct srht_cfg {
@@ -50,6 +103,8 @@ struct srht_cfg {
 
 	// Owned
 	const char *token;
+	/// Include/exclude rules for listed repositories
+	struct repo_filter filter;
 };
 
 enum remote_type {
@@ -67,6 +122,93 @@ struct remote_cfg {
 	struct remote_cfg *next;
 };
 
+struct maintenance_cfg {
+	/// Whether to run repository maintenance after fetching
+	int enabled;
+	/// Repack once a mirror has at least this many packs
+	long pack_threshold;
+	/// Repack once a mirror has at least this many loose objects
+	long loose_threshold;
+	/// CPU seconds maintenance may use per run, 0 for unlimited
+	long cpu_budget;
+	/// Bytes of disk IO maintenance may use per run, 0 for unlimited
+	long long io_budget;
+};
+
+struct lfs_cfg {
+	/// Whether to fetch the LFS objects of mirrors after fetching
+	int enabled;
+	/// LFS objects downloaded at once per mirror
+	int jobs;
+};
+
+/// IO scheduling class of git children
+enum io_class {
+	/// Leave the class of the mirror process
+	io_class_none,
+	/// Best-effort at the lowest priority level
+	io_class_best_effort,
+	/// Only use the disk when nothing else does
+	io_class_idle,
+};
+
+struct profile_cfg {
+	/// Niceness of git children, 0 to leave it unchanged
+	int nice;
+	/// IO scheduling class of git children
+	enum io_class io_class;
+	/// Bytes of memory each git child may use, 0 for unlimited
+	long long memory;
+	/// Threads each git child may use, 0 to share the CPUs between jobs
+	long pack_threads;
+	/// cgroup v2 directory to run git children in, NULL for none
+	const char *cgroup;
+	/// fetch.negotiationAlgorithm of fetches, NULL for git's default
+	const char *negotiation;
+};
+
+struct bundle_cfg {
+	/// Directory containing <owner>/<name>.bundle files to seed new mirrors
+	const char *dir;
+	/// Bundle URI template for new mirrors, with {owner} and {repo}
+	/// placeholders
+	const char *uri;
+};
+
+/// Most bandwidth windows a config may define
+#define BW_MAX_WINDOWS 16
+
+/// Bandwidth limit for a time of day
+struct bw_window {
+	/// Start and end of the window in minutes since local midnight, the
+	/// window wraps past midnight if end is before start
+	int start;
+	int end;
+	/// Bytes per second, 0 for unlimited
+	long long rate;
+};
+
+struct bandwidth_cfg {
+	/// Bytes per second outside of the windows, 0 for unlimited
+	long long rate;
+	/// Limits for times of day, the first matching window applies
+	struct bw_window windows[BW_MAX_WINDOWS];
+	size_t windows_len;
+};
+
+/// Most post-update hooks a config may define
+#define HOOKS_MAX 16
+
+struct hooks_cfg {
+	/// Shell commands run for the mirrors whose refs changed
+	const char *commands[HOOKS_MAX];
+	size_t commands_len;
+	/// Most mirrors passed to one run of a hook
+	long batch;
+	/// Most hooks running at once
+	int jobs;
+};
+
 struct config {
 	/// The content of the config file
 	char *contents;
@@ -74,6 +216,38 @@ struct config {
 
 	/// Quiet mode
 	int quiet;
+	/// Only report which repositories would be mirrored
+	int dry_run;
+	/// Maximum number of mirror jobs to run in parallel
+	int jobs;
+	/// Minimum number of mirror jobs to run in parallel, the number adapts
+	/// between this and jobs if lower
+	int jobs_min;
+	/// Shard of repositories mirrored by this node, 0-based
+	unsigned shard;
+	/// Total number of shards, 1 if not sharding
+	unsigned shards;
+	/// Seconds running jobs get to finish on shutdown
+	unsigned shutdown_timeout;
+	/// Times a failed transfer or API request is retried
+	unsigned retries;
+	/// Whether ssh transfers share master connections, see sshmux.h
+	int ssh_multiplex;
+	/// Master connections per ssh host, 0 to size them by jobs
+	unsigned ssh_masters;
+	/// How mirrors are cloned and fetched
+	enum git_backend backend;
+	/// File to write metrics to at the end of a run, NULL to disable
+	const char *metrics_path;
+	/// File to write phase timings to as JSON at the end of a run, NULL to
+	/// disable
+	const char *timings_path;
+	/// Milliseconds in which mirror jobs may start, 0 for no limit
+	long long time_budget;
+	/// Print the state of the mirrors instead of mirroring them
+	int show_status;
+	/// Print memory statistics at the end of the run
+	int show_stats;
 
 	/// Repo owners to mirror
 	struct remote_cfg *head;
@@ -81,6 +255,24 @@ struct config {
 	/// The filepath to the git mirrors
 	/// Default: /srv/git
 	const char *git_base;
+
+	/// Background repository maintenance settings
+	struct maintenance_cfg maint;
+
+	/// LFS objects of mirrors
+	struct lfs_cfg lfs;
+
+	/// Resources git children may use
+	struct profile_cfg profile;
+
+	/// Bundles used to bootstrap new mirrors
+	struct bundle_cfg bundle;
+
+	/// Aggregate bandwidth limit of all transfers
+	struct bandwidth_cfg bandwidth;
+
+	/// Hooks run after the mirrors were updated
+	struct hooks_cfg hooks;
 };
 
 /**
@@ -0,0 +1,392 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_config
+
+#include "filter.h"
+
+#include <ctype.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+enum term_field {
+	field_name,
+	field_topic,
+	field_language,
+	field_archived,
+	field_size,
+	field_pushed,
+};
+
+enum term_op {
+	op_glob,
+	op_regex,
+	op_less,
+	op_greater,
+	op_bool,
+};
+
+struct filter_term {
+	enum term_field field;
+	enum term_op op;
+	/// Glob pattern, owned
+	char *glob;
+	/// Compiled regex, valid if op is op_regex
+	regex_t regex;
+	/// Boolean, size in kilobytes, or age in seconds
+	long long num;
+};
+
+struct filter_rule {
+	/// Rule text, borrowed
+	const char *text;
+	int exclude;
+	struct filter_term *terms;
+	size_t terms_len;
+	struct filter_rule *next;
+};
+
+static const struct {
+	const char *name;
+	enum term_field field;
+} fields[] = {
+		{"name", field_name},	      {"topic", field_topic},
+		{"language", field_language}, {"archived", field_archived},
+		{"size", field_size},	      {"pushed", field_pushed},
+};
+
+static int parse_number(const char *value, long long *num, char *suffix)
+{
+	char *end;
+	const long long v = strtoll(value, &end, 10);
+	if (end == value || v < 0)
+		return -1;
+	*suffix = *end;
+	if (*end && end[1])
+		return -1;
+	*num = v;
+	return 0;
+}
+
+/**
+ * Parses a size into kilobytes, the unit GitHub reports repository sizes in.
+ */
+static int parse_size_kb(const char *value, long long *out)
+{
+	long long v;
+	char suffix;
+	if (parse_number(value, &v, &suffix) < 0)
+		return -1;
+
+	int shift;
+	switch (tolower((unsigned char) suffix)) {
+	case '\0':
+		// Plain bytes, round up to kilobytes
+		*out = (v + 1023) / 1024;
+		return 0;
+	case 'k':
+		shift = 0;
+		break;
+	case 'm':
+		shift = 10;
+		break;
+	case 'g':
+		shift = 20;
+		break;
+	case 't':
+		shift = 30;
+		break;
+	default:
+		return -1;
+	}
+	if (v > (LLONG_MAX >> shift))
+		return -1;
+	*out = v << shift;
+	return 0;
+}
+
+/**
+ * Parses an age into seconds.
+ */
+static int parse_age(const char *value, long long *out)
+{
+	long long v;
+	char suffix;
+	if (parse_number(value, &v, &suffix) < 0)
+		return -1;
+
+	long long mult;
+	switch (suffix) {
+	case '\0':
+	case 's':
+		mult = 1;
+		break;
+	case 'm':
+		mult = 60;
+		break;
+	case 'h':
+		mult = 60 * 60;
+		break;
+	case 'd':
+		mult = 24 * 60 * 60;
+		break;
+	case 'w':
+		mult = 7 * 24 * 60 * 60;
+		break;
+	case 'y':
+		mult = 365 * 24 * 60 * 60;
+		break;
+	default:
+		return -1;
+	}
+	if (v > LLONG_MAX / mult)
+		return -1;
+	*out = v * mult;
+	return 0;
+}
+
+static void term_free(struct filter_term *term)
+{
+	if (term->op == op_regex)
+		regfree(&term->regex);
+	gfree(term->glob);
+}
+
+/**
+ * Compiles a single term of a rule.
+ * @param term Term to compile into
+ * @param text Term text, NUL-terminated
+ * @return 0 on success, -1 on error
+ */
+static int term_compile(struct filter_term *term, const char *text)
+{
+	const char *op = strpbrk(text, ":~<>");
+	if (!op || op == text)
+		return -1;
+
+	const size_t name_len = op - text;
+	size_t i;
+	for (i = 0; i < sizeof(fields) / sizeof(*fields); i++) {
+		if (strlen(fields[i].name) == name_len &&
+		    !strncmp(fields[i].name, text, name_len))
+			break;
+	}
+	if (i == sizeof(fields) / sizeof(*fields))
+		return -1;
+	term->field = fields[i].field;
+
+	const char *value = op + 1;
+	if (!*value)
+		return -1;
+
+	switch (term->field) {
+	case field_name:
+	case field_topic:
+	case field_language:
+		if (*op == ':') {
+			term->op = op_glob;
+			const size_t len = strlen(value);
+			term->glob = gmalloc(len + 1);
+			if (!term->glob)
+				return -1;
+			memcpy(term->glob, value, len + 1);
+			return 0;
+		}
+		if (*op == '~') {
+			if (regcomp(&term->regex, value,
+				    REG_EXTENDED | REG_NOSUB) != 0)
+				return -1;
+			term->op = op_regex;
+			return 0;
+		}
+		return -1;
+	case field_archived:
+		if (*op != ':')
+			return -1;
+		term->op = op_bool;
+		if (!strcmp(value, "true"))
+			term->num = 1;
+		else if (!strcmp(value, "false"))
+			term->num = 0;
+		else
+			return -1;
+		return 0;
+	case field_size:
+	case field_pushed:
+		if (*op == '<')
+			term->op = op_less;
+		else if (*op == '>')
+			term->op = op_greater;
+		else
+			return -1;
+		return term->field == field_size
+				       ? parse_size_kb(value, &term->num)
+				       : parse_age(value, &term->num);
+	}
+	return -1;
+}
+
+int filter_add(struct repo_filter *filter, const char *rule, int exclude)
+{
+	struct filter_rule *r = gcalloc(1, sizeof(*r));
+	if (!r) {
+		perror("Error allocating filter rule");
+		return -1;
+	}
+	r->text = rule;
+	r->exclude = exclude;
+
+	const char *p = rule;
+	while (*p) {
+		while (isspace((unsigned char) *p))
+			p++;
+		if (!*p)
+			break;
+		const char *end = p;
+		while (*end && !isspace((unsigned char) *end))
+			end++;
+
+		// Copy the term so it is NUL-terminated
+		char term_text[256];
+		const size_t len = end - p;
+		if (len >= sizeof(term_text))
+			goto invalid;
+		memcpy(term_text, p, len);
+		term_text[len] = '\0';
+
+		struct filter_term *terms = grealloc(
+				r->terms, sizeof(*terms) * (r->terms_len + 1));
+		if (!terms)
+			goto invalid;
+		r->terms = terms;
+		struct filter_term *term = &r->terms[r->terms_len];
+		memset(term, 0, sizeof(*term));
+		if (term_compile(term, term_text) < 0) {
+			term_free(term);
+			fprintf(stderr, "Error: invalid filter term: %s\n",
+				term_text);
+			goto invalid;
+		}
+		r->terms_len++;
+		p = end;
+	}
+
+	if (r->terms_len == 0) {
+		fprintf(stderr, "Error: empty filter rule\n");
+		goto invalid;
+	}
+
+	if (filter->tail)
+		filter->tail->next = r;
+	else
+		filter->head = r;
+	filter->tail = r;
+	if (!exclude)
+		filter->has_includes = 1;
+	return 0;
+
+invalid:
+	fprintf(stderr, "Error: invalid filter rule: %s\n", rule);
+	for (size_t i = 0; i < r->terms_len; i++)
+		term_free(&r->terms[i]);
+	gfree(r->terms);
+	gfree(r);
+	return -1;
+}
+
+static int match_string(const struct filter_term *term, const char *str)
+{
+	if (!str)
+		return 0;
+	if (term->op == op_glob)
+		return fnmatch(term->glob, str, 0) == 0;
+	return regexec(&term->regex, str, 0, NULL, 0) == 0;
+}
+
+static int term_match(const struct filter_term *term,
+		      const struct repo_attrs *repo, time_t now)
+{
+	switch (term->field) {
+	case field_name:
+		return match_string(term, repo->name);
+	case field_topic:
+		for (size_t i = 0; i < repo->topics_len; i++) {
+			if (match_string(term, repo->topics[i]))
+				return 1;
+		}
+		return 0;
+	case field_language:
+		return match_string(term, repo->language);
+	case field_archived:
+		return !repo->archived == !term->num;
+	case field_size:
+		if (term->op == op_less)
+			return repo->disk_usage < term->num;
+		return repo->disk_usage > term->num;
+	case field_pushed:
+		// Unknown push times never match
+		if (!repo->pushed_at)
+			return 0;
+		if (term->op == op_less)
+			return now - repo->pushed_at < term->num;
+		return now - repo->pushed_at > term->num;
+	}
+	return 0;
+}
+
+static int rule_match(const struct filter_rule *rule,
+		      const struct repo_attrs *repo, time_t now)
+{
+	for (size_t i = 0; i < rule->terms_len; i++) {
+		if (!term_match(&rule->terms[i], repo, now))
+			return 0;
+	}
+	return 1;
+}
+
+int filter_eval(const struct repo_filter *filter, const struct repo_attrs *repo,
+		time_t now, const char **reason)
+{
+	const struct filter_rule *rule;
+	int included = !filter->has_includes;
+
+	*reason = NULL;
+
+	for (rule = filter->head; rule && !included; rule = rule->next) {
+		if (!rule->exclude && rule_match(rule, repo, now)) {
+			included = 1;
+			*reason = rule->text;
+		}
+	}
+	if (!included)
+		return 0;
+
+	for (rule = filter->head; rule; rule = rule->next) {
+		if (rule->exclude && rule_match(rule, repo, now)) {
+			*reason = rule->text;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+void filter_free(struct repo_filter *filter)
+{
+	struct filter_rule *rule = filter->head;
+	while (rule) {
+		struct filter_rule *next = rule->next;
+		for (size_t i = 0; i < rule->terms_len; i++)
+			term_free(&rule->terms[i]);
+		gfree(rule->terms);
+		gfree(rule);
+		rule = next;
+	}
+	memset(filter, 0, sizeof(*filter));
+}
@@ -0,0 +1,73 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stddef.h>
+#include <time.h>
+
+/// Attributes of a listed repository that rules can match on
+struct repo_attrs {
+	const char *name;
+	/// Topics of the repository
+	char *const *topics;
+	size_t topics_len;
+	/// Primary language, NULL if unknown
+	const char *language;
+	int archived;
+	/// Size of the repository in kilobytes, 0 if unknown
+	long long disk_usage;
+	/// Time of the last push, 0 if unknown
+	time_t pushed_at;
+};
+
+struct filter_rule;
+
+/// Compiled include/exclude rules of a remote
+struct repo_filter {
+	struct filter_rule *head;
+	struct filter_rule *tail;
+	/// Whether any include rules exist
+	int has_includes;
+};
+
+/**
+ * Compiles a rule and appends it to the filter.
+ * A rule is a whitespace-separated list of terms that must all match:
+ *	- name:GLOB, name~REGEX
+ *	- topic:GLOB, topic~REGEX (matches if any topic matches)
+ *	- language:GLOB, language~REGEX
+ *	- archived:BOOL
+ *	- size<SIZE, size>SIZE (with an optional K, M, G or T suffix)
+ *	- pushed<AGE, pushed>AGE (with an s, m, h, d, w or y suffix)
+ * Prints the error to stderr if the rule is invalid.
+ * @param filter Filter to add the rule to
+ * @param rule Rule text, must outlive the filter
+ * @param exclude Non-zero for an exclude rule, zero for an include rule
+ * @return 0 on success, -1 on error
+ */
+int filter_add(struct repo_filter *filter, const char *rule, int exclude);
+
+/**
+ * Decides whether a repository should be mirrored.
+ * If any include rules exist, the repository must match one of them.
+ * It is then skipped if it matches any exclude rule.
+ * @param filter Filter to evaluate
+ * @param repo Attributes of the repository
+ * @param now Current time, used for pushed rules
+ * @param reason Set to the text of the deciding rule, or NULL if no rule
+ * decided
+ * @return 1 if the repository should be mirrored, 0 if it should be skipped
+ */
+int filter_eval(const struct repo_filter *filter, const struct repo_attrs *repo,
+		time_t now, const char **reason);
+
+/**
+ * Free the compiled rules of the filter
+ * @param filter The filter to free
+ */
+void filter_free(struct repo_filter *filter);
+
+#endif // FILTER_H
@@ -2,32 +2,43 @@
 // Created by Anshul Gupta on 4/6/25.
 //
 
+#define ALLOC_SUBSYSTEM alloc_git
+
 #include "git.h"
 
+#include <dirent.h>
 #include <errno.h>
 #include <grp.h>
+#include <poll.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/fcntl.h>
+#include <sys/file.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "alloc.h"
+#include "buffer.h"
+#include "changes.h"
+#include "lfs.h"
+#include "maintenance.h"
+#include "profile.h"
+#include "refspec.h"
+#include "retry.h"
+#include "scan.h"
+#include "shutdown.h"
+#include "spawn.h"
+#include "timing.h"
+#ifdef HAVE_LIBGIT2
+#include "libgit2.h"
+#endif
+
 extern char **environ;
 
-/**
- * Constructs the full path to the git repository based on the base path, owner,
- * and name. If the name is NULL, it constructs the path to the owner's
- * directory.
- * @param base Base path for the git repository
- * @param owner Owner of the repository
- * @param name Name of the repository
- * @return A string containing the full path to the git repository or owner's
- * directory.
- */
-static char *get_git_path(const char *base, const char *owner, const char *name)
+char *get_git_path(const char *base, const char *owner, const char *name)
 {
 	if (!base || !owner)
 		return NULL;
@@ -40,13 +51,13 @@ static char *get_git_path(const char *base, const char *owner, const char *name)
 		return NULL;
 
 	// Allocate memory for the string
-	char *path = malloc(len + 1);
+	char *path = gmalloc(len + 1);
 	if (!path)
 		return NULL;
 
 	// Format the string
 	if (snprintf(path, len + 1, format, base, owner, name) < 0) {
-		free(path);
+		gfree(path);
 		return NULL;
 	}
 	return path;
@@ -78,7 +89,7 @@ static char *prepare_git_url(const char *url, const char *user,
 	// Check if the URL starts with "ssh://"
 	if (strncmp(url, ssh_prefix, ssh_prefix_len) == 0) {
 		// If it's an SSH URL, return it unchanged
-		return strdup(url);
+		return gstrdup(url);
 	}
 
 	// Find the position of "https://"
@@ -92,7 +103,7 @@ static char *prepare_git_url(const char *url, const char *user,
 		  2; // 2 for "@" and ":"
 
 	// Allocate memory for the new URL
-	if (!((new_url = malloc(new_len + 1)))) {
+	if (!((new_url = gmalloc(new_len + 1)))) {
 		perror("malloc");
 		return NULL;
 	}
@@ -111,7 +122,11 @@ static char *prepare_git_url(const char *url, const char *user,
  */
 static int contains_mirror(const char *path)
 {
-	const pid_t pid = fork();
+	const int known = scan_check_mirror(path);
+	if (known >= 0)
+		return known;
+
+	const pid_t pid = spawn_fork();
 	if (pid < 0) {
 		perror("fork");
 		return 0;
@@ -119,6 +134,7 @@ static int contains_mirror(const char *path)
 
 	if (pid == 0) {
 		// Child process
+		shutdown_detach_child();
 
 		// Redirect stdout to /dev/null
 		const int devnull = open("/dev/null", O_WRONLY);
@@ -139,15 +155,15 @@ static int contains_mirror(const char *path)
 				"config", "--get",     "remote.origin.mirror",
 				NULL,
 		};
-		execvp("git", args);
-		perror("execvp");
-		_exit(127); // execvp only returns on error
+		profile_exec(args);
 	}
 
+	shutdown_child_started(pid);
 	int status;
 	pid_t result;
 	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
 	}
+	shutdown_child_exited(pid);
 	if (result == -1) {
 		perror("waitpid");
 		return 0;
@@ -165,16 +181,342 @@ static int contains_mirror(const char *path)
 }
 
 /**
- * Creates a mirror of the git repository at the specified path.
+ * Runs git with the given arguments and waits for it to exit.
+ * @param args NULL-terminated git arguments
+ * @param in File descriptor to read standard input from, or -1 to inherit it
+ * @return 0 on success, -1 on error
+ */
+static int run_git_input(char *const args[], int in)
+{
+	const pid_t pid = spawn_fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		// Child process
+		shutdown_detach_child();
+		if (in != -1 && dup2(in, STDIN_FILENO) == -1) {
+			perror("dup2");
+			_exit(127);
+		}
+		profile_exec(args);
+	}
+
+	shutdown_child_started(pid);
+	int status;
+	pid_t result;
+	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
+	}
+	shutdown_child_exited(pid);
+	if (result == -1) {
+		perror("waitpid");
+		return -1;
+	}
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return 0; // Success
+	fprintf(stderr, "Error: git %s failed with status %d\n", args[3],
+		WEXITSTATUS(status));
+	return -1; // Error occurred
+}
+
+/**
+ * Runs git with the given arguments and waits for it to exit.
+ * @param args NULL-terminated git arguments
+ * @return 0 on success, -1 on error
+ */
+static int run_git(char *const args[])
+{
+	return run_git_input(args, -1);
+}
+
+/// Bytes at the end of git's standard error kept to classify a failure
+#define ERR_TAIL 4096
+
+/**
+ * Appends output of git to the end of its standard error that is kept,
+ * dropping the oldest bytes once it is full.
+ */
+static void keep_tail(char tail[ERR_TAIL + 1], size_t *len, const char *data,
+		      size_t n)
+{
+	if (n >= ERR_TAIL) {
+		data += n - ERR_TAIL;
+		n = ERR_TAIL;
+	}
+	if (*len + n > ERR_TAIL) {
+		const size_t drop = *len + n - ERR_TAIL;
+		memmove(tail, tail + drop, *len - drop);
+		*len -= drop;
+	}
+	memcpy(tail + *len, data, n);
+	*len += n;
+	tail[*len] = '\0';
+}
+
+/**
+ * Runs git with the given arguments, collecting its standard output. Its
+ * standard error is passed on, and its end is kept to tell failures that may
+ * go away, like network errors, from permanent ones.
+ * @param args NULL-terminated git arguments
+ * @param out Buffer to append the output to, or NULL to pass it on
+ * @return 0 on success, -2 if git failed in a way that may be transient, -1 on
+ * error
+ */
+static int run_git_output(char *const args[], buffer_t *out)
+{
+	int fds[2] = {-1, -1}, err_fds[2];
+	if ((out && spawn_pipe(fds) == -1) || spawn_pipe(err_fds) == -1) {
+		perror("pipe");
+		if (out) {
+			close(fds[0]);
+			close(fds[1]);
+		}
+		return -1;
+	}
+
+	const pid_t pid = spawn_fork();
+	if (pid < 0) {
+		perror("fork");
+		if (out) {
+			close(fds[0]);
+			close(fds[1]);
+		}
+		close(err_fds[0]);
+		close(err_fds[1]);
+		return -1;
+	}
+
+	if (pid == 0) {
+		// Child process
+		shutdown_detach_child();
+		if ((out && dup2(fds[1], STDOUT_FILENO) == -1) ||
+		    dup2(err_fds[1], STDERR_FILENO) == -1) {
+			perror("dup2");
+			_exit(127);
+		}
+		profile_exec(args);
+	}
+
+	shutdown_child_started(pid);
+	if (out)
+		close(fds[1]);
+	close(err_fds[1]);
+
+	char chunk[4096], tail[ERR_TAIL + 1] = "";
+	size_t tail_len = 0;
+	struct pollfd pfds[2] = {{.fd = err_fds[0], .events = POLLIN},
+				 {.fd = out ? fds[0] : -1, .events = POLLIN}};
+	while (pfds[0].fd >= 0 || pfds[1].fd >= 0) {
+		if (poll(pfds, 2, -1) == -1) {
+			if (errno == EINTR)
+				continue;
+			perror("poll");
+			break;
+		}
+		for (int i = 0; i < 2; i++) {
+			if (pfds[i].fd < 0 || !pfds[i].revents)
+				continue;
+			const ssize_t n = read(pfds[i].fd, chunk, sizeof(chunk));
+			if (n == -1 && errno == EINTR)
+				continue;
+			if (n <= 0) {
+				close(pfds[i].fd);
+				pfds[i].fd = -1;
+				continue;
+			}
+			if (i == 1) {
+				buffer_append(out, chunk, n);
+				continue;
+			}
+			fwrite(chunk, 1, (size_t) n, stderr);
+			keep_tail(tail, &tail_len, chunk, (size_t) n);
+		}
+	}
+	for (int i = 0; i < 2; i++) {
+		if (pfds[i].fd >= 0)
+			close(pfds[i].fd);
+	}
+
+	int status;
+	pid_t result;
+	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
+	}
+	shutdown_child_exited(pid);
+	if (result == -1) {
+		perror("waitpid");
+		return -1;
+	}
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return 0; // Success
+	const char *cmd = strcmp(args[1], "--git-dir") == 0 ? args[3] : args[1];
+	fprintf(stderr, "Error: git %s failed with status %d\n", cmd,
+		WEXITSTATUS(status));
+	// Only a shutdown kills git
+	if (!WIFEXITED(status))
+		return -1;
+	return retry_git_transient(tail) ? -2 : -1;
+}
+
+/**
+ * Lists the refs of a mirror as "<oid> <ref>" lines sorted by ref.
  * @param path Full path to the git repository
- * @param ctx Context containing the repository information
+ * @param out Buffer to append the refs to
+ * @return 0 on success, -1 on error
+ */
+static int snapshot_refs(const char *path, buffer_t *out)
+{
+	char *args[] = {
+			"git",
+			"--git-dir",
+			(char *) path,
+			"for-each-ref",
+			"--format=%(objectname) %(refname)",
+			NULL,
+	};
+	return run_git_output(args, out) == 0 ? 0 : -1;
+}
+
+/**
+ * Finds the mirror of the repository's parent, if it has one.
+ * @param ctx Repository context
+ * @return Full path to the parent's mirror, or NULL if the repository has no
+ * parent or the parent is not mirrored
+ */
+static char *get_parent_path(const struct repo_ctx *ctx)
+{
+	if (!ctx->parent)
+		return NULL;
+
+	// Split "owner/name"
+	const char *slash = strchr(ctx->parent, '/');
+	if (!slash || slash == ctx->parent || !slash[1])
+		return NULL;
+	char *owner = gstrndup(ctx->parent, slash - ctx->parent);
+	if (!owner)
+		return NULL;
+
+	char *path = get_git_path(ctx->git_base, owner, slash + 1);
+	gfree(owner);
+	if (path && !contains_mirror(path)) {
+		gfree(path);
+		return NULL;
+	}
+	return path;
+}
+
+/**
+ * Keeps git from pruning the objects of a mirror that a fork borrows through
+ * alternates. Fetches run gc --auto, which could prune objects that only the
+ * fork still reaches once a ref of the parent was deleted. Maintenance only
+ * rolls packs up without pruning, so it still runs on the parent;
+ * extensions.preciousObjects would stop that too.
+ * @param path Full path to the parent's mirror
+ * @return 0 on success, -1 on error
+ */
+static int protect_parent(const char *path)
+{
+	const char *config[][2] = {
+			{"gc.auto", "0"},
+			{"maintenance.auto", "false"},
+			{"gc.pruneExpire", "never"},
+	};
+	for (size_t i = 0; i < sizeof(config) / sizeof(*config); i++) {
+		char *args[] = {
+				"git",	  "--git-dir",		(char *) path,
+				"config", (char *) config[i][0],
+				(char *) config[i][1], NULL,
+		};
+		if (run_git(args) == -1)
+			return -1;
+	}
+	return 0;
+}
+
+/**
+ * Finds a local bundle to seed the repository's mirror from.
+ * Bundles are looked up as <bundle-dir>/<owner>/<name>.bundle.
+ * @param ctx Repository context
+ * @return Full path to the bundle, or NULL if there is none
+ */
+static char *get_bundle_path(const struct repo_ctx *ctx)
+{
+	if (!ctx->bundle || !ctx->bundle->dir)
+		return NULL;
+
+	const char *format = "%s/%s/%s.bundle";
+	const int len = snprintf(NULL, 0, format, ctx->bundle->dir, ctx->owner,
+				 ctx->name);
+	if (len < 0)
+		return NULL;
+	char *path = gmalloc(len + 1);
+	if (!path)
+		return NULL;
+	snprintf(path, len + 1, format, ctx->bundle->dir, ctx->owner,
+		 ctx->name);
+
+	if (access(path, R_OK) == -1) {
+		gfree(path);
+		return NULL;
+	}
+	return path;
+}
+
+/**
+ * Expands the {owner} and {repo} placeholders of the bundle URI template.
+ * @param ctx Repository context
+ * @return The bundle URI for the repository, or NULL if none is configured
+ */
+static char *get_bundle_uri(const struct repo_ctx *ctx)
+{
+	if (!ctx->bundle || !ctx->bundle->uri)
+		return NULL;
+
+	const char *tmpl = ctx->bundle->uri;
+	const size_t owner_len = strlen(ctx->owner);
+	const size_t name_len = strlen(ctx->name);
+
+	// Every placeholder is at least 6 characters long, so this is enough
+	// for any number of substitutions
+	const size_t tmpl_len = strlen(tmpl);
+	const size_t cap = tmpl_len + tmpl_len / 6 * (owner_len + name_len) + 1;
+	char *uri = gmalloc(cap);
+	if (!uri)
+		return NULL;
+
+	char *out = uri;
+	while (*tmpl) {
+		if (!strncmp(tmpl, "{owner}", 7)) {
+			memcpy(out, ctx->owner, owner_len);
+			out += owner_len;
+			tmpl += 7;
+		} else if (!strncmp(tmpl, "{repo}", 6)) {
+			memcpy(out, ctx->name, name_len);
+			out += name_len;
+			tmpl += 6;
+		} else {
+			*out++ = *tmpl++;
+		}
+	}
+	*out = '\0';
+	return uri;
+}
+
+/**
+ * Seeds a new mirror at the specified path from a local git bundle.
+ * The mirror still points at the bundle afterward, so its URL must be updated
+ * before fetching.
+ * @param path Full path to the git repository
+ * @param bundle Path to the bundle
  * @param quiet Suppress output if non-zero
  * @return 0 on success, -1 on error
  */
-static int create_mirror(const char *path, const struct repo_ctx *ctx,
-			 const int quiet)
+static int seed_mirror(const char *path, const char *bundle, const int quiet)
 {
-	const pid_t pid = fork();
+	const pid_t pid = spawn_fork();
 	if (pid < 0) {
 		perror("fork");
 		return -1;
@@ -182,11 +524,7 @@ static int create_mirror(const char *path, const struct repo_ctx *ctx,
 
 	if (pid == 0) {
 		// Child process
-		// Convert the URL to a format that git can use
-		char *url = prepare_git_url(ctx->url, ctx->username,
-					    ctx->token);
-
-		// Run git
+		shutdown_detach_child();
 		char *args[7];
 		int i = 0;
 		args[i++] = "git";
@@ -194,19 +532,19 @@ static int create_mirror(const char *path, const struct repo_ctx *ctx,
 		args[i++] = "--mirror";
 		if (quiet)
 			args[i++] = "--quiet";
-		args[i++] = url;
+		args[i++] = (char *) bundle;
 		args[i++] = (char *) path;
 		args[i] = NULL;
 
-		execvp("git", args);
-		perror("execvp");
-		_exit(127); // execvp only returns on error
+		profile_exec(args);
 	}
 
+	shutdown_child_started(pid);
 	int status;
 	pid_t result;
 	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
 	}
+	shutdown_child_exited(pid);
 	if (result == -1) {
 		perror("waitpid");
 		return -1;
@@ -214,28 +552,109 @@ static int create_mirror(const char *path, const struct repo_ctx *ctx,
 
 	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
 		return 0; // Success
-	fprintf(stderr, "Error: git clone failed with status %d\n",
+	fprintf(stderr, "Error: git clone from bundle failed with status %d\n",
 		WEXITSTATUS(status));
 	return -1; // Error occurred
 }
 
 /**
- * Creates the directory structure for the git repository.
- * @param ctx Repository context
+ * Creates a mirror of the git repository at the specified path.
+ * @param path Full path to the git repository
+ * @param ctx Context containing the repository information
+ * @param reference Path to a mirror to borrow objects from, or NULL
+ * @param bundle_uri Bundle URI to download before fetching, or NULL
+ * @param quiet Suppress output if non-zero
+ * @return 0 on success, -2 on a failure that may be transient, -1 on error
+ */
+static int create_mirror(const char *path, const struct repo_ctx *ctx,
+			 const char *reference, const char *bundle_uri,
+			 const int quiet)
+{
+	// Everything is prepared before forking, as the child must not
+	// allocate while other threads may hold the allocator's locks
+	char *url = prepare_git_url(ctx->url, ctx->username, ctx->token);
+	if (!url)
+		return -1;
+	char *filter_arg = NULL;
+	if (ctx->filter) {
+		// Fetches inherit the filter from the mirror's config
+		const size_t len = strlen(ctx->filter) + 10;
+		filter_arg = gmalloc(len);
+		if (filter_arg)
+			snprintf(filter_arg, len, "--filter=%s", ctx->filter);
+	}
+	char *bundle_arg = NULL;
+	if (bundle_uri) {
+		// Download the bundle first, then fetch the rest
+		const size_t len = strlen(bundle_uri) + 14;
+		bundle_arg = gmalloc(len);
+		if (bundle_arg)
+			snprintf(bundle_arg, len, "--bundle-uri=%s", bundle_uri);
+	}
+
+	char *args[11];
+	int i = 0;
+	args[i++] = "git";
+	args[i++] = "clone";
+	args[i++] = "--mirror";
+	// git only shows progress on a terminal, and its standard error is a
+	// pipe, see run_git_output()
+	if (quiet)
+		args[i++] = "--quiet";
+	else if (isatty(STDERR_FILENO))
+		args[i++] = "--progress";
+	if (reference) {
+		// Only fetch objects the referenced mirror lacks
+		args[i++] = "--reference";
+		args[i++] = (char *) reference;
+	}
+	if (filter_arg)
+		args[i++] = filter_arg;
+	if (bundle_arg)
+		args[i++] = bundle_arg;
+	args[i++] = url;
+	args[i++] = (char *) path;
+	args[i] = NULL;
+
+	const int ret = run_git_output(args, NULL);
+	gfree(url);
+	gfree(filter_arg);
+	gfree(bundle_arg);
+	return ret;
+}
+
+/**
+ * Creates the owner directory of the repository if it doesn't exist.
+ * @param ctx Context containing the repository information
  * @return 0 on success, -1 on error
  */
-static int create_git_path(const struct repo_ctx *ctx)
+static int create_owner_path(const struct repo_ctx *ctx)
 {
-	// Create owner directory if it doesn't exist
 	char *owner_path = get_git_path(ctx->git_base, ctx->owner, NULL);
 	if (!owner_path)
 		return -1;
-	if (mkdir(owner_path, 0755) == -1 && errno != EEXIST) {
-		perror("mkdir");
-		free(owner_path);
-		return -1;
+	// Only the first mirror of an owner creates its directory
+	if (scan_lookup(owner_path) != scan_dir) {
+		if (mkdir(owner_path, 0755) == -1 && errno != EEXIST) {
+			perror("mkdir");
+			gfree(owner_path);
+			return -1;
+		}
+		scan_set(owner_path, scan_dir);
 	}
-	free(owner_path);
+	gfree(owner_path);
+	return 0;
+}
+
+/**
+ * Creates the directory structure for the git repository.
+ * @param ctx Repository context
+ * @return 0 on success, -1 on error
+ */
+static int create_git_path(const struct repo_ctx *ctx)
+{
+	if (create_owner_path(ctx) == -1)
+		return -1;
 
 	// Create repo directory if it doesn't exist
 	char *repo_path = get_git_path(ctx->git_base, ctx->owner, ctx->name);
@@ -243,10 +662,10 @@ static int create_git_path(const struct repo_ctx *ctx)
 		return -1;
 	if (mkdir(repo_path, 0755) == -1 && errno != EEXIST) {
 		perror("mkdir");
-		free(repo_path);
+		gfree(repo_path);
 		return -1;
 	}
-	free(repo_path);
+	gfree(repo_path);
 	return 0;
 }
 
@@ -265,7 +684,7 @@ static int update_mirror_url(const char *path, const struct repo_ctx *ctx)
 		return -1;
 	}
 
-	const pid_t pid = fork();
+	const pid_t pid = spawn_fork();
 	if (pid < 0) {
 		perror("fork");
 		return -1;
@@ -273,6 +692,7 @@ static int update_mirror_url(const char *path, const struct repo_ctx *ctx)
 
 	if (pid == 0) {
 		// Child process
+		shutdown_detach_child();
 		char *args[8];
 		int i = 0;
 		args[i++] = "git";
@@ -284,16 +704,16 @@ static int update_mirror_url(const char *path, const struct repo_ctx *ctx)
 		args[i++] = url;
 		args[i] = NULL;
 
-		execvp("git", args);
-		perror("execvp");
-		_exit(127); // execvp only returns on error
+		profile_exec(args);
 	}
-	free(url);
+	gfree(url);
 
+	shutdown_child_started(pid);
 	int status;
 	pid_t result;
 	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
 	}
+	shutdown_child_exited(pid);
 	if (result == -1) {
 		perror("waitpid");
 		return -1;
@@ -310,76 +730,357 @@ static int update_mirror_url(const char *path, const struct repo_ctx *ctx)
  * Updates the git repository at the specified path from the remote.
  * @param path Full path to the git repository
  * @param quiet Suppress output if non-zero
- * @return 0 on success, -1 on error
+ * @param changes Buffer to append the changed refs to, as change lines, or
+ * NULL
+ * @return 0 on success, -2 on a failure that may be transient, -1 on error
  */
-static int update_mirror(const char *path, int quiet)
+static int update_mirror(const char *path, int quiet, buffer_t *changes)
 {
-	const pid_t pid = fork();
-	if (pid < 0) {
-		perror("fork");
-		return -1;
-	}
+	// Without fetch --porcelain, compare the refs before and after
+	const int porcelain = changes && changes_porcelain();
+	buffer_t before = buffer_new(4096);
+	buffer_t out = buffer_new(4096);
+	int ret = -1;
+	if (changes && !porcelain && snapshot_refs(path, &before) == -1)
+		goto end;
 
-	if (pid == 0) {
-		// Child process
-		char *args[9];
-		int i = 0;
-		args[i++] = "git";
-		args[i++] = "--git-dir";
-		args[i++] = (char *) path;
-		args[i++] = "fetch";
-		args[i++] = "--prune";
+	char *args[10];
+	int i = 0;
+	args[i++] = "git";
+	args[i++] = "--git-dir";
+	args[i++] = (char *) path;
+	args[i++] = "fetch";
+	args[i++] = "--prune";
+	// git only shows progress on a terminal, and its standard error is a
+	// pipe, see run_git_output()
+	if (!quiet && isatty(STDERR_FILENO))
+		args[i++] = "--progress";
+	if (porcelain) {
+		// Mirrors only have origin, and --all runs a fetch per remote
+		// whose porcelain output isn't passed through. The porcelain
+		// output replaces the ref summary, so --quiet isn't needed.
+		args[i++] = "--porcelain";
+		args[i++] = "--tags";
+		args[i++] = "origin";
+	} else {
 		if (quiet)
 			args[i++] = "--quiet";
 		args[i++] = "--all";
 		args[i++] = "--tags";
-		args[i] = NULL;
+	}
+	args[i] = NULL;
+
+	ret = run_git_output(args, &out);
+	if (ret != 0 || !changes)
+		goto end;
 
-		execvp("git", args);
-		perror("execvp");
-		_exit(127); // execvp only returns on error
+	if (porcelain) {
+		changes_parse_porcelain((const char *) out.data, out.len,
+					changes);
+	} else {
+		out.len = 0;
+		if (snapshot_refs(path, &out) == 0)
+			changes_diff(&before, &out, changes);
 	}
 
-	int status;
-	pid_t result;
-	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
+end:
+	buffer_free(before);
+	buffer_free(out);
+	return ret;
+}
+
+/**
+ * Replaces the fetch refspecs of a mirror's origin remote.
+ * @param path Full path to the git repository
+ * @param refspecs NULL-terminated refspecs
+ * @return 0 on success, -1 on error
+ */
+static int set_refspecs(const char *path, const char *const *refspecs)
+{
+	for (size_t i = 0; refspecs[i]; i++) {
+		char *config[] = {
+				"git",
+				"--git-dir",
+				(char *) path,
+				"config",
+				i == 0 ? "--replace-all" : "--add",
+				"remote.origin.fetch",
+				(char *) refspecs[i],
+				NULL,
+		};
+		if (run_git(config) == -1)
+			return -1;
 	}
-	if (result == -1) {
-		perror("waitpid");
+	return 0;
+}
+
+/**
+ * Switches an existing mirror to the given refspecs and deletes the refs they
+ * don't fetch, which fetch --prune leaves alone. Their objects stay until the
+ * next garbage collection.
+ * @param path Full path to the git repository
+ * @param refspecs NULL-terminated refspecs
+ * @param quiet Suppress output if non-zero
+ * @param changes Buffer to append the deleted refs to, as change lines, or
+ * NULL
+ * @return 0 on success, -1 on error
+ */
+static int migrate_refspecs(const char *path, const char *const *refspecs,
+			    int quiet, buffer_t *changes)
+{
+	if (!quiet)
+		printf("Switching mirror to new refspecs\n");
+	if (set_refspecs(path, refspecs) == -1)
 		return -1;
+
+	buffer_t refs = buffer_new(4096);
+	buffer_t kept = buffer_new(4096);
+	FILE *in = spawn_tmpfile();
+	int ret = -1;
+	if (!in) {
+		perror("tmpfile");
+		goto end;
 	}
+	if (snapshot_refs(path, &refs) == -1)
+		goto end;
 
-	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
-		return 0; // Success
-	fprintf(stderr, "Error: git remote update failed with status %d\n",
-		WEXITSTATUS(status));
-	return -1; // Error occurred
+	// Deleted in one transaction by update-ref --stdin
+	size_t pruned = 0;
+	const char *p = (const char *) refs.data;
+	const char *const refs_end = p + refs.len;
+	while (p < refs_end) {
+		const char *eol = memchr(p, '\n', refs_end - p);
+		const size_t len = (eol ? eol : refs_end) - p;
+		const char *sp = memchr(p, ' ', len);
+		char ref[4096];
+		const size_t ref_len = sp ? len - (sp + 1 - p) : sizeof(ref);
+		if (ref_len < sizeof(ref)) {
+			memcpy(ref, sp + 1, ref_len);
+			ref[ref_len] = '\0';
+		}
+		if (ref_len >= sizeof(ref) || refspec_wants(refspecs, ref)) {
+			buffer_append(&kept, p, len);
+			buffer_append(&kept, "\n", 1);
+		} else {
+			fprintf(in, "delete %s\n", ref);
+			pruned++;
+		}
+		p += len + 1;
+	}
+	if (pruned == 0) {
+		ret = 0;
+		goto end;
+	}
+	if (fflush(in) != 0 || fseek(in, 0, SEEK_SET) != 0) {
+		perror("Error writing refs to delete");
+		goto end;
+	}
+
+	char *args[] = {
+			"git",	      "--git-dir", (char *) path,
+			"update-ref", "--stdin",   NULL,
+	};
+	if (run_git_input(args, fileno(in)) == -1)
+		goto end;
+	if (!quiet)
+		printf("Pruned %zu refs\n", pruned);
+	if (changes)
+		changes_diff(&refs, &kept, changes);
+	ret = 0;
+
+end:
+	if (in)
+		fclose(in);
+	buffer_free(refs);
+	buffer_free(kept);
+	return ret;
 }
 
-int git_mirror_repo(const struct repo_ctx *ctx, int quiet)
+/**
+ * Removes the contents of a directory, as git clone does when it fails.
+ * @param path Path to the directory
+ * @return 0 on success, -1 on error
+ */
+static int remove_contents(const char *path)
 {
+	DIR *dir = opendir(path);
+	if (!dir)
+		return -1;
 	int ret = 0;
-	char *path = get_git_path(ctx->git_base, ctx->owner, ctx->name);
-	if (!path) {
-		perror("get_git_path");
+	const struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		if (!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, ".."))
+			continue;
+		char child[4096];
+		snprintf(child, sizeof(child), "%s/%s", path, ent->d_name);
+		struct stat st;
+		if (lstat(child, &st) == -1 ||
+		    (S_ISDIR(st.st_mode) && remove_contents(child) == -1) ||
+		    remove(child) == -1)
+			ret = -1;
+	}
+	closedir(dir);
+	return ret;
+}
+
+/**
+ * Sets up a mirror at the specified path that only tracks the refs matching
+ * the context's refspecs, without fetching anything.
+ * @param path Full path to the git repository
+ * @param ctx Context containing the repository information
+ * @param reference Path to a mirror to borrow objects from, or NULL
+ * @return 0 on success, -1 on error
+ */
+static int init_refs_mirror(const char *path, const struct repo_ctx *ctx,
+			    const char *reference)
+{
+	char *init[] = {"git", "init", "--bare", "--quiet", (char *) path, NULL};
+	if (run_git(init) == -1)
+		return -1;
+
+	if (reference) {
+		// What clone --reference does
+		char file[4096];
+		snprintf(file, sizeof(file), "%s/objects/info/alternates",
+			 path);
+		FILE *f = spawn_fopen(file, "w");
+		if (!f || fprintf(f, "%s/objects\n", reference) < 0 ||
+		    fclose(f) != 0) {
+			perror("Error writing alternates");
+			return -1;
+		}
+	}
+
+	char *url = prepare_git_url(ctx->url, ctx->username, ctx->token);
+	if (!url)
+		return -1;
+	char *remote[] = {
+			"git",	   "--git-dir", (char *) path, "remote", "add",
+			"--mirror=fetch", "origin",	url,	      NULL,
+	};
+	const int ret = run_git(remote);
+	gfree(url);
+	if (ret == -1)
+		return -1;
+
+	// Mark the repository as a mirror, which --mirror=fetch doesn't do,
+	// and as a partial clone, which clone --filter would do
+	const char *config[][2] = {
+			{"remote.origin.mirror", "true"},
+			{"core.repositoryformatversion", "1"},
+			{"extensions.partialClone", "origin"},
+			{"remote.origin.promisor", "true"},
+			{"remote.origin.partialclonefilter", ctx->filter},
+	};
+	const size_t config_len = ctx->filter ? 5 : 1;
+	for (size_t i = 0; i < config_len; i++) {
+		char *args[] = {
+				"git",	  "--git-dir",		(char *) path,
+				"config", (char *) config[i][0],
+				(char *) config[i][1], NULL,
+		};
+		if (run_git(args) == -1)
+			return -1;
+	}
+
+	// Replace the mirror's catch-all refspec
+	return set_refspecs(path, ctx->refspecs);
+}
+
+/**
+ * Creates a mirror at the specified path that only tracks the refs matching
+ * the context's refspecs. Bundle URIs are not used: git fetch would unbundle
+ * every ref of the bundle, not only those the mirror tracks.
+ * @param path Full path to the git repository
+ * @param ctx Context containing the repository information
+ * @param reference Path to a mirror to borrow objects from, or NULL
+ * @param quiet Suppress output if non-zero
+ * @return 0 on success, -2 on a failure that may be transient, -1 on error
+ */
+static int create_refs_mirror(const char *path, const struct repo_ctx *ctx,
+			      const char *reference, const int quiet)
+{
+	// A mirror left half set up would fail to be set up again, or be
+	// taken for a complete one with the wrong refspecs
+	if (init_refs_mirror(path, ctx, reference) == -1) {
+		if (remove_contents(path) == -1)
+			perror("Error removing incomplete mirror");
+		return -1;
+	}
+	// Once set up, a failed fetch is resumed by the next run's
+	return update_mirror(path, quiet, NULL);
+}
+
+int git_lock_mirror(const struct repo_ctx *ctx, const char *path)
+{
+	if (create_owner_path(ctx) == -1)
 		return -1;
+
+	const size_t len = strlen(path) + sizeof(".lock");
+	char *lock_path = gmalloc(len);
+	if (!lock_path)
+		return -1;
+	snprintf(lock_path, len, "%s.lock", path);
+
+	const int fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	gfree(lock_path);
+	if (fd == -1)
+		return -1;
+	if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+		const int err = errno;
+		close(fd);
+		errno = err;
+		return err == EWOULDBLOCK ? -2 : -1;
 	}
+	return fd;
+}
+
+/**
+ * Mirrors the repository while holding its lock.
+ * @param ctx Context containing the repository information
+ * @param path Full path to the git repository
+ * @param quiet Suppress output if non-zero
+ * @param changes Buffer to append the changed refs to, as change lines
+ * @return 0 on success, -2 on a failure that may be transient, -1 on error
+ */
+static int mirror_locked(const struct repo_ctx *ctx, const char *path,
+			 int quiet, buffer_t *changes)
+{
+	int ret = 0;
 
 	// Check whether repo exists
-	if (contains_mirror(path)) {
+	long long start = timing_now();
+	const int exists = contains_mirror(path);
+	timing_since(phase_exists, start);
+	if (exists) {
 		// Repo exists, so we can just update it
 		if (!quiet)
 			printf("Repo already exists, updating...\n");
+		start = timing_now();
 		if (update_mirror_url(path, ctx) == -1) {
 			perror("update_mirror_url");
 			ret = -1;
 			goto end;
 		}
-		if (update_mirror(path, quiet) == -1) {
-			perror("update_mirror");
+		timing_since(phase_url, start);
+		// Mirrors follow changes of the ref policy
+		if (ctx->migrate_refspecs &&
+		    !scan_has_refspecs(path, ctx->migrate_refspecs) &&
+		    migrate_refspecs(path, ctx->migrate_refspecs, quiet,
+				     changes) == -1) {
 			ret = -1;
 			goto end;
 		}
+		start = timing_now();
+		ret = update_mirror(path, quiet, changes);
+		timing_since(phase_fetch, start);
+		if (ret < 0)
+			goto end;
+		// A failed maintenance run leaves the mirror usable, so it
+		// doesn't fail the repo. It is not started during shutdown.
+		if (!shutdown_requested() &&
+		    maintenance_run(path, ctx->maint, quiet) == -1)
+			fprintf(stderr, "Error: maintenance failed\n");
 		goto end;
 	}
 
@@ -391,12 +1092,106 @@ int git_mirror_repo(const struct repo_ctx *ctx, int quiet)
 		ret = -1;
 		goto end;
 	}
-	if (create_mirror(path, ctx, quiet) == -1) {
-		perror("create_mirror");
-		ret = -1;
+
+	// Seed the mirror from a local bundle and top it up with a fetch
+	start = timing_now();
+	char *bundle = get_bundle_path(ctx);
+	if (bundle) {
+		if (!quiet)
+			printf("Seeding mirror from bundle: %s\n", bundle);
+		const int seeded = seed_mirror(path, bundle, quiet) == 0;
+		gfree(bundle);
+		if (seeded) {
+			if (update_mirror_url(path, ctx) == -1) {
+				perror("update_mirror_url");
+				ret = -1;
+				goto end;
+			}
+			// Bundles carry all of their refs
+			if (ctx->refspecs &&
+			    migrate_refspecs(path, ctx->refspecs, quiet,
+					     NULL) == -1) {
+				ret = -1;
+				goto end;
+			}
+			ret = update_mirror(path, quiet, NULL);
+			goto created;
+		}
+		// git only removes the contents of the directory on failure
+		fprintf(stderr, "Error: seeding from bundle failed, cloning "
+				"from upstream instead\n");
+	}
+
+	char *reference = get_parent_path(ctx);
+	if (reference && protect_parent(reference) == -1) {
+		fprintf(stderr, "Error: failed to disable gc in parent mirror, "
+				"not sharing its objects\n");
+		gfree(reference);
+		reference = NULL;
+	}
+	if (reference && !quiet)
+		printf("Sharing objects with parent mirror: %s\n", reference);
+	char *bundle_uri = get_bundle_uri(ctx);
+	if (ctx->refspecs)
+		ret = create_refs_mirror(path, ctx, reference, quiet);
+	else
+		ret = create_mirror(path, ctx, reference, bundle_uri, quiet);
+	gfree(bundle_uri);
+	gfree(reference);
+
+created:
+	timing_since(phase_clone, start);
+	// Every ref of a new mirror is new
+	if (ret == 0) {
+		scan_set(path, scan_mirror);
+		const buffer_t none = buffer_new(0);
+		buffer_t refs = buffer_new(4096);
+		if (snapshot_refs(path, &refs) == 0)
+			changes_diff(&none, &refs, changes);
+		buffer_free(refs);
 	}
 
 end:
-	free(path);
+	return ret;
+}
+
+int git_mirror_repo(const struct repo_ctx *ctx, int quiet)
+{
+#ifdef HAVE_LIBGIT2
+	if (ctx->backend == git_backend_libgit2)
+		return libgit2_mirror_repo(ctx, quiet);
+#endif
+
+	char *path = get_git_path(ctx->git_base, ctx->owner, ctx->name);
+	if (!path) {
+		perror("get_git_path");
+		return -1;
+	}
+
+	const int lock = git_lock_mirror(ctx, path);
+	if (lock == -2) {
+		fprintf(stderr, "Mirror is locked by another run, skipping: %s\n",
+			path);
+		gfree(path);
+		return 1;
+	}
+	if (lock == -1) {
+		perror("git_lock_mirror");
+		gfree(path);
+		return -1;
+	}
+
+	buffer_t changes = buffer_new(256);
+	int ret = mirror_locked(ctx, path, quiet, &changes);
+	if (ret == 0 &&
+	    changes_record(ctx->owner, ctx->name, path, &changes) == -1)
+		ret = -1;
+	// Missing LFS objects leave the mirror usable, the next run retries
+	if (ret == 0 && lfs_fetch(path, ctx, changes.len > 0, quiet) == -1)
+		fprintf(stderr, "Error: LFS fetch failed\n");
+	buffer_free(changes);
+
+	close(lock);
+	gfree(path);
 	return ret;
 }
@@ -5,6 +5,8 @@
 #ifndef GIT_H
 #define GIT_H
 
+#include <time.h>
+
 #include "config.h"
 
 struct repo_ctx {
@@ -18,8 +20,63 @@ struct repo_ctx {
 	const char *url;
 	/// GitHub username for authentication
 	const char *username;
+	/// Time of the upstream's last push, 0 if unknown
+	time_t pushed_at;
+	/// Owner and name ("owner/name") of the parent repository whose mirror
+	/// new clones should borrow objects from, or NULL
+	const char *parent;
+
+	/// Partial clone filter for new mirrors, or NULL to mirror all objects
+	const char *filter;
+	/// NULL-terminated refspecs of new mirrors, or NULL to mirror all refs
+	const char *const *refspecs;
+	/// NULL-terminated refspecs existing mirrors are switched to, or NULL
+	/// to leave them as they are
+	const char *const *migrate_refspecs;
+
+	/// Maintenance settings, or NULL to skip maintenance
+	const struct maintenance_cfg *maint;
+	/// LFS settings, or NULL to skip LFS objects
+	const struct lfs_cfg *lfs;
+	/// Bundles to bootstrap new mirrors from, or NULL
+	const struct bundle_cfg *bundle;
+	/// How the mirror is cloned and fetched
+	enum git_backend backend;
 };
 
+/**
+ * Constructs the full path to the git repository based on the base path, owner,
+ * and name. If the name is NULL, it constructs the path to the owner's
+ * directory.
+ * @param base Base path for the git repository
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @return A string containing the full path to the git repository or owner's
+ * directory.
+ */
+char *get_git_path(const char *base, const char *owner, const char *name);
+
+/**
+ * Takes an exclusive advisory lock on the mirror at the given path, so that
+ * overlapping runs and nodes never work on the same mirror at once. The lock
+ * file sits next to the mirror and is left in place afterwards.
+ * @param ctx Context containing the repository information
+ * @param path Full path to the git repository
+ * @return File descriptor holding the lock, -2 if another process holds it,
+ * -1 on error
+ */
+int git_lock_mirror(const struct repo_ctx *ctx, const char *path);
+
+/**
+ * Creates or updates the mirror of a repository. The mirror is locked for the
+ * duration, and skipped if another process already holds its lock.
+ * @param ctx Context containing the repository information
+ * @param quiet Suppress output if non-zero
+ * @return 0 on success, 1 if the mirror was skipped because it is locked,
+ * -2 if the transfer failed for a reason that may go away, like a network
+ * error, -1 on other errors, including missing repositories and rejected
+ * credentials
+ */
 int git_mirror_repo(const struct repo_ctx *ctx, int quiet);
 
 
@@ -2,17 +2,23 @@
 // Created by Anshul Gupta on 4/4/25.
 //
 
+#define ALLOC_SUBSYSTEM alloc_client
+
 #include "client.h"
 
 #include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
-#include <cjson/cJSON.h>
 #include <curl/curl.h>
 
 #include "queries/github/gh_identity.h"
 #include "queries/github/gh_list_repos.h"
 
+#include "../alloc.h"
 #include "../buffer.h"
+#include "../page_cache.h"
+#include "../timing.h"
 #include "types.h"
 
 char *github_identity(const gql_client *client)
@@ -20,31 +26,21 @@ char *github_identity(const gql_client *client)
 	char *login = NULL;
 	buffer_t buf = buffer_new(4096);
 
-	const CURLcode ret = gql_client_send(client, gh_identity, NULL, &buf);
+	const CURLcode ret = gql_client_send(client, gh_identity, NULL, 0, &buf);
 	if (ret != CURLE_OK) {
 		fprintf(stderr, "Failed to send request: %s\n",
 			curl_easy_strerror(ret));
 		goto fail;
 	}
 
-	// Parse the response
-	cJSON *root = cJSON_Parse((const char *) buf.data);
-	if (!root) {
-		const char *err = cJSON_GetErrorPtr();
-		if (err)
-			fprintf(stderr, "Error parsing response: %s\n", err);
+	// Decode the response
+	struct gh_identity_data data;
+	if (gh_identity_decode((const char *) buf.data, buf.len, &data) < 0)
 		goto fail;
-	}
-
-	// Check for errors
-	if (gql_handle_error(root) < 0)
-		goto fail1;
 
-	// Get login from json
-	login = identity_from_json(root);
+	login = identity_from_data(&data);
+	gh_identity_data_free(&data);
 
-fail1:
-	cJSON_Delete(root);
 fail:
 	buffer_free(buf);
 	return login;
@@ -56,15 +52,15 @@ int github_list_user_repos(const gql_client *client, const char *username,
 	int status = 0;
 	buffer_t buf = buffer_new(4096);
 
-	cJSON *args = cJSON_CreateObject();
-	if (!args) {
-		status = -1;
-		goto end;
-	}
-	cJSON_AddItemToObject(args, "username", cJSON_CreateString(username));
-	cJSON_AddItemToObject(args, "after", cJSON_CreateString(after));
+	const struct gql_var vars[] = {
+			{"username", username},
+			{"after", after},
+	};
 
-	const CURLcode ret = gql_client_send(client, gh_list_repos, args, &buf);
+	long long start = timing_now();
+	const CURLcode ret = gql_client_send(client, gh_list_repos, vars,
+					     sizeof(vars) / sizeof(*vars), &buf);
+	timing_since(phase_page, start);
 	if (ret != CURLE_OK) {
 		fprintf(stderr, "Failed to send request: %s\n",
 			curl_easy_strerror(ret));
@@ -72,29 +68,182 @@ int github_list_user_repos(const gql_client *client, const char *username,
 		goto end;
 	}
 
-	// Parse the response
-	cJSON *root = cJSON_Parse((const char *) buf.data);
-	if (!root) {
-		const char *err = cJSON_GetErrorPtr();
-		if (err)
-			fprintf(stderr, "Error parsing response: %s\n", err);
-		status = -1;
-		goto end;
-	}
-
-	// Check for errors
-	if (gql_handle_error(root) < 0) {
+	// Decode the response
+	start = timing_now();
+	struct gh_list_repos_data data;
+	if (gh_list_repos_decode((const char *) buf.data, buf.len, &data) < 0) {
 		status = -1;
 		goto end;
 	}
 
-	// Convert json to struct
-	if (gh_list_repos_from_json(root, res) < 0) {
+	// Convert the response to the listing
+	if (gh_list_repos_from_data(&data, res) < 0) {
 		fprintf(stderr, "Failed to parse response\n");
 		status = -1;
 	}
+	timing_since(phase_decode, start);
 
 end:
 	buffer_free(buf);
 	return status;
 }
+
+/**
+ * Gets a REST resource, revalidating the cached copy if there is one.
+ * @param client Client of the REST API
+ * @param ctx Settings of the backend
+ * @param url URL of the resource
+ * @param body Set to the NUL-terminated body, must be freed
+ * @param next Set to the URL of the next page, empty if there is none, or
+ * NULL
+ * @param next_len Size of next
+ * @return 0 on success, -1 on error
+ */
+static int rest_get(const gql_client *client, const struct gh_rest_ctx *ctx,
+		    const char *url, buffer_t *body, char *next,
+		    size_t next_len)
+{
+	// Other tokens may see other repositories
+	char key[4096];
+	snprintf(key, sizeof(key), "%s %s", ctx->login ? ctx->login : "", url);
+
+	struct cached_page page = {.body = buffer_new(0)};
+	const int cached =
+			ctx->cache && page_cache_read(ctx->cache, key, &page);
+
+	struct rest_headers headers;
+	*body = buffer_new(4096);
+	const CURLcode ret = gql_client_get(client, url,
+					    cached ? page.etag : NULL, body,
+					    &headers);
+	if (ret != CURLE_OK) {
+		fprintf(stderr, "Failed to send request: %s\n",
+			curl_easy_strerror(ret));
+		buffer_free(*body);
+		buffer_free(page.body);
+		return -1;
+	}
+
+	if (headers.status == 304) {
+		// Not modified, and free of charge
+		buffer_free(*body);
+		*body = page.body;
+		if (next)
+			snprintf(next, next_len, "%s", page.next);
+		if (cached)
+			return 0;
+		fprintf(stderr, "Error: unexpected 304 for %s\n", url);
+		return -1;
+	}
+	buffer_free(page.body);
+	if (next)
+		snprintf(next, next_len, "%s", headers.next);
+	// A response that can't be cached is only fetched again in full
+	if (ctx->cache && headers.etag[0])
+		page_cache_write(ctx->cache, key, headers.etag, headers.next,
+				 body->data, body->len - 1);
+	return 0;
+}
+
+/**
+ * Builds the URL of the first page of an owner's repositories. Only the
+ * authenticated user's own private repositories are listed under /user, and
+ * organizations are listed apart from users.
+ * @return 0 on success, -1 on error
+ */
+static int first_page(const gql_client *client, const struct gh_rest_ctx *ctx,
+		      const char *owner, char *url, size_t len)
+{
+	if (ctx->login && !strcasecmp(ctx->login, owner)) {
+		snprintf(url, len,
+			 "%s/user/repos?affiliation=owner&per_page=100",
+			 ctx->endpoint);
+		return 0;
+	}
+
+	snprintf(url, len, "%s/users/%s", ctx->endpoint, owner);
+	buffer_t body;
+	if (rest_get(client, ctx, url, &body, NULL, 0) < 0)
+		return -1;
+	const int org = gh_rest_is_org_decode((const char *) body.data,
+					      body.len);
+	buffer_free(body);
+	if (org < 0) {
+		fprintf(stderr, "Failed to parse response\n");
+		return -1;
+	}
+
+	if (org)
+		snprintf(url, len, "%s/orgs/%s/repos?type=all&per_page=100",
+			 ctx->endpoint, owner);
+	else
+		snprintf(url, len, "%s/users/%s/repos?type=owner&per_page=100",
+			 ctx->endpoint, owner);
+	return 0;
+}
+
+/**
+ * Looks up the parent of a fork, which REST listings leave out.
+ * @return Owned owner and name of the parent, or NULL if not found
+ */
+static char *rest_parent(const gql_client *client,
+			 const struct gh_rest_ctx *ctx, const char *owner,
+			 const char *name)
+{
+	char url[2048];
+	snprintf(url, sizeof(url), "%s/repos/%s/%s", ctx->endpoint, owner,
+		 name);
+	buffer_t body;
+	if (rest_get(client, ctx, url, &body, NULL, 0) < 0)
+		return NULL;
+	char *parent = gh_rest_parent_decode((const char *) body.data,
+					     body.len);
+	buffer_free(body);
+	return parent;
+}
+
+int github_rest_list_repos(const gql_client *client,
+			   const struct gh_rest_ctx *ctx, const char *owner,
+			   const char *after, struct gh_list_repos_res *res)
+{
+	memset(res, 0, sizeof(*res));
+
+	// Cursors left by the GraphQL backend start over
+	char url[2048];
+	if (after && !strncmp(after, ctx->endpoint, strlen(ctx->endpoint)))
+		snprintf(url, sizeof(url), "%s", after);
+	else if (first_page(client, ctx, owner, url, sizeof(url)) < 0)
+		return -1;
+
+	buffer_t body;
+	char next[2048];
+	long long start = timing_now();
+	const int ret = rest_get(client, ctx, url, &body, next, sizeof(next));
+	timing_since(phase_page, start);
+	if (ret < 0)
+		return -1;
+
+	start = timing_now();
+	const int status = gh_rest_repos_decode((const char *) body.data,
+						body.len, res);
+	timing_since(phase_decode, start);
+	buffer_free(body);
+	if (status < 0)
+		return -1;
+
+	if (next[0]) {
+		res->has_next_page = 1;
+		res->end_cursor = gstrdup(next);
+		if (!res->end_cursor) {
+			gh_list_repos_res_free(*res);
+			return -1;
+		}
+	}
+
+	// A parent that can't be looked up only loses the shared objects
+	for (size_t i = 0; ctx->parents && i < res->repos_len; i++)
+		if (res->repos[i].is_fork)
+			res->repos[i].parent = rest_parent(
+					client, ctx, owner, res->repos[i].name);
+	return 0;
+}
@@ -9,9 +9,39 @@
 
 #include "types.h"
 
+/// Looks up the login of the token's user, to be freed with gfree()
 char *github_identity(const gql_client *client);
 
 int github_list_user_repos(const gql_client *client, const char *username,
 			   const char *after, struct gh_list_repos_res *res);
 
+/// Settings of the REST listing backend
+struct gh_rest_ctx {
+	/// Base URL of the REST API, such as https://api.github.com
+	const char *endpoint;
+	/// Directory to cache responses in, or NULL to not cache them
+	const char *cache;
+	/// Login of the authenticated user, or NULL if unknown
+	const char *login;
+	/// Whether the parents of forks are looked up
+	int parents;
+};
+
+/**
+ * Lists the repositories of a user or organization through the REST API,
+ * as github_list_user_repos() does through GraphQL. Responses are cached
+ * along with their ETags and revalidated with conditional requests, which
+ * GitHub doesn't count against the rate limit while nothing changed.
+ * @param client Client of the REST API
+ * @param ctx Settings of the backend
+ * @param owner Owner of the repositories
+ * @param after URL of the page to list, the end cursor of the previous page,
+ * or NULL for the first page
+ * @param res Set to the listing, whose end cursor is the URL of the next page
+ * @return 0 on success, -1 on error
+ */
+int github_rest_list_repos(const gql_client *client,
+			   const struct gh_rest_ctx *ctx, const char *owner,
+			   const char *after, struct gh_list_repos_res *res);
+
 #endif // GITHUB_CLIENT_H
@@ -2,172 +2,158 @@
 // Created by Anshul Gupta on 4/4/25.
 //
 
+#define ALLOC_SUBSYSTEM alloc_client
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#include <cjson/cJSON.h>
-
 #include "types.h"
 
+#include "../alloc.h"
+#include "../json.h"
+
+
+/**
+ * Parses an ISO 8601 UTC timestamp as returned by GitHub.
+ * @param str Timestamp of the form YYYY-MM-DDTHH:MM:SSZ
+ * @return The timestamp, or 0 if it could not be parsed
+ */
+static time_t parse_timestamp(const char *str)
+{
+	struct tm tm = {0};
+	if (sscanf(str, "%4d-%2d-%2dT%2d:%2d:%2d", &tm.tm_year, &tm.tm_mon,
+		   &tm.tm_mday, &tm.tm_hour, &tm.tm_min, &tm.tm_sec) != 6)
+		return 0;
+	tm.tm_year -= 1900;
+	tm.tm_mon -= 1;
+	return timegm(&tm);
+}
 
-char *identity_from_json(const cJSON *root)
+/**
+ * Moves the topic names out of a repositoryTopics connection.
+ * @param topics_v repositoryTopics connection
+ * @param len Set to the number of topics
+ * @return Array of owned topic names, or NULL if there are none
+ */
+static char **
+topics_from_data(struct gh_list_repos_repository_topics *topics_v, size_t *len)
 {
-	cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
-	if (!data || !cJSON_IsObject(data)) {
-		fprintf(stderr, "Error: data object not found\n");
+	*len = 0;
+	if (topics_v->nodes_len == 0)
 		return NULL;
-	}
-	cJSON *viewer = cJSON_GetObjectItemCaseSensitive(data, "viewer");
-	if (!viewer || !cJSON_IsObject(viewer)) {
-		fprintf(stderr, "Error: viewer object not found\n");
+	char **topics = gmalloc(sizeof(*topics) * topics_v->nodes_len);
+	if (!topics)
 		return NULL;
+
+	for (size_t i = 0; i < topics_v->nodes_len; i++) {
+		topics[(*len)++] = topics_v->nodes[i].topic.name;
+		topics_v->nodes[i].topic.name = NULL;
 	}
-	cJSON *login = cJSON_GetObjectItemCaseSensitive(viewer, "login");
-	if (!login || !cJSON_IsString(login)) {
-		fprintf(stderr, "Error: login not found\n");
+	return topics;
+}
+
+/**
+ * Converts an SSH remote like git@github.com:owner/name.git to a URL.
+ * @return The URL, or NULL on error
+ */
+static char *ssh_url_from_remote(const char *remote)
+{
+	const char *prefix = "ssh://";
+	char *ssh_url = gmalloc(strlen(prefix) + strlen(remote) + 1);
+	if (!ssh_url) {
+		fprintf(stderr, "Error: malloc failed\n");
 		return NULL;
 	}
+	strcpy(ssh_url, prefix);
+	strcat(ssh_url, remote);
+	// Replace 2nd colon with slash
+	char *colon = strchr(ssh_url + strlen(prefix), ':');
+	if (colon)
+		*colon = '/';
+	return ssh_url;
+}
 
-	return strdup(login->valuestring);
+char *identity_from_data(struct gh_identity_data *data)
+{
+	char *login = data->viewer.login;
+	data->viewer.login = NULL;
+	return login;
 }
 
-int gh_list_repos_from_json(cJSON *root, struct gh_list_repos_res *res)
+int gh_list_repos_from_data(struct gh_list_repos_data *data,
+			    struct gh_list_repos_res *res)
 {
 	int status = 0;
-	cJSON *repo;
 
 	// Initialize the response structure
 	memset(res, 0, sizeof(*res));
 
-	// Get the data object
-	cJSON *data = cJSON_GetObjectItemCaseSensitive(root, "data");
-	if (!data || !cJSON_IsObject(data)) {
-		fprintf(stderr, "Error: data object not found\n");
-		status = -1;
-		goto end;
-	}
-
-	// Get the repositoryOwner object
-	cJSON *repositoryOwner = cJSON_GetObjectItemCaseSensitive(
-			data, "repositoryOwner");
-	if (!repositoryOwner || !cJSON_IsObject(repositoryOwner)) {
+	if (!data->repository_owner) {
 		fprintf(stderr, "Error: repositoryOwner object not found\n");
 		status = -1;
 		goto end;
 	}
+	struct gh_list_repos_repositories *repositories =
+			&data->repository_owner->repositories;
 
-	// Get the repositories object
-	cJSON *repositories = cJSON_GetObjectItemCaseSensitive(repositoryOwner,
-							       "repositories");
-	if (!repositories || !cJSON_IsObject(repositories)) {
-		fprintf(stderr, "Error: repositories object not found\n");
-		status = -1;
-		goto end;
-	}
-
-	// Get the pageInfo object
-	cJSON *page_info = cJSON_GetObjectItemCaseSensitive(repositories,
-							    "pageInfo");
-	if (!page_info || !cJSON_IsObject(page_info)) {
-		fprintf(stderr, "Error: pageInfo object not found\n");
-		status = -1;
-		goto end;
-	}
+	res->has_next_page = repositories->page_info.has_next_page;
+	res->end_cursor = repositories->page_info.end_cursor;
+	repositories->page_info.end_cursor = NULL;
 
-	// Get the hasNextPage and endCursor values
-	cJSON *has_next_page = cJSON_GetObjectItemCaseSensitive(page_info,
-								"hasNextPage");
-	if (!has_next_page || !cJSON_IsBool(has_next_page)) {
-		fprintf(stderr, "Error: hasNextPage not found\n");
-		status = -1;
+	if (repositories->nodes_len == 0)
 		goto end;
-	}
-	res->has_next_page = cJSON_IsTrue(has_next_page);
-
-	cJSON *end_cursor = cJSON_GetObjectItemCaseSensitive(page_info,
-							     "endCursor");
-	if (!end_cursor || !cJSON_IsString(end_cursor)) {
-		fprintf(stderr, "Error: endCursor not found\n");
+	res->repos = gmalloc(sizeof(*res->repos) * repositories->nodes_len);
+	if (!res->repos) {
+		fprintf(stderr, "Error: malloc failed\n");
 		status = -1;
 		goto end;
 	}
-	res->end_cursor = strdup(end_cursor->valuestring);
 
-	// Get the nodes array
-	cJSON *nodes = cJSON_GetObjectItemCaseSensitive(repositories, "nodes");
-	if (!nodes || !cJSON_IsArray(nodes)) {
-		fprintf(stderr, "Error: nodes array not found\n");
-		status = -1;
-		goto end;
-	}
+	for (size_t i = 0; i < repositories->nodes_len; i++) {
+		struct gh_list_repos_repositories_nodes *repo =
+				&repositories->nodes[i];
 
-	// Iterate over the nodes array
-	size_t len = cJSON_GetArraySize(nodes);
-	res->repos = malloc(sizeof(*res->repos) * len);
-	cJSON_ArrayForEach(repo, nodes)
-	{
-		cJSON *name = cJSON_GetObjectItemCaseSensitive(repo, "name");
-		if (!name || !cJSON_IsString(name)) {
-			fprintf(stderr, "Error: name not found\n");
-			status = -1;
-			goto end;
-		}
-		cJSON *url = cJSON_GetObjectItemCaseSensitive(repo, "url");
-		if (!url || !cJSON_IsString(url)) {
-			fprintf(stderr, "Error: url not found\n");
-			status = -1;
-			goto end;
-		}
-		cJSON *ssh_url_v = cJSON_GetObjectItemCaseSensitive(repo,
-								    "sshUrl");
-		if (!ssh_url_v || !cJSON_IsString(ssh_url_v)) {
-			fprintf(stderr, "Error: sshUrl not found\n");
-			status = -1;
-			goto end;
-		}
-		const char *prefix = "ssh://";
-		char *ssh_url = malloc(strlen(prefix) +
-				       strlen(ssh_url_v->valuestring) + 1);
+		char *ssh_url = ssh_url_from_remote(repo->ssh_url);
 		if (!ssh_url) {
-			fprintf(stderr, "Error: malloc failed\n");
-			status = -1;
-			goto end;
-		}
-		strcpy(ssh_url, prefix);
-		strcat(ssh_url, ssh_url_v->valuestring);
-		// Replace 2nd colon with slash
-		char *colon = strchr(ssh_url + strlen(prefix), ':');
-		if (colon)
-			*colon = '/';
-
-
-		cJSON *is_fork = cJSON_GetObjectItemCaseSensitive(repo,
-								  "isFork");
-		if (!is_fork || !cJSON_IsBool(is_fork)) {
-			fprintf(stderr, "Error: isFork not found\n");
-			status = -1;
-			goto end;
-		}
-		cJSON *is_private = cJSON_GetObjectItemCaseSensitive(
-				repo, "isPrivate");
-		if (!is_private || !cJSON_IsBool(is_private)) {
-			fprintf(stderr, "Error: isPrivate not found\n");
 			status = -1;
 			goto end;
 		}
 
-		res->repos[res->repos_len].name = strdup(name->valuestring);
-		res->repos[res->repos_len].url = strdup(url->valuestring);
+		res->repos[res->repos_len].name = repo->name;
+		res->repos[res->repos_len].url = repo->url;
 		res->repos[res->repos_len].ssh_url = ssh_url;
-		res->repos[res->repos_len].is_fork = cJSON_IsTrue(is_fork);
-		res->repos[res->repos_len].is_private =
-				cJSON_IsTrue(is_private);
+		res->repos[res->repos_len].is_fork = repo->is_fork;
+		res->repos[res->repos_len].is_private = repo->is_private;
+		res->repos[res->repos_len].is_archived = repo->is_archived;
+		res->repos[res->repos_len].pushed_at =
+				repo->pushed_at ? parse_timestamp(repo->pushed_at)
+						: 0;
+		res->repos[res->repos_len].language = NULL;
+		if (repo->primary_language) {
+			res->repos[res->repos_len].language =
+					repo->primary_language->name;
+			repo->primary_language->name = NULL;
+		}
+		res->repos[res->repos_len].topics = topics_from_data(
+				&repo->repository_topics,
+				&res->repos[res->repos_len].topics_len);
+		res->repos[res->repos_len].parent = NULL;
+		if (repo->parent) {
+			res->repos[res->repos_len].parent =
+					repo->parent->name_with_owner;
+			repo->parent->name_with_owner = NULL;
+		}
+		// diskUsage is null for repositories that are still being
+		// created on GitHub's side, and decodes to 0
+		res->repos[res->repos_len].disk_usage = repo->disk_usage;
+		repo->name = NULL;
+		repo->url = NULL;
 		res->repos_len++;
 	}
 
 end:
-	cJSON_Delete(root);
+	gh_list_repos_data_free(data);
 	if (status != 0)
 		gh_list_repos_res_free(*res);
 	return status;
@@ -175,10 +161,214 @@ end:
 
 void gh_list_repos_res_free(struct gh_list_repos_res res)
 {
-	free(res.end_cursor);
+	gfree(res.end_cursor);
 	for (size_t i = 0; i < res.repos_len; i++) {
-		free(res.repos[i].name);
-		free(res.repos[i].url);
+		gfree(res.repos[i].name);
+		gfree(res.repos[i].url);
+		gfree(res.repos[i].ssh_url);
+		gfree(res.repos[i].parent);
+		gfree(res.repos[i].language);
+		for (size_t j = 0; j < res.repos[i].topics_len; j++)
+			gfree(res.repos[i].topics[j]);
+		gfree(res.repos[i].topics);
+	}
+	gfree(res.repos);
+}
+
+/// Checks whether an object key read from JSON is the given name
+static int key_is(const char *key, size_t len, const char *name)
+{
+	return strlen(name) == len && !memcmp(key, name, len);
+}
+
+/**
+ * Reads the topics of a REST repository.
+ * @param r Reader positioned at the topics array
+ * @param topics Set to the owned topic names
+ * @param len Set to the number of topics
+ * @return 0 on success, -1 on error
+ */
+static int read_topics(struct json_reader *r, char ***topics, size_t *len)
+{
+	size_t cap = 0;
+	int ret = json_array_begin(r);
+	if (ret <= 0)
+		return ret;
+	while ((ret = json_array_next(r)) == 1) {
+		char *topic;
+		if (json_read_string(r, &topic) < 0)
+			return -1;
+		if (!topic)
+			continue;
+		if (*len == cap) {
+			cap = cap ? cap * 2 : 8;
+			char **grown =
+					grealloc(*topics, sizeof(*grown) * cap);
+			if (!grown) {
+				gfree(topic);
+				return -1;
+			}
+			*topics = grown;
+		}
+		(*topics)[(*len)++] = topic;
+	}
+	return ret;
+}
+
+/**
+ * Reads one repository of a REST listing into the next slot of the result.
+ * @return 0 on success, -1 on error
+ */
+static int read_rest_repo(struct json_reader *r, struct gh_list_repos_res *res)
+{
+	if (json_object_begin(r) != 1)
+		return -1;
+	const size_t i = res->repos_len++;
+	memset(&res->repos[i], 0, sizeof(res->repos[i]));
+
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	char *ssh_remote = NULL, *pushed_at = NULL;
+	int ret;
+	while ((ret = json_object_next(r, &key, &key_len, &hash)) == 1) {
+		if (key_is(key, key_len, "name"))
+			ret = json_read_string(r, &res->repos[i].name);
+		// html_url is what GraphQL calls url, without .git
+		else if (key_is(key, key_len, "html_url"))
+			ret = json_read_string(r, &res->repos[i].url);
+		else if (key_is(key, key_len, "ssh_url"))
+			ret = json_read_string(r, &ssh_remote);
+		else if (key_is(key, key_len, "fork"))
+			ret = json_read_bool(r, &res->repos[i].is_fork);
+		else if (key_is(key, key_len, "private"))
+			ret = json_read_bool(r, &res->repos[i].is_private);
+		else if (key_is(key, key_len, "archived"))
+			ret = json_read_bool(r, &res->repos[i].is_archived);
+		else if (key_is(key, key_len, "pushed_at"))
+			ret = json_read_string(r, &pushed_at);
+		else if (key_is(key, key_len, "language"))
+			ret = json_read_string(r, &res->repos[i].language);
+		else if (key_is(key, key_len, "topics"))
+			ret = read_topics(r, &res->repos[i].topics,
+					  &res->repos[i].topics_len);
+		else if (key_is(key, key_len, "size"))
+			ret = json_read_int(r, &res->repos[i].disk_usage);
+		else
+			ret = json_skip(r);
+		if (ret < 0)
+			break;
+	}
+
+	if (pushed_at)
+		res->repos[i].pushed_at = parse_timestamp(pushed_at);
+	gfree(pushed_at);
+	if (ssh_remote)
+		res->repos[i].ssh_url = ssh_url_from_remote(ssh_remote);
+	gfree(ssh_remote);
+	if (ret < 0 || !res->repos[i].name || !res->repos[i].url ||
+	    !res->repos[i].ssh_url) {
+		fprintf(stderr, "Error: malformed repository in listing\n");
+		return -1;
+	}
+	return 0;
+}
+
+int gh_rest_repos_decode(const char *json, size_t len,
+			 struct gh_list_repos_res *res)
+{
+	memset(res, 0, sizeof(*res));
+
+	struct json_reader r;
+	json_reader_init(&r, json, len);
+	if (json_array_begin(&r) != 1) {
+		fprintf(stderr, "Error: repository listing is not an array\n");
+		return -1;
+	}
+
+	size_t cap = 0;
+	int ret;
+	while ((ret = json_array_next(&r)) == 1) {
+		if (res->repos_len == cap) {
+			cap = cap ? cap * 2 : 32;
+			void *grown = grealloc(res->repos,
+					       sizeof(*res->repos) * cap);
+			if (!grown) {
+				ret = -1;
+				break;
+			}
+			res->repos = grown;
+		}
+		if (read_rest_repo(&r, res) < 0) {
+			ret = -1;
+			break;
+		}
+	}
+	if (ret < 0) {
+		gh_list_repos_res_free(*res);
+		memset(res, 0, sizeof(*res));
+		return -1;
+	}
+	return 0;
+}
+
+char *gh_rest_parent_decode(const char *json, size_t len)
+{
+	struct json_reader r;
+	json_reader_init(&r, json, len);
+	if (json_object_begin(&r) != 1)
+		return NULL;
+
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	char *parent = NULL;
+	while (json_object_next(&r, &key, &key_len, &hash) == 1) {
+		if (!key_is(key, key_len, "parent")) {
+			if (json_skip(&r) < 0)
+				break;
+			continue;
+		}
+		if (json_object_begin(&r) != 1)
+			break;
+		while (json_object_next(&r, &key, &key_len, &hash) == 1) {
+			if (!key_is(key, key_len, "full_name")) {
+				if (json_skip(&r) < 0)
+					break;
+				continue;
+			}
+			if (json_read_string(&r, &parent) < 0)
+				parent = NULL;
+			// Nothing else is needed
+			return parent;
+		}
+		break;
+	}
+	return NULL;
+}
+
+int gh_rest_is_org_decode(const char *json, size_t len)
+{
+	struct json_reader r;
+	json_reader_init(&r, json, len);
+	if (json_object_begin(&r) != 1)
+		return -1;
+
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	while (json_object_next(&r, &key, &key_len, &hash) == 1) {
+		if (!key_is(key, key_len, "type")) {
+			if (json_skip(&r) < 0)
+				return -1;
+			continue;
+		}
+		char *type;
+		if (json_read_string(&r, &type) != 1)
+			return -1;
+		const int org = !strcmp(type, "Organization");
+		gfree(type);
+		return org;
 	}
-	free(res.repos);
+	return -1;
 }
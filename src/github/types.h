@@ -5,9 +5,17 @@
 #ifndef GITHUB_TYPES_H
 #define GITHUB_TYPES_H
 
-#include <cjson/cJSON.h>
+#include <time.h>
 
-char *identity_from_json(const cJSON *root);
+#include "queries/github/gh_identity.h"
+#include "queries/github/gh_list_repos.h"
+
+/**
+ * Takes the login out of a decoded identity response.
+ * @param data Decoded response, the login is moved out of it
+ * @return The login, or NULL if it is missing
+ */
+char *identity_from_data(struct gh_identity_data *data);
 
 struct gh_list_repos_res {
 	int has_next_page;
@@ -19,12 +27,61 @@ struct gh_list_repos_res {
 		char *ssh_url;
 		int is_fork;
 		int is_private;
+		int is_archived;
+		/// Time of the last push, 0 if never pushed
+		time_t pushed_at;
+		/// Primary language, NULL if unknown
+		char *language;
+		/// Repository topics
+		char **topics;
+		size_t topics_len;
+		/// Owner and name of the parent repository, NULL if not a fork
+		char *parent;
+		/// Size of the repository in kilobytes, 0 if unknown
+		long long disk_usage;
 	} *repos;
 
 	size_t repos_len;
 };
 
-int gh_list_repos_from_json(cJSON *root, struct gh_list_repos_res *res);
+/**
+ * Converts a decoded repository listing.
+ * @param data Decoded response, its strings are moved into the result and it
+ * is freed
+ * @param res Set to the converted listing
+ * @return 0 on success, -1 on error
+ */
+int gh_list_repos_from_data(struct gh_list_repos_data *data,
+			    struct gh_list_repos_res *res);
 void gh_list_repos_res_free(struct gh_list_repos_res res);
 
+/**
+ * Decodes a page of a REST repository listing, an array of repositories.
+ * REST listings don't carry the parents of forks, which are left NULL, nor
+ * paging information, which comes from the Link header.
+ * @param json Response body
+ * @param len Length of the body
+ * @param res Set to the listing
+ * @return 0 on success, -1 on error
+ */
+int gh_rest_repos_decode(const char *json, size_t len,
+			 struct gh_list_repos_res *res);
+
+/**
+ * Decodes the parent of a repository returned by the REST API.
+ * @param json Response body
+ * @param len Length of the body
+ * @return Owned owner and name ("owner/name") of the parent, NULL if the
+ * repository has none or on error
+ */
+char *gh_rest_parent_decode(const char *json, size_t len);
+
+/**
+ * Decodes whether an account returned by the REST API is an organization.
+ * @param json Response body
+ * @param len Length of the body
+ * @return 1 for an organization, 0 for a user, -1 on error
+ */
+int gh_rest_is_org_decode(const char *json, size_t len);
+
 #endif // GITHUB_TYPES_H
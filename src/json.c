@@ -0,0 +1,400 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_decoder
+
+#include "json.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+/// Deepest nesting json_skip() accepts
+#define JSON_MAX_DEPTH 256
+/// Longest number json_read_int() and json_read_double() accept
+#define JSON_MAX_NUMBER 64
+
+void json_reader_init(struct json_reader *r, const char *json, size_t len)
+{
+	r->p = json;
+	r->end = json + len;
+	r->first = 0;
+}
+
+static void skip_ws(struct json_reader *r)
+{
+	while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' ||
+				 *r->p == '\n' || *r->p == '\r'))
+		r->p++;
+}
+
+/// Skips whitespace and returns the next character, or 0 at the end
+static char peek(struct json_reader *r)
+{
+	skip_ws(r);
+	return r->p < r->end ? *r->p : 0;
+}
+
+static int expect_literal(struct json_reader *r, const char *lit)
+{
+	const size_t len = strlen(lit);
+	if ((size_t) (r->end - r->p) < len || memcmp(r->p, lit, len) != 0)
+		return -1;
+	r->p += len;
+	return 0;
+}
+
+int json_read_null(struct json_reader *r)
+{
+	return peek(r) == 'n' && expect_literal(r, "null") == 0;
+}
+
+static int begin(struct json_reader *r, char open)
+{
+	if (json_read_null(r))
+		return 0;
+	if (peek(r) != open)
+		return -1;
+	r->p++;
+	r->first = 1;
+	return 1;
+}
+
+/**
+ * Moves past the separator before the next member or element.
+ * @return 1 if a member or element follows, 0 after the closing bracket,
+ * -1 on error
+ */
+static int next(struct json_reader *r, char close)
+{
+	const char c = peek(r);
+	if (c == close) {
+		r->p++;
+		// The enclosing container has read at least this value
+		r->first = 0;
+		return 0;
+	}
+	if (!r->first) {
+		if (c != ',')
+			return -1;
+		r->p++;
+	}
+	r->first = 0;
+	return 1;
+}
+
+int json_object_begin(struct json_reader *r) { return begin(r, '{'); }
+
+int json_array_begin(struct json_reader *r) { return begin(r, '['); }
+
+int json_array_next(struct json_reader *r) { return next(r, ']'); }
+
+/**
+ * Moves past the closing quote of a string starting at the opening quote.
+ * @return 0 on success, -1 if the string is unterminated
+ */
+static int skip_string(struct json_reader *r)
+{
+	for (r->p++; r->p < r->end; r->p++) {
+		if (*r->p == '\\')
+			r->p++;
+		else if (*r->p == '"') {
+			r->p++;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int json_object_next(struct json_reader *r, const char **key, size_t *key_len,
+		     uint32_t *hash)
+{
+	const int ret = next(r, '}');
+	if (ret != 1)
+		return ret;
+	if (peek(r) != '"')
+		return -1;
+
+	const char *start = ++r->p;
+	uint32_t h = JSON_HASH_BASIS;
+	while (r->p < r->end && *r->p != '"') {
+		if (*r->p == '\\') {
+			h = (h ^ (unsigned char) *r->p++) * JSON_HASH_PRIME;
+			if (r->p == r->end)
+				return -1;
+		}
+		h = (h ^ (unsigned char) *r->p++) * JSON_HASH_PRIME;
+	}
+	if (r->p == r->end)
+		return -1;
+	*key = start;
+	*key_len = (size_t) (r->p - start);
+	*hash = h;
+	r->p++;
+
+	if (peek(r) != ':')
+		return -1;
+	r->p++;
+	return 1;
+}
+
+static int hex_digit(char c)
+{
+	if (c >= '0' && c <= '9')
+		return c - '0';
+	if (c >= 'a' && c <= 'f')
+		return c - 'a' + 10;
+	if (c >= 'A' && c <= 'F')
+		return c - 'A' + 10;
+	return -1;
+}
+
+/// Reads the 4 hex digits of a \u escape
+static long read_hex4(const char *p, const char *end)
+{
+	if (end - p < 4)
+		return -1;
+	long v = 0;
+	for (int i = 0; i < 4; i++) {
+		const int d = hex_digit(p[i]);
+		if (d < 0)
+			return -1;
+		v = v << 4 | d;
+	}
+	return v;
+}
+
+static size_t put_utf8(char *out, unsigned long cp)
+{
+	if (cp < 0x80) {
+		out[0] = (char) cp;
+		return 1;
+	}
+	if (cp < 0x800) {
+		out[0] = (char) (0xc0 | cp >> 6);
+		out[1] = (char) (0x80 | (cp & 0x3f));
+		return 2;
+	}
+	if (cp < 0x10000) {
+		out[0] = (char) (0xe0 | cp >> 12);
+		out[1] = (char) (0x80 | (cp >> 6 & 0x3f));
+		out[2] = (char) (0x80 | (cp & 0x3f));
+		return 3;
+	}
+	out[0] = (char) (0xf0 | cp >> 18);
+	out[1] = (char) (0x80 | (cp >> 12 & 0x3f));
+	out[2] = (char) (0x80 | (cp >> 6 & 0x3f));
+	out[3] = (char) (0x80 | (cp & 0x3f));
+	return 4;
+}
+
+int json_read_string(struct json_reader *r, char **out)
+{
+	*out = NULL;
+	if (json_read_null(r))
+		return 0;
+	if (peek(r) != '"')
+		return -1;
+
+	const char *start = r->p + 1;
+	if (skip_string(r) < 0)
+		return -1;
+	const char *end = r->p - 1;
+
+	// Unescaping never makes a string longer
+	char *s = gmalloc(end - start + 1);
+	if (!s)
+		return -1;
+	size_t len = 0;
+	for (const char *p = start; p < end; p++) {
+		if (*p != '\\') {
+			s[len++] = *p;
+			continue;
+		}
+		switch (*++p) {
+		case '"':
+		case '\\':
+		case '/':
+			s[len++] = *p;
+			break;
+		case 'b':
+			s[len++] = '\b';
+			break;
+		case 'f':
+			s[len++] = '\f';
+			break;
+		case 'n':
+			s[len++] = '\n';
+			break;
+		case 'r':
+			s[len++] = '\r';
+			break;
+		case 't':
+			s[len++] = '\t';
+			break;
+		case 'u': {
+			long cp = read_hex4(p + 1, end);
+			if (cp < 0)
+				goto fail;
+			p += 4;
+			// Combine a surrogate pair
+			if (cp >= 0xd800 && cp < 0xdc00 && end - p > 2 &&
+			    p[1] == '\\' && p[2] == 'u') {
+				const long lo = read_hex4(p + 3, end);
+				if (lo >= 0xdc00 && lo < 0xe000) {
+					cp = 0x10000 + ((cp - 0xd800) << 10) +
+					     (lo - 0xdc00);
+					p += 6;
+				}
+			}
+			// A lone surrogate isn't valid UTF-8, replace it
+			if (cp >= 0xd800 && cp < 0xe000)
+				cp = 0xfffd;
+			len += put_utf8(s + len, (unsigned long) cp);
+			break;
+		}
+		default:
+			goto fail;
+		}
+	}
+	s[len] = '\0';
+	*out = s;
+	return 1;
+
+fail:
+	gfree(s);
+	return -1;
+}
+
+int json_read_bool(struct json_reader *r, int *out)
+{
+	if (json_read_null(r))
+		return 0;
+	if (peek(r) == 't' && expect_literal(r, "true") == 0) {
+		*out = 1;
+		return 1;
+	}
+	if (peek(r) == 'f' && expect_literal(r, "false") == 0) {
+		*out = 0;
+		return 1;
+	}
+	return -1;
+}
+
+/**
+ * Copies the next number into a NUL-terminated buffer.
+ * @return 0 on success, -1 if the value is not a number
+ */
+static int read_number(struct json_reader *r, char buf[JSON_MAX_NUMBER])
+{
+	size_t len = 0;
+	peek(r);
+	while (r->p < r->end && *r->p && strchr("+-0123456789.eE", *r->p)) {
+		if (len == JSON_MAX_NUMBER - 1)
+			return -1;
+		buf[len++] = *r->p++;
+	}
+	buf[len] = '\0';
+	return len ? 0 : -1;
+}
+
+int json_read_int(struct json_reader *r, long long *out)
+{
+	char buf[JSON_MAX_NUMBER];
+	if (json_read_null(r))
+		return 0;
+	if (read_number(r, buf) < 0)
+		return -1;
+
+	char *end;
+	errno = 0;
+	*out = strtoll(buf, &end, 10);
+	if (*end == '.' || *end == 'e' || *end == 'E') {
+		// Only integers written with a fraction or exponent, like 1e3
+		const double d = strtod(buf, &end);
+		if (*end != '\0' || !(d >= -0x1p63 && d < 0x1p63))
+			return -1;
+		*out = (long long) d;
+		return (double) *out == d ? 1 : -1;
+	}
+	return *end == '\0' && errno != ERANGE ? 1 : -1;
+}
+
+int json_read_double(struct json_reader *r, double *out)
+{
+	char buf[JSON_MAX_NUMBER];
+	if (json_read_null(r))
+		return 0;
+	if (read_number(r, buf) < 0)
+		return -1;
+
+	char *end;
+	*out = strtod(buf, &end);
+	return *end == '\0' ? 1 : -1;
+}
+
+int json_skip(struct json_reader *r)
+{
+	// One bit per open container, set for objects
+	uint64_t objects[JSON_MAX_DEPTH / 64] = {0};
+	int depth = 0;
+	do {
+		const char c = peek(r);
+		switch (c) {
+		case '{':
+		case '[':
+			if (depth == JSON_MAX_DEPTH)
+				return -1;
+			if (c == '{')
+				objects[depth / 64] |= UINT64_C(1) << depth % 64;
+			else
+				objects[depth / 64] &= ~(UINT64_C(1) << depth % 64);
+			depth++;
+			r->p++;
+			break;
+		case '}':
+		case ']':
+			if (depth == 0)
+				return -1;
+			depth--;
+			if (!(objects[depth / 64] >> depth % 64 & 1) != (c == ']'))
+				return -1;
+			r->p++;
+			break;
+		case ',':
+		case ':':
+			// Only valid inside a container being skipped
+			if (depth == 0)
+				return -1;
+			r->p++;
+			break;
+		case '"':
+			if (skip_string(r) < 0)
+				return -1;
+			break;
+		case 't':
+			if (expect_literal(r, "true") < 0)
+				return -1;
+			break;
+		case 'f':
+			if (expect_literal(r, "false") < 0)
+				return -1;
+			break;
+		case 'n':
+			if (expect_literal(r, "null") < 0)
+				return -1;
+			break;
+		case 0:
+			return -1;
+		default: {
+			double v;
+			if (json_read_double(r, &v) < 0)
+				return -1;
+		}
+		}
+	} while (depth > 0);
+	return 0;
+}
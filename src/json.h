@@ -0,0 +1,102 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Single-pass pull reader over a JSON document. Values are read in document
+ * order straight from the input, so no tree is built. Used by the response
+ * decoders generated from the GraphQL queries.
+ */
+struct json_reader {
+	/// Next unread character
+	const char *p;
+	/// End of the input
+	const char *end;
+	/// Whether the current object or array has no members read yet
+	int first;
+};
+
+/// FNV-1a basis and prime used for object key hashes
+#define JSON_HASH_BASIS 2166136261u
+#define JSON_HASH_PRIME 16777619u
+
+void json_reader_init(struct json_reader *r, const char *json, size_t len);
+
+/**
+ * Starts reading an object.
+ * @return 1 if an object was started, 0 if the value is null, -1 on error
+ */
+int json_object_begin(struct json_reader *r);
+
+/**
+ * Reads the key of the next object member. The value must be read or skipped
+ * before the next call. Keys are returned as they appear in the input, escape
+ * sequences included.
+ * @param key Set to the start of the key, not NUL-terminated
+ * @param key_len Set to the length of the key
+ * @param hash Set to the FNV-1a hash of the key
+ * @return 1 if a member follows, 0 at the end of the object, -1 on error
+ */
+int json_object_next(struct json_reader *r, const char **key, size_t *key_len,
+		     uint32_t *hash);
+
+/**
+ * Starts reading an array.
+ * @return 1 if an array was started, 0 if the value is null, -1 on error
+ */
+int json_array_begin(struct json_reader *r);
+
+/**
+ * Moves to the next array element, which must be read or skipped before the
+ * next call.
+ * @return 1 if an element follows, 0 at the end of the array, -1 on error
+ */
+int json_array_next(struct json_reader *r);
+
+/**
+ * Consumes a null value.
+ * @return 1 if the value was null, 0 if not
+ */
+int json_read_null(struct json_reader *r);
+
+/**
+ * Reads a string value.
+ * @param out Set to the unescaped, owned string, or NULL if the value is null
+ * @return 1 if a string was read, 0 if the value is null, -1 on error
+ */
+int json_read_string(struct json_reader *r, char **out);
+
+/**
+ * Reads a boolean value.
+ * @return 1 if a boolean was read, 0 if the value is null, -1 on error
+ */
+int json_read_bool(struct json_reader *r, int *out);
+
+/**
+ * Reads an integer value. Numbers with a fraction or exponent are only
+ * accepted if they are integers, like 1e3 or 2.0.
+ * @return 1 if a number was read, 0 if the value is null, -1 on error or if
+ * the number is not an integer or out of range
+ */
+int json_read_int(struct json_reader *r, long long *out);
+
+/**
+ * Reads a floating point value.
+ * @return 1 if a number was read, 0 if the value is null, -1 on error
+ */
+int json_read_double(struct json_reader *r, double *out);
+
+/**
+ * Skips over the next value, whatever its type. Only the tokens and the
+ * nesting of the skipped value are checked, not the placement of separators.
+ * @return 0 on success, -1 on error
+ */
+int json_skip(struct json_reader *r);
+
+#endif // JSON_H
@@ -0,0 +1,864 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_client
+
+#include "lfs.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <curl/curl.h>
+
+#include "alloc.h"
+#include "buffer.h"
+#include "lfs_parse.h"
+#include "metrics.h"
+#include "profile.h"
+#include "retry.h"
+#include "sha256.h"
+#include "shutdown.h"
+#include "spawn.h"
+#include "timing.h"
+
+/// Objects per batch request, the most GitHub accepts
+#define BATCH_SIZE 100
+/// Attempts of a batch request
+#define BATCH_ATTEMPTS 3
+/// Delay bound of the first retry and the largest delay bound
+#define RETRY_BASE_MS 1000
+#define RETRY_MAX_MS 30000
+/// Seconds a download may stall before it is abandoned
+#define STALL_TIMEOUT 60
+/// File in a mirror marking that its last scan left no object missing
+#define DONE_FILE "github-mirror-lfs"
+#define MEDIA_TYPE "application/vnd.git-lfs+json"
+#define USER_AGENT "github-mirror/" GITHUB_MIRROR_VERSION
+
+struct object_list {
+	struct lfs_object *items;
+	size_t len;
+	size_t cap;
+};
+
+struct download {
+	/// Object and where the batch response said to get it
+	const struct lfs_action *act;
+	CURL *curl;
+	/// Temporary file in the store the object is written to
+	FILE *f;
+	char tmp[PATH_MAX];
+	struct sha256 hash;
+	/// Bytes received so far
+	long long got;
+};
+
+/// DNS and TLS session caches and objects being downloaded, shared by all
+/// mirrors
+static struct {
+	pthread_once_t once;
+	CURLSH *share;
+	pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+
+	/// Objects being downloaded by some mirror
+	char (*claimed)[SHA256_HEX_LEN + 1];
+	size_t claimed_len;
+	size_t claimed_cap;
+	pthread_mutex_t claim_lock;
+} pool = {
+		.once = PTHREAD_ONCE_INIT,
+		.claim_lock = PTHREAD_MUTEX_INITIALIZER,
+};
+
+static void share_lock(CURL *handle, curl_lock_data data,
+		       curl_lock_access access, void *userptr)
+{
+	(void) handle;
+	(void) access;
+	(void) userptr;
+	pthread_mutex_lock(&pool.locks[data]);
+}
+
+static void share_unlock(CURL *handle, curl_lock_data data, void *userptr)
+{
+	(void) handle;
+	(void) userptr;
+	pthread_mutex_unlock(&pool.locks[data]);
+}
+
+static void init_pool(void)
+{
+	for (int i = 0; i < CURL_LOCK_DATA_LAST; i++)
+		pthread_mutex_init(&pool.locks[i], NULL);
+	pool.share = curl_share_init();
+	if (!pool.share)
+		return;
+	curl_share_setopt(pool.share, CURLSHOPT_LOCKFUNC, share_lock);
+	curl_share_setopt(pool.share, CURLSHOPT_UNLOCKFUNC, share_unlock);
+	curl_share_setopt(pool.share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+	curl_share_setopt(pool.share, CURLSHOPT_SHARE,
+			  CURL_LOCK_DATA_SSL_SESSION);
+	// Sharing connections between threads isn't supported by libcurl, so
+	// each mirror's multi handle keeps its own and mirrors only skip the
+	// lookups and full TLS handshakes
+}
+
+/**
+ * Claims an object for download, so that mirrors referring to the same object
+ * don't download it at once.
+ * @return 1 if claimed, 0 if another mirror is downloading it
+ */
+static int claim(const char *oid)
+{
+	int ret = 1;
+	pthread_mutex_lock(&pool.claim_lock);
+	for (size_t i = 0; i < pool.claimed_len; i++) {
+		if (!strcmp(pool.claimed[i], oid)) {
+			ret = 0;
+			goto end;
+		}
+	}
+	if (pool.claimed_len == pool.claimed_cap) {
+		const size_t cap = pool.claimed_cap ? pool.claimed_cap * 2 : 64;
+		void *claimed = grealloc(pool.claimed,
+					 sizeof(*pool.claimed) * cap);
+		if (!claimed) {
+			perror("realloc");
+			goto end; // Downloading it twice does no harm
+		}
+		pool.claimed = claimed;
+		pool.claimed_cap = cap;
+	}
+	memcpy(pool.claimed[pool.claimed_len++], oid, SHA256_HEX_LEN + 1);
+end:
+	pthread_mutex_unlock(&pool.claim_lock);
+	return ret;
+}
+
+static void release(const char *oid)
+{
+	pthread_mutex_lock(&pool.claim_lock);
+	for (size_t i = 0; i < pool.claimed_len; i++) {
+		if (!strcmp(pool.claimed[i], oid)) {
+			memcpy(pool.claimed[i],
+			       pool.claimed[--pool.claimed_len],
+			       SHA256_HEX_LEN + 1);
+			break;
+		}
+	}
+	pthread_mutex_unlock(&pool.claim_lock);
+}
+
+/// Path of an object in the store, laid out like git-lfs does
+static void object_path(char *buf, size_t len, const char *store,
+			const char *oid)
+{
+	snprintf(buf, len, "%s/objects/%.2s/%.2s/%s", store, oid, oid + 2,
+		 oid);
+}
+
+/**
+ * Creates the directories of a path, up to its last component.
+ * @return 0 on success, -1 on error
+ */
+static int make_parents(const char *path)
+{
+	char dir[PATH_MAX];
+	snprintf(dir, sizeof(dir), "%s", path);
+	for (char *p = dir + 1; (p = strchr(p, '/')); p++) {
+		*p = '\0';
+		if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	return 0;
+}
+
+/**
+ * Starts git with its standard output on a pipe.
+ * @param args NULL-terminated git arguments
+ * @param in File descriptor for the standard input of git, or -1
+ * @param out Set to the read end of the pipe
+ * @return Process ID of git, or -1 on error
+ */
+static pid_t start_git(char *const args[], int in, int *out)
+{
+	int fds[2];
+	if (spawn_pipe(fds) == -1) {
+		perror("pipe");
+		return -1;
+	}
+
+	const pid_t pid = spawn_fork();
+	if (pid < 0) {
+		perror("fork");
+		close(fds[0]);
+		close(fds[1]);
+		return -1;
+	}
+	if (pid == 0) {
+		shutdown_detach_child();
+		if (dup2(fds[1], STDOUT_FILENO) == -1 ||
+		    (in >= 0 && dup2(in, STDIN_FILENO) == -1)) {
+			perror("dup2");
+			_exit(127);
+		}
+		profile_exec(args);
+	}
+
+	shutdown_child_started(pid);
+	close(fds[1]);
+	*out = fds[0];
+	return pid;
+}
+
+/**
+ * Waits for git to exit.
+ * @return Exit status of git, or -1 if it didn't exit normally
+ */
+static int wait_git(pid_t pid)
+{
+	int status;
+	pid_t result;
+	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
+	}
+	shutdown_child_exited(pid);
+	if (result == -1) {
+		perror("waitpid");
+		return -1;
+	}
+	return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static void list_add(struct object_list *list, const struct lfs_object *obj)
+{
+	if (list->len == list->cap) {
+		const size_t cap = list->cap ? list->cap * 2 : 64;
+		void *items = grealloc(list->items, sizeof(*list->items) * cap);
+		if (!items) {
+			perror("realloc");
+			return;
+		}
+		list->items = items;
+		list->cap = cap;
+	}
+	list->items[list->len++] = *obj;
+}
+
+/**
+ * Writes the blobs of a mirror that are small enough to be pointer files to a
+ * file, one per line.
+ * @return 0 on success, -1 on error
+ */
+static int list_candidates(const char *path, FILE *out)
+{
+	char *args[] = {
+			"git",
+			"--git-dir",
+			(char *) path,
+			"cat-file",
+			"--batch-all-objects",
+			"--unordered",
+			"--batch-check=%(objectname) %(objecttype) "
+			"%(objectsize)",
+			NULL,
+	};
+	int fd;
+	const pid_t pid = start_git(args, -1, &fd);
+	if (pid < 0)
+		return -1;
+	FILE *in = fdopen(fd, "r");
+	if (!in) {
+		perror("fdopen");
+		close(fd);
+		wait_git(pid);
+		return -1;
+	}
+
+	char line[256], oid[SHA256_HEX_LEN + 1], type[16];
+	long long size;
+	while (fgets(line, sizeof(line), in)) {
+		if (sscanf(line, "%64s %15s %lld", oid, type, &size) == 3 &&
+		    !strcmp(type, "blob") &&
+		    size >= (long long) strlen(LFS_POINTER_VERSION) &&
+		    size < LFS_POINTER_MAX)
+			fprintf(out, "%s\n", oid);
+	}
+	fclose(in);
+	return wait_git(pid) == 0 && !ferror(out) ? 0 : -1;
+}
+
+/**
+ * Finds the LFS objects that pointer files in a mirror refer to.
+ * @param path Full path to the git repository
+ * @param objs List to add the objects to, which may repeat
+ * @return 0 on success, -1 on error
+ */
+static int scan_pointers(const char *path, struct object_list *objs)
+{
+	FILE *candidates = spawn_tmpfile();
+	if (!candidates) {
+		perror("tmpfile");
+		return -1;
+	}
+	if (list_candidates(path, candidates) < 0 || fflush(candidates) ||
+	    fseek(candidates, 0, SEEK_SET)) {
+		fclose(candidates);
+		return -1;
+	}
+
+	char *args[] = {
+			"git",	    "--git-dir", (char *) path,
+			"cat-file", "--batch",	 NULL,
+	};
+	int fd;
+	const pid_t pid = start_git(args, fileno(candidates), &fd);
+	fclose(candidates);
+	if (pid < 0)
+		return -1;
+	FILE *in = fdopen(fd, "r");
+	if (!in) {
+		perror("fdopen");
+		close(fd);
+		wait_git(pid);
+		return -1;
+	}
+
+	// Each blob is "<oid> blob <size>\n<contents>\n"
+	char line[256], data[LFS_POINTER_MAX];
+	long long size;
+	while (fgets(line, sizeof(line), in)) {
+		if (sscanf(line, "%*s blob %lld", &size) != 1 || size < 0 ||
+		    size >= LFS_POINTER_MAX)
+			continue;
+		if (fread(data, 1, (size_t) size, in) != (size_t) size)
+			break;
+		fgetc(in);
+		struct lfs_object obj;
+		if (lfs_parse_pointer(data, (size_t) size, &obj))
+			list_add(objs, &obj);
+	}
+	fclose(in);
+	return wait_git(pid) == 0 ? 0 : -1;
+}
+
+static int object_cmp(const void *a, const void *b)
+{
+	const struct lfs_object *oa = a, *ob = b;
+	return strcmp(oa->oid, ob->oid);
+}
+
+/// Drops repeated objects and those already in the store
+static void drop_present(struct object_list *objs, const char *store)
+{
+	if (objs->len)
+		qsort(objs->items, objs->len, sizeof(*objs->items),
+		      object_cmp);
+	size_t kept = 0;
+	for (size_t i = 0; i < objs->len; i++) {
+		const struct lfs_object *obj = &objs->items[i];
+		if (kept && !strcmp(objs->items[kept - 1].oid, obj->oid))
+			continue;
+		char path[PATH_MAX];
+		struct stat st;
+		object_path(path, sizeof(path), store, obj->oid);
+		if (stat(path, &st) == 0 && st.st_size == obj->size)
+			continue;
+		objs->items[kept++] = *obj;
+	}
+	objs->len = kept;
+}
+
+/**
+ * Reads a config option of a mirror.
+ * @return 1 if it is set, 0 if not, -1 on error
+ */
+static int get_config(const char *path, const char *name, char *buf,
+		      size_t len)
+{
+	char *args[] = {
+			"git",	  "--git-dir", (char *) path,
+			"config", "--get",     (char *) name,
+			NULL,
+	};
+	int fd;
+	const pid_t pid = start_git(args, -1, &fd);
+	if (pid < 0)
+		return -1;
+	size_t n = 0;
+	ssize_t r;
+	while (n + 1 < len && (r = read(fd, buf + n, len - n - 1)) != 0) {
+		if (r == -1) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		n += (size_t) r;
+	}
+	close(fd);
+	buf[n] = '\0';
+	buf[strcspn(buf, "\n")] = '\0';
+	const int status = wait_git(pid);
+	return status == 0 ? 1 : status == 1 ? 0 : -1;
+}
+
+/**
+ * Points the mirror's git-lfs at the store, unless it already is.
+ * @return 0 on success, -1 on error
+ */
+static int set_storage(const char *path, const char *store)
+{
+	char current[PATH_MAX];
+	if (get_config(path, "lfs.storage", current, sizeof(current)) == 1 &&
+	    !strcmp(current, store))
+		return 0;
+
+	char *args[] = {
+			"git",	  "--git-dir",	 (char *) path,
+			"config", "lfs.storage", (char *) store,
+			NULL,
+	};
+	int fd;
+	const pid_t pid = start_git(args, -1, &fd);
+	if (pid < 0)
+		return -1;
+	close(fd);
+	return wait_git(pid) == 0 ? 0 : -1;
+}
+
+/**
+ * Finds the batch endpoint of a mirror, see lfs_batch_url().
+ * @return 0 on success, -1 if the upstream has no endpoint
+ */
+static int batch_url(const char *path, const char *url, char *buf, size_t len)
+{
+	char lfs_url[2048];
+	if (get_config(path, "lfs.url", lfs_url, sizeof(lfs_url)) != 1)
+		lfs_url[0] = '\0';
+	return lfs_batch_url(lfs_url, url, buf, len);
+}
+
+static size_t write_buffer(const void *ptr, const size_t size, size_t nmemb,
+			   void *stream)
+{
+	(void) size; // unused
+
+	buffer_append(stream, ptr, nmemb);
+	return nmemb;
+}
+
+/// Sets the options every request of the LFS stage shares
+static void set_common(CURL *curl)
+{
+	curl_easy_setopt(curl, CURLOPT_USERAGENT, USER_AGENT);
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, (long) STALL_TIMEOUT);
+	if (pool.share)
+		curl_easy_setopt(curl, CURLOPT_SHARE, pool.share);
+}
+
+/**
+ * Asks the batch endpoint where to download objects from, retrying transient
+ * failures.
+ * @param url Batch endpoint
+ * @param ctx Context of the repository, for its credentials
+ * @param objs Objects to download
+ * @param n Number of objects
+ * @param resp Buffer to append the NUL-terminated response to
+ * @return 0 on success, -1 on error
+ */
+static int request_batch(const char *url, const struct repo_ctx *ctx,
+			 const struct lfs_object *objs, size_t n,
+			 buffer_t *resp)
+{
+	buffer_t body = buffer_new(128 + n * 100);
+	const char *head = "{\"operation\":\"download\","
+			   "\"transfers\":[\"basic\"],\"objects\":[";
+	buffer_append(&body, head, strlen(head));
+	for (size_t i = 0; i < n; i++) {
+		char obj[128];
+		const int len = snprintf(obj, sizeof(obj),
+					 "%s{\"oid\":\"%s\",\"size\":%lld}",
+					 i ? "," : "", objs[i].oid,
+					 objs[i].size);
+		buffer_append(&body, obj, (size_t) len);
+	}
+	buffer_append(&body, "]}", 3);
+
+	CURL *curl = curl_easy_init();
+	if (!curl) {
+		buffer_free(body);
+		return -1;
+	}
+	struct curl_slist *headers = NULL;
+	headers = curl_slist_append(headers, "Accept: " MEDIA_TYPE);
+	headers = curl_slist_append(headers, "Content-Type: " MEDIA_TYPE);
+	set_common(curl);
+	curl_easy_setopt(curl, CURLOPT_URL, url);
+	curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+	curl_easy_setopt(curl, CURLOPT_POSTFIELDS, (char *) body.data);
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_buffer);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp);
+
+	// Credentials only go to the upstream's host, not to any lfs.url
+	char host[RETRY_HOST_MAX], upstream[RETRY_HOST_MAX];
+	if (ctx->username && ctx->token &&
+	    retry_host(url, host, sizeof(host)) == 0 &&
+	    retry_host(ctx->url, upstream, sizeof(upstream)) == 0 &&
+	    !strcmp(host, upstream)) {
+		curl_easy_setopt(curl, CURLOPT_USERNAME, ctx->username);
+		curl_easy_setopt(curl, CURLOPT_PASSWORD, ctx->token);
+	}
+
+	int ret = -1;
+	const size_t start = resp->len;
+	for (unsigned attempt = 1; attempt <= BATCH_ATTEMPTS; attempt++) {
+		resp->len = start;
+		const CURLcode res = curl_easy_perform(curl);
+		long code = 0;
+		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &code);
+		if (res == CURLE_OK && code == 200) {
+			ret = 0;
+			break;
+		}
+		if (res != CURLE_OK)
+			fprintf(stderr, "Error: LFS batch request failed: %s\n",
+				curl_easy_strerror(res));
+		else
+			fprintf(stderr,
+				"Error: LFS batch request failed with HTTP "
+				"%ld\n",
+				code);
+		// Other errors, such as a missing endpoint, won't go away
+		const int transient = res != CURLE_OK ||
+				      code == 429 || code >= 500;
+		if (!transient || attempt == BATCH_ATTEMPTS ||
+		    retry_sleep(retry_delay_ms(attempt, RETRY_BASE_MS,
+					       RETRY_MAX_MS)) < 0)
+			break;
+	}
+	buffer_append(resp, "\0", 1);
+
+	curl_slist_free_all(headers);
+	curl_easy_cleanup(curl);
+	buffer_free(body);
+	return ret;
+}
+
+/// Releases the transfer of a download and removes its temporary file
+static void download_free(struct download *d)
+{
+	if (d->curl)
+		curl_easy_cleanup(d->curl);
+	if (d->f) {
+		fclose(d->f);
+		remove(d->tmp);
+	}
+}
+
+static size_t write_object(const void *ptr, const size_t size, size_t nmemb,
+			   void *stream)
+{
+	(void) size; // unused
+
+	struct download *d = stream;
+	d->got += (long long) nmemb;
+	// More than the pointer says can only be the wrong object
+	if (d->got > d->act->obj.size || fwrite(ptr, 1, nmemb, d->f) != nmemb)
+		return 0;
+	sha256_update(&d->hash, ptr, nmemb);
+	return nmemb;
+}
+
+/**
+ * Starts downloading an object to a temporary file in the store.
+ * @return 0 on success, -1 on error
+ */
+static int start_download(CURLM *multi, struct download *d, const char *store)
+{
+	snprintf(d->tmp, sizeof(d->tmp), "%s/tmp/%s-XXXXXX", store,
+		 d->act->obj.oid);
+	if (make_parents(d->tmp) < 0) {
+		perror("Error creating LFS store");
+		return -1;
+	}
+	spawn_lock();
+	const int fd = mkstemp(d->tmp);
+	if (fd != -1)
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+	spawn_unlock();
+	if (fd == -1) {
+		perror("Error creating LFS object");
+		return -1;
+	}
+	d->f = fdopen(fd, "wb");
+	if (!d->f) {
+		perror("fdopen");
+		close(fd);
+		remove(d->tmp);
+		return -1;
+	}
+	d->curl = curl_easy_init();
+	if (!d->curl)
+		return -1;
+
+	sha256_init(&d->hash);
+	set_common(d->curl);
+	curl_easy_setopt(d->curl, CURLOPT_URL, d->act->href);
+	curl_easy_setopt(d->curl, CURLOPT_HTTPHEADER,
+			 d->act->headers);
+	curl_easy_setopt(d->curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(d->curl, CURLOPT_WRITEFUNCTION, write_object);
+	curl_easy_setopt(d->curl, CURLOPT_WRITEDATA, d);
+	curl_easy_setopt(d->curl, CURLOPT_PRIVATE, d);
+	return curl_multi_add_handle(multi, d->curl) == CURLM_OK ? 0 : -1;
+}
+
+/**
+ * Verifies a finished download and moves it into the store.
+ * @return 0 on success, -1 on error
+ */
+static int finish_download(struct download *d, CURLcode res,
+			   const char *store)
+{
+	long code = 0;
+	curl_easy_getinfo(d->curl, CURLINFO_RESPONSE_CODE, &code);
+	char hex[SHA256_HEX_LEN + 1];
+	sha256_final(&d->hash, hex);
+	const int err = fclose(d->f);
+	d->f = NULL;
+
+	char path[PATH_MAX];
+	object_path(path, sizeof(path), store, d->act->obj.oid);
+	if (res != CURLE_OK || code != 200 || err) {
+		fprintf(stderr, "Error: downloading LFS object %s failed: %s\n",
+			d->act->obj.oid,
+			res != CURLE_OK ? curl_easy_strerror(res)
+					: "unexpected response");
+	} else if (d->got != d->act->obj.size || strcmp(hex, d->act->obj.oid) != 0) {
+		fprintf(stderr, "Error: LFS object %s is corrupt\n",
+			d->act->obj.oid);
+	} else if (make_parents(path) < 0 || rename(d->tmp, path) < 0) {
+		perror("Error storing LFS object");
+	} else {
+		metrics_add(metric_lfs_objects_ok, 1);
+		metrics_add(metric_lfs_bytes, d->got);
+		return 0;
+	}
+	remove(d->tmp);
+	metrics_add(metric_lfs_objects_failed, 1);
+	return -1;
+}
+
+/**
+ * Downloads objects, a number of them at once.
+ * @param acts Downloads the batch response gave
+ * @param n Number of downloads
+ * @param jobs Downloads at once
+ * @param store Path of the store
+ * @param deferred Incremented for every object left to another mirror
+ * @return Number of objects that failed to download
+ */
+static size_t run_downloads(const struct lfs_action *acts, size_t n,
+			    int jobs, const char *store, size_t *deferred)
+{
+	struct download *ds = gcalloc(n, sizeof(*ds));
+	CURLM *multi = curl_multi_init();
+	if (!ds || !multi) {
+		gfree(ds);
+		if (multi)
+			curl_multi_cleanup(multi);
+		return n;
+	}
+	for (size_t i = 0; i < n; i++)
+		ds[i].act = &acts[i];
+	curl_multi_setopt(multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, (long) jobs);
+	curl_multi_setopt(multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+
+	size_t next = 0, failed = 0;
+	int active = 0;
+	while (next < n || active > 0) {
+		// Nothing new once a shutdown was requested
+		while (active < jobs && next < n && !shutdown_requested()) {
+			struct download *d = &ds[next++];
+			if (!claim(d->act->obj.oid)) {
+				(*deferred)++;
+				continue;
+			}
+			if (start_download(multi, d, store) < 0) {
+				release(d->act->obj.oid);
+				failed++;
+				continue;
+			}
+			active++;
+		}
+		if (shutdown_requested()) {
+			*deferred += n - next;
+			next = n;
+		}
+		if (!active)
+			break;
+
+		int running;
+		curl_multi_perform(multi, &running);
+		CURLMsg *msg;
+		int left;
+		while ((msg = curl_multi_info_read(multi, &left))) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			struct download *d;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE,
+					  (char **) &d);
+			const CURLcode res = msg->data.result;
+			curl_multi_remove_handle(multi, d->curl);
+			if (finish_download(d, res, store) < 0)
+				failed++;
+			release(d->act->obj.oid);
+			curl_easy_cleanup(d->curl);
+			d->curl = NULL;
+			active--;
+		}
+		// Transfers in flight are abandoned once the grace period ends
+		if (shutdown_expired())
+			break;
+		if (running)
+			curl_multi_wait(multi, NULL, 0, 1000, NULL);
+	}
+
+	// Left over after an abandoned shutdown
+	for (size_t i = 0; i < next; i++) {
+		if (!ds[i].curl)
+			continue;
+		curl_multi_remove_handle(multi, ds[i].curl);
+		release(ds[i].act->obj.oid);
+		metrics_add(metric_lfs_objects_failed, 1);
+		failed++;
+	}
+	curl_multi_cleanup(multi);
+	for (size_t i = 0; i < n; i++)
+		download_free(&ds[i]);
+	gfree(ds);
+	return failed;
+}
+
+/**
+ * Finds the store in the git base, by its absolute path, so that mirrors can
+ * be pointed at it.
+ * @return 0 on success, -1 on error
+ */
+static int store_path(const char *git_base, char *buf, size_t len)
+{
+	char base[PATH_MAX];
+	if (!realpath(git_base, base)) {
+		perror("realpath");
+		return -1;
+	}
+	const size_t base_len = strlen(base);
+	if (base_len + sizeof("/" LFS_STORE_DIR) > len) {
+		fprintf(stderr, "Error: path of LFS store is too long\n");
+		return -1;
+	}
+	memcpy(buf, base, base_len);
+	memcpy(buf + base_len, "/" LFS_STORE_DIR, sizeof("/" LFS_STORE_DIR));
+	return 0;
+}
+
+int lfs_fetch(const char *path, const struct repo_ctx *ctx, int changed,
+	      int quiet)
+{
+	const struct lfs_cfg *cfg = ctx->lfs;
+	if (!cfg || !cfg->enabled || shutdown_requested())
+		return 0;
+
+	char done[PATH_MAX];
+	snprintf(done, sizeof(done), "%s/%s", path, DONE_FILE);
+	if (!changed && access(done, F_OK) == 0)
+		return 0;
+	remove(done);
+
+	const long long start = timing_now();
+	pthread_once(&pool.once, init_pool);
+	struct object_list objs = {0};
+	// Leaves room for the paths of objects in the store
+	char store[PATH_MAX - 128], url[4096];
+	int ret = -1, complete = 0;
+	if (store_path(ctx->git_base, store, sizeof(store)) < 0 ||
+	    scan_pointers(path, &objs) < 0)
+		goto end;
+	if (objs.len && set_storage(path, store) < 0)
+		fprintf(stderr, "Error: failed to set lfs.storage\n");
+	drop_present(&objs, store);
+	if (!objs.len) {
+		ret = 0;
+		complete = 1;
+		goto end;
+	}
+	if (batch_url(path, ctx->url, url, sizeof(url)) < 0) {
+		fprintf(stderr, "Error: no LFS endpoint for %s\n", ctx->url);
+		goto end;
+	}
+
+	if (!quiet)
+		printf("Fetching %zu LFS objects...\n", objs.len);
+	size_t failed = 0, deferred = 0;
+	for (size_t i = 0; i < objs.len && !shutdown_requested();
+	     i += BATCH_SIZE) {
+		// Actions expire, so each batch is downloaded before the next
+		const size_t n = objs.len - i < BATCH_SIZE ? objs.len - i
+							   : BATCH_SIZE;
+		buffer_t resp = buffer_new(16384);
+		struct lfs_action *acts = NULL;
+		size_t acts_len = 0, missing = 0;
+		if (request_batch(url, ctx, objs.items + i, n, &resp) < 0 ||
+		    lfs_parse_batch(&resp, &acts, &acts_len, &missing) < 0) {
+			buffer_free(resp);
+			failed += n;
+			continue;
+		}
+		buffer_free(resp);
+		// Objects left out of the response are fetched next time
+		failed += n - acts_len - missing;
+		failed += run_downloads(acts, acts_len, cfg->jobs, store,
+					&deferred);
+		for (size_t j = 0; j < acts_len; j++)
+			lfs_action_free(&acts[j]);
+		gfree(acts);
+	}
+	if (failed)
+		fprintf(stderr, "Error: %zu LFS objects failed to download\n",
+			failed);
+	else
+		ret = 0;
+	// The next run scans again for what others were downloading
+	complete = !failed && !deferred && !shutdown_requested();
+
+end:
+	gfree(objs.items);
+	timing_since(phase_lfs, start);
+	if (complete) {
+		const int fd = open(done, O_WRONLY | O_CREAT, 0644);
+		if (fd >= 0)
+			close(fd);
+	}
+	return ret;
+}
+
+void lfs_cleanup(void)
+{
+	if (pool.share)
+		curl_share_cleanup(pool.share);
+	pool.share = NULL;
+	gfree(pool.claimed);
+	pool.claimed = NULL;
+	pool.claimed_len = pool.claimed_cap = 0;
+}
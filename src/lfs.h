@@ -0,0 +1,38 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef LFS_H
+#define LFS_H
+
+#include "git.h"
+
+/// Directory in the git base that LFS objects of all mirrors are stored in
+#define LFS_STORE_DIR ".github-mirror-lfs"
+
+/**
+ * Downloads the LFS objects that pointer files in the mirror refer to and the
+ * shared store lacks, using the LFS batch API of the upstream. Objects are
+ * stored once by their SHA-256 in LFS_STORE_DIR, which the mirror's
+ * lfs.storage is pointed at, and verified before they are stored. Downloads of
+ * all mirrors share DNS and TLS session caches, and an object another mirror
+ * is downloading at the same time is left to it.
+ *
+ * A mirror whose refs did not change is only scanned again if a previous scan
+ * left objects missing. Must only be called once the fetch of the repository
+ * has finished.
+ * @param path Full path to the git repository
+ * @param ctx Context containing the repository information
+ * @param changed Whether the fetch changed any refs
+ * @param quiet Suppress output if non-zero
+ * @return 0 on success or if skipped, -1 on error
+ */
+int lfs_fetch(const char *path, const struct repo_ctx *ctx, int changed,
+	      int quiet);
+
+/**
+ * Frees the caches shared by LFS downloads. Call once all mirrors are done.
+ */
+void lfs_cleanup(void);
+
+#endif // LFS_H
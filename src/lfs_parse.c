@@ -0,0 +1,291 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_client
+
+#include "lfs_parse.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+#include "json.h"
+
+#define HEX_DIGITS "0123456789abcdef"
+
+int lfs_parse_pointer(const char *data, size_t len, struct lfs_object *obj)
+{
+	const size_t version_len = strlen(LFS_POINTER_VERSION);
+	if (len < version_len || len >= LFS_POINTER_MAX ||
+	    memcmp(data, LFS_POINTER_VERSION, version_len) != 0)
+		return 0;
+	char text[LFS_POINTER_MAX];
+	memcpy(text, data, len);
+	text[len] = '\0';
+
+	const char *oid = strstr(text, "\noid sha256:");
+	const char *size = strstr(text, "\nsize ");
+	if (!oid || !size)
+		return 0;
+	oid += strlen("\noid sha256:");
+	size += strlen("\nsize ");
+	if (strspn(oid, HEX_DIGITS) != SHA256_HEX_LEN ||
+	    oid[SHA256_HEX_LEN] != '\n')
+		return 0;
+	// strtoll would also take whitespace and signs
+	if (*size < '0' || *size > '9')
+		return 0;
+	char *end;
+	errno = 0;
+	const long long n = strtoll(size, &end, 10);
+	if (errno || *end != '\n')
+		return 0;
+
+	memcpy(obj->oid, oid, SHA256_HEX_LEN);
+	obj->oid[SHA256_HEX_LEN] = '\0';
+	obj->size = n;
+	return 1;
+}
+
+/**
+ * Writes a URL and a suffix, without the slashes the URL ends in.
+ * @return 0 on success, -1 if it doesn't fit
+ */
+static int join_url(char *buf, size_t len, const char *url, size_t url_len,
+		    const char *suffix)
+{
+	while (url_len && url[url_len - 1] == '/')
+		url_len--;
+	const int n = snprintf(buf, len, "%.*s%s", (int) url_len, url, suffix);
+	return n < 0 || (size_t) n >= len ? -1 : 0;
+}
+
+int lfs_batch_url(const char *lfs_url, const char *url, char *buf, size_t len)
+{
+	if (lfs_url && lfs_url[0])
+		return join_url(buf, len, lfs_url, strlen(lfs_url),
+				"/objects/batch");
+
+	char base[2048];
+	const char *https = "https://", *ssh = "ssh://";
+	if (!strncmp(url, https, strlen(https))) {
+		snprintf(base, sizeof(base), "%s", url);
+	} else if (!strncmp(url, ssh, strlen(ssh))) {
+		// ssh://[user@]host[:port]/path
+		const char *host = url + strlen(ssh);
+		const char *slash = strchr(host, '/');
+		if (!slash)
+			return -1;
+		const char *at = memchr(host, '@', slash - host);
+		if (at)
+			host = at + 1;
+		const size_t host_len = strcspn(host, ":/");
+		snprintf(base, sizeof(base), "https://%.*s%s", (int) host_len,
+			 host, slash);
+	} else {
+		return -1;
+	}
+
+	size_t base_len = strlen(base);
+	while (base_len && base[base_len - 1] == '/')
+		base_len--;
+	const int dot_git =
+			base_len >= 4 && !memcmp(base + base_len - 4, ".git", 4);
+	return join_url(buf, len, base, base_len,
+			dot_git ? "/info/lfs/objects/batch"
+				: ".git/info/lfs/objects/batch");
+}
+
+#define KEY_IS(key, len, lit)                                                  \
+	((len) == sizeof(lit) - 1 && !memcmp((key), (lit), sizeof(lit) - 1))
+
+/**
+ * Reads the download action of an object in a batch response.
+ * @return 0 on success, -1 on error
+ */
+static int parse_action(struct json_reader *r, struct lfs_action *act)
+{
+	const char *key;
+	size_t len;
+	uint32_t hash;
+	int more;
+	if (json_object_begin(r) != 1)
+		return -1;
+	while ((more = json_object_next(r, &key, &len, &hash)) == 1) {
+		if (KEY_IS(key, len, "href")) {
+			gfree(act->href);
+			act->href = NULL;
+			if (json_read_string(r, &act->href) < 0)
+				return -1;
+		} else if (KEY_IS(key, len, "header")) {
+			if (json_object_begin(r) < 0)
+				return -1;
+			while ((more = json_object_next(r, &key, &len,
+							&hash)) == 1) {
+				char *value;
+				if (json_read_string(r, &value) != 1)
+					return -1;
+				char line[4096];
+				snprintf(line, sizeof(line), "%.*s: %s",
+					 (int) len, key, value);
+				gfree(value);
+				act->headers = curl_slist_append(act->headers,
+								 line);
+			}
+			if (more < 0)
+				return -1;
+		} else if (json_skip(r) < 0) {
+			return -1;
+		}
+	}
+	return more;
+}
+
+/**
+ * Reads one object of a batch response.
+ * @param r Reader at the object
+ * @param act Set to the download of the object, with href NULL if it has none
+ * @param missing Set if the upstream lacks the object
+ * @return 0 on success, -1 on error
+ */
+static int parse_object(struct json_reader *r, struct lfs_action *act,
+			int *missing)
+{
+	const char *key;
+	size_t len;
+	uint32_t hash;
+	int more;
+	if (json_object_begin(r) != 1)
+		return -1;
+	while ((more = json_object_next(r, &key, &len, &hash)) == 1) {
+		if (KEY_IS(key, len, "oid")) {
+			char *oid;
+			if (json_read_string(r, &oid) != 1)
+				return -1;
+			// Longer ones aren't cut down to something valid
+			if (strlen(oid) < sizeof(act->obj.oid))
+				strcpy(act->obj.oid, oid);
+			else
+				act->obj.oid[0] = '\0';
+			gfree(oid);
+		} else if (KEY_IS(key, len, "size")) {
+			if (json_read_int(r, &act->obj.size) != 1)
+				return -1;
+		} else if (KEY_IS(key, len, "actions")) {
+			if (json_object_begin(r) != 1)
+				return -1;
+			while ((more = json_object_next(r, &key, &len,
+							&hash)) == 1) {
+				if (KEY_IS(key, len, "download")
+					    ? parse_action(r, act) < 0
+					    : json_skip(r) < 0)
+					return -1;
+			}
+			if (more < 0)
+				return -1;
+		} else if (KEY_IS(key, len, "error")) {
+			if (json_object_begin(r) != 1)
+				return -1;
+			while ((more = json_object_next(r, &key, &len,
+							&hash)) == 1) {
+				long long code;
+				if (!KEY_IS(key, len, "code")) {
+					if (json_skip(r) < 0)
+						return -1;
+				} else if (json_read_int(r, &code) != 1) {
+					return -1;
+				} else {
+					// Gone for good, not worth rescanning
+					*missing = code == 404 || code == 410;
+				}
+			}
+			if (more < 0)
+				return -1;
+		} else if (json_skip(r) < 0) {
+			return -1;
+		}
+	}
+	return more;
+}
+
+void lfs_action_free(struct lfs_action *act)
+{
+	curl_slist_free_all(act->headers);
+	gfree(act->href);
+}
+
+int lfs_parse_batch(const buffer_t *resp, struct lfs_action **out,
+		    size_t *out_len, size_t *missing)
+{
+	struct json_reader r;
+	json_reader_init(&r, (const char *) resp->data, resp->len - 1);
+	struct lfs_action *acts = NULL;
+	size_t len = 0, cap = 0;
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	int more;
+
+	*missing = 0;
+	if (json_object_begin(&r) != 1)
+		goto err;
+	while ((more = json_object_next(&r, &key, &key_len, &hash)) == 1) {
+		if (!KEY_IS(key, key_len, "objects")) {
+			if (json_skip(&r) < 0)
+				goto err;
+			continue;
+		}
+		if (json_array_begin(&r) < 0)
+			goto err;
+		while ((more = json_array_next(&r)) == 1) {
+			if (len == cap) {
+				cap = cap ? cap * 2 : 16;
+				void *grown = grealloc(acts,
+						       sizeof(*acts) * cap);
+				if (!grown) {
+					perror("realloc");
+					goto err;
+				}
+				acts = grown;
+			}
+			struct lfs_action *act = &acts[len++];
+			*act = (struct lfs_action) {0};
+			int gone = 0;
+			if (parse_object(&r, act, &gone) < 0)
+				goto err;
+			if (gone) {
+				fprintf(stderr,
+					"Warning: LFS object missing "
+					"upstream: %s\n",
+					act->obj.oid);
+				(*missing)++;
+			}
+			if (gone || !act->href ||
+			    strlen(act->obj.oid) != SHA256_HEX_LEN ||
+			    strspn(act->obj.oid, HEX_DIGITS) !=
+					    SHA256_HEX_LEN) {
+				lfs_action_free(act);
+				len--;
+			}
+		}
+		if (more < 0)
+			goto err;
+	}
+	if (more < 0)
+		goto err;
+
+	*out = acts;
+	*out_len = len;
+	return 0;
+
+err:
+	fprintf(stderr, "Error: invalid LFS batch response\n");
+	for (size_t i = 0; i < len; i++)
+		lfs_action_free(&acts[i]);
+	gfree(acts);
+	return -1;
+}
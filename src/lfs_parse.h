@@ -0,0 +1,78 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef LFS_PARSE_H
+#define LFS_PARSE_H
+
+#include <stddef.h>
+
+#include <curl/curl.h>
+
+#include "buffer.h"
+#include "sha256.h"
+
+/// Pointer files are smaller than this, per the LFS specification
+#define LFS_POINTER_MAX 1024
+/// First line of a pointer file
+#define LFS_POINTER_VERSION "version https://git-lfs.github.com/spec/v1\n"
+
+/// Object a pointer file refers to
+struct lfs_object {
+	/// SHA-256 of the object in lowercase hex
+	char oid[SHA256_HEX_LEN + 1];
+	long long size;
+};
+
+/// Download of an object, as given by a batch response
+struct lfs_action {
+	struct lfs_object obj;
+	/// URL to download the object from
+	char *href;
+	/// Headers to send with the download
+	struct curl_slist *headers;
+};
+
+/**
+ * Reads an LFS pointer file. Only pointers as git-lfs writes them are
+ * accepted: the version line first, a lowercase SHA-256 oid, a size of
+ * decimal digits, and every line ending in a line feed.
+ * @param data Contents of the file
+ * @param len Length of the contents
+ * @param obj Set to the object the file points to
+ * @return 1 if the file is a pointer, 0 if not
+ */
+int lfs_parse_pointer(const char *data, size_t len, struct lfs_object *obj);
+
+/**
+ * Finds the batch endpoint of a repository: lfs.url if it is set, as git-lfs
+ * does, or else the upstream's URL followed by .git/info/lfs. The endpoint of
+ * ssh upstreams is served over HTTPS by the same host, on the default port.
+ * @param lfs_url lfs.url of the repository, or NULL or empty if unset
+ * @param url URL of the upstream
+ * @param buf Buffer to write the URL of the endpoint to
+ * @param len Size of the buffer
+ * @return 0 on success, -1 if the upstream has no endpoint or it doesn't fit
+ */
+int lfs_batch_url(const char *lfs_url, const char *url, char *buf, size_t len);
+
+/**
+ * Reads a download batch response. Objects the upstream reports as gone (404
+ * or 410) are counted as missing, and those without a download URL or a
+ * valid oid are left out.
+ * @param resp NUL-terminated response
+ * @param out Set to the downloads, to free with lfs_action_free() and gfree()
+ * @param out_len Set to the number of downloads
+ * @param missing Set to the number of objects the upstream lacks
+ * @return 0 on success, -1 on error
+ */
+int lfs_parse_batch(const buffer_t *resp, struct lfs_action **out,
+		    size_t *out_len, size_t *missing);
+
+/**
+ * Frees the URL and headers of a download.
+ * @param act Download
+ */
+void lfs_action_free(struct lfs_action *act);
+
+#endif // LFS_PARSE_H
@@ -0,0 +1,418 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_git
+
+#include "libgit2.h"
+
+#include <git2.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "alloc.h"
+#include "changes.h"
+#include "lfs.h"
+#include "maintenance.h"
+#include "proxy.h"
+#include "refspec.h"
+#include "scan.h"
+#include "shutdown.h"
+#include "timing.h"
+
+/// Refspec of mirrors that track every ref, as set by git clone --mirror
+#define MIRROR_REFSPEC "+refs/*:refs/*"
+/// Credential requests before giving up, libgit2 asks again on rejection
+#define MAX_CRED_ATTEMPTS 3
+
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static void init_libgit2(void) { git_libgit2_init(); }
+
+struct fetch_state {
+	const struct repo_ctx *ctx;
+	int cred_attempts;
+	/// Change lines of the updated refs
+	buffer_t *changes;
+};
+
+static void print_error(const char *what)
+{
+	const git_error *err = git_error_last();
+	fprintf(stderr, "Error: libgit2 %s failed: %s\n", what,
+		err && err->message ? err->message : "unknown error");
+}
+
+static int acquire_cred(git_credential **out, const char *url,
+			const char *username_from_url,
+			unsigned int allowed_types, void *payload)
+{
+	struct fetch_state *st = payload;
+	if (++st->cred_attempts > MAX_CRED_ATTEMPTS) {
+		fprintf(stderr, "Error: authentication failed for %s\n", url);
+		return -1;
+	}
+
+	const char *user = username_from_url ? username_from_url : "git";
+	if (allowed_types & GIT_CREDENTIAL_USERPASS_PLAINTEXT)
+		return git_credential_userpass_plaintext_new(
+				out, st->ctx->username, st->ctx->token);
+	if (allowed_types & GIT_CREDENTIAL_SSH_KEY)
+		return git_credential_ssh_key_from_agent(out, user);
+	if (allowed_types & GIT_CREDENTIAL_USERNAME)
+		return git_credential_username_new(out, user);
+	return GIT_PASSTHROUGH;
+}
+
+/// Aborts the transfer once the shutdown grace period is over
+static int transfer_progress(const git_indexer_progress *stats, void *payload)
+{
+	(void) stats;
+	(void) payload;
+	return shutdown_expired() ? -1 : 0;
+}
+
+/**
+ * Checks if the git repository at the specified path is a mirror.
+ * @param path Path to the git repository
+ * @return 1 if the repository is a mirror, 0 if not
+ */
+static int contains_mirror(const char *path)
+{
+	const int known = scan_check_mirror(path);
+	if (known >= 0)
+		return known;
+
+	git_repository *repo = NULL;
+	git_config *cfg = NULL;
+	int mirror = 0;
+
+	if (git_repository_open_bare(&repo, path) == 0 &&
+	    git_repository_config_snapshot(&cfg, repo) == 0 &&
+	    git_config_get_bool(&mirror, cfg, "remote.origin.mirror") != 0)
+		mirror = 0;
+
+	git_config_free(cfg);
+	git_repository_free(repo);
+	return mirror;
+}
+
+/// Appends a change line of a ref
+static void append_change(buffer_t *changes, const char *refname,
+			  const git_oid *a, const git_oid *b)
+{
+	// Large enough for SHA-256 object IDs
+	char old[65], new[65];
+	git_oid_tostr(old, sizeof(old), a);
+	git_oid_tostr(new, sizeof(new), b);
+
+	buffer_append(changes, old, strlen(old));
+	buffer_append(changes, " ", 1);
+	buffer_append(changes, new, strlen(new));
+	buffer_append(changes, " ", 1);
+	buffer_append(changes, refname, strlen(refname));
+	buffer_append(changes, "\n", 1);
+}
+
+/// Records a ref the fetch created, updated or pruned
+static int update_tips(const char *refname, const git_oid *a, const git_oid *b,
+		       void *payload)
+{
+	struct fetch_state *st = payload;
+	append_change(st->changes, refname, a, b);
+	return 0;
+}
+
+/**
+ * Fetches all refs of the origin remote, pruning refs deleted upstream.
+ * @param repo Repository to fetch into
+ * @param ctx Context containing the repository information
+ * @param set_head Non-zero to point HEAD at the remote's default branch
+ * @param quiet Suppress output if non-zero
+ * @param changes Buffer to append the changed refs to, as change lines
+ * @return 0 on success, -2 on a network error, -1 on other errors
+ */
+static int fetch_mirror(git_repository *repo, const struct repo_ctx *ctx,
+			int set_head, int quiet, buffer_t *changes)
+{
+	git_remote *remote = NULL;
+	int ret = -1;
+
+	struct fetch_state st = {.ctx = ctx, .changes = changes};
+	git_fetch_options opts;
+	git_fetch_options_init(&opts, GIT_FETCH_OPTIONS_VERSION);
+	opts.callbacks.credentials = acquire_cred;
+	opts.callbacks.transfer_progress = transfer_progress;
+	opts.callbacks.update_tips = update_tips;
+	opts.callbacks.payload = &st;
+	opts.prune = GIT_FETCH_PRUNE;
+	// Over any proxy of the git config, which would skip the bandwidth limit
+	opts.proxy_opts.url = proxy_url();
+	opts.proxy_opts.type = opts.proxy_opts.url ? GIT_PROXY_SPECIFIED
+						   : GIT_PROXY_AUTO;
+
+	if (git_remote_lookup(&remote, repo, "origin") != 0) {
+		print_error("remote lookup");
+		goto end;
+	}
+	if (git_remote_fetch(remote, NULL, &opts, "fetch") != 0) {
+		print_error("fetch");
+		const git_error *err = git_error_last();
+		if (err && (err->klass == GIT_ERROR_NET ||
+			    err->klass == GIT_ERROR_HTTP ||
+			    err->klass == GIT_ERROR_SSH))
+			ret = -2;
+		goto end;
+	}
+
+	if (!quiet) {
+		const git_indexer_progress *stats = git_remote_stats(remote);
+		printf("Received %u objects (%zu bytes)\n",
+		       stats->received_objects, stats->received_bytes);
+	}
+
+	// The advertised refs stay available after the fetch. An empty
+	// upstream has no default branch, which is fine.
+	if (set_head) {
+		git_buf head = {0};
+		if (git_remote_default_branch(&head, remote) == 0 &&
+		    git_repository_set_head(repo, head.ptr) != 0)
+			print_error("set HEAD");
+		git_buf_dispose(&head);
+	}
+	ret = 0;
+
+end:
+	git_remote_free(remote);
+	return ret;
+}
+
+/**
+ * Switches an existing mirror to the given refspecs and deletes the refs they
+ * don't fetch, as the CLI backend does.
+ * @param repo Repository of the mirror
+ * @param refspecs NULL-terminated refspecs
+ * @param quiet Suppress output if non-zero
+ * @param changes Buffer to append the deleted refs to, as change lines
+ * @return 0 on success, -1 on error
+ */
+static int migrate_refspecs(git_repository *repo,
+			    const char *const *refspecs, int quiet,
+			    buffer_t *changes)
+{
+	git_config *cfg = NULL;
+	git_strarray names = {0};
+	int ret = -1;
+
+	if (!quiet)
+		printf("Switching mirror to new refspecs\n");
+	if (git_repository_config(&cfg, repo) != 0) {
+		print_error("config");
+		goto end;
+	}
+	const int err = git_config_delete_multivar(cfg, "remote.origin.fetch",
+						   ".*");
+	if (err != 0 && err != GIT_ENOTFOUND) {
+		print_error("remove refspecs");
+		goto end;
+	}
+	for (size_t i = 0; refspecs[i]; i++) {
+		if (git_remote_add_fetch(repo, "origin", refspecs[i]) != 0) {
+			print_error("add refspec");
+			goto end;
+		}
+	}
+
+	if (git_reference_list(&names, repo) != 0) {
+		print_error("list refs");
+		goto end;
+	}
+	size_t pruned = 0;
+	for (size_t i = 0; i < names.count; i++) {
+		git_reference *ref = NULL;
+		if (refspec_wants(refspecs, names.strings[i]) ||
+		    git_reference_lookup(&ref, repo, names.strings[i]) != 0)
+			continue;
+		if (git_reference_type(ref) == GIT_REFERENCE_DIRECT) {
+			const git_oid *old = git_reference_target(ref);
+			git_oid zero;
+			memset(&zero, 0, sizeof(zero));
+			append_change(changes, names.strings[i], old, &zero);
+		}
+		const int deleted = git_reference_delete(ref) == 0;
+		git_reference_free(ref);
+		if (!deleted) {
+			print_error("delete ref");
+			goto end;
+		}
+		pruned++;
+	}
+	if (pruned && !quiet)
+		printf("Pruned %zu refs\n", pruned);
+	ret = 0;
+
+end:
+	git_strarray_dispose(&names);
+	git_config_free(cfg);
+	return ret;
+}
+
+/**
+ * Updates the existing mirror at the given path.
+ * @return 0 on success, -2 on a network error, -1 on other errors
+ */
+static int update_mirror(const char *path, const struct repo_ctx *ctx,
+			 int quiet, buffer_t *changes)
+{
+	git_repository *repo = NULL;
+	int ret = -1;
+
+	if (git_repository_open_bare(&repo, path) != 0) {
+		print_error("open");
+		goto end;
+	}
+	// Credentials are passed per fetch, so the URL doesn't carry them
+	const long long start = timing_now();
+	if (git_remote_set_url(repo, "origin", ctx->url) != 0) {
+		print_error("set URL");
+		goto end;
+	}
+	timing_since(phase_url, start);
+	// Mirrors follow changes of the ref policy
+	if (ctx->migrate_refspecs &&
+	    !scan_has_refspecs(path, ctx->migrate_refspecs) &&
+	    migrate_refspecs(repo, ctx->migrate_refspecs, quiet, changes) != 0)
+		goto end;
+	ret = fetch_mirror(repo, ctx, 0, quiet, changes);
+
+end:
+	git_repository_free(repo);
+	return ret;
+}
+
+/**
+ * Creates a new mirror at the given path, like git clone --mirror.
+ * @return 0 on success, -2 on a network error, -1 on other errors
+ */
+static int create_mirror(const char *path, const struct repo_ctx *ctx,
+			 int quiet, buffer_t *changes)
+{
+	git_repository *repo = NULL;
+	git_remote *remote = NULL;
+	git_config *cfg = NULL;
+	int ret = -1;
+
+	if (git_repository_init(&repo, path, 1) != 0) {
+		print_error("init");
+		goto end;
+	}
+
+	const char *const *specs = ctx->refspecs;
+	if (git_remote_create_with_fetchspec(&remote, repo, "origin", ctx->url,
+					     specs ? specs[0]
+						   : MIRROR_REFSPEC) != 0) {
+		print_error("remote create");
+		goto end;
+	}
+	for (size_t i = 1; specs && specs[i]; i++) {
+		if (git_remote_add_fetch(repo, "origin", specs[i]) != 0) {
+			print_error("add refspec");
+			goto end;
+		}
+	}
+
+	// Marked as a mirror before the first fetch, so that an interrupted
+	// clone is resumed by the next update
+	if (git_repository_config(&cfg, repo) != 0 ||
+	    git_config_set_bool(cfg, "remote.origin.mirror", 1) != 0) {
+		print_error("config");
+		goto end;
+	}
+
+	ret = fetch_mirror(repo, ctx, 1, quiet, changes);
+
+end:
+	git_config_free(cfg);
+	git_remote_free(remote);
+	git_repository_free(repo);
+	return ret;
+}
+
+/**
+ * Checks whether creating the mirror needs features libgit2 lacks.
+ * @return 1 if the mirror must be created with the git command line tool
+ */
+static int needs_cli(const struct repo_ctx *ctx)
+{
+	return ctx->filter || ctx->parent ||
+	       (ctx->bundle && (ctx->bundle->dir || ctx->bundle->uri));
+}
+
+int libgit2_mirror_repo(const struct repo_ctx *ctx, int quiet)
+{
+	pthread_once(&init_once, init_libgit2);
+
+	char *path = get_git_path(ctx->git_base, ctx->owner, ctx->name);
+	if (!path) {
+		perror("get_git_path");
+		return -1;
+	}
+
+	if (!contains_mirror(path) && needs_cli(ctx)) {
+		gfree(path);
+		struct repo_ctx cli = *ctx;
+		cli.backend = git_backend_cli;
+		return git_mirror_repo(&cli, quiet);
+	}
+
+	const int lock = git_lock_mirror(ctx, path);
+	if (lock == -2) {
+		fprintf(stderr, "Mirror is locked by another run, skipping: %s\n",
+			path);
+		gfree(path);
+		return 1;
+	}
+	if (lock == -1) {
+		perror("git_lock_mirror");
+		gfree(path);
+		return -1;
+	}
+
+	buffer_t changes = buffer_new(256);
+	int ret;
+	long long start = timing_now();
+	const int exists = contains_mirror(path);
+	timing_since(phase_exists, start);
+	start = timing_now();
+	if (exists) {
+		if (!quiet)
+			printf("Repo already exists, updating...\n");
+		ret = update_mirror(path, ctx, quiet, &changes);
+		timing_since(phase_fetch, start);
+		// Maintenance failures don't fail the repo, as with the CLI
+		if (ret == 0 && !shutdown_requested() &&
+		    maintenance_run(path, ctx->maint, quiet) == -1)
+			fprintf(stderr, "Error: maintenance failed\n");
+	} else {
+		if (!quiet)
+			printf("Repo does not exist, cloning...\n");
+		ret = create_mirror(path, ctx, quiet, &changes);
+		timing_since(phase_clone, start);
+		if (ret == 0)
+			scan_set(path, scan_mirror);
+	}
+	if (ret == 0 &&
+	    changes_record(ctx->owner, ctx->name, path, &changes) == -1)
+		ret = -1;
+	// Missing LFS objects leave the mirror usable, the next run retries
+	if (ret == 0 && lfs_fetch(path, ctx, changes.len > 0, quiet) == -1)
+		fprintf(stderr, "Error: LFS fetch failed\n");
+	buffer_free(changes);
+
+	close(lock);
+	gfree(path);
+	return ret;
+}
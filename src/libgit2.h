@@ -0,0 +1,24 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef LIBGIT2_H
+#define LIBGIT2_H
+
+#include "git.h"
+
+/**
+ * Creates or updates the mirror of a repository in-process with libgit2.
+ * Behaves like git_mirror_repo(): the mirror is locked for the duration and
+ * skipped if another process holds its lock. New mirrors that need a partial
+ * clone filter, a bundle or objects from a parent are created with the git
+ * command line tool instead, since libgit2 doesn't support those.
+ * Thread-safe.
+ * @param ctx Context containing the repository information
+ * @param quiet Suppress output if non-zero
+ * @return 0 on success, 1 if the mirror was skipped because it is locked,
+ * -2 if the transfer failed and may succeed when retried, -1 on error
+ */
+int libgit2_mirror_repo(const struct repo_ctx *ctx, int quiet);
+
+#endif // LIBGIT2_H
@@ -1,33 +1,118 @@
+#include <errno.h>
 #include <getopt.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/resource.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <curl/curl.h>
 
+#include "alloc.h"
+#ifdef ALLOC_STATS
+#include "alloc_stats.h"
+#endif
+#include "bwlimit.h"
+#include "changes.h"
+#include "checkpoint.h"
 #include "client.h"
 #include "config.h"
+#include "filter.h"
 #include "git.h"
 #include "github/client.h"
 #include "github/types.h"
+#include "lfs.h"
+#include "metrics.h"
+#include "page_cache.h"
 #include "precheck.h"
+#include "profile.h"
+#include "proxy.h"
+#include "refspec.h"
+#include "scan.h"
+#include "sched.h"
+#include "shard.h"
+#include "shutdown.h"
 #include "srht/client.h"
 #include "srht/types.h"
+#include "sshmux.h"
+#include "state.h"
+#include "status.h"
+#include "summary.h"
+#include "timing.h"
+
+/**
+ * Parses a shard specification of the form "i/N", with i between 1 and N.
+ * @param spec Shard specification
+ * @param shard Set to the 0-based shard index
+ * @param shards Set to the total number of shards
+ * @return 0 on success, -1 on error
+ */
+static int parse_shard(const char *spec, unsigned *shard, unsigned *shards)
+{
+	char *end;
+	errno = 0;
+	const unsigned long i = strtoul(spec, &end, 10);
+	if (errno || end == spec || *end != '/')
+		return -1;
+	const char *n_str = end + 1;
+	const unsigned long n = strtoul(n_str, &end, 10);
+	if (errno || end == n_str || *end != '\0')
+		return -1;
+	if (i < 1 || n > 65536 || i > n)
+		return -1;
+	*shard = (unsigned) i - 1;
+	*shards = (unsigned) n;
+	return 0;
+}
+
+/// Prints the memory use of the run to stderr
+static void print_stats(void)
+{
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) == 0) {
+#ifdef __APPLE__
+		const long long rss = ru.ru_maxrss;
+#else
+		const long long rss = (long long) ru.ru_maxrss * 1024;
+#endif
+		fprintf(stderr, "Peak resident memory: %lld bytes\n", rss);
+	}
+#ifdef ALLOC_STATS
+	alloc_stats_print(stderr);
+#else
+	fprintf(stderr, "Allocation counters need a build with ALLOC_STATS\n");
+#endif
+}
 
 static int load_config(int argc, char **argv, struct config **cfg_out)
 {
 	int opt, opt_idx = 0;
 	size_t i;
 	int quiet = 0;
+	int dry_run = 0;
+	unsigned shard = 0, shards = 1;
 	char *cfg_path = NULL;
+	char *metrics_path = NULL;
+	char *timings_path = NULL;
+	long long time_budget = 0;
+	int show_stats = 0;
 
 	static struct option long_options[] = {
 			{"version", no_argument, 0, 'v'},
 			{"config", required_argument, 0, 'c'},
 			{"help", no_argument, 0, 'h'},
 			{"quiet", no_argument, 0, 'q'},
+			{"dry-run", no_argument, 0, 'n'},
+			{"shard", required_argument, 0, 's'},
+			{"metrics", required_argument, 0, 'm'},
+			{"stats", no_argument, 0, 'S'},
+			{"timings", required_argument, 0, 'T'},
+			{"time-budget", required_argument, 0, 'B'},
+			// ssh ProxyCommand used to limit bandwidth, see proxy.h
+			{"relay", required_argument, 0, 'r'},
 			{0, 0, 0, 0}};
 
-	while ((opt = getopt_long(argc, argv, "C:c:h:q:v", long_options,
+	while ((opt = getopt_long(argc, argv, "C:c:h:q:ns:m:v", long_options,
 				  &opt_idx)) != -1) {
 		switch (opt) {
 		case 'C':
@@ -42,6 +127,37 @@ static int load_config(int argc, char **argv, struct config **cfg_out)
 		case 'q':
 			quiet = 1;
 			break;
+		case 'n':
+			dry_run = 1;
+			break;
+		case 's':
+			if (parse_shard(optarg, &shard, &shards) == -1) {
+				fprintf(stderr, "Invalid shard: %s\n", optarg);
+				return 1;
+			}
+			break;
+		case 'm':
+			metrics_path = optarg;
+			break;
+		case 'S':
+			show_stats = 1;
+			break;
+		case 'T':
+			timings_path = optarg;
+			break;
+		case 'B':
+			if (sched_parse_budget(optarg, &time_budget) == -1) {
+				fprintf(stderr, "Invalid time budget: %s\n",
+					optarg);
+				return 1;
+			}
+			break;
+		case 'r':
+			if (optind >= argc) {
+				fprintf(stderr, "Missing relay target\n");
+				return 1;
+			}
+			return proxy_relay(optarg, argv[optind]);
 		case 'v':
 			fprintf(stderr, "github-mirror v%s\n",
 				GITHUB_MIRROR_VERSION);
@@ -50,17 +166,38 @@ static int load_config(int argc, char **argv, struct config **cfg_out)
 			fprintf(stderr, "Unknown option: %c\n", opt);
 			fprintf(stderr,
 				"Usage: %s [--config <file>] [--quiet] "
-				"[--help]\n",
+				"[--dry-run] [--shard <i/N>] "
+				"[--metrics <file>] [--timings <file>] "
+				"[--time-budget <duration>] [--stats] "
+				"[--help] [status]\n",
 				argv[0]);
 			return 1;
 		}
 	}
 
+	// The only command besides mirroring is status
+	int show_status = 0;
+	if (optind < argc) {
+		if (strcmp(argv[optind], "status") != 0 || optind + 1 < argc) {
+			fprintf(stderr, "Unknown command: %s\n", argv[optind]);
+			return 1;
+		}
+		show_status = 1;
+	}
+
 	// Config file given, use it
 	if (cfg_path) {
 		*cfg_out = config_read(cfg_path);
 		if (*cfg_out) {
 			(*cfg_out)->quiet = quiet;
+			(*cfg_out)->dry_run = dry_run;
+			(*cfg_out)->shard = shard;
+			(*cfg_out)->shards = shards;
+			(*cfg_out)->metrics_path = metrics_path;
+			(*cfg_out)->timings_path = timings_path;
+			(*cfg_out)->time_budget = time_budget;
+			(*cfg_out)->show_stats = show_stats;
+			(*cfg_out)->show_status = show_status;
 			return 0;
 		}
 		return 1;
@@ -77,6 +214,14 @@ static int load_config(int argc, char **argv, struct config **cfg_out)
 				fprintf(stderr, "Using config file: %s\n",
 					config_locations[i]);
 			(*cfg_out)->quiet = quiet;
+			(*cfg_out)->dry_run = dry_run;
+			(*cfg_out)->shard = shard;
+			(*cfg_out)->shards = shards;
+			(*cfg_out)->metrics_path = metrics_path;
+			(*cfg_out)->timings_path = timings_path;
+			(*cfg_out)->time_budget = time_budget;
+			(*cfg_out)->show_stats = show_stats;
+			(*cfg_out)->show_status = show_status;
 			return 0;
 		}
 	}
@@ -84,124 +229,403 @@ static int load_config(int argc, char **argv, struct config **cfg_out)
 	return 1;
 }
 
-static int mirror_github(const char *git_base, const struct github_cfg *cfg,
-			 int quiet)
+/**
+ * Checks whether the comma-separated list contains the given name.
+ * @param list Comma-separated list of names, may be NULL
+ * @param name Name to look for
+ * @return 1 if the name is in the list, 0 if not
+ */
+static int list_contains(const char *list, const char *name)
+{
+	const size_t name_len = strlen(name);
+
+	while (list && *list) {
+		while (*list == ' ' || *list == ',')
+			list++;
+		const char *end = strchr(list, ',');
+		if (!end)
+			end = list + strlen(list);
+		const char *item_end = end;
+		while (item_end > list && item_end[-1] == ' ')
+			item_end--;
+		if ((size_t) (item_end - list) == name_len &&
+		    !strncmp(list, name, name_len))
+			return 1;
+		list = end;
+	}
+	return 0;
+}
+
+/**
+ * Checks whether a repository belongs to this node's shard.
+ * @param cfg Global configuration
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @return 1 if this node mirrors the repository, 0 if not
+ */
+static int in_shard(const struct config *cfg, const char *owner,
+		    const char *name)
+{
+	if (cfg->shards <= 1)
+		return 1;
+
+	const unsigned shard = shard_of(shard_key(owner, name), cfg->shards);
+	if (shard == cfg->shard)
+		return 1;
+	if (cfg->dry_run)
+		printf("Skipping repo: %s\t(shard %u/%u)\n", name, shard + 1,
+		       cfg->shards);
+	return 0;
+}
+
+/**
+ * Evaluates the remote's include/exclude rules against a listed repository.
+ * In dry-run mode the decision is always reported.
+ * @param cfg Global configuration
+ * @param filter Compiled rules of the remote
+ * @param repo Attributes of the repository
+ * @return 1 if the repository should be mirrored, 0 if it should be skipped
+ */
+static int filter_repo(const struct config *cfg,
+		       const struct repo_filter *filter,
+		       const struct repo_attrs *repo)
 {
+	const char *reason;
+	const int mirror = filter_eval(filter, repo, time(NULL), &reason);
+
+	if (mirror && !cfg->dry_run)
+		return 1;
+	if (cfg->dry_run || !cfg->quiet) {
+		printf("%s repo: %s", mirror ? "Mirroring" : "Skipping",
+		       repo->name);
+		if (reason)
+			printf("\t(%s %s)", mirror ? "include" : "exclude",
+			       reason);
+		printf("\n");
+	}
+	return mirror;
+}
+
+/**
+ * Queues a mirror job for a single GitHub repository, applying the owner's
+ * partial mirroring policy to it.
+ * @param cfg Global configuration
+ * @param gh GitHub remote configuration
+ * @param sched Job queue
+ * @param login Login of the authenticated user
+ * @param attrs Attributes of the repository
+ * @param url URL to mirror the repository from
+ * @param parent Owner and name of the parent repository, or NULL
+ * @return 0 on success, -1 on error
+ */
+static int queue_github_repo(const struct config *cfg,
+			     const struct github_cfg *gh, struct sched *sched,
+			     const char *login, const struct repo_attrs *attrs,
+			     const char *url, const char *parent)
+{
+	const char *name = attrs->name;
+	const long long disk_usage = attrs->disk_usage;
+	struct repo_ctx repo = {
+			.git_base = cfg->git_base,
+			.owner = gh->owner,
+			.token = gh->token,
+			.name = name,
+			.url = url,
+			.username = login,
+			.pushed_at = attrs->pushed_at,
+			.parent = parent,
+			.maint = &cfg->maint,
+			.lfs = &cfg->lfs,
+			.bundle = &cfg->bundle,
+			.backend = cfg->backend,
+	};
+
+	if (cfg->dry_run)
+		return 0;
+
+	// Existing mirrors are switched to the owner's ref policy too
+	repo.migrate_refspecs = refspec_policy(gh->refs);
+	if (gh->refs != ref_policy_all)
+		repo.refspecs = repo.migrate_refspecs;
+
+	// Huge repositories are mirrored partially
+	if ((gh->partial_size && disk_usage * 1024 >= gh->partial_size) ||
+	    list_contains(gh->partial_repos, name)) {
+		switch (gh->partial_mode) {
+		case partial_mode_filter:
+			repo.filter = gh->partial_filter;
+			break;
+		case partial_mode_refs:
+			// Existing mirrors keep their layout
+			repo.refspecs = refspec_policy(ref_policy_heads_tags);
+			repo.migrate_refspecs = NULL;
+			break;
+		}
+	}
+
+	// Forks sharing objects with their parents start after them
+	return sched_add(sched, &repo, disk_usage, parent != NULL);
+}
+
+/**
+ * Builds the key identifying a remote in the checkpoint journal.
+ * @param buf Buffer to write the key to
+ * @param len Size of the buffer
+ * @param type Type of the remote
+ * @param owner Owner configured for the remote
+ */
+static void remote_key(char *buf, size_t len, const char *type,
+		       const char *owner)
+{
+	snprintf(buf, len, "%s:%s", type, owner);
+}
+
+/**
+ * Checks whether a repository was already mirrored by an interrupted sweep
+ * that this run resumes.
+ * @return 1 if the repository should be skipped, 0 if not
+ */
+static int already_done(const struct config *cfg, const char *owner,
+			const char *name)
+{
+	if (!checkpoint_is_done(owner, name))
+		return 0;
+	if (!cfg->quiet)
+		printf("Skipping repo mirrored earlier in this sweep: %s\n",
+		       name);
+	return 1;
+}
+
+/// Records a repository that could not be queued in the failure summary
+static void queue_failed(const char *owner, const char *name)
+{
+	char what[512];
+	snprintf(what, sizeof(what), "%s/%s", owner, name);
+	fprintf(stderr, "Failed to queue repo: %s\n", what);
+	summary_add(what, "failed to queue");
+}
+
+/**
+ * Lists the repositories of a GitHub owner and queues those to mirror.
+ * A repository that fails to queue doesn't stop the others.
+ * @return 0 on success, 1 if some repositories failed to queue, -1 if listing
+ * failed
+ */
+static int queue_github(const struct config *cfg, const struct github_cfg *gh,
+			struct sched *sched)
+{
+	const int quiet = cfg->quiet;
+
+	char key[256];
+	remote_key(key, sizeof(key), "github", gh->owner);
+	const char *resume;
+	if (checkpoint_resume(key, &resume)) {
+		if (!quiet)
+			printf("Skipping Github owner mirrored earlier in this "
+			       "sweep: %s\n",
+			       gh->owner);
+		return 0;
+	}
+
 	if (!quiet)
-		printf("Mirroring Github owner: %s\n", cfg->owner);
+		printf("Listing Github owner: %s\n", gh->owner);
 
 	const struct gql_ctx ctx = {
-			.endpoint = cfg->endpoint,
-			.token = cfg->token,
-			.user_agent = cfg->user_agent,
+			.endpoint = gh->endpoint,
+			.token = gh->token,
+			.user_agent = gh->user_agent,
+			.retries = cfg->retries,
 	};
 	gql_client *client = gql_client_new(ctx);
 	if (!client) {
 		fprintf(stderr, "Failed to create GitHub client\n");
-		return 1;
+		return -1;
 	}
 
 	// Get identity
+	const long long start = timing_now();
 	char *login = github_identity(client);
+	timing_since(phase_identity, start);
+
+	// The REST API has its own endpoint, and the client is kept apart so
+	// that its host gets its own circuit breaker
+	gql_client *rest = NULL;
+	char cache[4096];
+	snprintf(cache, sizeof(cache), "%s/%s", cfg->git_base, PAGE_CACHE_DIR);
+	const struct gh_rest_ctx rest_ctx = {
+			.endpoint = gh->rest_endpoint,
+			.cache = cfg->dry_run ? NULL : cache,
+			.login = login,
+			.parents = gh->fork_alternates,
+	};
+	if (gh->listing == gh_listing_rest) {
+		struct gql_ctx ctx_rest = ctx;
+		ctx_rest.endpoint = gh->rest_endpoint;
+		rest = gql_client_new(ctx_rest);
+		if (!rest) {
+			fprintf(stderr, "Failed to create GitHub client\n");
+			gfree(login);
+			gql_client_free(client);
+			return -1;
+		}
+	}
 
 	struct gh_list_repos_res res;
-	char *end_cursor = NULL;
-	int status = 0;
+	char *end_cursor = resume ? strdup(resume) : NULL;
+	int status = 0, skipped = 0;
 	do {
-		if (github_list_user_repos(client, cfg->owner, end_cursor,
-					   &res))
-			return -1;
+		if (checkpoint_page(key, end_cursor) == -1 ||
+		    (rest ? github_rest_list_repos(rest, &rest_ctx, gh->owner,
+						   end_cursor, &res)
+			  : github_list_user_repos(client, gh->owner,
+						   end_cursor, &res))) {
+			status = -1;
+			break;
+		}
 
 		for (size_t i = 0; i < res.repos_len; i++) {
-			if (cfg->skip_forks && res.repos[i].is_fork) {
+			if (gh->skip_forks && res.repos[i].is_fork) {
 				if (!quiet)
 					printf("Skipping forked repo: %s\n",
 					       res.repos[i].name);
 				continue;
 			}
-			if (cfg->skip_private && res.repos[i].is_private) {
+			if (gh->skip_private && res.repos[i].is_private) {
 				if (!quiet)
 					printf("Skipping private repo: %s\n",
 					       res.repos[i].name);
 				continue;
 			}
 
-			const char *url = cfg->transport == git_transport_ssh
+			const struct repo_attrs attrs = {
+					.name = res.repos[i].name,
+					.topics = res.repos[i].topics,
+					.topics_len = res.repos[i].topics_len,
+					.language = res.repos[i].language,
+					.archived = res.repos[i].is_archived,
+					.disk_usage = res.repos[i].disk_usage,
+					.pushed_at = res.repos[i].pushed_at,
+			};
+			if (!in_shard(cfg, gh->owner, res.repos[i].name) ||
+			    !filter_repo(cfg, &gh->filter, &attrs) ||
+			    already_done(cfg, gh->owner, res.repos[i].name))
+				continue;
+
+			const char *url = gh->transport == git_transport_ssh
 							  ? res.repos[i].ssh_url
 							  : res.repos[i].url;
+			sshmux_add_url(url);
 
-			if (!quiet)
-				printf("Repo: %s\t%s\n", res.repos[i].name,
-				       url);
+			// Mirror forks after their parents so that they can
+			// share the parent's objects
+			const char *parent = gh->fork_alternates
+							     ? res.repos[i].parent
+							     : NULL;
 
-			const struct repo_ctx repo = {
-					.git_base = git_base,
-					.owner = cfg->owner,
-					.token = cfg->token,
-					.name = res.repos[i].name,
-					.url = url,
-					.username = login,
-			};
-			if (git_mirror_repo(&repo, quiet) != 0) {
-				fprintf(stderr, "Failed to mirror repo\n");
-				status = -1;
-				break;
+			// Carry on with the rest, the next sweep retries it
+			if (queue_github_repo(cfg, gh, sched, login, &attrs,
+					      url, parent) != 0 ||
+			    checkpoint_queue(key, gh->owner,
+					     res.repos[i].name) != 0) {
+				queue_failed(gh->owner, res.repos[i].name);
+				skipped = 1;
 			}
 		}
 
 		free(end_cursor);
-		end_cursor = strdup(res.end_cursor);
+		end_cursor = res.end_cursor ? strdup(res.end_cursor) : NULL;
 
 		gh_list_repos_res_free(res);
-	} while (res.has_next_page);
+	} while (res.has_next_page && !shutdown_requested());
+
+	if (!status && !skipped && !shutdown_requested())
+		checkpoint_listed(key);
 
 	free(end_cursor);
-	free(login);
+	gfree(login);
+	gql_client_free(rest);
 	gql_client_free(client);
-	return status;
+	return status ? status : skipped;
 }
 
-static int mirror_srht(const char *git_base, const struct srht_cfg *cfg,
-		       int quiet)
+/**
+ * Lists the repositories of a sr.ht owner and queues those to mirror.
+ * A repository that fails to queue doesn't stop the others.
+ * @return 0 on success, 1 if some repositories failed to queue, -1 if listing
+ * failed
+ */
+static int queue_srht(const struct config *cfg, const struct srht_cfg *srht,
+		      struct sched *sched)
 {
+	const int quiet = cfg->quiet;
+
+	char key[256];
+	remote_key(key, sizeof(key), "srht", srht->owner);
+	const char *resume;
+	if (checkpoint_resume(key, &resume)) {
+		if (!quiet)
+			printf("Skipping sr.ht owner mirrored earlier in this "
+			       "sweep: %s\n",
+			       srht->owner);
+		return 0;
+	}
+
 	if (!quiet)
-		printf("Mirroring sr.ht owner: %s\n", cfg->owner);
+		printf("Listing sr.ht owner: %s\n", srht->owner);
 
 	const struct gql_ctx ctx = {
-			.endpoint = cfg->endpoint,
-			.token = cfg->token,
-			.user_agent = cfg->user_agent,
+			.endpoint = srht->endpoint,
+			.token = srht->token,
+			.user_agent = srht->user_agent,
+			.retries = cfg->retries,
 	};
 	gql_client *client = gql_client_new(ctx);
 	if (!client) {
 		fprintf(stderr, "Failed to create sr.ht client\n");
-		return 1;
+		return -1;
 	}
 
 	struct srht_list_repos_res res;
-	char *cursor = NULL;
-	int status = 0;
+	char *cursor = resume ? strdup(resume) : NULL;
+	int status = 0, skipped = 0;
 	do {
-		if (srht_list_user_repos(client, cfg->owner, cursor, &res))
-			return -1;
+		if (checkpoint_page(key, cursor) == -1 ||
+		    srht_list_user_repos(client, srht->owner, cursor, &res)) {
+			status = -1;
+			break;
+		}
 
 		for (size_t i = 0; i < res.repos_len; i++) {
-			if (!quiet)
-				printf("Repo: %s\t%s\n", res.repos[i].name,
-				       res.repos[i].url);
+			// SourceHut listings only carry the name
+			const struct repo_attrs attrs = {
+					.name = res.repos[i].name,
+			};
+			if (!in_shard(cfg, res.canonical_name,
+				      res.repos[i].name) ||
+			    !filter_repo(cfg, &srht->filter, &attrs) ||
+			    cfg->dry_run ||
+			    already_done(cfg, res.canonical_name,
+					 res.repos[i].name))
+				continue;
 
 			const struct repo_ctx repo = {
-					.git_base = git_base,
+					.git_base = cfg->git_base,
 					.owner = res.canonical_name,
-					.token = cfg->token,
+					.token = srht->token,
 					.name = res.repos[i].name,
 					.url = res.repos[i].url,
 					.username = res.canonical_name,
+					.maint = &cfg->maint,
+					.lfs = &cfg->lfs,
+					.bundle = &cfg->bundle,
+					.backend = cfg->backend,
 			};
-			if (git_mirror_repo(&repo, quiet) != 0) {
-				fprintf(stderr, "Failed to mirror repo\n");
-				status = -1;
-				break;
+			if (sched_add(sched, &repo, 0, 0) != 0 ||
+			    checkpoint_queue(key, res.canonical_name,
+					     res.repos[i].name) != 0) {
+				queue_failed(res.canonical_name,
+					     res.repos[i].name);
+				skipped = 1;
 			}
 		}
 
@@ -210,56 +634,179 @@ static int mirror_srht(const char *git_base, const struct srht_cfg *cfg,
 			cursor = strdup(res.cursor);
 		}
 		srht_list_repos_res_free(res);
-	} while (res.cursor != NULL);
+	} while (res.cursor != NULL && !shutdown_requested());
+
+	if (!status && !skipped && !shutdown_requested())
+		checkpoint_listed(key);
 
 	free(cursor);
 	gql_client_free(client);
-	return status;
+	return status ? status : skipped;
 }
 
 
 int main(int argc, char **argv)
 {
+	// GIT_SSH_COMMAND sharing ssh connections, see sshmux.h. Handled
+	// before getopt, which would take the options meant for ssh.
+	if (argc >= 2 && !strcmp(argv[1], "--ssh-mux")) {
+		if (argc < 3) {
+			fprintf(stderr, "Missing ssh multiplexing spec\n");
+			return 1;
+		}
+		return sshmux_exec(argv[2], argc - 3, argv + 3);
+	}
+
 	setbuf(stdout, NULL);
 	curl_global_init(CURL_GLOBAL_DEFAULT);
 
 	struct config *cfg = NULL;
+	long long phase_start = timing_now();
 	const int ret = load_config(argc, argv, &cfg);
 	if (ret != 0 || !cfg)
 		return ret;
+	timing_since(phase_config, phase_start);
+
+	if (cfg->show_status) {
+		const int status = status_print(cfg->git_base, cfg->quiet);
+		config_free(cfg);
+		curl_global_cleanup();
+		return status;
+	}
 
+	phase_start = timing_now();
 	if (precheck_self(cfg)) {
 		fprintf(stderr, "Precheck failed\n");
 		config_free(cfg);
 		return 1;
 	}
+	timing_since(phase_precheck, phase_start);
+
+	struct sched *sched = sched_new();
+	if (!sched || state_open(cfg->git_base, cfg->dry_run) < 0) {
+		fprintf(stderr, "Failed to initialize job queue\n");
+		state_close();
+		sched_free(sched);
+		config_free(cfg);
+		return 1;
+	}
+	// Listing the remotes takes from the budget too
+	sched_budget(sched, cfg->time_budget);
+
+	if (!cfg->dry_run && changes_open(cfg->git_base) < 0) {
+		fprintf(stderr, "Failed to open change journal\n");
+		state_close();
+		sched_free(sched);
+		config_free(cfg);
+		return 1;
+	}
 
+	// One pass over the base directory saves running git for every mirror
+	if (!cfg->dry_run && scan_git_base(cfg->git_base, cfg->jobs) < 0)
+		fprintf(stderr, "Failed to scan git base, checking mirrors one "
+				"by one\n");
+	if (!cfg->dry_run && profile_init(&cfg->profile, cfg->jobs) < 0)
+		fprintf(stderr, "Failed to set up cgroup, limiting memory "
+				"of git processes one by one\n");
+
+	const time_t start = time(NULL);
+	shutdown_init(cfg->shutdown_timeout);
+	if (!cfg->dry_run && bwlimit_init(&cfg->bandwidth) &&
+	    proxy_start() < 0) {
+		fprintf(stderr, "Failed to start bandwidth limiter\n");
+		changes_close();
+		state_close();
+		sched_free(sched);
+		config_free(cfg);
+		return 1;
+	}
+	if (!cfg->dry_run && cfg->ssh_multiplex &&
+	    cfg->backend == git_backend_cli) {
+		// Sized so that every job can hold a session at once
+		unsigned masters = cfg->ssh_masters;
+		if (!masters)
+			masters = (cfg->jobs + SSHMUX_SESSIONS - 1) /
+				  SSHMUX_SESSIONS;
+		if (sshmux_init(masters) < 0)
+			fprintf(stderr, "Failed to share SSH connections, "
+					"connecting for every transfer\n");
+	}
+	if (!cfg->dry_run &&
+	    checkpoint_open(cfg->git_base, cfg->shard, cfg->shards) == 1 &&
+	    !cfg->quiet)
+		printf("Resuming interrupted sweep\n");
+
+	// List every remote first, so that jobs can be ordered across all of
+	// them
 	int status = 0;
+	int listed = 1;
 	const struct remote_cfg *remote = cfg->head;
-	while (remote) {
+	while (remote && !shutdown_requested()) {
+		int queued = 0;
+		const char *owner = NULL;
 		switch (remote->type) {
 		case remote_type_github:
-			if (mirror_github(cfg->git_base, &remote->gh,
-					  cfg->quiet)) {
-				fprintf(stderr, "Failed to mirror owner: %s\n",
-					remote->gh.owner);
-				status = 1;
-			}
+			queued = queue_github(cfg, &remote->gh, sched);
+			owner = remote->gh.owner;
 			break;
 		case remote_type_srht:
-			if (mirror_srht(cfg->git_base, &remote->srht,
-					cfg->quiet)) {
-				fprintf(stderr,
-					"Failed to mirror sr.ht owner: %s\n",
-					remote->srht.owner);
-				status = 1;
-			}
+			queued = queue_srht(cfg, &remote->srht, sched);
+			owner = remote->srht.owner;
 			break;
 		}
+		if (queued < 0) {
+			fprintf(stderr, "Failed to list owner: %s\n", owner);
+			summary_add(owner, "listing failed");
+		}
+		if (queued != 0) {
+			status = 1;
+			listed = 0;
+		}
 		remote = remote->next;
 	}
 
+	sshmux_start();
+	if (sched_run(sched, cfg->jobs_min, cfg->jobs, cfg->retries,
+		      cfg->quiet) != 0)
+		status = 1;
+	sshmux_stop();
+	sched_free(sched);
+
+	// Keep the checkpoint until every remote was listed and every job ran
+	const int interrupted = shutdown_requested();
+	if (interrupted) {
+		fprintf(stderr, "Interrupted, the next run resumes from the "
+				"checkpoint\n");
+		status = 1;
+	}
+	if (checkpoint_close(cfg->git_base, listed && !interrupted) < 0)
+		status = 1;
+	state_close();
+	scan_free();
+
+	// The next run passes the changes of an interrupted one to the hooks
+	if (!interrupted && changes_run_hooks(&cfg->hooks, cfg->quiet) < 0)
+		status = 1;
+	changes_close();
+
+	summary_print();
+
+	metrics_set(metric_run_seconds, time(NULL) - start);
+	if (cfg->metrics_path && !cfg->dry_run &&
+	    metrics_write(cfg->metrics_path) < 0)
+		status = 1;
+	if (!cfg->quiet)
+		timing_print(stdout);
+	if (cfg->timings_path && !cfg->dry_run &&
+	    timing_write_json(cfg->timings_path) < 0)
+		status = 1;
+
+	// Memory still allocated after this was never freed
+	const int show_stats = cfg->show_stats;
 	config_free(cfg);
+	lfs_cleanup();
 	curl_global_cleanup();
+	if (show_stats)
+		print_stats();
 	return status;
 }
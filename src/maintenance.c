@@ -0,0 +1,227 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "maintenance.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "profile.h"
+#include "shutdown.h"
+#include "spawn.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+#endif
+
+/// Number of loose object directories (objects/00 - objects/ff)
+#define LOOSE_DIRS 256
+/// Loose object directory sampled to estimate the total loose object count
+#define LOOSE_SAMPLE_DIR "17"
+
+/// Resources used by maintenance children so far this run, shared by all jobs
+static struct {
+	pthread_mutex_t lock;
+	/// CPU time in microseconds
+	long long cpu_usec;
+	/// Disk IO in bytes
+	long long io_bytes;
+} usage = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static int budget_exhausted(const struct maintenance_cfg *cfg)
+{
+	int exhausted = 0;
+
+	pthread_mutex_lock(&usage.lock);
+	if (cfg->cpu_budget &&
+	    usage.cpu_usec >= (long long) cfg->cpu_budget * 1000000)
+		exhausted = 1;
+	if (cfg->io_budget && usage.io_bytes >= cfg->io_budget)
+		exhausted = 1;
+	pthread_mutex_unlock(&usage.lock);
+	return exhausted;
+}
+
+static void charge_usage(const struct rusage *ru)
+{
+	pthread_mutex_lock(&usage.lock);
+	usage.cpu_usec += (long long) ru->ru_utime.tv_sec * 1000000 +
+			  ru->ru_utime.tv_usec;
+	usage.cpu_usec += (long long) ru->ru_stime.tv_sec * 1000000 +
+			  ru->ru_stime.tv_usec;
+	// Block counts are reported in 512-byte units
+	usage.io_bytes += ((long long) ru->ru_inblock + ru->ru_oublock) * 512;
+	pthread_mutex_unlock(&usage.lock);
+}
+
+/**
+ * Counts the directory entries in the given directory whose names end with the
+ * given suffix.
+ * @param path Directory to scan
+ * @param suffix Suffix to match, or NULL to count all non-hidden entries
+ * @return Number of matching entries, 0 if the directory cannot be read
+ */
+static long count_entries(const char *path, const char *suffix)
+{
+	DIR *dir = opendir(path);
+	if (!dir)
+		return 0;
+
+	const size_t suffix_len = suffix ? strlen(suffix) : 0;
+	long count = 0;
+	const struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.')
+			continue;
+		const size_t len = strlen(ent->d_name);
+		if (suffix && (len < suffix_len ||
+			       strcmp(ent->d_name + len - suffix_len, suffix)))
+			continue;
+		count++;
+	}
+	closedir(dir);
+	return count;
+}
+
+/**
+ * Checks whether the mirror at the given path crossed a maintenance threshold.
+ * The loose object count is estimated from a single fan-out directory, the
+ * same way `git gc --auto` does it.
+ * @param path Full path to the git repository
+ * @param cfg Maintenance configuration
+ * @return 1 if maintenance is needed, 0 if not
+ */
+static int needs_maintenance(const char *path, const struct maintenance_cfg *cfg)
+{
+	char dir[4096];
+
+	snprintf(dir, sizeof(dir), "%s/objects/pack", path);
+	const long packs = count_entries(dir, ".pack");
+	if (cfg->pack_threshold && packs >= cfg->pack_threshold)
+		return 1;
+
+	snprintf(dir, sizeof(dir), "%s/objects/" LOOSE_SAMPLE_DIR, path);
+	const long loose = count_entries(dir, NULL) * LOOSE_DIRS;
+	if (cfg->loose_threshold && loose >= cfg->loose_threshold)
+		return 1;
+
+	return 0;
+}
+
+/**
+ * Runs a git command at idle CPU and IO priority, within the limits of other
+ * git children, and charges its resource usage against the maintenance
+ * budget.
+ * @param args NULL-terminated git arguments
+ * @return 0 on success, -1 on error
+ */
+static int run_idle(char *const args[])
+{
+	const pid_t pid = spawn_fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+
+	if (pid == 0) {
+		// Child process
+		shutdown_detach_child();
+		if (setpriority(PRIO_PROCESS, 0, 19) == -1)
+			perror("setpriority");
+#ifdef __linux__
+		if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+			    IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT) == -1)
+			perror("ioprio_set");
+#endif
+
+		profile_exec(args);
+	}
+
+	shutdown_child_started(pid);
+	int status;
+	struct rusage ru;
+	pid_t result;
+	while ((result = wait4(pid, &status, 0, &ru)) == -1 && errno == EINTR) {
+	}
+	shutdown_child_exited(pid);
+	if (result == -1) {
+		perror("wait4");
+		return -1;
+	}
+	charge_usage(&ru);
+
+	if (WIFEXITED(status) && WEXITSTATUS(status) == 0)
+		return 0; // Success
+	fprintf(stderr, "Error: git %s failed with status %d\n", args[3],
+		WEXITSTATUS(status));
+	return -1; // Error occurred
+}
+
+int maintenance_run(const char *path, const struct maintenance_cfg *cfg,
+		    int quiet)
+{
+	if (!cfg || !cfg->enabled)
+		return 0;
+	if (!needs_maintenance(path, cfg))
+		return 0;
+	if (budget_exhausted(cfg)) {
+		if (!quiet)
+			printf("Maintenance budget exhausted, skipping...\n");
+		return 0;
+	}
+
+	if (!quiet)
+		printf("Running maintenance...\n");
+
+	// Roll small packs up into a geometric progression, then write a
+	// multi-pack-index with a reachability bitmap over the result
+	char *repack[11];
+	int i = 0;
+	repack[i++] = "git";
+	repack[i++] = "--git-dir";
+	repack[i++] = (char *) path;
+	repack[i++] = "repack";
+	repack[i++] = "-d";
+	// Never copy objects borrowed from a parent mirror via alternates
+	repack[i++] = "-l";
+	repack[i++] = "--geometric=2";
+	repack[i++] = "--write-midx";
+	repack[i++] = "--write-bitmap-index";
+	if (quiet)
+		repack[i++] = "--quiet";
+	repack[i] = NULL;
+	if (run_idle(repack) == -1)
+		return -1;
+
+	if (budget_exhausted(cfg))
+		return 0;
+
+	// Extend the split commit-graph with the newly fetched commits
+	char *commit_graph[10];
+	i = 0;
+	commit_graph[i++] = "git";
+	commit_graph[i++] = "--git-dir";
+	commit_graph[i++] = (char *) path;
+	commit_graph[i++] = "commit-graph";
+	commit_graph[i++] = "write";
+	commit_graph[i++] = "--reachable";
+	commit_graph[i++] = "--split";
+	if (quiet)
+		commit_graph[i++] = "--no-progress";
+	commit_graph[i] = NULL;
+	return run_idle(commit_graph);
+}
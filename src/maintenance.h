@@ -0,0 +1,28 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef MAINTENANCE_H
+#define MAINTENANCE_H
+
+#include "config.h"
+
+/**
+ * Runs background maintenance on the mirror at the given path if it has
+ * crossed the configured pack-count or loose-object thresholds.
+ * Maintenance consists of a geometric repack that writes a multi-pack-index
+ * and reachability bitmap, followed by an incremental commit-graph write.
+ * Git children run at the lowest CPU and IO priority, and their resource usage
+ * is charged against the global per-run budget. Once the budget is exhausted
+ * no further maintenance is started.
+ *
+ * Must only be called once the fetch of the repository has finished.
+ * @param path Full path to the git repository
+ * @param cfg Maintenance configuration
+ * @param quiet Suppress output if non-zero
+ * @return 0 on success or if maintenance was skipped, -1 on error
+ */
+int maintenance_run(const char *path, const struct maintenance_cfg *cfg,
+		    int quiet);
+
+#endif // MAINTENANCE_H
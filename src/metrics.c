@@ -0,0 +1,121 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "metrics.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef ALLOC_STATS
+#include "alloc_stats.h"
+#endif
+
+struct metric_desc {
+	const char *name;
+	/// Label set of this series, empty if none
+	const char *labels;
+	const char *type;
+	const char *help;
+};
+
+#define JOBS "github_mirror_jobs_total"
+#define JOBS_HELP "Mirror jobs run, by result"
+#define INCREASES "github_mirror_concurrency_increases_total"
+#define DECREASES "github_mirror_concurrency_decreases_total"
+#define DECREASES_HELP "Decreases of the concurrency limit, by reason"
+#define LFS "github_mirror_lfs_objects_total"
+#define LFS_HELP "LFS objects downloaded, by result"
+
+/// Series of the same metric must be adjacent
+static const struct metric_desc descs[metric_count_] = {
+		[metric_jobs_ok] = {JOBS, "result=\"ok\"", "counter",
+				    JOBS_HELP},
+		[metric_jobs_failed] = {JOBS, "result=\"failed\"", "counter",
+					JOBS_HELP},
+		[metric_jobs_locked] = {JOBS, "result=\"locked\"", "counter",
+					JOBS_HELP},
+		[metric_jobs_deferred] = {JOBS, "result=\"deferred\"",
+					  "counter", JOBS_HELP},
+		[metric_jobs_retried] = {"github_mirror_job_retries_total", "",
+					 "counter",
+					 "Failed transfers retried"},
+		[metric_concurrency_limit] = {"github_mirror_concurrency_limit",
+					      "", "gauge",
+					      "Mirror jobs allowed in flight"},
+		[metric_concurrency_increases] = {INCREASES, "", "counter",
+						  "Increases of the "
+						  "concurrency limit"},
+		[metric_concurrency_decreases_failure] = {DECREASES,
+							  "reason=\"failure\"",
+							  "counter",
+							  DECREASES_HELP},
+		[metric_concurrency_decreases_latency] = {DECREASES,
+							  "reason=\"latency\"",
+							  "counter",
+							  DECREASES_HELP},
+		[metric_lfs_objects_ok] = {LFS, "result=\"ok\"", "counter",
+					   LFS_HELP},
+		[metric_lfs_objects_failed] = {LFS, "result=\"failed\"",
+					       "counter", LFS_HELP},
+		[metric_lfs_bytes] = {"github_mirror_lfs_bytes_total", "",
+				      "counter",
+				      "Bytes of LFS objects downloaded"},
+		[metric_run_seconds] = {"github_mirror_run_duration_seconds",
+					"", "gauge", "Duration of the run"},
+};
+
+static _Atomic long long values[metric_count_];
+
+void metrics_add(enum metric m, long long v)
+{
+	atomic_fetch_add_explicit(&values[m], v, memory_order_relaxed);
+}
+
+void metrics_set(enum metric m, long long v)
+{
+	atomic_store_explicit(&values[m], v, memory_order_relaxed);
+}
+
+long long metrics_get(enum metric m)
+{
+	return atomic_load_explicit(&values[m], memory_order_relaxed);
+}
+
+int metrics_write(const char *path)
+{
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	FILE *f = fopen(tmp, "w");
+	if (!f) {
+		perror("fopen");
+		return -1;
+	}
+	for (size_t i = 0; i < metric_count_; i++) {
+		const struct metric_desc *d = &descs[i];
+		if (i == 0 || strcmp(d->name, descs[i - 1].name) != 0)
+			fprintf(f, "# HELP %s %s\n# TYPE %s %s\n", d->name,
+				d->help, d->name, d->type);
+		if (d->labels[0])
+			fprintf(f, "%s{%s} %lld\n", d->name, d->labels,
+				metrics_get(i));
+		else
+			fprintf(f, "%s %lld\n", d->name, metrics_get(i));
+	}
+#ifdef ALLOC_STATS
+	alloc_stats_write_metrics(f);
+#endif
+	if (fclose(f) != 0) {
+		perror("fclose");
+		remove(tmp);
+		return -1;
+	}
+	if (rename(tmp, path) < 0) {
+		perror("rename");
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,55 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef METRICS_H
+#define METRICS_H
+
+/// Metrics of a run, exported in the Prometheus text format
+enum metric {
+	metric_jobs_ok,
+	metric_jobs_failed,
+	metric_jobs_locked,
+	metric_jobs_deferred,
+	metric_jobs_retried,
+	metric_concurrency_limit,
+	metric_concurrency_increases,
+	metric_concurrency_decreases_failure,
+	metric_concurrency_decreases_latency,
+	metric_lfs_objects_ok,
+	metric_lfs_objects_failed,
+	metric_lfs_bytes,
+	metric_run_seconds,
+	metric_count_,
+};
+
+/**
+ * Adds to a counter or gauge.
+ * @param m Metric
+ * @param v Value to add
+ */
+void metrics_add(enum metric m, long long v);
+
+/**
+ * Sets a gauge.
+ * @param m Metric
+ * @param v New value
+ */
+void metrics_set(enum metric m, long long v);
+
+/**
+ * Reads a metric.
+ * @param m Metric
+ * @return Current value
+ */
+long long metrics_get(enum metric m);
+
+/**
+ * Writes all metrics in the Prometheus text exposition format, suitable for
+ * the node_exporter textfile collector. The file is replaced atomically.
+ * @param path Path of the file to write
+ * @return 0 on success, -1 on error
+ */
+int metrics_write(const char *path);
+
+#endif // METRICS_H
@@ -0,0 +1,129 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_client
+
+#include "page_cache.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+
+/// FNV-1a 64-bit basis and prime used to name cache files
+#define FNV_BASIS 14695981039346656037ull
+#define FNV_PRIME 1099511628211ull
+
+/// Path of the file caching a key, named after the hash of the key
+static void cache_path(char *buf, size_t len, const char *dir,
+		       const char *key)
+{
+	uint64_t h = FNV_BASIS;
+	for (const char *p = key; *p; p++) {
+		h ^= (unsigned char) *p;
+		h *= FNV_PRIME;
+	}
+	snprintf(buf, len, "%s/%016llx", dir, (unsigned long long) h);
+}
+
+/**
+ * Copies the next line of a cache file.
+ * @param p Start of the line, moved past it
+ * @param end End of the file
+ * @param out Buffer to copy the line to
+ * @param out_len Size of the buffer
+ * @return 0 on success, -1 if the line is missing or too long
+ */
+static int read_line(const char **p, const char *end, char *out,
+		     size_t out_len)
+{
+	const char *nl = memchr(*p, '\n', end - *p);
+	if (!nl || (size_t) (nl - *p) >= out_len)
+		return -1;
+	memcpy(out, *p, nl - *p);
+	out[nl - *p] = '\0';
+	*p = nl + 1;
+	return 0;
+}
+
+int page_cache_read(const char *dir, const char *key, struct cached_page *page)
+{
+	char path[4096];
+	cache_path(path, sizeof(path), dir, key);
+
+	page->body = buffer_new(0);
+	FILE *f = fopen(path, "rb");
+	if (!f)
+		return 0;
+	buffer_t file = buffer_new(16384);
+	char chunk[8192];
+	size_t n;
+	while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0)
+		buffer_append(&file, chunk, n);
+	const int err = ferror(f);
+	fclose(f);
+
+	// The ETag and next page URL are on lines of their own before the
+	// body. Anything else is treated as a miss and overwritten later.
+	const char *p = (const char *) file.data;
+	const char *end = p + file.len;
+	if (err || read_line(&p, end, page->etag, sizeof(page->etag)) < 0 ||
+	    read_line(&p, end, page->next, sizeof(page->next)) < 0 ||
+	    !page->etag[0]) {
+		buffer_free(file);
+		return 0;
+	}
+	buffer_append(&page->body, p, end - p);
+	buffer_append(&page->body, "\0", 1);
+	buffer_free(file);
+	return 1;
+}
+
+int page_cache_write(const char *dir, const char *key, const char *etag,
+		     const char *next, const void *body, size_t len)
+{
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+		perror("Error creating page cache");
+		return -1;
+	}
+	if (strchr(etag, '\n') || strchr(next, '\n'))
+		return -1;
+
+	char path[4096], tmp[4096 + 8];
+	cache_path(path, sizeof(path), dir, key);
+	// A unique name keeps concurrent runs sharing the cache from writing
+	// into each other's temporary file before the rename
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+	const int fd = mkstemp(tmp);
+	if (fd == -1) {
+		perror("Error writing page cache");
+		return -1;
+	}
+	FILE *f = fdopen(fd, "wb");
+	if (!f) {
+		perror("Error writing page cache");
+		close(fd);
+		remove(tmp);
+		return -1;
+	}
+	fprintf(f, "%s\n%s\n", etag, next);
+	fwrite(body, 1, len, f);
+	if (ferror(f) | fclose(f)) {
+		perror("Error writing page cache");
+		remove(tmp);
+		return -1;
+	}
+	if (rename(tmp, path) == -1) {
+		perror("Error writing page cache");
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
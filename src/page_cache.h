@@ -0,0 +1,46 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include "buffer.h"
+
+/// Directory in the git base that REST responses are cached in
+#define PAGE_CACHE_DIR ".github-mirror-cache"
+
+/// Cached response to a conditional request
+struct cached_page {
+	/// ETag the response was served with
+	char etag[256];
+	/// URL of the next page, empty if it is the last
+	char next[2048];
+	/// NUL-terminated body of the response
+	buffer_t body;
+};
+
+/**
+ * Reads the cached response for a key.
+ * @param dir Cache directory
+ * @param key Key of the response, such as the login and URL of the request
+ * @param page Set to the cached response, its body must be freed on a hit
+ * @return 1 on a hit, 0 if nothing usable is cached
+ */
+int page_cache_read(const char *dir, const char *key, struct cached_page *page);
+
+/**
+ * Caches a response, replacing the one cached for the key atomically. The
+ * cache directory is created if needed.
+ * @param dir Cache directory
+ * @param key Key of the response
+ * @param etag ETag the response was served with
+ * @param next URL of the next page, empty if it is the last
+ * @param body Body of the response
+ * @param len Length of the body
+ * @return 0 on success, -1 on error
+ */
+int page_cache_write(const char *dir, const char *key, const char *etag,
+		     const char *next, const void *body, size_t len);
+
+#endif // PAGE_CACHE_H
@@ -0,0 +1,258 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "profile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "spawn.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+/// Lowest priority level within the best-effort class
+#define IOPRIO_BE_LOWEST 7
+#endif
+
+/// Smallest delta base cache given to a git child
+#define DELTA_CACHE_MIN (16LL << 20)
+/// Largest delta base cache given to a git child, git's own default
+#define DELTA_CACHE_MAX (96LL << 20)
+/// Most config options injected into a git command
+#define PROFILE_OPTS 16
+/// Most arguments of a git command, including the injected options
+#define PROFILE_ARGS 64
+
+/// Resource profile of git children, read-only once set up
+static struct {
+	int nice;
+	enum io_class io_class;
+	/// Address space limit of each child outside of a cgroup, 0 for none
+	long long memory;
+	/// cgroup.procs file children move themselves into, empty for none
+	char procs[4096];
+	/// Values of the -c options
+	char opts[PROFILE_OPTS][256];
+	size_t opts_len;
+} profile;
+
+/**
+ * Adds a -c option to git commands.
+ * @return 0 on success, -1 if there is no room for it
+ */
+static int add_opt(const char *fmt, ...)
+{
+	if (profile.opts_len == PROFILE_OPTS)
+		return -1;
+	va_list ap;
+	va_start(ap, fmt);
+	const int n = vsnprintf(profile.opts[profile.opts_len],
+				sizeof(profile.opts[0]), fmt, ap);
+	va_end(ap);
+	if (n < 0 || (size_t) n >= sizeof(profile.opts[0]))
+		return -1;
+	profile.opts_len++;
+	return 0;
+}
+
+/**
+ * Creates the cgroup of git children and caps the memory of all of them.
+ * @param dir cgroup v2 directory
+ * @param memory Bytes of memory all children may use together, 0 for no cap
+ * @return 0 on success, -1 on error
+ */
+static int setup_cgroup(const char *dir, long long memory)
+{
+	if (mkdir(dir, 0755) == -1 && errno != EEXIST) {
+		perror("Error creating cgroup");
+		return -1;
+	}
+
+	char path[4096];
+	if (memory) {
+		snprintf(path, sizeof(path), "%s/memory.max", dir);
+		FILE *f = fopen(path, "w");
+		if (!f || fprintf(f, "%lld\n", memory) < 0 || fclose(f)) {
+			perror("Error setting cgroup memory.max");
+			return -1;
+		}
+	}
+
+	snprintf(path, sizeof(path), "%s/cgroup.procs", dir);
+	if (access(path, W_OK) == -1) {
+		perror("Error opening cgroup.procs");
+		return -1;
+	}
+	snprintf(profile.procs, sizeof(profile.procs), "%s", path);
+	return 0;
+}
+
+int profile_init(const struct profile_cfg *cfg, int jobs)
+{
+	if (jobs < 1)
+		jobs = 1;
+	profile.nice = cfg->nice;
+	profile.io_class = cfg->io_class;
+	profile.memory = cfg->memory;
+	profile.procs[0] = '\0';
+	profile.opts_len = 0;
+
+	// Every child of a full set of jobs gets its share of the CPUs
+	long threads = cfg->pack_threads;
+	if (!threads) {
+		const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = cpus > jobs ? cpus / jobs : 1;
+	}
+	add_opt("pack.threads=%ld", threads);
+
+	// ... and of the memory, half the RAM unless capped
+	long long share = cfg->memory;
+	if (!share) {
+		const long pages = sysconf(_SC_PHYS_PAGES);
+		const long page = sysconf(_SC_PAGESIZE);
+		if (pages > 0 && page > 0)
+			share = (long long) pages * page / 2 / jobs;
+	}
+	if (share) {
+		long long delta = share / 8;
+		if (delta < DELTA_CACHE_MIN)
+			delta = DELTA_CACHE_MIN;
+		if (delta > DELTA_CACHE_MAX)
+			delta = DELTA_CACHE_MAX;
+		add_opt("core.deltaBaseCacheLimit=%lld", delta);
+	}
+	if (cfg->memory) {
+		// Keep pack mappings and repack windows within the cap, git
+		// unmaps pack windows when it runs out of address space
+		add_opt("core.packedGitWindowSize=%lld", cfg->memory / 8);
+		add_opt("core.packedGitLimit=%lld", cfg->memory / 4);
+		add_opt("pack.windowMemory=%lld", cfg->memory / 4 / threads);
+	}
+	if (cfg->negotiation)
+		add_opt("fetch.negotiationAlgorithm=%s", cfg->negotiation);
+	add_opt("protocol.version=2");
+
+	// The cgroup caps all children together instead
+	const long long total =
+			cfg->memory > LLONG_MAX / jobs ? 0 : cfg->memory * jobs;
+	if (cfg->cgroup && setup_cgroup(cfg->cgroup, total) < 0)
+		return -1;
+	return 0;
+}
+
+void profile_proxy(const char *url)
+{
+	if (add_opt("http.proxy=%s", url) < 0)
+		fprintf(stderr, "Warning: HTTPS transfers of git are not "
+				"bandwidth limited\n");
+
+	// http.<url>.proxy wins over http.proxy for its URLs, so each one
+	// configured is overridden by its own key
+	spawn_lock();
+	FILE *p = popen("git config --get-regexp '^http\\..+\\.proxy$'", "r");
+	spawn_unlock();
+	if (!p)
+		return;
+	char line[1024];
+	while (fgets(line, sizeof(line), p)) {
+		line[strcspn(line, " \n")] = '\0';
+		if (add_opt("%s=%s", line, url) < 0)
+			fprintf(stderr, "Warning: %s is not bandwidth limited\n",
+				line);
+	}
+	pclose(p);
+}
+
+/// Lowers the CPU and IO priority of the calling process, never raising them
+static void lower_priority(void)
+{
+	errno = 0;
+	const int nice = getpriority(PRIO_PROCESS, 0);
+	if ((nice != -1 || errno == 0) && nice < profile.nice &&
+	    setpriority(PRIO_PROCESS, 0, profile.nice) == -1)
+		perror("setpriority");
+
+#ifdef __linux__
+	if (profile.io_class == io_class_none)
+		return;
+	const long cur = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+	if (cur != -1 && (cur >> IOPRIO_CLASS_SHIFT) == IOPRIO_CLASS_IDLE)
+		return; // Already as low as it gets
+	const int prio = profile.io_class == io_class_idle
+				 ? IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+				 : IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT |
+					   IOPRIO_BE_LOWEST;
+	if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, prio) == -1)
+		perror("ioprio_set");
+#endif
+}
+
+/// Caps the memory of the calling process and its children
+static void limit_memory(void)
+{
+	if (profile.procs[0]) {
+		// Writing 0 moves the writing process
+		const int fd = open(profile.procs, O_WRONLY | O_CLOEXEC);
+		if (fd != -1 && write(fd, "0", 1) == 1) {
+			close(fd);
+			return;
+		}
+		perror("Error joining cgroup");
+		if (fd != -1)
+			close(fd);
+	}
+	if (!profile.memory)
+		return;
+	const struct rlimit rl = {
+			.rlim_cur = (rlim_t) profile.memory,
+			.rlim_max = (rlim_t) profile.memory,
+	};
+	if (setrlimit(RLIMIT_AS, &rl) == -1)
+		perror("setrlimit");
+}
+
+_Noreturn void profile_exec(char *const args[])
+{
+	lower_priority();
+	limit_memory();
+
+	size_t argc = 0;
+	while (args[argc])
+		argc++;
+	if (argc + 2 * profile.opts_len >= PROFILE_ARGS) {
+		// Too long to fit the options, run it as given
+		execvp("git", args);
+		perror("execvp");
+		_exit(127);
+	}
+
+	// The options go before the subcommand, so they only last for this
+	// command and aren't written to the config of a clone
+	char *argv[PROFILE_ARGS];
+	size_t n = 0;
+	argv[n++] = args[0];
+	for (size_t i = 0; i < profile.opts_len; i++) {
+		argv[n++] = "-c";
+		argv[n++] = profile.opts[i];
+	}
+	for (size_t i = 1; i < argc; i++)
+		argv[n++] = args[i];
+	argv[n] = NULL;
+
+	execvp("git", argv);
+	perror("execvp");
+	_exit(127); // execvp only returns on error
+}
@@ -0,0 +1,36 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "config.h"
+
+/**
+ * Sets up the resource profile of git children, sharing the CPUs and memory
+ * between the jobs running at once. Until this is called, git children run
+ * unrestricted.
+ * @param cfg Resource profile configuration
+ * @param jobs Most mirror jobs running at once
+ * @return 0 on success, -1 if the cgroup couldn't be set up, in which case
+ * memory is limited per child instead
+ */
+int profile_init(const struct profile_cfg *cfg, int jobs);
+
+/**
+ * Points git children at a proxy, over any proxy set in the git config. Call
+ * after profile_init().
+ * @param url URL of the proxy
+ */
+void profile_proxy(const char *url);
+
+/**
+ * Applies the resource profile to the calling process and executes git with
+ * the profile's config options in front of the given arguments. Only call in
+ * a child process after fork, it allocates nothing.
+ * @param args NULL-terminated git arguments, starting with "git"
+ */
+_Noreturn void profile_exec(char *const args[]);
+
+#endif // PROFILE_H
@@ -0,0 +1,631 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "proxy.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __APPLE__
+#include <mach-o/dyld.h>
+#endif
+
+#include "bwlimit.h"
+#include "profile.h"
+#include "spawn.h"
+
+/// Longest CONNECT request or response header accepted
+#define HEADER_MAX 8192
+/// Largest read of a relay
+#define RELAY_BUF (64 * 1024)
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+/// Environment variable passing the credentials to --relay
+#define AUTH_ENV "GITHUB_MIRROR_PROXY_AUTH"
+/// User name of the proxy's credentials
+#define AUTH_USER "github-mirror"
+/// Bytes of the per-run secret
+#define SECRET_LEN 16
+
+/// Proxy configured before this one started, chained to if set
+static struct {
+	char host[256];
+	char port[8];
+} upstream;
+
+/// Hosts no_proxy excluded from the upstream proxy, comma separated
+static char no_upstream[1024];
+
+/// Proxy-Authorization value clients must send, "Basic <base64>"
+static char auth[128];
+
+/// URL of the proxy with its credentials, empty until it is started
+static char proxy_addr[128];
+
+/**
+ * Writes a whole buffer. Sockets of the proxy are written with send(), so a
+ * closed peer does not raise SIGPIPE.
+ * @return 0 on success, -1 on error
+ */
+static int write_all(int fd, const char *buf, size_t len, int is_proxy)
+{
+	while (len > 0) {
+		const ssize_t n = is_proxy ? send(fd, buf, len, SEND_FLAGS)
+					   : write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= (size_t) n;
+	}
+	return 0;
+}
+
+static void set_socket_flags(int fd)
+{
+	fcntl(fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+	const int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+}
+
+/**
+ * Splits an address of the form host:port or [host]:port in place.
+ * @return 0 on success, -1 on error
+ */
+static int split_host_port(char *addr, char **host, char **port)
+{
+	char *colon;
+	if (addr[0] == '[') {
+		char *close = strchr(addr, ']');
+		if (!close || close[1] != ':')
+			return -1;
+		*close = '\0';
+		*host = addr + 1;
+		colon = close + 1;
+	} else {
+		colon = strrchr(addr, ':');
+		if (!colon)
+			return -1;
+		*colon = '\0';
+		*host = addr;
+	}
+	*port = colon + 1;
+	return **host && **port ? 0 : -1;
+}
+
+/**
+ * Opens a TCP connection.
+ * @return The socket, or -1 on error
+ */
+static int connect_to(const char *host, const char *port)
+{
+	struct addrinfo hints = {0}, *res, *ai;
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host, port, &hints, &res) != 0)
+		return -1;
+
+	int fd = -1;
+	for (ai = res; ai; ai = ai->ai_next) {
+		spawn_lock();
+		fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+		if (fd >= 0)
+			set_socket_flags(fd);
+		spawn_unlock();
+		if (fd < 0)
+			continue;
+		if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0)
+			break;
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+	return fd;
+}
+
+/// Ends the writing side of a connection, or closes a pipe
+static void half_close(int fd)
+{
+	if (shutdown(fd, SHUT_WR) < 0 && errno == ENOTSOCK)
+		close(fd);
+}
+
+/**
+ * Copies data both ways between two endpoints until both sides are done.
+ * @param a_in Endpoint a, read side
+ * @param a_out Endpoint a, write side
+ * @param b Endpoint b, a socket
+ * @param is_proxy Whether this runs in the proxy, counting bytes against the
+ * bandwidth limit
+ */
+static void pump(int a_in, int a_out, int b, int is_proxy)
+{
+	struct pollfd fds[2] = {{.fd = a_in, .events = POLLIN},
+				{.fd = b, .events = POLLIN}};
+	const int outs[2] = {b, a_out};
+	char *buf = malloc(RELAY_BUF);
+	if (!buf)
+		return;
+
+	while (fds[0].fd >= 0 || fds[1].fd >= 0) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		for (int i = 0; i < 2; i++) {
+			if (fds[i].fd < 0 ||
+			    !(fds[i].revents & (POLLIN | POLLHUP | POLLERR)))
+				continue;
+			const size_t want =
+					is_proxy ? bwlimit_chunk() : RELAY_BUF;
+			const ssize_t n = read(fds[i].fd, buf, want);
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n <= 0) {
+				// Pass the end of the stream on
+				half_close(outs[i]);
+				fds[i].fd = -1;
+				continue;
+			}
+			if (is_proxy)
+				bwlimit_take((size_t) n);
+			if (write_all(outs[i], buf, (size_t) n, is_proxy) < 0)
+				goto end;
+		}
+	}
+end:
+	free(buf);
+}
+
+/**
+ * Reads a header up to and including the blank line ending it.
+ * @param fd Socket to read from
+ * @param buf Buffer of HEADER_MAX + 1 bytes, NUL-terminated on return
+ * @param len Set to the number of bytes read, which may exceed the header
+ * @return Length of the header, or -1 on error
+ */
+static ssize_t read_header(int fd, char *buf, size_t *len)
+{
+	*len = 0;
+	buf[0] = '\0';
+	while (*len < HEADER_MAX) {
+		const ssize_t n = recv(fd, buf + *len, HEADER_MAX - *len, 0);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			return -1;
+		*len += (size_t) n;
+		buf[*len] = '\0';
+		char *end = strstr(buf, "\r\n\r\n");
+		if (end)
+			return end + 4 - buf;
+	}
+	return -1;
+}
+
+/**
+ * Checks the credentials of a CONNECT request in constant time, so that other
+ * local users can't tunnel through the proxy.
+ * @param req NUL-terminated request header
+ * @return Non-zero if the request carries the run's credentials
+ */
+static int authorized(const char *req)
+{
+	static const char name[] = "Proxy-Authorization:";
+	for (const char *line = strstr(req, "\r\n"); line;
+	     line = strstr(line + 2, "\r\n")) {
+		if (strncasecmp(line + 2, name, sizeof(name) - 1) != 0)
+			continue;
+		const char *v = line + 2 + sizeof(name) - 1;
+		while (*v == ' ' || *v == '\t')
+			v++;
+		const size_t len = strcspn(v, "\r\n");
+		if (len != strlen(auth))
+			return 0;
+		unsigned char diff = 0;
+		for (size_t i = 0; i < len; i++)
+			diff |= (unsigned char) (v[i] ^ auth[i]);
+		return diff == 0;
+	}
+	return 0;
+}
+
+/**
+ * Checks whether no_proxy excludes a host from the upstream proxy, as curl
+ * does: by name or by domain, with "*" excluding every host.
+ */
+static int bypasses_upstream(const char *host)
+{
+	const size_t host_len = strlen(host);
+	const char *p = no_upstream;
+	while (*(p += strspn(p, ", "))) {
+		const char *entry = p;
+		size_t len = strcspn(p, ", ");
+		p += len;
+		if (len == 1 && *entry == '*')
+			return 1;
+		if (*entry == '.') {
+			entry++;
+			len--;
+		}
+		if (!len || len > host_len)
+			continue;
+		const char *tail = host + host_len - len;
+		if (!strncasecmp(tail, entry, len) &&
+		    (tail == host || tail[-1] == '.'))
+			return 1;
+	}
+	return 0;
+}
+
+/// Response to a CONNECT request once the tunnel is open
+#define CONNECTED "HTTP/1.1 200 Connection established\r\n\r\n"
+
+/// Sends an error response to a proxy client
+static void reply(int fd, const char *status)
+{
+	char resp[256];
+	const int n = snprintf(resp, sizeof(resp),
+			       "HTTP/1.1 %s\r\nConnection: close\r\n\r\n",
+			       status);
+	write_all(fd, resp, (size_t) n, 1);
+}
+
+static void *handle_conn(void *arg)
+{
+	const int client = (int) (intptr_t) arg;
+	int server = -1;
+	char req[HEADER_MAX + 1];
+	char target[512];
+	size_t len;
+
+	const ssize_t header_len = read_header(client, req, &len);
+	if (header_len < 0)
+		goto end;
+	if (sscanf(req, "CONNECT %511s HTTP/1.", target) != 1) {
+		reply(client, "405 Method Not Allowed");
+		goto end;
+	}
+	if (!authorized(req)) {
+		reply(client, "407 Proxy Authentication Required\r\n"
+			      "Proxy-Authenticate: Basic realm=\"" AUTH_USER
+			      "\"");
+		goto end;
+	}
+
+	char addr[sizeof(target)], *host, *port;
+	snprintf(addr, sizeof(addr), "%s", target);
+	if (split_host_port(addr, &host, &port) < 0) {
+		reply(client, "400 Bad Request");
+		goto end;
+	}
+
+	if (upstream.host[0] && !bypasses_upstream(host)) {
+		// The upstream proxy answers the request itself, without our
+		// credentials
+		char fwd[1200];
+		snprintf(fwd, sizeof(fwd),
+			 "CONNECT %s HTTP/1.1\r\nHost: %s\r\n\r\n", target,
+			 target);
+		server = connect_to(upstream.host, upstream.port);
+		if (server < 0 || write_all(server, fwd, strlen(fwd), 1) < 0 ||
+		    write_all(server, req + header_len,
+			      len - (size_t) header_len, 1) < 0) {
+			reply(client, "502 Bad Gateway");
+			goto end;
+		}
+	} else {
+		if ((server = connect_to(host, port)) < 0) {
+			reply(client, "502 Bad Gateway");
+			goto end;
+		}
+		// Bytes sent ahead of the response belong to the tunnel
+		const size_t extra = len - (size_t) header_len;
+		if (write_all(client, CONNECTED, strlen(CONNECTED), 1) < 0 ||
+		    write_all(server, req + header_len, extra, 1) < 0)
+			goto end;
+	}
+
+	bwlimit_flow_begin();
+	pump(client, client, server, 1);
+	bwlimit_flow_end();
+
+end:
+	if (server >= 0)
+		close(server);
+	close(client);
+	return NULL;
+}
+
+static void *accept_loop(void *arg)
+{
+	const int lfd = (int) (intptr_t) arg;
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	for (;;) {
+		// The listening socket doesn't block, so that the spawn lock
+		// is only held while a pending connection is taken
+		struct pollfd pfd = {.fd = lfd, .events = POLLIN};
+		if (poll(&pfd, 1, -1) < 0)
+			continue;
+		spawn_lock();
+		const int fd = accept(lfd, NULL, NULL);
+		if (fd >= 0)
+			set_socket_flags(fd);
+		spawn_unlock();
+		if (fd < 0) {
+			if (errno != EINTR && errno != ECONNABORTED &&
+			    errno != EAGAIN && errno != EWOULDBLOCK) {
+				perror("accept");
+				sleep(1);
+			}
+			continue;
+		}
+		// BSDs pass O_NONBLOCK on to accepted sockets
+		fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+		pthread_t thread;
+		if (pthread_create(&thread, &attr, handle_conn,
+				   (void *) (intptr_t) fd) != 0)
+			close(fd);
+	}
+	return NULL;
+}
+
+/**
+ * Reads the proxy to chain to from https_proxy, and the hosts not to chain
+ * from no_proxy.
+ */
+static void load_upstream(void)
+{
+	const char *skip = getenv("no_proxy");
+	if (!skip || !*skip)
+		skip = getenv("NO_PROXY");
+	if (skip)
+		snprintf(no_upstream, sizeof(no_upstream), "%s", skip);
+
+	const char *env = getenv("https_proxy");
+	if (!env || !*env)
+		env = getenv("HTTPS_PROXY");
+	if (!env || !*env)
+		return;
+
+	const char *p = strstr(env, "://");
+	p = p ? p + 3 : env;
+	const char *at = strchr(p, '@');
+	if (at) {
+		fprintf(stderr, "Warning: credentials of https_proxy are not "
+				"forwarded\n");
+		p = at + 1;
+	}
+
+	char addr[sizeof(upstream.host) + sizeof(upstream.port)];
+	snprintf(addr, sizeof(addr), "%.*s", (int) strcspn(p, "/"), p);
+	char *host, *port = "1080";
+	if (split_host_port(addr, &host, &port) < 0)
+		host = addr;
+	snprintf(upstream.host, sizeof(upstream.host), "%s", host);
+	snprintf(upstream.port, sizeof(upstream.port), "%s", port);
+}
+
+int self_path(char *buf, size_t len)
+{
+#ifdef __APPLE__
+	uint32_t size = (uint32_t) len;
+	return _NSGetExecutablePath(buf, &size) == 0 ? 0 : -1;
+#else
+	const ssize_t n = readlink("/proc/self/exe", buf, len - 1);
+	if (n < 0)
+		return -1;
+	buf[n] = '\0';
+	return 0;
+#endif
+}
+
+/**
+ * Encodes bytes as base64, with padding.
+ * @param out Buffer of at least 4 * ((len + 2) / 3) + 1 bytes
+ */
+static void base64(const unsigned char *in, size_t len, char *out)
+{
+	static const char digits[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				     "abcdefghijklmnopqrstuvwxyz0123456789+/";
+	for (size_t i = 0; i < len; i += 3) {
+		const unsigned long v =
+				(unsigned long) in[i] << 16 |
+				(i + 1 < len ? (unsigned long) in[i + 1] << 8
+					     : 0) |
+				(i + 2 < len ? in[i + 2] : 0);
+		*out++ = digits[v >> 18];
+		*out++ = digits[v >> 12 & 0x3f];
+		*out++ = i + 1 < len ? digits[v >> 6 & 0x3f] : '=';
+		*out++ = i + 2 < len ? digits[v & 0x3f] : '=';
+	}
+	*out = '\0';
+}
+
+/**
+ * Makes up the credentials of this run.
+ * @param secret Buffer for the secret in hex
+ * @return 0 on success, -1 on error
+ */
+static int make_secret(char secret[SECRET_LEN * 2 + 1])
+{
+	static const char hex[] = "0123456789abcdef";
+	unsigned char raw[SECRET_LEN];
+	const int fd = open("/dev/urandom", O_RDONLY | O_CLOEXEC);
+	if (fd < 0 || read(fd, raw, sizeof(raw)) != (ssize_t) sizeof(raw)) {
+		perror("/dev/urandom");
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+	close(fd);
+	for (size_t i = 0; i < SECRET_LEN; i++) {
+		secret[i * 2] = hex[raw[i] >> 4];
+		secret[i * 2 + 1] = hex[raw[i] & 0xf];
+	}
+	secret[SECRET_LEN * 2] = '\0';
+
+	char creds[sizeof(AUTH_USER) + SECRET_LEN * 2 + 1];
+	snprintf(creds, sizeof(creds), "%s:%s", AUTH_USER, secret);
+	memcpy(auth, "Basic ", 6);
+	base64((const unsigned char *) creds, strlen(creds), auth + 6);
+	return 0;
+}
+
+/**
+ * Routes ssh through the proxy with a ProxyCommand running this program.
+ * @param port Port of the proxy
+ */
+static void setup_ssh(unsigned port)
+{
+	char self[PATH_MAX];
+	if (getenv("GIT_SSH") && !getenv("GIT_SSH_COMMAND")) {
+		fprintf(stderr, "Warning: GIT_SSH is set, SSH transfers are "
+				"not bandwidth limited\n");
+		return;
+	}
+	if (self_path(self, sizeof(self)) < 0 || strpbrk(self, "'\"")) {
+		fprintf(stderr, "Warning: SSH transfers are not bandwidth "
+				"limited\n");
+		return;
+	}
+
+	const char *ssh = getenv("GIT_SSH_COMMAND");
+	if (!ssh || !*ssh)
+		ssh = "ssh";
+	char cmd[PATH_MAX + 256];
+	snprintf(cmd, sizeof(cmd),
+		 "%s -o 'ProxyCommand=\"%s\" --relay 127.0.0.1:%u %%h:%%p'",
+		 ssh, self, port);
+	setenv("GIT_SSH_COMMAND", cmd, 1);
+}
+
+int proxy_start(void)
+{
+	char secret[SECRET_LEN * 2 + 1];
+	if (make_secret(secret) < 0)
+		return -1;
+
+	const int lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("socket");
+		return -1;
+	}
+	set_socket_flags(lfd);
+	fcntl(lfd, F_SETFL, fcntl(lfd, F_GETFL) | O_NONBLOCK);
+
+	struct sockaddr_in addr = {0};
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	socklen_t addr_len = sizeof(addr);
+	if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    listen(lfd, SOMAXCONN) < 0 ||
+	    getsockname(lfd, (struct sockaddr *) &addr, &addr_len) < 0) {
+		perror("bind");
+		close(lfd);
+		return -1;
+	}
+	const unsigned port = ntohs(addr.sin_port);
+
+	load_upstream();
+
+	pthread_t thread;
+	if (pthread_create(&thread, NULL, accept_loop,
+			   (void *) (intptr_t) lfd) != 0) {
+		fprintf(stderr, "Failed to start proxy thread\n");
+		close(lfd);
+		return -1;
+	}
+	pthread_detach(thread);
+
+	// git and libcurl pick the proxy and its credentials up from the
+	// environment, which other users can't read. Hosts in no_proxy would
+	// skip the limit, the proxy connects to them directly instead.
+	snprintf(proxy_addr, sizeof(proxy_addr), "http://%s:%s@127.0.0.1:%u",
+		 AUTH_USER, secret, port);
+	setenv("https_proxy", proxy_addr, 1);
+	setenv("HTTPS_PROXY", proxy_addr, 1);
+	unsetenv("no_proxy");
+	unsetenv("NO_PROXY");
+	setenv(AUTH_ENV, auth, 1);
+	// git prefers the proxies of its config to the environment
+	profile_proxy(proxy_addr);
+	setup_ssh(port);
+	return 0;
+}
+
+const char *proxy_url(void)
+{
+	return proxy_addr[0] ? proxy_addr : NULL;
+}
+
+int proxy_relay(const char *proxy, const char *target)
+{
+	char addr[512], req[HEADER_MAX + 1];
+	char *host, *port;
+	size_t len;
+
+	snprintf(addr, sizeof(addr), "%s", proxy);
+	if (split_host_port(addr, &host, &port) < 0) {
+		fprintf(stderr, "Invalid proxy address: %s\n", proxy);
+		return 1;
+	}
+	const int fd = connect_to(host, port);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to connect to proxy: %s\n", proxy);
+		return 1;
+	}
+
+	const char *creds = getenv(AUTH_ENV);
+	snprintf(req, sizeof(req),
+		 "CONNECT %s HTTP/1.1\r\nHost: %s\r\n"
+		 "Proxy-Authorization: %s\r\n\r\n",
+		 target, target, creds ? creds : "");
+	ssize_t header_len = -1;
+	int code = 0;
+	if (write_all(fd, req, strlen(req), 0) == 0)
+		header_len = read_header(fd, req, &len);
+	if (header_len < 0 || sscanf(req, "HTTP/1.%*d %d", &code) != 1 ||
+	    code != 200) {
+		fprintf(stderr, "Proxy refused connection to %s\n", target);
+		close(fd);
+		return 1;
+	}
+
+	// Anything after the response header already belongs to the tunnel
+	if (write_all(STDOUT_FILENO, req + header_len,
+		      len - (size_t) header_len, 0) < 0) {
+		close(fd);
+		return 1;
+	}
+	pump(STDIN_FILENO, STDOUT_FILENO, fd, 0);
+	close(fd);
+	return 0;
+}
@@ -0,0 +1,47 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef PROXY_H
+#define PROXY_H
+
+#include <stddef.h>
+
+/**
+ * Starts a local HTTP CONNECT proxy that relays every connection through the
+ * global bandwidth limit, and points git and curl at it. HTTPS transfers of
+ * git children and GraphQL requests use it through https_proxy, SSH
+ * transfers through an ssh ProxyCommand running this program with --relay.
+ * A proxy already set in https_proxy is chained to, except for the hosts in
+ * no_proxy, and proxies of the git config are overridden. Clients must send
+ * credentials made up for the run, which are passed to them in https_proxy and
+ * to --relay in the environment.
+ * Must be called before any threads or git children are started.
+ * @return 0 on success, -1 on error
+ */
+int proxy_start(void);
+
+/**
+ * Gives the URL of the proxy, with its credentials.
+ * @return The URL, or NULL if the proxy isn't running
+ */
+const char *proxy_url(void);
+
+/**
+ * Tunnels stdin and stdout to a host through the local proxy, as an ssh
+ * ProxyCommand.
+ * @param proxy Address of the local proxy, host:port
+ * @param target Host to connect to, host:port
+ * @return Exit status
+ */
+int proxy_relay(const char *proxy, const char *target);
+
+/**
+ * Finds the path of the running executable, for helpers that run it again.
+ * @param buf Buffer to write the path to
+ * @param len Size of the buffer
+ * @return 0 on success, -1 on error
+ */
+int self_path(char *buf, size_t len);
+
+#endif // PROXY_H
@@ -0,0 +1,76 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "refspec.h"
+
+#include <string.h>
+
+static const char *const all_refspecs[] = {
+		"+refs/*:refs/*",
+		NULL,
+};
+
+/// GitHub keeps refs/pull/<n>/head and refs/pull/<n>/merge for every pull
+/// request ever opened, negative refspecs need git 2.29
+static const char *const no_pull_refspecs[] = {
+		"+refs/*:refs/*",
+		"^refs/pull/*",
+		NULL,
+};
+
+static const char *const heads_tags_refspecs[] = {
+		"+refs/heads/*:refs/heads/*",
+		"+refs/tags/*:refs/tags/*",
+		NULL,
+};
+
+const char *const *refspec_policy(enum ref_policy policy)
+{
+	switch (policy) {
+	case ref_policy_all:
+		break;
+	case ref_policy_no_pull:
+		return no_pull_refspecs;
+	case ref_policy_heads_tags:
+		return heads_tags_refspecs;
+	}
+	return all_refspecs;
+}
+
+/**
+ * Matches a ref against a refspec pattern with at most one "*".
+ * @param pattern Pattern, ending at its end or the given length
+ * @param len Length of the pattern
+ * @param ref Full name of the ref
+ * @return 1 if the ref matches, 0 if not
+ */
+static int pattern_match(const char *pattern, size_t len, const char *ref)
+{
+	const char *star = memchr(pattern, '*', len);
+	if (!star)
+		return strlen(ref) == len && !strncmp(ref, pattern, len);
+
+	const size_t prefix = star - pattern;
+	const size_t suffix = len - prefix - 1;
+	const size_t ref_len = strlen(ref);
+	return ref_len >= prefix + suffix && !strncmp(ref, pattern, prefix) &&
+	       !strncmp(ref + ref_len - suffix, star + 1, suffix);
+}
+
+int refspec_wants(const char *const *refspecs, const char *ref)
+{
+	int wanted = !strncmp(ref, "refs/tags/", 10);
+	for (size_t i = 0; refspecs[i]; i++) {
+		const char *spec = refspecs[i];
+		if (*spec == '^') {
+			if (pattern_match(spec + 1, strlen(spec + 1), ref))
+				return 0;
+			continue;
+		}
+		const char *dst = strchr(spec, ':');
+		if (dst && pattern_match(dst + 1, strlen(dst + 1), ref))
+			wanted = 1;
+	}
+	return wanted;
+}
@@ -0,0 +1,28 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef REFSPEC_H
+#define REFSPEC_H
+
+#include "config.h"
+
+/**
+ * Gets the fetch refspecs of mirrors following a ref policy.
+ * @param policy Ref policy
+ * @return NULL-terminated refspecs
+ */
+const char *const *refspec_policy(enum ref_policy policy);
+
+/**
+ * Checks whether a mirror fetching with the given refspecs keeps a ref.
+ * Only the destination side of a refspec is matched, with at most one "*",
+ * and refs matching a negative refspec ("^pattern") are never kept. Tags are
+ * always kept, as mirrors fetch them with --tags.
+ * @param refspecs NULL-terminated refspecs
+ * @param ref Full name of the ref
+ * @return 1 if the ref is kept, 0 if it should be pruned
+ */
+int refspec_wants(const char *const *refspecs, const char *ref);
+
+#endif // REFSPEC_H
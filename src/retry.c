@@ -0,0 +1,287 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "retry.h"
+
+#include <ctype.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "shutdown.h"
+
+/// Consecutive transient failures that open a breaker
+#define BREAKER_THRESHOLD 5
+/// Time a breaker stays open the first time, doubled on every reopening
+#define BREAKER_COOLDOWN_MS 30000
+/// Openings after which a host is given up on for the rest of the run
+#define BREAKER_MAX_OPENS 3
+/// Number of hosts tracked, further hosts are never turned away
+#define BREAKER_HOSTS 64
+
+struct breaker {
+	char host[RETRY_HOST_MAX];
+	/// Consecutive transient failures
+	unsigned failures;
+	/// Times the breaker opened since the host last succeeded
+	unsigned opens;
+	/// Time until which the breaker is open, 0 if closed
+	long long open_until;
+	/// Whether a request probing the host is in flight
+	int probing;
+};
+
+static struct breaker breakers[BREAKER_HOSTS];
+static size_t breakers_len;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/// xorshift64* generator, one per thread so that no lock is needed
+static uint64_t next_random(void)
+{
+	static _Thread_local uint64_t state;
+	if (state == 0) {
+		struct timespec ts;
+		clock_gettime(CLOCK_REALTIME, &ts);
+		state = ((uint64_t) ts.tv_sec << 30 ^ (uint64_t) ts.tv_nsec ^
+			 (uintptr_t) &state) |
+			1;
+	}
+	state ^= state >> 12;
+	state ^= state << 25;
+	state ^= state >> 27;
+	return state * 2685821657736338717ULL;
+}
+
+long retry_delay_ms(unsigned attempt, long base_ms, long max_ms)
+{
+	long bound = base_ms;
+	for (unsigned i = 1; i < attempt && bound < max_ms; i++)
+		bound *= 2;
+	if (bound > max_ms)
+		bound = max_ms;
+	if (bound <= 0)
+		return 0;
+	return (long) (next_random() % (uint64_t) (bound + 1));
+}
+
+int retry_sleep(long ms)
+{
+	const long long until = now_ms() + ms;
+	long long left;
+	while ((left = until - now_ms()) > 0) {
+		if (shutdown_requested())
+			return -1;
+		// Short naps, so that a shutdown is noticed quickly
+		if (left > 250)
+			left = 250;
+		const struct timespec ts = {
+				.tv_sec = 0,
+				.tv_nsec = (long) left * 1000000,
+		};
+		nanosleep(&ts, NULL);
+	}
+	return shutdown_requested() ? -1 : 0;
+}
+
+int retry_host(const char *url, char *host, size_t len)
+{
+	const char *start, *end;
+	const char *scheme = strstr(url, "://");
+	if (scheme) {
+		start = scheme + 3;
+		end = start + strcspn(start, "/?#");
+		// Skip credentials
+		const char *at = memchr(start, '@', end - start);
+		if (at)
+			start = at + 1;
+		if (*start == '[') {
+			// IPv6 literal
+			const char *close = memchr(start, ']', end - start);
+			if (!close)
+				return -1;
+			end = close + 1;
+		} else {
+			const char *colon = memchr(start, ':', end - start);
+			if (colon)
+				end = colon;
+		}
+	} else {
+		// scp-like syntax, user@host:path
+		end = strchr(url, ':');
+		if (!end)
+			return -1;
+		start = url;
+		const char *at = memchr(url, '@', end - url);
+		if (at)
+			start = at + 1;
+	}
+
+	const size_t n = end - start;
+	if (n == 0 || n >= len)
+		return -1;
+	memcpy(host, start, n);
+	host[n] = '\0';
+	return 0;
+}
+
+/// Finds or adds the breaker of a host, with the lock held
+static struct breaker *find(const char *host, int add)
+{
+	for (size_t i = 0; i < breakers_len; i++) {
+		if (!strcmp(breakers[i].host, host))
+			return &breakers[i];
+	}
+	if (!add || breakers_len == BREAKER_HOSTS ||
+	    strlen(host) >= RETRY_HOST_MAX)
+		return NULL;
+
+	struct breaker *b = &breakers[breakers_len++];
+	memset(b, 0, sizeof(*b));
+	strcpy(b->host, host);
+	return b;
+}
+
+/// Time the breaker stays open after its latest opening
+static long long cooldown(const struct breaker *b)
+{
+	return (long long) BREAKER_COOLDOWN_MS << (b->opens - 1);
+}
+
+long breaker_check(const char *host)
+{
+	long ret = 0;
+	pthread_mutex_lock(&lock);
+	struct breaker *b = find(host, 0);
+	if (!b || b->open_until == 0)
+		goto end;
+	if (b->opens > BREAKER_MAX_OPENS) {
+		ret = -1;
+		goto end;
+	}
+
+	const long long now = now_ms();
+	if (now < b->open_until) {
+		ret = (long) (b->open_until - now);
+	} else {
+		// Let this request probe the host, the others wait for its
+		// verdict. A probe that never reports is replaced by the next.
+		b->probing = 1;
+		b->open_until = now + cooldown(b);
+	}
+
+end:
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+void breaker_report(const char *host, int ok)
+{
+	pthread_mutex_lock(&lock);
+	struct breaker *b = find(host, !ok);
+	if (!b)
+		goto end;
+
+	if (ok) {
+		b->failures = 0;
+		b->opens = 0;
+		b->open_until = 0;
+		b->probing = 0;
+		goto end;
+	}
+
+	b->failures++;
+	// Requests that were in flight when the breaker opened don't reopen it
+	const int open = b->open_until != 0;
+	if (b->probing || (!open && b->failures >= BREAKER_THRESHOLD)) {
+		b->probing = 0;
+		b->opens++;
+		b->open_until = now_ms() + cooldown(b);
+	}
+
+end:
+	pthread_mutex_unlock(&lock);
+}
+
+/// Finds a string in another, ignoring case
+static const char *find_nocase(const char *s, const char *needle)
+{
+	const size_t len = strlen(needle);
+	for (; *s; s++) {
+		size_t i = 0;
+		while (i < len && tolower((unsigned char) s[i]) == needle[i])
+			i++;
+		if (i == len)
+			return s;
+	}
+	return NULL;
+}
+
+/// Checks the HTTP status following each occurrence of a prefix
+static int transient_status(const char *err, const char *prefix)
+{
+	for (const char *p = err; (p = find_nocase(p, prefix));) {
+		p += strlen(prefix);
+		const long code = strtol(p, NULL, 10);
+		if (code == 429 || (code >= 500 && code <= 599))
+			return 1;
+	}
+	return 0;
+}
+
+int retry_git_transient(const char *err)
+{
+	// Lowercase messages of git, curl, ssh and the resolver. A remote that
+	// refuses access may hang up after saying so, which wins.
+	static const char *const permanent[] = {
+			"not found",
+			"authentication failed",
+			"permission denied",
+			"access denied",
+			"could not read username",
+			"terminal prompts disabled",
+			"does not appear to be a git repository",
+	};
+	for (size_t i = 0; i < sizeof(permanent) / sizeof(*permanent); i++) {
+		if (find_nocase(err, permanent[i]))
+			return 0;
+	}
+	static const char *const network[] = {
+			"could not resolve host",
+			"could not resolve hostname",
+			"temporary failure in name resolution",
+			"timed out",
+			"connection refused",
+			"connection reset",
+			"connection closed by",
+			"failed to connect to",
+			"network is unreachable",
+			"no route to host",
+			"early eof",
+			"the remote end hung up",
+			"unexpected disconnect",
+			"transfer closed with",
+			"recv failure",
+			"send failure",
+			"ssl_error_syscall",
+			"gnutls recv error",
+			"kex_exchange_identification",
+			"broken pipe",
+	};
+	for (size_t i = 0; i < sizeof(network) / sizeof(*network); i++) {
+		if (find_nocase(err, network[i]))
+			return 1;
+	}
+	// "The requested URL returned error: 503", "RPC failed; HTTP 502"
+	return transient_status(err, "returned error: ") ||
+	       transient_status(err, "http ");
+}
@@ -0,0 +1,71 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <stddef.h>
+
+/// Longest length of a host name tracked by the circuit breakers
+#define RETRY_HOST_MAX 256
+
+/**
+ * Computes the delay before retrying, with full jitter: a uniformly random
+ * delay of up to base * 2^attempt, capped at max. Thread-safe.
+ * @param attempt Number of attempts so far, starting at 1
+ * @param base_ms Delay bound of the first retry in milliseconds
+ * @param max_ms Largest delay bound in milliseconds
+ * @return Delay in milliseconds
+ */
+long retry_delay_ms(unsigned attempt, long base_ms, long max_ms);
+
+/**
+ * Sleeps for the given time, returning early on a shutdown request.
+ * @param ms Time to sleep in milliseconds
+ * @return 0 after the full time, -1 if a shutdown was requested
+ */
+int retry_sleep(long ms);
+
+/**
+ * Extracts the host of a URL, either "scheme://[user@]host[:port]/..." or the
+ * scp-like "user@host:path" used for ssh.
+ * @param url URL
+ * @param host Buffer for the host
+ * @param len Size of the buffer
+ * @return 0 on success, -1 if the URL has no host or it doesn't fit
+ */
+int retry_host(const char *url, char *host, size_t len);
+
+/**
+ * Tells from the standard error of a failed git transfer whether it failed
+ * for a reason that may go away, a network error, a remote that hung up or an
+ * HTTP 429 or 5xx. Missing repositories, rejected credentials and local errors
+ * are permanent.
+ * @param err NUL-terminated standard error of git, or its end
+ * @return 1 if the failure may be transient, 0 if not
+ */
+int retry_git_transient(const char *err);
+
+/**
+ * Checks whether a host may be contacted. A host's circuit breaker opens
+ * after consecutive transient failures and turns requests away until a
+ * cooldown passes; then one request probes the host. A failed probe reopens
+ * the breaker with twice the cooldown, and after a few failed probes the host
+ * is given up on for the rest of the run. Thread-safe.
+ * @param host Host name
+ * @return 0 if the host may be contacted, milliseconds until it may be tried
+ * again, or -1 if it was given up on
+ */
+long breaker_check(const char *host);
+
+/**
+ * Records the outcome of a request to a host. Only transient failures count
+ * against the host; a permanent error shows that it responds. Thread-safe.
+ * @param host Host name
+ * @param ok Non-zero if the request succeeded or failed permanently, 0 on a
+ * transient failure
+ */
+void breaker_report(const char *host, int ok);
+
+#endif // RETRY_H
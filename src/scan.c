@@ -0,0 +1,405 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_state
+
+#include "scan.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "alloc.h"
+
+#define SCAN_BUCKETS 16384
+
+struct scan_node {
+	char *path;
+	enum scan_entry entry;
+	struct scan_node *next;
+};
+
+static struct scan_node **buckets;
+static char *base;
+static size_t base_len;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+/// Owner directories shared by the scanning threads
+struct scan_run {
+	char **owners;
+	size_t owners_len;
+	size_t next;
+	long mirrors;
+	pthread_mutex_t lock;
+};
+
+/// FNV-1a hash of a path
+static uint32_t path_hash(const char *path)
+{
+	uint32_t h = 2166136261u;
+	for (const char *p = path; *p; p++)
+		h = (h ^ (unsigned char) *p) * 16777619u;
+	return h;
+}
+
+static char *join(const char *dir, const char *name, const char *suffix)
+{
+	const size_t len = strlen(dir) + strlen(name) + strlen(suffix) + 2;
+	char *path = gmalloc(len);
+	if (path)
+		snprintf(path, len, "%s/%s%s", dir, name, suffix);
+	return path;
+}
+
+/// Adds or updates a path, with the lock held. Takes ownership of the path.
+static void set_locked(char *path, enum scan_entry entry)
+{
+	struct scan_node **b = &buckets[path_hash(path) % SCAN_BUCKETS];
+	for (struct scan_node *n = *b; n; n = n->next) {
+		if (!strcmp(n->path, path)) {
+			n->entry = entry;
+			gfree(path);
+			return;
+		}
+	}
+
+	struct scan_node *n = gmalloc(sizeof(*n));
+	if (!n) {
+		gfree(path);
+		return;
+	}
+	n->path = path;
+	n->entry = entry;
+	n->next = *b;
+	*b = n;
+}
+
+/// Checks whether a directory entry is a directory, following symlinks
+static int is_dir(DIR *dir, const struct dirent *ent)
+{
+	if (ent->d_type == DT_DIR)
+		return 1;
+	if (ent->d_type != DT_UNKNOWN && ent->d_type != DT_LNK)
+		return 0;
+	struct stat st;
+	return fstatat(dirfd(dir), ent->d_name, &st, 0) == 0 &&
+	       S_ISDIR(st.st_mode);
+}
+
+/// Checks whether a config line opens the [remote "origin"] section
+static int is_origin_section(const char *p)
+{
+	p++; // '['
+	p += strspn(p, " \t");
+	if (strncasecmp(p, "remote", 6) != 0 || (p[6] != ' ' && p[6] != '\t'))
+		return 0;
+	p += 6;
+	p += strspn(p, " \t");
+	if (strncmp(p, "\"origin\"", 8) != 0)
+		return 0;
+	p += 8;
+	p += strspn(p, " \t");
+	return *p == ']';
+}
+
+/// Removes trailing whitespace
+static void trim_end(char *s)
+{
+	size_t len = strlen(s);
+	while (len > 0 && (s[len - 1] == ' ' || s[len - 1] == '\t'))
+		s[--len] = '\0';
+}
+
+/**
+ * Calls a function for every key of the [remote "origin"] section of a
+ * repository's config file, in order.
+ * @param path Full path to the git repository
+ * @param fn Function called with the key and its value, NULL for a key
+ * without one
+ * @param arg Argument passed to the function
+ * @return 0 on success, -1 if the config can't be read
+ */
+static int origin_each(const char *path,
+		       void (*fn)(const char *key, const char *value, void *arg),
+		       void *arg)
+{
+	char *file = join(path, "config", "");
+	FILE *f = file ? fopen(file, "r") : NULL;
+	gfree(file);
+	if (!f)
+		return -1;
+
+	char line[1024];
+	int origin = 0;
+	while (fgets(line, sizeof(line), f)) {
+		char *p = line + strspn(line, " \t");
+		p[strcspn(p, "#;\r\n")] = '\0';
+		if (*p == '[') {
+			origin = is_origin_section(p);
+			continue;
+		}
+		if (!origin)
+			continue;
+
+		// "key = value", or just "key" for true
+		char *eq = strchr(p, '=');
+		if (eq)
+			*eq = '\0';
+		trim_end(p);
+		if (!*p)
+			continue;
+		char *value = NULL;
+		if (eq) {
+			value = eq + 1 + strspn(eq + 1, " \t");
+			trim_end(value);
+		}
+		fn(p, value, arg);
+	}
+	fclose(f);
+	return 0;
+}
+
+static void find_mirror(const char *key, const char *value, void *arg)
+{
+	int *mirror = arg;
+	if (strcasecmp(key, "mirror") != 0)
+		return;
+	*mirror = !value || !strcasecmp(value, "true") ||
+		  !strcasecmp(value, "yes") || !strcasecmp(value, "on") ||
+		  !strcmp(value, "1");
+}
+
+int scan_is_mirror(const char *path)
+{
+	int mirror = 0;
+	if (origin_each(path, find_mirror, &mirror) == -1)
+		return 0;
+	return mirror;
+}
+
+/// Fetch refspecs of the origin remote compared against the expected ones
+struct refspec_match {
+	const char *const *refspecs;
+	size_t next;
+	int match;
+};
+
+static void match_refspec(const char *key, const char *value, void *arg)
+{
+	struct refspec_match *m = arg;
+	if (strcasecmp(key, "fetch") != 0)
+		return;
+	if (!value || !m->refspecs[m->next] ||
+	    strcmp(value, m->refspecs[m->next]) != 0)
+		m->match = 0;
+	else
+		m->next++;
+}
+
+int scan_has_refspecs(const char *path, const char *const *refspecs)
+{
+	struct refspec_match m = {.refspecs = refspecs, .match = 1};
+	if (origin_each(path, match_refspec, &m) == -1)
+		return 0;
+	return m.match && !refspecs[m.next];
+}
+
+/**
+ * Indexes the repositories in an owner directory.
+ * @param owner Name of the owner directory
+ * @return Number of mirrors found
+ */
+static long scan_owner(const char *owner)
+{
+	char *owner_path = join(base, owner, "");
+	if (!owner_path)
+		return 0;
+	DIR *dir = opendir(owner_path);
+	if (!dir) {
+		perror("Error scanning owner directory");
+		gfree(owner_path);
+		return 0;
+	}
+
+	long mirrors = 0;
+	const struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		const size_t len = strlen(ent->d_name);
+		if (ent->d_name[0] == '.' || len <= 4 ||
+		    strcmp(ent->d_name + len - 4, ".git") != 0 ||
+		    !is_dir(dir, ent))
+			continue;
+		char *path = join(owner_path, ent->d_name, "");
+		if (!path)
+			continue;
+		const int mirror = scan_is_mirror(path);
+		mirrors += mirror;
+
+		pthread_mutex_lock(&lock);
+		set_locked(path, mirror ? scan_mirror : scan_dir);
+		pthread_mutex_unlock(&lock);
+	}
+	closedir(dir);
+
+	pthread_mutex_lock(&lock);
+	set_locked(owner_path, scan_dir);
+	pthread_mutex_unlock(&lock);
+	return mirrors;
+}
+
+static void *scan_worker(void *arg)
+{
+	struct scan_run *run = arg;
+	for (;;) {
+		pthread_mutex_lock(&run->lock);
+		const size_t i = run->next++;
+		pthread_mutex_unlock(&run->lock);
+		if (i >= run->owners_len)
+			break;
+
+		const long mirrors = scan_owner(run->owners[i]);
+		pthread_mutex_lock(&run->lock);
+		run->mirrors += mirrors;
+		pthread_mutex_unlock(&run->lock);
+	}
+	return NULL;
+}
+
+long scan_git_base(const char *git_base, int jobs)
+{
+	scan_free();
+	base = gstrdup(git_base);
+	buckets = gcalloc(SCAN_BUCKETS, sizeof(*buckets));
+	if (!base || !buckets) {
+		perror("malloc");
+		scan_free();
+		return -1;
+	}
+	base_len = strlen(base);
+
+	DIR *dir = opendir(git_base);
+	if (!dir) {
+		perror("Error scanning git base");
+		scan_free();
+		return -1;
+	}
+
+	// Collect the owner directories first, then scan them in parallel
+	struct scan_run run = {.lock = PTHREAD_MUTEX_INITIALIZER};
+	size_t cap = 0;
+	const struct dirent *ent;
+	while ((ent = readdir(dir))) {
+		if (ent->d_name[0] == '.' || !is_dir(dir, ent))
+			continue;
+		if (run.owners_len == cap) {
+			cap = cap ? cap * 2 : 64;
+			char **owners =
+					grealloc(run.owners, sizeof(*owners) * cap);
+			if (!owners)
+				break;
+			run.owners = owners;
+		}
+		run.owners[run.owners_len] = gstrdup(ent->d_name);
+		if (run.owners[run.owners_len])
+			run.owners_len++;
+	}
+	closedir(dir);
+
+	if (jobs < 1)
+		jobs = 1;
+	if ((size_t) jobs > run.owners_len)
+		jobs = (int) run.owners_len;
+	pthread_t *threads = gmalloc(sizeof(*threads) * (jobs ? jobs : 1));
+	int started = 0;
+	while (threads && started < jobs &&
+	       pthread_create(&threads[started], NULL, scan_worker, &run) == 0)
+		started++;
+	// Without threads, scan on this one
+	if (started == 0)
+		scan_worker(&run);
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	gfree(threads);
+
+	for (size_t i = 0; i < run.owners_len; i++)
+		gfree(run.owners[i]);
+	gfree(run.owners);
+	pthread_mutex_destroy(&run.lock);
+	return run.mirrors;
+}
+
+enum scan_entry scan_lookup(const char *path)
+{
+	enum scan_entry entry = scan_unknown;
+	pthread_mutex_lock(&lock);
+	if (!buckets || strncmp(path, base, base_len) != 0 ||
+	    path[base_len] != '/')
+		goto end;
+
+	entry = scan_none;
+	const struct scan_node *n = buckets[path_hash(path) % SCAN_BUCKETS];
+	for (; n; n = n->next) {
+		if (!strcmp(n->path, path)) {
+			entry = n->entry;
+			break;
+		}
+	}
+
+end:
+	pthread_mutex_unlock(&lock);
+	return entry;
+}
+
+int scan_check_mirror(const char *path)
+{
+	switch (scan_lookup(path)) {
+	case scan_mirror:
+		return 1;
+	case scan_dir:
+		return 0;
+	case scan_none:
+		return access(path, F_OK) == -1 ? 0 : -1;
+	case scan_unknown:
+		break;
+	}
+	return -1;
+}
+
+void scan_set(const char *path, enum scan_entry entry)
+{
+	pthread_mutex_lock(&lock);
+	if (buckets && !strncmp(path, base, base_len) &&
+	    path[base_len] == '/') {
+		char *copy = gstrdup(path);
+		if (copy)
+			set_locked(copy, entry);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void scan_free(void)
+{
+	pthread_mutex_lock(&lock);
+	for (size_t i = 0; buckets && i < SCAN_BUCKETS; i++) {
+		struct scan_node *n = buckets[i];
+		while (n) {
+			struct scan_node *next = n->next;
+			gfree(n->path);
+			gfree(n);
+			n = next;
+		}
+	}
+	gfree(buckets);
+	gfree(base);
+	buckets = NULL;
+	base = NULL;
+	base_len = 0;
+	pthread_mutex_unlock(&lock);
+}
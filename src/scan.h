@@ -0,0 +1,76 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SCAN_H
+#define SCAN_H
+
+/// What is known about a path under the git base directory
+enum scan_entry {
+	/// Not covered by the index, look at the file system
+	scan_unknown = -1,
+	/// Did not exist when the base directory was scanned
+	scan_none = 0,
+	/// A directory, such as an owner's or a repository that isn't a mirror
+	scan_dir,
+	/// A repository whose origin is a mirror
+	scan_mirror,
+};
+
+/**
+ * Walks the git base directory once and indexes the owner directories and
+ * the mirrors in them, reading each repository's config file instead of
+ * running git. Owner directories are scanned in parallel. Until this is
+ * called, every lookup is scan_unknown.
+ * @param git_base Base path of the git mirrors
+ * @param jobs Most owner directories scanned at once
+ * @return Number of mirrors found, or -1 on error
+ */
+long scan_git_base(const char *git_base, int jobs);
+
+/**
+ * Checks whether the config file of a bare repository marks its origin remote
+ * as a mirror.
+ * @param path Full path to the git repository
+ * @return 1 if it does, 0 if not or the config can't be read
+ */
+int scan_is_mirror(const char *path);
+
+/**
+ * Checks whether the fetch refspecs of a repository's origin remote are
+ * exactly the given ones, in order, reading its config file.
+ * @param path Full path to the git repository
+ * @param refspecs NULL-terminated refspecs
+ * @return 1 if they are, 0 if not or the config can't be read
+ */
+int scan_has_refspecs(const char *path, const char *const *refspecs);
+
+/**
+ * Looks up a path in the index. Thread-safe.
+ * @param path Full path to an owner directory or a git repository, as built by
+ * get_git_path()
+ * @return What the path is, or scan_unknown if it isn't indexed
+ */
+enum scan_entry scan_lookup(const char *path);
+
+/**
+ * Answers whether a git repository is a mirror from the index where it can.
+ * A repository that didn't exist at the scan is checked for again, in case
+ * another run created it since. Thread-safe.
+ * @param path Full path to the git repository
+ * @return 1 if it is a mirror, 0 if it isn't, -1 if git must be asked
+ */
+int scan_check_mirror(const char *path);
+
+/**
+ * Records a path created or changed since the scan. Does nothing if the index
+ * wasn't built. Thread-safe.
+ * @param path Full path to an owner directory or a git repository
+ * @param entry What the path now is
+ */
+void scan_set(const char *path, enum scan_entry entry);
+
+/// Frees the index
+void scan_free(void);
+
+#endif // SCAN_H
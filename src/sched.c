@@ -0,0 +1,757 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_sched
+
+#include "sched.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "alloc.h"
+#include "checkpoint.h"
+#include "metrics.h"
+#include "retry.h"
+#include "shutdown.h"
+#include "state.h"
+#include "summary.h"
+#include "timing.h"
+
+/// Fixed cost of a job that has never been mirrored, in milliseconds
+#define JOB_OVERHEAD_MS 1000
+/// Assumed clone throughput for repositories without history, in KiB/s
+#define CLONE_KIB_PER_SEC (10 * 1024)
+/// A job taking this many times longer than its last run is a latency spike
+#define LATENCY_SPIKE_FACTOR 2
+/// Jobs shorter than this are too noisy to count as latency spikes, in ms
+#define LATENCY_MIN_MS 2000
+/// Delay bound of the first retry of a failed transfer and the largest bound
+#define RETRY_BASE_MS 5000
+#define RETRY_MAX_MS 60000
+/// Longest a job waits for its host's breaker before checking again, in ms
+#define DEFER_MAX_MS 5000
+/// Runs in a row a job is deferred for the time budget before one starts it
+/// anyway
+#define OVERDUE_RUNS 3
+
+/// Order of jobs under a time budget, earlier tiers start first
+enum job_tier {
+	/// Mirrors that may be behind their upstream, stalest first
+	tier_stale,
+	/// Mirrors that never succeeded, cheapest first
+	tier_clone,
+	/// Mirrors that succeeded after the upstream's last push
+	tier_fresh,
+};
+
+struct mirror_job {
+	/// Repository context, its strings are owned by the job
+	struct repo_ctx ctx;
+	/// Expected duration in milliseconds
+	long long cost;
+	/// Duration of the last successful run in milliseconds, -1 if unknown
+	long long last_ms;
+	/// Time the mirror last succeeded, 0 if never
+	int64_t last_success;
+	enum job_tier tier;
+	/// Host of the URL for its circuit breaker, or NULL
+	char *host;
+	/// Number of failed transfers so far
+	unsigned attempts;
+	/// Time before which a retried job doesn't start
+	long long not_before;
+	/// Consecutive earlier runs that deferred the job for the time budget
+	uint32_t deferrals;
+	/// Started even if it doesn't fit in the time budget
+	int overdue;
+};
+
+struct job_list {
+	struct mirror_job *jobs;
+	size_t len;
+	size_t cap;
+};
+
+/// Time new jobs may start in
+struct budget {
+	/// Length of the budget in milliseconds, 0 for no limit
+	long long ms;
+	/// Time the budget runs out
+	long long deadline;
+	/// Jobs not started because they wouldn't finish in time
+	size_t deferred;
+	/// Whether an overdue job was picked to start regardless
+	int overdue;
+};
+
+struct sched {
+	/// Jobs started first, and jobs started once those finished
+	struct job_list phases[2];
+	struct budget budget;
+};
+
+/**
+ * Additive increase, multiplicative decrease controller of the number of
+ * jobs in flight, as used for TCP congestion windows.
+ */
+struct aimd {
+	/// Jobs allowed in flight, fractional to grow by one per round
+	double limit;
+	/// Limit below which it grows by one per completed job
+	double threshold;
+	int min;
+	int max;
+	/// Incremented on every decrease, so that jobs started before it don't
+	/// decrease the limit again
+	unsigned long epoch;
+};
+
+/// State shared by the workers of one phase
+struct run_state {
+	pthread_mutex_t lock;
+	/// Signalled when a job finished
+	pthread_cond_t done;
+	struct job_list *list;
+	/// Index of the next job to start
+	size_t next;
+	/// Indices of jobs waiting to be retried
+	size_t *retry;
+	size_t retry_len;
+	size_t retry_cap;
+	/// Times a failed transfer is retried
+	unsigned retries;
+	/// Number of jobs running
+	int in_flight;
+	struct aimd *aimd;
+	struct budget *budget;
+	int quiet;
+	int failed;
+};
+
+struct sched *sched_new(void)
+{
+	return gcalloc(1, sizeof(struct sched));
+}
+
+static char *dup_or_null(const char *s) { return s ? gstrdup(s) : NULL; }
+
+static void job_free(struct mirror_job *job)
+{
+	gfree((char *) job->ctx.owner);
+	gfree((char *) job->ctx.name);
+	gfree((char *) job->ctx.url);
+	gfree((char *) job->ctx.username);
+	gfree((char *) job->ctx.parent);
+	gfree(job->host);
+}
+
+static long long estimate_cost(const struct repo_ctx *ctx, long long disk_usage)
+{
+	const long long ms = state_duration(ctx->owner, ctx->name);
+	if (ms >= 0)
+		return ms;
+	return JOB_OVERHEAD_MS + disk_usage * 1000 / CLONE_KIB_PER_SEC;
+}
+
+int sched_add(struct sched *sched, const struct repo_ctx *ctx,
+	      long long disk_usage, int after_parents)
+{
+	struct job_list *list = &sched->phases[after_parents ? 1 : 0];
+
+	if (list->len == list->cap) {
+		const size_t cap = list->cap ? list->cap * 2 : 64;
+		struct mirror_job *jobs =
+				grealloc(list->jobs, sizeof(*jobs) * cap);
+		if (!jobs) {
+			perror("realloc");
+			return -1;
+		}
+		list->jobs = jobs;
+		list->cap = cap;
+	}
+
+	struct mirror_job *job = &list->jobs[list->len];
+	job->ctx = *ctx;
+	job->ctx.owner = dup_or_null(ctx->owner);
+	job->ctx.name = dup_or_null(ctx->name);
+	job->ctx.url = dup_or_null(ctx->url);
+	job->ctx.username = dup_or_null(ctx->username);
+	job->ctx.parent = dup_or_null(ctx->parent);
+	if (!job->ctx.owner || !job->ctx.name || !job->ctx.url ||
+	    (ctx->username && !job->ctx.username) ||
+	    (ctx->parent && !job->ctx.parent)) {
+		perror("strdup");
+		job_free(job);
+		return -1;
+	}
+	char host[RETRY_HOST_MAX];
+	job->host = retry_host(ctx->url, host, sizeof(host)) == 0
+			    ? gstrdup(host)
+			    : NULL;
+	job->attempts = 0;
+	job->not_before = 0;
+	job->last_ms = state_duration(ctx->owner, ctx->name);
+	job->cost = estimate_cost(ctx, disk_usage);
+
+	struct state_record rec;
+	const int known = state_get(ctx->owner, ctx->name, &rec);
+	job->last_success = known ? rec.last_success : 0;
+	job->deferrals = known ? rec.deferrals : 0;
+	job->overdue = 0;
+	if (!job->last_success)
+		job->tier = tier_clone;
+	else if (ctx->pushed_at && ctx->pushed_at <= job->last_success)
+		job->tier = tier_fresh;
+	else
+		job->tier = tier_stale;
+	list->len++;
+	return 0;
+}
+
+static int job_cmp(const void *a, const void *b)
+{
+	const struct mirror_job *ja = a, *jb = b;
+	if (ja->cost != jb->cost)
+		return ja->cost < jb->cost ? 1 : -1;
+	return 0;
+}
+
+/// Orders jobs under a time budget, so that mirrors that fall behind in one
+/// run go first in the next
+static int budget_cmp(const void *a, const void *b)
+{
+	const struct mirror_job *ja = a, *jb = b;
+	if (ja->tier != jb->tier)
+		return ja->tier < jb->tier ? -1 : 1;
+	if (ja->tier != tier_clone && ja->last_success != jb->last_success)
+		return ja->last_success < jb->last_success ? -1 : 1;
+	if (ja->cost != jb->cost)
+		return ja->cost < jb->cost ? -1 : 1;
+	return 0;
+}
+
+static long long now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int sched_parse_budget(const char *spec, long long *ms)
+{
+	// strtoll would also take whitespace and signs
+	if (*spec < '0' || *spec > '9')
+		return -1;
+	char *end;
+	errno = 0;
+	const long long v = strtoll(spec, &end, 10);
+	if (errno || v <= 0 || (*end && end[1]))
+		return -1;
+
+	long long unit;
+	switch (*end) {
+	case '\0':
+	case 's':
+		unit = 1;
+		break;
+	case 'm':
+		unit = 60;
+		break;
+	case 'h':
+		unit = 60 * 60;
+		break;
+	default:
+		return -1;
+	}
+	// A week is plenty for any sweep
+	if (v > 7 * 24 * 60 * 60 / unit)
+		return -1;
+	*ms = v * unit * 1000;
+	return 0;
+}
+
+void sched_budget(struct sched *sched, long long ms)
+{
+	sched->budget.ms = ms > 0 ? ms : 0;
+	sched->budget.deadline = now_ms() + sched->budget.ms;
+}
+
+/**
+ * Checks whether a job is expected to finish within the time budget.
+ * @param st Run state
+ * @param job Job to check
+ * @param delay Time until the job would start, in ms
+ * @return Non-zero if it fits or there is no budget
+ */
+static int fits(const struct run_state *st, const struct mirror_job *job,
+		long long delay)
+{
+	const struct budget *budget = st->budget;
+	return !budget->ms || now_ms() + delay + job->cost <= budget->deadline;
+}
+
+/// Leaves a job to the next run, with the lock held
+static void defer(struct run_state *st, const struct mirror_job *job)
+{
+	st->budget->deferred++;
+	metrics_add(metric_jobs_deferred, 1);
+	state_defer(job->ctx.owner, job->ctx.name);
+	if (job->cost > st->budget->ms)
+		fprintf(stderr,
+			"%s/%s is expected to take %.0fs, longer than the "
+			"time budget\n",
+			job->ctx.owner, job->ctx.name,
+			(double) job->cost / 1000);
+}
+
+static void aimd_set(struct aimd *aimd, double limit, int quiet,
+		     const char *reason)
+{
+	const int before = (int) aimd->limit;
+	if (limit < aimd->min)
+		limit = aimd->min;
+	if (limit > aimd->max)
+		limit = aimd->max;
+	aimd->limit = limit;
+
+	const int after = (int) limit;
+	metrics_set(metric_concurrency_limit, after);
+	if (after != before && !quiet)
+		printf("Concurrency: %d -> %d (%s)\n", before, after, reason);
+}
+
+/**
+ * Adjusts the concurrency limit once a job finished, with the lock held.
+ * @param st Run state
+ * @param job Finished job
+ * @param ret Result of the job
+ * @param ms Duration of the job in milliseconds
+ * @param epoch Epoch of the controller when the job started
+ */
+static void aimd_update(struct run_state *st, const struct mirror_job *job,
+			int ret, long long ms, unsigned long epoch)
+{
+	struct aimd *aimd = st->aimd;
+	// A permanent failure, like a deleted upstream, says nothing about
+	// the load
+	if (aimd->min == aimd->max || ret > 0 || ret == -1)
+		return;
+
+	const int spike = ret == 0 && job->last_ms >= LATENCY_MIN_MS &&
+			  ms > job->last_ms * LATENCY_SPIKE_FACTOR;
+	if (ret == -2 || spike) {
+		// Jobs started before the last decrease already ran with a
+		// higher limit, their failures are not news
+		if (epoch != aimd->epoch)
+			return;
+		aimd->epoch++;
+		aimd->threshold = aimd->limit / 2;
+		metrics_add(spike ? metric_concurrency_decreases_latency
+				  : metric_concurrency_decreases_failure,
+			    1);
+		aimd_set(aimd, aimd->threshold, st->quiet,
+			 spike ? "latency spike" : "transient failure");
+		return;
+	}
+
+	const int before = (int) aimd->limit;
+	// Grow quickly up to the threshold, then by one per round
+	aimd_set(aimd,
+		 aimd->limit < aimd->threshold ? aimd->limit + 1
+					       : aimd->limit + 1 / aimd->limit,
+		 st->quiet, "throughput holds");
+	if ((int) aimd->limit > before)
+		metrics_add(metric_concurrency_increases, 1);
+}
+
+/// Waits on the run state's condition for up to the given time
+static void wait_done(struct run_state *st, long long ms)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	pthread_cond_timedwait(&st->done, &st->lock, &ts);
+}
+
+/**
+ * Takes a retry that is due, with the lock held. Retries that would not
+ * finish within the time budget are deferred.
+ * @param st Run state
+ * @param out Set to the index of the job
+ * @param wait Lowered to the time until the next retry is due, in ms
+ * @return 1 if a job was taken, 0 if none is due
+ */
+static int take_retry(struct run_state *st, size_t *out, long long *wait)
+{
+	const long long now = now_ms();
+	for (size_t k = 0; k < st->retry_len;) {
+		const size_t i = st->retry[k];
+		const struct mirror_job *job = &st->list->jobs[i];
+		const long long due = job->not_before - now;
+		if (!fits(st, job, due > 0 ? due : 0)) {
+			st->retry[k] = st->retry[--st->retry_len];
+			defer(st, job);
+			continue;
+		}
+		if (due <= 0) {
+			st->retry[k] = st->retry[--st->retry_len];
+			*out = i;
+			return 1;
+		}
+		if (due < *wait)
+			*wait = due;
+		k++;
+	}
+	return 0;
+}
+
+/**
+ * Takes the next job once one is due and the concurrency limit allows it,
+ * with the lock held. Due retries go before new jobs. New jobs that would not
+ * finish within the time budget are deferred; as the remaining time only
+ * shrinks, they are not looked at again.
+ * @param st Run state
+ * @param out Set to the index of the job
+ * @return 1 if a job was taken, 0 if no jobs are left or on shutdown
+ */
+static int take_job(struct run_state *st, size_t *out)
+{
+	while (!shutdown_requested()) {
+		const int fresh = st->next < st->list->len;
+		// Running jobs may still fail and be retried
+		if (!fresh && st->retry_len == 0 && st->in_flight == 0)
+			return 0;
+
+		// Wake up now and then to notice a shutdown
+		long long wait = 1000;
+		if (st->in_flight < (int) st->aimd->limit) {
+			int taken = take_retry(st, out, &wait);
+			while (!taken && st->next < st->list->len) {
+				const size_t i = st->next++;
+				if (st->list->jobs[i].overdue ||
+				    fits(st, &st->list->jobs[i], 0)) {
+					*out = i;
+					taken = 1;
+				} else {
+					defer(st, &st->list->jobs[i]);
+				}
+			}
+			if (taken) {
+				st->in_flight++;
+				return 1;
+			}
+			// Everything left was deferred
+			if (st->retry_len == 0 && st->in_flight == 0)
+				return 0;
+		}
+		wait_done(st, wait);
+	}
+	return 0;
+}
+
+/**
+ * Queues a job to run again later, with the lock held.
+ * @return 0 on success, -1 on error
+ */
+static int requeue(struct run_state *st, size_t i, long long delay)
+{
+	if (st->retry_len == st->retry_cap) {
+		const size_t cap = st->retry_cap ? st->retry_cap * 2 : 16;
+		size_t *retry = grealloc(st->retry, sizeof(*retry) * cap);
+		if (!retry) {
+			perror("realloc");
+			return -1;
+		}
+		st->retry = retry;
+		st->retry_cap = cap;
+	}
+	st->list->jobs[i].not_before = now_ms() + delay;
+	st->retry[st->retry_len++] = i;
+	return 0;
+}
+
+/**
+ * Records the outcome of a job, retrying failed transfers, with the lock
+ * held.
+ * @param st Run state
+ * @param i Index of the job
+ * @param ret Result of git_mirror_repo(), or -3 if the job's host was given up
+ * on
+ */
+static void job_done(struct run_state *st, size_t i, int ret)
+{
+	struct mirror_job *job = &st->list->jobs[i];
+
+	if (ret == -2 && job->attempts < st->retries && !shutdown_requested()) {
+		const long delay = retry_delay_ms(job->attempts + 1,
+						  RETRY_BASE_MS, RETRY_MAX_MS);
+		// A retry past the time budget is left to the next run
+		if (fits(st, job, delay) && requeue(st, i, delay) == 0) {
+			job->attempts++;
+			fprintf(stderr, "Retrying %s/%s in %.1fs (%u of %u)\n",
+				job->ctx.owner, job->ctx.name,
+				(double) delay / 1000, job->attempts,
+				st->retries);
+			metrics_add(metric_jobs_retried, 1);
+			return;
+		}
+	}
+
+	if (ret > 0) {
+		// Locked by another run
+		metrics_add(metric_jobs_locked, 1);
+		return;
+	}
+	if (ret == 0) {
+		metrics_add(metric_jobs_ok, 1);
+		return;
+	}
+
+	fprintf(stderr, "Failed to mirror repo: %s/%s\n", job->ctx.owner,
+		job->ctx.name);
+	metrics_add(metric_jobs_failed, 1);
+	st->failed = 1;
+
+	char what[512], reason[128];
+	snprintf(what, sizeof(what), "%s/%s", job->ctx.owner, job->ctx.name);
+	if (ret == -3)
+		snprintf(reason, sizeof(reason),
+			 "gave up on %s after repeated failures", job->host);
+	else if (ret == -2)
+		snprintf(reason, sizeof(reason), "transfer failed %u time%s",
+			 job->attempts + 1, job->attempts ? "s" : "");
+	else
+		snprintf(reason, sizeof(reason), "error");
+	summary_add(what, reason);
+}
+
+/// Records the outcome of an attempt in the state database
+static void record_state(const struct mirror_job *job, int ret, long long ms)
+{
+	char error[128];
+	if (ret == -3)
+		snprintf(error, sizeof(error), "gave up on %s", job->host);
+	else
+		snprintf(error, sizeof(error), "%s",
+			 ret == -2 ? "transfer failed" : "error");
+	state_update(job->ctx.owner, job->ctx.name, ret, ms,
+		     (int64_t) job->ctx.pushed_at, ret == 0 ? NULL : error);
+}
+
+static void *worker(void *arg)
+{
+	struct run_state *st = arg;
+
+	// Running jobs finish on shutdown, but no new ones start
+	for (;;) {
+		size_t i;
+		pthread_mutex_lock(&st->lock);
+		const int taken = take_job(st, &i);
+		const unsigned long epoch = st->aimd->epoch;
+		pthread_mutex_unlock(&st->lock);
+		if (!taken)
+			break;
+
+		const struct mirror_job *job = &st->list->jobs[i];
+
+		// Leave a host whose breaker is open alone for a while
+		const long wait = job->host ? breaker_check(job->host) : 0;
+		if (wait > 0) {
+			pthread_mutex_lock(&st->lock);
+			st->in_flight--;
+			const long delay = wait < DEFER_MAX_MS ? wait
+							       : DEFER_MAX_MS;
+			if (requeue(st, i, delay) < 0)
+				job_done(st, i, -1);
+			pthread_cond_broadcast(&st->done);
+			pthread_mutex_unlock(&st->lock);
+			continue;
+		}
+
+		int ret = -3;
+		long long ms = 0;
+		if (wait == 0) {
+			if (!st->quiet)
+				printf("Repo: %s/%s\t%s\n", job->ctx.owner,
+				       job->ctx.name, job->ctx.url);
+
+			const long long start = timing_now();
+			ret = git_mirror_repo(&job->ctx, st->quiet);
+			const long long us = timing_now() - start;
+			ms = us / 1000;
+			if (ret != 1)
+				timing_repo(job->ctx.owner, job->ctx.name, us);
+
+			// Only transient failures count against the host, and
+			// other errors say nothing about it
+			if (job->host && (ret == 0 || ret == -2))
+				breaker_report(job->host, ret == 0);
+			if (ret == 0)
+				checkpoint_done(job->ctx.owner, job->ctx.name);
+		}
+		if (ret != 1)
+			record_state(job, ret, ms);
+
+		pthread_mutex_lock(&st->lock);
+		st->in_flight--;
+		job_done(st, i, ret);
+		if (ret != -3)
+			aimd_update(st, job, ret, ms, epoch);
+		pthread_cond_broadcast(&st->done);
+		pthread_mutex_unlock(&st->lock);
+	}
+
+	// Let waiting workers see the shutdown
+	pthread_mutex_lock(&st->lock);
+	pthread_cond_broadcast(&st->done);
+	pthread_mutex_unlock(&st->lock);
+	return NULL;
+}
+
+/**
+ * Picks the job deferred the most runs in a row, once it was deferred
+ * OVERDUE_RUNS times, to start first regardless of the time budget. Without
+ * this, a job that never fits, like a new mirror larger than the whole budget,
+ * would be deferred forever. One job is picked per run.
+ * @param list Jobs of the phase, in the order they start
+ * @param budget Time budget
+ * @param quiet Suppress output if non-zero
+ */
+static void pick_overdue(struct job_list *list, struct budget *budget,
+			 int quiet)
+{
+	if (!budget->ms || budget->overdue)
+		return;
+	size_t pick = list->len;
+	for (size_t i = 0; i < list->len; i++) {
+		const struct mirror_job *job = &list->jobs[i];
+		if (job->deferrals >= OVERDUE_RUNS &&
+		    (pick == list->len ||
+		     job->deferrals > list->jobs[pick].deferrals))
+			pick = i;
+	}
+	if (pick == list->len)
+		return;
+
+	// Start it first, so that it overruns the budget the least
+	struct mirror_job job = list->jobs[pick];
+	memmove(&list->jobs[1], &list->jobs[0], sizeof(job) * pick);
+	job.overdue = 1;
+	list->jobs[0] = job;
+	budget->overdue = 1;
+	if (!quiet)
+		printf("Time budget: %s/%s was deferred %u runs in a row, "
+		       "starting it regardless\n",
+		       job.ctx.owner, job.ctx.name, job.deferrals);
+}
+
+/**
+ * Runs the jobs of one phase to completion.
+ * @return 0 if all jobs succeeded, -1 otherwise
+ */
+static int run_phase(struct job_list *list, struct aimd *aimd,
+		     struct budget *budget, unsigned retries, int quiet)
+{
+	if (list->len == 0)
+		return 0;
+
+	// Longest processing time first, unless time is short
+	qsort(list->jobs, list->len, sizeof(*list->jobs),
+	      budget->ms ? budget_cmp : job_cmp);
+	pick_overdue(list, budget, quiet);
+
+	struct run_state st = {
+			.list = list,
+			.next = 0,
+			.retry = NULL,
+			.retry_len = 0,
+			.retry_cap = 0,
+			.retries = retries,
+			.in_flight = 0,
+			.aimd = aimd,
+			.budget = budget,
+			.quiet = quiet,
+			.failed = 0,
+	};
+	pthread_mutex_init(&st.lock, NULL);
+	pthread_cond_init(&st.done, NULL);
+
+	// Enough workers for the largest limit, the surplus waits
+	int jobs = aimd->max;
+	if ((size_t) jobs > list->len)
+		jobs = (int) list->len;
+
+	pthread_t *threads = gmalloc(sizeof(*threads) * jobs);
+	int started = 0;
+	if (threads) {
+		for (; started < jobs; started++) {
+			if (pthread_create(&threads[started], NULL, worker,
+					   &st) != 0)
+				break;
+		}
+	}
+	// Run on this thread if no worker could be started
+	if (started == 0)
+		worker(&st);
+	for (int i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	gfree(threads);
+
+	gfree(st.retry);
+	pthread_cond_destroy(&st.done);
+	pthread_mutex_destroy(&st.lock);
+	return st.failed ? -1 : 0;
+}
+
+int sched_run(struct sched *sched, int jobs_min, int jobs, unsigned retries,
+	      int quiet)
+{
+	if (jobs < 1)
+		jobs = 1;
+	if (jobs_min < 1 || jobs_min > jobs)
+		jobs_min = jobs;
+
+	// Start low and let successes find the limit the remote tolerates
+	struct aimd aimd = {
+			.limit = jobs_min,
+			.threshold = jobs,
+			.min = jobs_min,
+			.max = jobs,
+			.epoch = 0,
+	};
+	metrics_set(metric_concurrency_limit, jobs_min);
+
+	int status = 0;
+	for (size_t i = 0; i < 2 && !shutdown_requested(); i++) {
+		if (run_phase(&sched->phases[i], &aimd, &sched->budget,
+			      retries, quiet) != 0)
+			status = -1;
+	}
+	if (sched->budget.deferred && !quiet)
+		printf("Time budget: %zu mirror%s deferred to the next run\n",
+		       sched->budget.deferred,
+		       sched->budget.deferred == 1 ? "" : "s");
+	return status;
+}
+
+void sched_free(struct sched *sched)
+{
+	if (!sched)
+		return;
+	for (size_t i = 0; i < 2; i++) {
+		for (size_t j = 0; j < sched->phases[i].len; j++)
+			job_free(&sched->phases[i].jobs[j]);
+		gfree(sched->phases[i].jobs);
+	}
+	gfree(sched);
+}
@@ -0,0 +1,88 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SCHED_H
+#define SCHED_H
+
+#include "git.h"
+
+/// Queue of mirror jobs run in parallel, longest expected job first
+struct sched;
+
+/**
+ * Creates an empty job queue.
+ * @return The queue, or NULL on error
+ */
+struct sched *sched_new(void);
+
+/**
+ * Adds a mirror job to the queue.
+ * The expected cost of the job is the duration of its last successful run,
+ * or an estimate from the repository size if it has never been mirrored.
+ * @param sched Job queue
+ * @param ctx Repository context, copied into the job
+ * @param disk_usage Size of the repository in kilobytes, 0 if unknown
+ * @param after_parents Non-zero to only start the job once all other jobs
+ * finished, so that the mirrors of its parents exist
+ * @return 0 on success, -1 on error
+ */
+int sched_add(struct sched *sched, const struct repo_ctx *ctx,
+	      long long disk_usage, int after_parents);
+
+/**
+ * Parses a time budget: a positive whole number of seconds, minutes or hours
+ * with an optional s, m or h suffix, seconds by default, of at most a week.
+ * @param spec Duration, e.g. "30m"
+ * @param ms Set to the duration in milliseconds
+ * @return 0 on success, -1 on error
+ */
+int sched_parse_budget(const char *spec, long long *ms);
+
+/**
+ * Limits the time in which jobs are started. With a budget, the mirrors that
+ * may be behind their upstream start first, the ones that were updated the
+ * longest ago first, then mirrors that never succeeded, cheapest first, and
+ * mirrors that are known to be current last. A job is only started if its
+ * expected cost fits in the remaining time, the others are left to the next
+ * run, which then starts them first. So that jobs that never fit are not left
+ * behind forever, each run starts the job deferred the most runs in a row
+ * first and regardless of the budget, once it was deferred three times.
+ * Running jobs are not stopped when the budget runs out.
+ * @param sched Job queue
+ * @param ms Budget in milliseconds from now, 0 for no limit
+ */
+void sched_budget(struct sched *sched, long long ms);
+
+/**
+ * Runs all queued jobs with a bounded number of jobs in flight.
+ * The limit starts at jobs_min and adapts like a TCP congestion window: it
+ * grows while jobs succeed and halves when a transfer fails in a way that may
+ * go away or a job takes more than twice as long as its last run. Permanent
+ * failures leave it as it is. Jobs are started in order of decreasing
+ * expected cost, so the largest jobs start first and cheap jobs fill in around
+ * them. A failed job does not stop the others. Failed transfers are retried
+ * after a jittered exponential backoff, and jobs whose host's circuit breaker
+ * is open wait while other hosts' jobs run. Failures are added to the summary.
+ * The outcome of every attempt is recorded in the state database and the
+ * completion of successful jobs in the checkpoint journal. Once a shutdown is
+ * requested or the time budget set by sched_budget() runs out, no new jobs are
+ * started.
+ * @param sched Job queue
+ * @param jobs_min Minimum number of jobs in flight
+ * @param jobs Maximum number of jobs in flight, equal to jobs_min for a fixed
+ *             limit
+ * @param retries Times a failed transfer is retried
+ * @param quiet Suppress output if non-zero
+ * @return 0 if all jobs succeeded, -1 otherwise
+ */
+int sched_run(struct sched *sched, int jobs_min, int jobs, unsigned retries,
+	      int quiet);
+
+/**
+ * Free the job queue
+ * @param sched The job queue to free
+ */
+void sched_free(struct sched *sched);
+
+#endif // SCHED_H
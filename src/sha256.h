@@ -0,0 +1,40 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Length of a digest in hex, without the NUL
+#define SHA256_HEX_LEN 64
+
+/// Incremental SHA-256, used to verify LFS objects as they download
+struct sha256 {
+	uint32_t state[8];
+	/// Bytes hashed so far
+	uint64_t len;
+	/// Input not yet forming a whole block
+	uint8_t block[64];
+};
+
+void sha256_init(struct sha256 *ctx);
+
+/**
+ * Hashes more input.
+ * @param ctx Hash state
+ * @param data Input
+ * @param len Length of the input
+ */
+void sha256_update(struct sha256 *ctx, const void *data, size_t len);
+
+/**
+ * Finishes the hash. The state must be initialized again before reuse.
+ * @param ctx Hash state
+ * @param hex Set to the NUL-terminated lowercase hex digest
+ */
+void sha256_final(struct sha256 *ctx, char hex[SHA256_HEX_LEN + 1]);
+
+#endif // SHA256_H
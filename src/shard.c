@@ -0,0 +1,39 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "shard.h"
+
+#include <ctype.h>
+
+/// FNV-1a over a lowercased string
+static uint64_t hash_lower(uint64_t h, const char *s)
+{
+	for (; *s; s++) {
+		h ^= (unsigned char) tolower((unsigned char) *s);
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+uint64_t shard_key(const char *owner, const char *name)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	h = hash_lower(h, owner);
+	h = hash_lower(h, "/");
+	return hash_lower(h, name);
+}
+
+unsigned shard_of(uint64_t key, const unsigned shards)
+{
+	// Lamping & Veach, "A Fast, Minimal Memory, Consistent Hash Algorithm"
+	int64_t b = -1, j = 0;
+	while (j < (int64_t) shards) {
+		b = j;
+		key = key * 2862933555777941757ULL + 1;
+		j = (int64_t) ((double) (b + 1) *
+			       ((double) (1LL << 31) /
+				(double) ((key >> 33) + 1)));
+	}
+	return (unsigned) b;
+}
@@ -0,0 +1,29 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <stdint.h>
+
+/**
+ * Hashes a repository's owner and name into a 64-bit key. GitHub names are
+ * case-insensitive, so the key is too.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @return Hash of "owner/name"
+ */
+uint64_t shard_key(const char *owner, const char *name);
+
+/**
+ * Maps a key onto one of the shards with a jump consistent hash. When the
+ * number of shards grows from N to N + 1, only 1 / (N + 1) of the keys move,
+ * and all of them move to the new shard.
+ * @param key Key to map
+ * @param shards Total number of shards, at least 1
+ * @return Shard of the key, between 0 and shards - 1
+ */
+unsigned shard_of(uint64_t key, unsigned shards);
+
+#endif // SHARD_H
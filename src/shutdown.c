@@ -0,0 +1,96 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "shutdown.h"
+
+#include <signal.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <unistd.h>
+
+/// Upper bound on concurrently running git commands, one per job
+#define MAX_CHILDREN 1024
+
+static volatile sig_atomic_t requested;
+/// The grace period is over, git commands are terminated as they start
+static volatile sig_atomic_t expired;
+static unsigned grace_secs;
+/// Process groups of running git commands, 0 for free slots
+static _Atomic pid_t children[MAX_CHILDREN];
+
+static void kill_children(void)
+{
+	for (size_t i = 0; i < MAX_CHILDREN; i++) {
+		const pid_t pid = atomic_load(&children[i]);
+		if (pid > 0)
+			kill(-pid, SIGTERM);
+	}
+}
+
+static void on_signal(int sig)
+{
+	if (sig == SIGALRM || requested) {
+		expired = 1;
+		kill_children();
+		return;
+	}
+	requested = 1;
+
+	static const char msg[] =
+			"Shutting down, waiting for running jobs to finish\n";
+	const ssize_t ret = write(STDERR_FILENO, msg, sizeof(msg) - 1);
+	(void) ret;
+
+	if (grace_secs) {
+		alarm(grace_secs);
+	} else {
+		expired = 1;
+		kill_children();
+	}
+}
+
+void shutdown_init(const unsigned grace)
+{
+	grace_secs = grace;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = on_signal;
+	sigemptyset(&sa.sa_mask);
+	sa.sa_flags = SA_RESTART;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+	sigaction(SIGALRM, &sa, NULL);
+}
+
+int shutdown_requested(void) { return requested; }
+
+int shutdown_expired(void) { return expired; }
+
+void shutdown_detach_child(void) { setpgid(0, 0); }
+
+void shutdown_child_started(const pid_t pid)
+{
+	// Also set in the parent, so the child can't be signalled before it
+	// has run shutdown_detach_child()
+	setpgid(pid, pid);
+
+	for (size_t i = 0; i < MAX_CHILDREN; i++) {
+		pid_t expected = 0;
+		if (atomic_compare_exchange_strong(&children[i], &expected,
+						   pid))
+			break;
+	}
+	if (expired)
+		kill(-pid, SIGTERM);
+}
+
+void shutdown_child_exited(const pid_t pid)
+{
+	for (size_t i = 0; i < MAX_CHILDREN; i++) {
+		pid_t expected = pid;
+		if (atomic_compare_exchange_strong(&children[i], &expected, 0))
+			return;
+	}
+}
@@ -0,0 +1,52 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SHUTDOWN_H
+#define SHUTDOWN_H
+
+#include <sys/types.h>
+
+/**
+ * Installs the SIGINT and SIGTERM handlers. The first signal requests a
+ * graceful shutdown: no new jobs are started, and running git commands get
+ * the given number of seconds to finish before they are terminated. A second
+ * signal terminates them right away.
+ * @param grace Seconds to wait for running git commands, 0 to terminate them
+ * immediately
+ */
+void shutdown_init(unsigned grace);
+
+/**
+ * Checks whether a shutdown was requested.
+ * @return 1 if a shutdown was requested, 0 if not
+ */
+int shutdown_requested(void);
+
+/**
+ * Checks whether the shutdown grace period is over. In-process transfers
+ * should abort once it is.
+ * @return 1 if the grace period is over, 0 if not
+ */
+int shutdown_expired(void);
+
+/**
+ * Moves the calling child process into its own process group, so that a ^C on
+ * the terminal doesn't interrupt it. Call in the child right after fork().
+ */
+void shutdown_detach_child(void);
+
+/**
+ * Registers a child process to terminate if it outlives the shutdown grace
+ * period. Call in the parent right after fork().
+ * @param pid Process ID of the child
+ */
+void shutdown_child_started(pid_t pid);
+
+/**
+ * Unregisters a child process once it has been waited for.
+ * @param pid Process ID of the child
+ */
+void shutdown_child_exited(pid_t pid);
+
+#endif // SHUTDOWN_H
@@ -0,0 +1,63 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "spawn.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+void spawn_lock(void)
+{
+	pthread_mutex_lock(&lock);
+}
+
+void spawn_unlock(void)
+{
+	pthread_mutex_unlock(&lock);
+}
+
+pid_t spawn_fork(void)
+{
+	pthread_mutex_lock(&lock);
+	const pid_t pid = fork();
+	// The child's copy of the lock stays taken, it only execs or exits
+	if (pid != 0)
+		pthread_mutex_unlock(&lock);
+	return pid;
+}
+
+int spawn_pipe(int fds[2])
+{
+	pthread_mutex_lock(&lock);
+	const int ret = pipe(fds);
+	if (ret == 0) {
+		fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+		fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+	}
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+FILE *spawn_tmpfile(void)
+{
+	pthread_mutex_lock(&lock);
+	FILE *f = tmpfile();
+	if (f)
+		fcntl(fileno(f), F_SETFD, FD_CLOEXEC);
+	pthread_mutex_unlock(&lock);
+	return f;
+}
+
+FILE *spawn_fopen(const char *path, const char *mode)
+{
+	pthread_mutex_lock(&lock);
+	FILE *f = fopen(path, mode);
+	if (f)
+		fcntl(fileno(f), F_SETFD, FD_CLOEXEC);
+	pthread_mutex_unlock(&lock);
+	return f;
+}
@@ -0,0 +1,58 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SPAWN_H
+#define SPAWN_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+/*
+ * Descriptors can only be marked close-on-exec after they are created, and a
+ * child forked by another thread in between inherits them. A child holding
+ * the write end of a pipe keeps its reader from ever seeing the end of it.
+ * Forks and the creation of descriptors that outlive a call therefore take
+ * the same lock.
+ */
+
+/**
+ * Takes the lock forks are serialized with, to create descriptors by other
+ * means than the functions below.
+ */
+void spawn_lock(void);
+
+/**
+ * Releases the lock taken by spawn_lock().
+ */
+void spawn_unlock(void);
+
+/**
+ * Forks a child process. The child must only exec or exit.
+ * @return The process ID of the child in the parent, 0 in the child, or -1 on
+ * error
+ */
+pid_t spawn_fork(void);
+
+/**
+ * Creates a pipe with both ends close-on-exec.
+ * @param fds Set to the read and write ends
+ * @return 0 on success, -1 on error
+ */
+int spawn_pipe(int fds[2]);
+
+/**
+ * Creates a close-on-exec temporary file, like tmpfile().
+ * @return The file, or NULL on error
+ */
+FILE *spawn_tmpfile(void);
+
+/**
+ * Opens a close-on-exec file, like fopen().
+ * @param path Path to the file
+ * @param mode Mode to open it in
+ * @return The file, or NULL on error
+ */
+FILE *spawn_fopen(const char *path, const char *mode);
+
+#endif // SPAWN_H
@@ -7,6 +7,7 @@
 #include "queries/srht/srht_list_repos.h"
 
 #include "../buffer.h"
+#include "../timing.h"
 
 int srht_list_user_repos(const gql_client *client, const char *username,
 			 const char *cursor, struct srht_list_repos_res *res)
@@ -14,21 +15,15 @@ int srht_list_user_repos(const gql_client *client, const char *username,
 	int status = 0;
 	buffer_t buf = buffer_new(4096);
 
-	cJSON *args = cJSON_CreateObject();
-	if (!args) {
-		status = -1;
-		goto end;
-	}
-	cJSON_AddItemToObject(args, "username", cJSON_CreateString(username));
-
-	if (cursor != NULL)
-		cJSON_AddItemToObject(args, "cursor",
-				      cJSON_CreateString(cursor));
-	else
-		cJSON_AddItemToObject(args, "cursor", cJSON_CreateNull());
+	const struct gql_var vars[] = {
+			{"username", username},
+			{"cursor", cursor},
+	};
 
-	const CURLcode ret =
-			gql_client_send(client, srht_list_repos, args, &buf);
+	long long start = timing_now();
+	const CURLcode ret = gql_client_send(client, srht_list_repos, vars,
+					     sizeof(vars) / sizeof(*vars), &buf);
+	timing_since(phase_page, start);
 	if (ret != CURLE_OK) {
 		fprintf(stderr, "Failed to send request: %s\n",
 			curl_easy_strerror(ret));
@@ -36,28 +31,21 @@ int srht_list_user_repos(const gql_client *client, const char *username,
 		goto end;
 	}
 
-	// Parse the response
-	cJSON *root = cJSON_Parse((const char *) buf.data);
-	if (!root) {
-		const char *err = cJSON_GetErrorPtr();
-		if (err)
-			fprintf(stderr, "Error parsing response: %s\n", err);
-		status = -1;
-		goto end;
-	}
-
-	// Check for errors
-	if (gql_handle_error(root) < 0) {
-		cJSON_Delete(root);
+	// Decode the response
+	start = timing_now();
+	struct srht_list_repos_data data;
+	if (srht_list_repos_decode((const char *) buf.data, buf.len, &data) <
+	    0) {
 		status = -1;
 		goto end;
 	}
 
-	// Convert json to struct
-	if (srht_list_repos_from_json(root, res) < 0) {
+	// Convert the response to the listing
+	if (srht_list_repos_from_data(&data, res) < 0) {
 		fprintf(stderr, "Failed to parse response\n");
 		status = -1;
 	}
+	timing_since(phase_decode, start);
 
 end:
 	buffer_free(buf);
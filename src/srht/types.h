@@ -5,7 +5,7 @@
 #ifndef SRHT_TYPES_H
 #define SRHT_TYPES_H
 
-#include <cjson/cJSON.h>
+#include "queries/srht/srht_list_repos.h"
 
 struct srht_list_repos_res {
 	char *cursor;
@@ -18,7 +18,15 @@ struct srht_list_repos_res {
 	size_t repos_len;
 };
 
-int srht_list_repos_from_json(cJSON *root, struct srht_list_repos_res *res);
+/**
+ * Converts a decoded repository listing.
+ * @param data Decoded response, its strings are moved into the result and it
+ * is freed
+ * @param res Set to the converted listing
+ * @return 0 on success, -1 on error
+ */
+int srht_list_repos_from_data(struct srht_list_repos_data *data,
+			      struct srht_list_repos_res *res);
 void srht_list_repos_res_free(struct srht_list_repos_res res);
 
 #endif // SRHT_TYPES_H
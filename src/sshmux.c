@@ -0,0 +1,394 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "sshmux.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "proxy.h"
+#include "shutdown.h"
+#include "spawn.h"
+
+/// Hosts that get masters, any others are connected to directly
+#define SSHMUX_HOSTS 8
+/// Times a master is restarted after exiting before it is given up on
+#define SSHMUX_RESTARTS 5
+/// Seconds to wait for a master to accept sessions
+#define SSHMUX_READY_TIMEOUT 10
+/// Seconds between checks of the masters
+#define SSHMUX_CHECK_INTERVAL 2
+/// Environment variable with the ssh command the helper runs
+#define SSHMUX_ENV "GITHUB_MIRROR_SSH"
+
+struct master {
+	/// Process ID of the master, 0 if it is not running
+	pid_t pid;
+	/// Times the master was restarted
+	unsigned restarts;
+};
+
+struct host {
+	/// Destination as user@host
+	char dest[320];
+	/// Port, empty for the default
+	char port[8];
+	struct master masters[SSHMUX_MASTERS_MAX];
+};
+
+static struct {
+	/// Directory of the master sockets, empty if not multiplexing
+	char dir[32];
+	/// ssh command the masters and sessions run
+	char ssh[PATH_MAX + 256];
+	/// Masters per host
+	unsigned masters;
+	struct host hosts[SSHMUX_HOSTS];
+	size_t hosts_len;
+
+	pthread_t monitor;
+	int monitoring;
+	/// Set once sshmux_stop() is called, the monitor exits then
+	int stopping;
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+} mux = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+};
+
+int sshmux_init(unsigned masters)
+{
+	char self[PATH_MAX];
+	if (getenv("GIT_SSH") && !getenv("GIT_SSH_COMMAND")) {
+		fprintf(stderr, "Warning: GIT_SSH is set, SSH connections are "
+				"not shared\n");
+		return 0;
+	}
+	if (self_path(self, sizeof(self)) < 0 || strpbrk(self, "'\"")) {
+		fprintf(stderr, "Warning: SSH connections are not shared\n");
+		return 0;
+	}
+
+	// Socket paths are limited to about 100 bytes, so stay out of TMPDIR
+	snprintf(mux.dir, sizeof(mux.dir), "/tmp/gm-ssh-XXXXXX");
+	if (!mkdtemp(mux.dir)) {
+		perror("Error creating ssh socket directory");
+		mux.dir[0] = '\0';
+		return -1;
+	}
+
+	const char *ssh = getenv("GIT_SSH_COMMAND");
+	if (!ssh || !*ssh)
+		ssh = "ssh";
+	snprintf(mux.ssh, sizeof(mux.ssh), "%s", ssh);
+	mux.masters = masters < 1                    ? 1
+		      : masters > SSHMUX_MASTERS_MAX ? SSHMUX_MASTERS_MAX
+						     : masters;
+
+	// git would otherwise run the helper with -G to tell which ssh it is
+	char cmd[PATH_MAX + 64];
+	snprintf(cmd, sizeof(cmd), "'%s' --ssh-mux %u:%s", self, mux.masters,
+		 mux.dir);
+	setenv(SSHMUX_ENV, mux.ssh, 1);
+	setenv("GIT_SSH_COMMAND", cmd, 1);
+	setenv("GIT_SSH_VARIANT", "ssh", 1);
+	return 0;
+}
+
+void sshmux_add_url(const char *url)
+{
+	const char *prefix = "ssh://";
+	if (!mux.dir[0] || strncmp(url, prefix, strlen(prefix)) != 0)
+		return;
+
+	// ssh://[user@]host[:port]/path
+	const char *authority = url + strlen(prefix);
+	const size_t len = strcspn(authority, "/");
+	const char *colon = memchr(authority, ':', len);
+	const size_t dest_len = colon ? (size_t) (colon - authority) : len;
+
+	struct host host = {0};
+	if (dest_len == 0 || dest_len >= sizeof(host.dest))
+		return;
+	memcpy(host.dest, authority, dest_len);
+	if (colon) {
+		const size_t port_len = len - dest_len - 1;
+		if (port_len >= sizeof(host.port))
+			return;
+		memcpy(host.port, colon + 1, port_len);
+	}
+	if (strpbrk(host.dest, "'\"\\ ") || strpbrk(host.port, "'\"\\ "))
+		return;
+
+	for (size_t i = 0; i < mux.hosts_len; i++) {
+		if (!strcmp(mux.hosts[i].dest, host.dest) &&
+		    !strcmp(mux.hosts[i].port, host.port))
+			return;
+	}
+	if (mux.hosts_len < SSHMUX_HOSTS)
+		mux.hosts[mux.hosts_len++] = host;
+}
+
+/**
+ * Runs an ssh command for a master's socket through the shell.
+ * @param host Host of the master
+ * @param slot Index of the master
+ * @param opts Options of the command
+ * @param quiet Whether to discard the output of the command
+ * @return Process ID of the command, or -1 on error
+ */
+static pid_t run_ssh(const struct host *host, unsigned slot, const char *opts,
+		     int quiet)
+{
+	char cmd[sizeof(mux.ssh) + sizeof(host->dest) + 256];
+	snprintf(cmd, sizeof(cmd),
+		 "exec %s %s -o 'ControlPath=%s/%u-%%C'%s%s '%s'", mux.ssh,
+		 opts, mux.dir, slot, host->port[0] ? " -p " : "", host->port,
+		 host->dest);
+
+	const pid_t pid = spawn_fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0) {
+		shutdown_detach_child();
+
+		const int devnull = open("/dev/null", O_RDWR);
+		if (devnull == -1) {
+			perror("open");
+			_exit(127);
+		}
+		dup2(devnull, STDIN_FILENO);
+		dup2(devnull, STDOUT_FILENO);
+		if (quiet)
+			dup2(devnull, STDERR_FILENO);
+		close(devnull);
+
+		execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+		perror("execl");
+		_exit(127);
+	}
+	return pid;
+}
+
+/// Starts the master of a host in a slot, in the foreground of its process
+static void start_master(struct host *host, unsigned slot)
+{
+	const pid_t pid = run_ssh(host, slot,
+				  "-M -N -o ControlMaster=yes "
+				  "-o ControlPersist=no -o BatchMode=yes "
+				  "-o ServerAliveInterval=15 "
+				  "-o ServerAliveCountMax=3",
+				  0);
+	host->masters[slot].pid = pid > 0 ? pid : 0;
+}
+
+/**
+ * Checks whether a master accepts sessions.
+ * @return 1 if it does, 0 if not
+ */
+static int master_ready(const struct host *host, unsigned slot)
+{
+	const pid_t pid = run_ssh(host, slot, "-O check", 1);
+	if (pid < 0)
+		return 0;
+	int status;
+	pid_t result;
+	while ((result = waitpid(pid, &status, 0)) == -1 && errno == EINTR) {
+	}
+	return result == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+/**
+ * Reaps a master that exited.
+ * @return 1 if it exited, 0 if it is still running
+ */
+static int master_exited(struct master *master)
+{
+	int status;
+	if (!master->pid || waitpid(master->pid, &status, WNOHANG) == 0)
+		return 0;
+	master->pid = 0;
+	return 1;
+}
+
+/**
+ * Waits until a master accepts sessions, or gives up on it.
+ * @return 1 if it is ready, 0 if not
+ */
+static int wait_ready(struct host *host, unsigned slot)
+{
+	const struct timespec delay = {.tv_nsec = 100 * 1000 * 1000};
+	const time_t deadline = time(NULL) + SSHMUX_READY_TIMEOUT;
+	struct master *master = &host->masters[slot];
+	while (master->pid && !master_exited(master)) {
+		if (master_ready(host, slot))
+			return 1;
+		if (time(NULL) >= deadline || shutdown_requested())
+			break;
+		nanosleep(&delay, NULL);
+	}
+	return 0;
+}
+
+/// Restarts masters that exited, such as after the server dropped them
+static void *monitor(void *arg)
+{
+	(void) arg;
+	pthread_mutex_lock(&mux.lock);
+	while (!mux.stopping) {
+		struct timespec until;
+		clock_gettime(CLOCK_REALTIME, &until);
+		until.tv_sec += SSHMUX_CHECK_INTERVAL;
+		pthread_cond_timedwait(&mux.cond, &mux.lock, &until);
+		if (mux.stopping)
+			break;
+
+		for (size_t i = 0; i < mux.hosts_len; i++) {
+			struct host *host = &mux.hosts[i];
+			for (unsigned slot = 0; slot < mux.masters; slot++) {
+				struct master *master = &host->masters[slot];
+				if (!master_exited(master) ||
+				    master->restarts >= SSHMUX_RESTARTS)
+					continue;
+				master->restarts++;
+				fprintf(stderr,
+					"SSH connection to %s closed, "
+					"reconnecting\n",
+					host->dest);
+				start_master(host, slot);
+			}
+		}
+	}
+	pthread_mutex_unlock(&mux.lock);
+	return NULL;
+}
+
+void sshmux_start(void)
+{
+	if (!mux.dir[0] || !mux.hosts_len)
+		return;
+
+	for (size_t i = 0; i < mux.hosts_len; i++) {
+		for (unsigned slot = 0; slot < mux.masters; slot++)
+			start_master(&mux.hosts[i], slot);
+	}
+
+	// Sessions connect directly until their master is up, so this only
+	// saves them the extra handshakes
+	for (size_t i = 0; i < mux.hosts_len; i++) {
+		unsigned ready = 0;
+		for (unsigned slot = 0; slot < mux.masters; slot++)
+			ready += (unsigned) wait_ready(&mux.hosts[i], slot);
+		if (ready < mux.masters)
+			fprintf(stderr,
+				"Warning: %u of %u SSH connections to %s "
+				"failed, connecting directly\n",
+				mux.masters - ready, mux.masters,
+				mux.hosts[i].dest);
+	}
+
+	if (pthread_create(&mux.monitor, NULL, monitor, NULL) == 0)
+		mux.monitoring = 1;
+	else
+		fprintf(stderr, "Failed to start ssh monitor thread\n");
+}
+
+void sshmux_stop(void)
+{
+	if (!mux.dir[0])
+		return;
+
+	if (mux.monitoring) {
+		pthread_mutex_lock(&mux.lock);
+		mux.stopping = 1;
+		pthread_cond_signal(&mux.cond);
+		pthread_mutex_unlock(&mux.lock);
+		pthread_join(mux.monitor, NULL);
+		mux.monitoring = 0;
+	}
+
+	for (size_t i = 0; i < mux.hosts_len; i++) {
+		for (unsigned slot = 0; slot < mux.masters; slot++) {
+			struct master *master = &mux.hosts[i].masters[slot];
+			if (!master->pid)
+				continue;
+			kill(master->pid, SIGTERM);
+			while (waitpid(master->pid, NULL, 0) == -1 &&
+			       errno == EINTR) {
+			}
+			master->pid = 0;
+		}
+	}
+
+	// Masters that were killed leave their sockets behind
+	DIR *d = opendir(mux.dir);
+	if (d) {
+		const struct dirent *ent;
+		char path[PATH_MAX];
+		while ((ent = readdir(d))) {
+			if (ent->d_name[0] == '.')
+				continue;
+			snprintf(path, sizeof(path), "%s/%s", mux.dir,
+				 ent->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+	if (rmdir(mux.dir) == -1)
+		perror("Error removing ssh socket directory");
+	mux.dir[0] = '\0';
+}
+
+int sshmux_exec(const char *spec, int argc, char **argv)
+{
+	const char *ssh = getenv(SSHMUX_ENV);
+	char *dir;
+	errno = 0;
+	const unsigned long masters = strtoul(spec, &dir, 10);
+	if (errno || *dir != ':' || masters < 1 ||
+	    masters > SSHMUX_MASTERS_MAX || !ssh) {
+		fprintf(stderr, "Invalid ssh multiplexing: %s\n", spec);
+		return 1;
+	}
+	dir++;
+
+	// Children of one run get spread over the masters by their process
+	// ID. A missing master makes ssh connect directly.
+	const unsigned slot = (unsigned) getpid() % (unsigned) masters;
+	char cmd[PATH_MAX + 512];
+	snprintf(cmd, sizeof(cmd),
+		 "exec %s -o ControlMaster=no -o 'ControlPath=%s/%u-%%C' "
+		 "\"$@\"",
+		 ssh, dir, slot);
+
+	char **args = malloc(sizeof(*args) * ((size_t) argc + 5));
+	if (!args) {
+		perror("malloc");
+		return 1;
+	}
+	args[0] = "sh";
+	args[1] = "-c";
+	args[2] = cmd;
+	args[3] = "ssh";
+	for (int i = 0; i < argc; i++)
+		args[4 + i] = argv[i];
+	args[4 + argc] = NULL;
+	execv("/bin/sh", args);
+	perror("execv");
+	free(args);
+	return 1;
+}
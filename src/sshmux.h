@@ -0,0 +1,57 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SSHMUX_H
+#define SSHMUX_H
+
+/// Sessions a master carries when the pool is sized by the number of jobs,
+/// below sshd's default MaxSessions of 10
+#define SSHMUX_SESSIONS 8
+/// Most masters per host
+#define SSHMUX_MASTERS_MAX 16
+
+/**
+ * Makes ssh transfers of git children share OpenSSH ControlMaster
+ * connections, so that they skip the key exchange and authentication.
+ * GIT_SSH_COMMAND is pointed at this program with --ssh-mux, which runs the
+ * previous ssh command through one of the masters of the host. Without a
+ * working master, ssh connects directly as before.
+ * Call after proxy_start(), whose ProxyCommand the masters then use, and
+ * before any git children are started.
+ * @param masters Masters per host
+ * @return 0 on success, -1 on error
+ */
+int sshmux_init(unsigned masters);
+
+/**
+ * Records the host of a mirror's URL, for which sshmux_start() starts
+ * masters. URLs other than ssh:// ones are ignored. Not thread-safe.
+ * @param url URL of the mirror
+ */
+void sshmux_add_url(const char *url);
+
+/**
+ * Starts the masters of every recorded host and waits until they accept
+ * sessions. A monitor thread restarts masters that exit until sshmux_stop()
+ * is called.
+ */
+void sshmux_start(void);
+
+/**
+ * Stops the monitor and the masters, and removes their sockets.
+ */
+void sshmux_stop(void);
+
+/**
+ * Runs ssh through a master as GIT_SSH_COMMAND, spreading sessions over the
+ * masters of the host.
+ * @param spec Number of masters per host and directory of their sockets, as
+ * "masters:dir"
+ * @param argc Number of ssh arguments
+ * @param argv ssh arguments given by git
+ * @return Exit status, only returns on error
+ */
+int sshmux_exec(const char *spec, int argc, char **argv);
+
+#endif // SSHMUX_H
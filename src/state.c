@@ -0,0 +1,560 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_state
+
+#include "state.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "alloc.h"
+
+/*
+ * The database is an open-addressing hash table of fixed-size records keyed
+ * by "owner/name", mapped into memory. The first block is a header, then
+ * follow the slots, whose number is a power of two. Records are updated in
+ * place and carry a checksum, so that a record torn by a crash is ignored
+ * rather than misread. Growing the table writes a new file that replaces the
+ * old one in one step.
+ */
+
+#define STATE_MAGIC "GMSTATE"
+#define STATE_VERSION 1
+/// Slots of a new database
+#define STATE_MIN_SLOTS 256
+
+/// Durations file of earlier versions, imported into a new database
+#define HISTORY_FILE ".github-mirror-history"
+
+struct state_header {
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint64_t slots;
+	char reserved[sizeof(struct state_record) - 24];
+};
+
+_Static_assert(sizeof(struct state_record) == 512, "record size changed");
+_Static_assert(sizeof(struct state_header) == sizeof(struct state_record),
+	       "header must fill one block");
+
+static char *db_path;
+static char *base;
+static int fd = -1;
+static int readonly;
+static void *map;
+static size_t map_len;
+static size_t slots;
+static size_t used;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct state_record *records(void)
+{
+	return (struct state_record *) ((char *) map +
+					sizeof(struct state_header));
+}
+
+/// FNV-1a hash of a key
+static uint32_t key_hash(const char *key)
+{
+	uint32_t h = 2166136261u;
+	for (const char *p = key; *p; p++)
+		h = (h ^ (unsigned char) *p) * 16777619u;
+	return h;
+}
+
+static uint32_t checksum(const struct state_record *rec)
+{
+	const unsigned char *p = (const unsigned char *) rec;
+	uint32_t h = 2166136261u;
+	for (size_t i = 0; i < offsetof(struct state_record, checksum); i++)
+		h = (h ^ p[i]) * 16777619u;
+	return h;
+}
+
+static int valid(const struct state_record *rec)
+{
+	return rec->key[0] && memchr(rec->key, '\0', STATE_KEY_MAX) &&
+	       rec->checksum == checksum(rec);
+}
+
+/**
+ * Finds the slot of a key in a table.
+ * @return The slot holding the key, or the empty slot it would go in
+ */
+static struct state_record *probe(struct state_record *table, size_t n,
+				  const char *key)
+{
+	size_t i = key_hash(key) & (n - 1);
+	while (table[i].key[0] && strncmp(table[i].key, key, STATE_KEY_MAX))
+		i = (i + 1) & (n - 1);
+	return &table[i];
+}
+
+static char *join(const char *dir, const char *file, const char *suffix)
+{
+	const size_t len = strlen(dir) + strlen(file) + strlen(suffix) + 2;
+	char *path = gmalloc(len);
+	if (path)
+		snprintf(path, len, "%s/%s%s", dir, file, suffix);
+	return path;
+}
+
+static int make_key(char *key, const char *owner, const char *name)
+{
+	const int n = snprintf(key, STATE_KEY_MAX, "%s/%s", owner, name);
+	return n > 0 && n < STATE_KEY_MAX ? 0 : -1;
+}
+
+/**
+ * Writes a new database with the valid records of the current one, and puts
+ * it in place of the current one. The new database is locked before it
+ * becomes visible. With the lock held, if a database is open.
+ * @param n Number of slots of the new database
+ * @return 0 on success, -1 on error
+ */
+static int rebuild(size_t n)
+{
+	int ret = -1;
+	char *tmp_path = join(base, STATE_FILE, ".tmp");
+	if (!tmp_path)
+		return -1;
+	const int new_fd = open(tmp_path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC,
+				0644);
+	if (new_fd == -1) {
+		perror("Error creating state database");
+		gfree(tmp_path);
+		return -1;
+	}
+	const size_t new_len = (n + 1) * sizeof(struct state_record);
+	void *new_map = MAP_FAILED;
+	if (flock(new_fd, LOCK_EX) == -1 || ftruncate(new_fd, new_len) == -1 ||
+	    (new_map = mmap(NULL, new_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+			    new_fd, 0)) == MAP_FAILED) {
+		perror("Error creating state database");
+		goto end;
+	}
+
+	struct state_header *h = new_map;
+	memcpy(h->magic, STATE_MAGIC, sizeof(h->magic));
+	h->version = STATE_VERSION;
+	h->record_size = sizeof(struct state_record);
+	h->slots = n;
+
+	struct state_record *table = (struct state_record *) (h + 1);
+	size_t new_used = 0;
+	for (size_t i = 0; map && i < slots; i++) {
+		const struct state_record *rec = &records()[i];
+		if (!valid(rec))
+			continue;
+		*probe(table, n, rec->key) = *rec;
+		new_used++;
+	}
+
+	// The records must be on disk before the file replaces the old one
+	if (msync(new_map, new_len, MS_SYNC) == -1 ||
+	    rename(tmp_path, db_path) == -1) {
+		perror("Error writing state database");
+		goto end;
+	}
+
+	if (map)
+		munmap(map, map_len);
+	if (fd != -1)
+		close(fd); // Releases the lock of the replaced file
+	fd = new_fd;
+	map = new_map;
+	map_len = new_len;
+	slots = n;
+	used = new_used;
+	ret = 0;
+
+end:
+	if (ret == -1) {
+		if (new_map != MAP_FAILED)
+			munmap(new_map, new_len);
+		close(new_fd);
+		unlink(tmp_path);
+	}
+	gfree(tmp_path);
+	return ret;
+}
+
+/**
+ * Maps the opened database and checks its header.
+ * @return 0 on success, -1 if the file isn't a valid database
+ */
+static int map_db(void)
+{
+	struct stat st;
+	if (fstat(fd, &st) == -1 ||
+	    (size_t) st.st_size < sizeof(struct state_header))
+		return -1;
+	map_len = st.st_size;
+	const int prot = readonly ? PROT_READ : PROT_READ | PROT_WRITE;
+	map = mmap(NULL, map_len, prot, MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED) {
+		map = NULL;
+		return -1;
+	}
+
+	const struct state_header *h = map;
+	if (memcmp(h->magic, STATE_MAGIC, sizeof(h->magic)) != 0 ||
+	    h->version != STATE_VERSION ||
+	    h->record_size != sizeof(struct state_record) || h->slots == 0 ||
+	    (h->slots & (h->slots - 1)) != 0 ||
+	    (h->slots + 1) * sizeof(struct state_record) != map_len) {
+		munmap(map, map_len);
+		map = NULL;
+		return -1;
+	}
+	slots = h->slots;
+	used = 0;
+	for (size_t i = 0; i < slots; i++)
+		used += records()[i].key[0] != '\0';
+	return 0;
+}
+
+/// Finds or adds the record of a key, with the lock held
+static struct state_record *find(const char *key, int add)
+{
+	if (!map)
+		return NULL;
+	struct state_record *rec = probe(records(), slots, key);
+	if (rec->key[0] || !add || readonly)
+		return rec->key[0] ? rec : NULL;
+
+	// Keep the table at most half full
+	if ((used + 1) * 2 > slots) {
+		if (rebuild(slots * 2) == -1)
+			return NULL;
+		rec = probe(records(), slots, key);
+	}
+	struct state_record new = {.duration_ms = -1};
+	strcpy(new.key, key);
+	new.checksum = checksum(&new);
+	*rec = new;
+	used++;
+	return rec;
+}
+
+/// Imports the durations of an earlier version's history file
+static void import_history(void)
+{
+	char *path = join(base, HISTORY_FILE, "");
+	if (!path)
+		return;
+	FILE *f = fopen(path, "r");
+	if (!f) {
+		gfree(path);
+		return;
+	}
+
+	// Each line is "owner/name<TAB>milliseconds"
+	char line[1024];
+	while (fgets(line, sizeof(line), f)) {
+		char *tab = strchr(line, '\t');
+		if (!tab || tab - line >= STATE_KEY_MAX)
+			continue;
+		*tab = '\0';
+		struct state_record *rec = find(line, 1);
+		if (!rec)
+			continue;
+		rec->duration_ms = strtoll(tab + 1, NULL, 10);
+		rec->checksum = checksum(rec);
+	}
+	fclose(f);
+	unlink(path);
+	gfree(path);
+}
+
+int state_open(const char *git_base, int ro)
+{
+	readonly = ro;
+	base = gstrdup(git_base);
+	db_path = join(git_base, STATE_FILE, "");
+	if (!base || !db_path)
+		goto fail;
+
+	for (;;) {
+		fd = open(db_path, (ro ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+		if (fd == -1 && errno == ENOENT) {
+			if (ro)
+				goto missing;
+			// A new database starts locked
+			if (rebuild(STATE_MIN_SLOTS) == -1)
+				goto fail;
+			import_history();
+			return 0;
+		}
+		if (fd == -1) {
+			perror("Error opening state database");
+			goto fail;
+		}
+		if (ro)
+			break;
+
+		if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+			if (errno != EWOULDBLOCK) {
+				perror("Error locking state database");
+				goto fail;
+			}
+			fprintf(stderr, "State database is in use by another "
+					"run, not recording state\n");
+			goto missing;
+		}
+		// Another run may have replaced the file in the meantime
+		struct stat locked, current;
+		if (fstat(fd, &locked) == 0 && stat(db_path, &current) == 0 &&
+		    locked.st_ino == current.st_ino &&
+		    locked.st_dev == current.st_dev)
+			break;
+		close(fd);
+	}
+
+	if (map_db() == -1) {
+		if (ro) {
+			fprintf(stderr, "Error: invalid state database: %s\n",
+				db_path);
+			goto fail;
+		}
+		fprintf(stderr, "State database is invalid, starting over\n");
+		if (rebuild(STATE_MIN_SLOTS) == -1)
+			goto fail;
+	}
+	return 0;
+
+missing:
+	state_close();
+	return 1;
+fail:
+	state_close();
+	return -1;
+}
+
+long long state_duration(const char *owner, const char *name)
+{
+	char key[STATE_KEY_MAX];
+	if (make_key(key, owner, name) == -1)
+		return -1;
+
+	pthread_mutex_lock(&lock);
+	const struct state_record *rec = find(key, 0);
+	const long long ms = rec && valid(rec) ? rec->duration_ms : -1;
+	pthread_mutex_unlock(&lock);
+	return ms;
+}
+
+int state_get(const char *owner, const char *name, struct state_record *out)
+{
+	char key[STATE_KEY_MAX];
+	if (make_key(key, owner, name) == -1)
+		return 0;
+
+	pthread_mutex_lock(&lock);
+	const struct state_record *rec = find(key, 0);
+	const int found = rec && valid(rec);
+	if (found)
+		*out = *rec;
+	pthread_mutex_unlock(&lock);
+	return found;
+}
+
+/// Copies an object ID, which must be hexadecimal and fit
+static int copy_oid(char *tip, size_t len, const char *oid)
+{
+	const size_t n = strspn(oid, "0123456789abcdef");
+	if (n == 0 || n >= len || oid[n] != '\0')
+		return -1;
+	memcpy(tip, oid, n + 1);
+	return 0;
+}
+
+/**
+ * Reads the object ID a ref points at from a loose ref file or packed-refs.
+ * @param path Full path to the git repository
+ * @param ref Name of the ref
+ * @param tip Buffer for the object ID
+ * @param len Size of the buffer
+ * @return 0 on success, -1 if the ref wasn't found
+ */
+static int read_ref(const char *path, const char *ref, char *tip, size_t len)
+{
+	char line[512];
+	char *file = join(path, ref, "");
+	FILE *f = file ? fopen(file, "r") : NULL;
+	gfree(file);
+	if (f) {
+		const int found = fgets(line, sizeof(line), f) != NULL;
+		fclose(f);
+		if (!found)
+			return -1;
+		line[strcspn(line, "\n")] = '\0';
+		return copy_oid(tip, len, line);
+	}
+
+	file = join(path, "packed-refs", "");
+	f = file ? fopen(file, "r") : NULL;
+	gfree(file);
+	if (!f)
+		return -1;
+	// Lines of "<oid> <ref>", comments start with '#' and peeled tags
+	// with '^'
+	const size_t ref_len = strlen(ref);
+	int ret = -1;
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = '\0';
+		char *sp = strchr(line, ' ');
+		if (line[0] == '#' || line[0] == '^' || !sp ||
+		    strncmp(sp + 1, ref, ref_len + 1) != 0)
+			continue;
+		*sp = '\0';
+		ret = copy_oid(tip, len, line);
+		break;
+	}
+	fclose(f);
+	return ret;
+}
+
+/// Reads the object ID HEAD of a mirror points at, without running git
+static void read_tip(const char *path, char *tip, size_t len)
+{
+	tip[0] = '\0';
+	char head[512];
+	char *file = join(path, "HEAD", "");
+	FILE *f = file ? fopen(file, "r") : NULL;
+	gfree(file);
+	if (!f)
+		return;
+	const int found = fgets(head, sizeof(head), f) != NULL;
+	fclose(f);
+	if (!found)
+		return;
+	head[strcspn(head, "\n")] = '\0';
+
+	const int ret = strncmp(head, "ref: ", 5) != 0
+				? copy_oid(tip, len, head) // Detached
+				: read_ref(path, head + 5, tip, len);
+	if (ret == -1)
+		tip[0] = '\0'; // Unborn branch
+}
+
+void state_update(const char *owner, const char *name, int ret, long long ms,
+		  int64_t pushed_at, const char *error)
+{
+	char key[STATE_KEY_MAX];
+	if (!map || readonly || make_key(key, owner, name) == -1)
+		return;
+
+	// Read the mirror before taking the lock
+	char tip[STATE_TIP_MAX] = "";
+	if (ret == 0) {
+		char *path = join(base, key, ".git");
+		if (path)
+			read_tip(path, tip, sizeof(tip));
+		gfree(path);
+	}
+
+	pthread_mutex_lock(&lock);
+	struct state_record *slot = find(key, 1);
+	if (!slot)
+		goto end;
+	// A torn record starts over
+	struct state_record rec = {.duration_ms = -1};
+	if (valid(slot))
+		rec = *slot;
+	else
+		strcpy(rec.key, key);
+
+	const time_t now = time(NULL);
+	rec.last_attempt = now;
+	rec.status = ret;
+	rec.deferrals = 0;
+	if (pushed_at)
+		rec.pushed_at = pushed_at;
+	if (ret == 0) {
+		rec.last_success = now;
+		rec.duration_ms = ms;
+		rec.failures = 0;
+		memcpy(rec.tip, tip, sizeof(rec.tip));
+		memset(rec.error, 0, sizeof(rec.error));
+	} else {
+		rec.failures++;
+		memset(rec.error, 0, sizeof(rec.error));
+		snprintf(rec.error, sizeof(rec.error), "%s",
+			 error ? error : "error");
+	}
+	rec.checksum = checksum(&rec);
+	*slot = rec;
+
+end:
+	pthread_mutex_unlock(&lock);
+}
+
+void state_defer(const char *owner, const char *name)
+{
+	char key[STATE_KEY_MAX];
+	if (!map || readonly || make_key(key, owner, name) == -1)
+		return;
+
+	pthread_mutex_lock(&lock);
+	struct state_record *slot = find(key, 1);
+	if (slot) {
+		// A torn record starts over
+		struct state_record rec = {.duration_ms = -1};
+		if (valid(slot))
+			rec = *slot;
+		else
+			strcpy(rec.key, key);
+		rec.deferrals++;
+		rec.checksum = checksum(&rec);
+		*slot = rec;
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+size_t state_each(int (*fn)(const struct state_record *rec, void *arg),
+		  void *arg)
+{
+	size_t n = 0;
+	pthread_mutex_lock(&lock);
+	for (size_t i = 0; map && i < slots; i++) {
+		const struct state_record *rec = &records()[i];
+		if (!valid(rec))
+			continue;
+		n++;
+		if (fn(rec, arg))
+			break;
+	}
+	pthread_mutex_unlock(&lock);
+	return n;
+}
+
+void state_close(void)
+{
+	if (map) {
+		if (!readonly && msync(map, map_len, MS_SYNC) == -1)
+			perror("Error writing state database");
+		munmap(map, map_len);
+	}
+	if (fd != -1)
+		close(fd);
+	gfree(db_path);
+	gfree(base);
+	map = NULL;
+	map_len = 0;
+	slots = used = 0;
+	fd = -1;
+	db_path = base = NULL;
+}
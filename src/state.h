@@ -0,0 +1,110 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef STATE_H
+#define STATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// Name of the state database inside the git base directory
+#define STATE_FILE ".github-mirror-state"
+
+/// Longest "owner/name" key of a record, including the terminator
+#define STATE_KEY_MAX 256
+/// Longest object ID of a record, including the terminator
+#define STATE_TIP_MAX 72
+
+/// What the last run knew about a mirror, one fixed-size record per repository
+struct state_record {
+	/// "owner/name"
+	char key[STATE_KEY_MAX];
+	/// Time the mirror was last attempted, in seconds since the epoch
+	int64_t last_attempt;
+	/// Time the mirror last succeeded, 0 if never
+	int64_t last_success;
+	/// Duration of the last successful mirror in milliseconds, -1 if unknown
+	int64_t duration_ms;
+	/// Time of the upstream's last push, 0 if unknown
+	int64_t pushed_at;
+	/// Result of the last attempt, as returned by git_mirror_repo()
+	int32_t status;
+	/// Consecutive failed attempts
+	uint32_t failures;
+	/// Object ID HEAD pointed at after the last success, empty if unknown
+	char tip[STATE_TIP_MAX];
+	/// Reason of the last failure, empty if it succeeded
+	char error[128];
+	/// Consecutive runs that left the mirror to the next for the time budget
+	uint32_t deferrals;
+	uint32_t reserved[2];
+	/// Checksum of the record, so that torn writes are detected
+	uint32_t checksum;
+};
+
+/**
+ * Opens the state database in the git base directory, creating it if needed.
+ * A history file of an older version is imported into a new database. The
+ * database is locked against other runs; if another run holds it, state is
+ * neither read nor recorded. Must be called before any threads are started.
+ * @param git_base Base path of the git mirrors
+ * @param readonly Non-zero to only read the database, without locking it
+ * @return 0 on success, 1 if the database is in use or doesn't exist yet when
+ * read-only, -1 on error
+ */
+int state_open(const char *git_base, int readonly);
+
+/**
+ * Looks up how long the last successful mirror of a repository took.
+ * Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @return Duration in milliseconds, or -1 if none was recorded
+ */
+long long state_duration(const char *owner, const char *name);
+
+/**
+ * Looks up what the last runs knew about a repository. Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @param out Set to a copy of the record if one exists
+ * @return 1 if a record was found, 0 otherwise
+ */
+int state_get(const char *owner, const char *name, struct state_record *out);
+
+/**
+ * Records the outcome of mirroring a repository. On success, the object ID
+ * HEAD points at is read from the mirror. Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @param ret Result of git_mirror_repo()
+ * @param ms Duration of the attempt in milliseconds
+ * @param pushed_at Time of the upstream's last push, 0 if unknown
+ * @param error Reason of a failure, or NULL on success
+ */
+void state_update(const char *owner, const char *name, int ret, long long ms,
+		  int64_t pushed_at, const char *error);
+
+/**
+ * Records that a repository was left to the next run because it didn't fit in
+ * the time budget. Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ */
+void state_defer(const char *owner, const char *name);
+
+/**
+ * Calls a function with every valid record, in no particular order, without
+ * running git. Thread-safe.
+ * @param fn Function to call, iteration stops if it returns non-zero
+ * @param arg Argument passed to the function
+ * @return Number of records visited
+ */
+size_t state_each(int (*fn)(const struct state_record *rec, void *arg),
+		  void *arg);
+
+/// Flushes the database to disk and closes it
+void state_close(void);
+
+#endif // STATE_H
@@ -0,0 +1,109 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "status.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "state.h"
+
+#define DAY (24 * 60 * 60)
+
+struct totals {
+	time_t now;
+	int quiet;
+	size_t day;
+	size_t week;
+	size_t older;
+	size_t never;
+	/// Mirrors whose last attempt failed
+	size_t failing;
+	/// Mirrors pushed to upstream after their last success
+	size_t behind;
+};
+
+/**
+ * Formats the time since an instant, such as "5m" or "3d".
+ * @param buf Buffer for the age
+ * @param len Size of the buffer
+ * @param now Current time
+ * @param then Instant, 0 if there is none
+ * @return The buffer
+ */
+static const char *age(char *buf, size_t len, time_t now, time_t then)
+{
+	if (then == 0) {
+		snprintf(buf, len, "-");
+		return buf;
+	}
+	const long long s = now > then ? (long long) (now - then) : 0;
+	if (s < 60)
+		snprintf(buf, len, "%llds", s);
+	else if (s < 60 * 60)
+		snprintf(buf, len, "%lldm", s / 60);
+	else if (s < DAY)
+		snprintf(buf, len, "%lldh", s / (60 * 60));
+	else
+		snprintf(buf, len, "%lldd", s / DAY);
+	return buf;
+}
+
+static int print_record(const struct state_record *rec, void *arg)
+{
+	struct totals *t = arg;
+	const time_t success = (time_t) rec->last_success;
+
+	if (success == 0)
+		t->never++;
+	else if (t->now - success < DAY)
+		t->day++;
+	else if (t->now - success < 7 * DAY)
+		t->week++;
+	else
+		t->older++;
+	if (rec->status != 0 && rec->status != 1)
+		t->failing++;
+	if (rec->pushed_at > rec->last_success)
+		t->behind++;
+	if (t->quiet)
+		return 0;
+
+	char ok[16], tried[16], pushed[16], duration[16] = "-";
+	if (rec->duration_ms >= 0)
+		snprintf(duration, sizeof(duration), "%.1fs",
+			 (double) rec->duration_ms / 1000);
+	printf("%-40s %7s %7s %9s %7s %3u %-12.12s %s\n", rec->key,
+	       age(ok, sizeof(ok), t->now, success),
+	       age(tried, sizeof(tried), t->now, (time_t) rec->last_attempt),
+	       duration, age(pushed, sizeof(pushed), t->now, rec->pushed_at),
+	       rec->failures, rec->tip[0] ? rec->tip : "-",
+	       rec->error[0] ? rec->error : "-");
+	return 0;
+}
+
+int status_print(const char *git_base, int quiet)
+{
+	const int ret = state_open(git_base, 1);
+	if (ret < 0)
+		return 1;
+	if (ret > 0) {
+		printf("No mirrors recorded yet\n");
+		return 0;
+	}
+
+	struct totals t = {.now = time(NULL), .quiet = quiet};
+	if (!quiet)
+		printf("%-40s %7s %7s %9s %7s %3s %-12s %s\n", "REPOSITORY",
+		       "SUCCESS", "TRIED", "DURATION", "PUSHED", "ERR", "HEAD",
+		       "ERROR");
+	const size_t n = state_each(print_record, &t);
+	state_close();
+
+	printf("%zu mirror%s: %zu updated within a day, %zu within a week, "
+	       "%zu earlier, %zu never\n",
+	       n, n == 1 ? "" : "s", t.day, t.week, t.older, t.never);
+	printf("%zu failing, %zu behind upstream\n", t.failing, t.behind);
+	return 0;
+}
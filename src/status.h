@@ -0,0 +1,18 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef STATUS_H
+#define STATUS_H
+
+/**
+ * Prints the state of every mirror recorded in the state database, followed
+ * by a summary of how fresh the mirrors are. Only reads the database, so it
+ * neither runs git nor touches the mirrors.
+ * @param git_base Base path of the git mirrors
+ * @param quiet Only print the summary if non-zero
+ * @return 0 on success, 1 on error
+ */
+int status_print(const char *git_base, int quiet);
+
+#endif // STATUS_H
@@ -0,0 +1,73 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#define ALLOC_SUBSYSTEM alloc_report
+
+#include "summary.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloc.h"
+
+struct failure {
+	char *what;
+	char *reason;
+	struct failure *next;
+};
+
+static struct failure *head;
+static struct failure **tail = &head;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+
+void summary_add(const char *what, const char *reason)
+{
+	struct failure *f = gmalloc(sizeof(*f));
+	if (!f) {
+		perror("malloc");
+		return;
+	}
+	f->what = gstrdup(what);
+	f->reason = gstrdup(reason);
+	f->next = NULL;
+	if (!f->what || !f->reason) {
+		perror("strdup");
+		gfree(f->what);
+		gfree(f->reason);
+		gfree(f);
+		return;
+	}
+
+	pthread_mutex_lock(&lock);
+	*tail = f;
+	tail = &f->next;
+	pthread_mutex_unlock(&lock);
+}
+
+size_t summary_print(void)
+{
+	pthread_mutex_lock(&lock);
+	struct failure *f = head;
+	head = NULL;
+	tail = &head;
+	pthread_mutex_unlock(&lock);
+
+	size_t n = 0;
+	for (const struct failure *p = f; p; p = p->next)
+		n++;
+	if (n > 0)
+		fprintf(stderr, "%zu failure%s:\n", n, n == 1 ? "" : "s");
+
+	while (f) {
+		struct failure *next = f->next;
+		fprintf(stderr, "  %s: %s\n", f->what, f->reason);
+		gfree(f->what);
+		gfree(f->reason);
+		gfree(f);
+		f = next;
+	}
+	return n;
+}
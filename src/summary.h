@@ -0,0 +1,24 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef SUMMARY_H
+#define SUMMARY_H
+
+#include <stddef.h>
+
+/**
+ * Records a failure for the summary printed at the end of the run.
+ * Thread-safe.
+ * @param what What failed, such as "owner/name"
+ * @param reason Why it failed
+ */
+void summary_add(const char *what, const char *reason);
+
+/**
+ * Prints the recorded failures to stderr and forgets them.
+ * @return Number of failures printed
+ */
+size_t summary_print(void);
+
+#endif // SUMMARY_H
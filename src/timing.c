@@ -0,0 +1,260 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include "timing.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+/// Buckets per power of two, each covers 1/8 of its power
+#define SUB_BITS 3
+#define SUBS (1 << SUB_BITS)
+/// Enough buckets for any positive long long
+#define BUCKETS (64 * SUBS)
+
+struct histogram {
+	_Atomic long long buckets[BUCKETS];
+	_Atomic long long count;
+	_Atomic long long total;
+	_Atomic long long max;
+};
+
+static struct histogram histograms[phase_count_];
+
+static const char *const names[phase_count_] = {
+		[phase_config] = "config",   [phase_precheck] = "precheck",
+		[phase_identity] = "identity", [phase_page] = "page",
+		[phase_decode] = "decode",   [phase_exists] = "exists",
+		[phase_url] = "url",	     [phase_clone] = "clone",
+		[phase_fetch] = "fetch",     [phase_lfs] = "lfs",
+};
+
+struct slow_repo {
+	char repo[256];
+	long long us;
+};
+
+/// Slowest repositories, slowest first
+static struct slow_repo slowest[TIMING_TOP];
+static size_t slowest_len;
+static pthread_mutex_t slowest_lock = PTHREAD_MUTEX_INITIALIZER;
+
+long long timing_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/// Bucket of a duration: exact below SUBS, log-linear above
+static size_t bucket_of(long long us)
+{
+	if (us < SUBS)
+		return (size_t) us;
+	const int e = 63 - __builtin_clzll((unsigned long long) us);
+	const size_t sub = (size_t) (us >> (e - SUB_BITS)) & (SUBS - 1);
+	return (size_t) (e - SUB_BITS + 1) * SUBS + sub;
+}
+
+/// Largest duration that falls into a bucket
+static long long bucket_max(size_t i)
+{
+	if (i < SUBS)
+		return (long long) i;
+	const int shift = (int) (i / SUBS) - 1;
+	const long long lower = (long long) (SUBS + i % SUBS) << shift;
+	return lower + (1LL << shift) - 1;
+}
+
+void timing_since(enum phase p, long long start)
+{
+	long long us = timing_now() - start;
+	if (us < 0)
+		us = 0;
+
+	struct histogram *h = &histograms[p];
+	atomic_fetch_add_explicit(&h->buckets[bucket_of(us)], 1,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->count, 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->total, us, memory_order_relaxed);
+	long long cur = atomic_load_explicit(&h->max, memory_order_relaxed);
+	while (cur < us && !atomic_compare_exchange_weak_explicit(
+				   &h->max, &cur, us, memory_order_relaxed,
+				   memory_order_relaxed)) {
+	}
+}
+
+void timing_repo(const char *owner, const char *name, long long us)
+{
+	char repo[sizeof(slowest[0].repo)];
+	snprintf(repo, sizeof(repo), "%s/%s", owner, name);
+
+	pthread_mutex_lock(&slowest_lock);
+	// A retried repo only keeps its slowest attempt
+	size_t i = 0;
+	while (i < slowest_len && strcmp(slowest[i].repo, repo) != 0)
+		i++;
+	if (i < slowest_len) {
+		if (us <= slowest[i].us)
+			goto end;
+		memmove(&slowest[i], &slowest[i + 1],
+			(slowest_len - i - 1) * sizeof(*slowest));
+		slowest_len--;
+	}
+
+	// Insert in order, dropping the fastest of a full list
+	size_t at = slowest_len;
+	while (at > 0 && slowest[at - 1].us < us)
+		at--;
+	if (at == TIMING_TOP)
+		goto end;
+	if (slowest_len == TIMING_TOP)
+		slowest_len--;
+	memmove(&slowest[at + 1], &slowest[at],
+		(slowest_len - at) * sizeof(*slowest));
+	memcpy(slowest[at].repo, repo, sizeof(repo));
+	slowest[at].us = us;
+	slowest_len++;
+
+end:
+	pthread_mutex_unlock(&slowest_lock);
+}
+
+long long timing_percentile(enum phase p, double q)
+{
+	const struct histogram *h = &histograms[p];
+	const long long count =
+			atomic_load_explicit(&h->count, memory_order_relaxed);
+	if (count == 0)
+		return 0;
+
+	// Nearest rank: the smallest duration covering q of the runs
+	long long rank = (long long) (q * (double) count + 0.999999);
+	if (rank < 1)
+		rank = 1;
+	const long long max =
+			atomic_load_explicit(&h->max, memory_order_relaxed);
+	long long seen = 0;
+	for (size_t i = 0; i < BUCKETS; i++) {
+		seen += atomic_load_explicit(&h->buckets[i],
+					     memory_order_relaxed);
+		if (seen >= rank) {
+			const long long v = bucket_max(i);
+			return v < max ? v : max;
+		}
+	}
+	return max;
+}
+
+/**
+ * Formats a duration for the summary table.
+ * @param buf Buffer to write to
+ * @param len Size of the buffer
+ * @param us Duration in microseconds
+ * @return buf
+ */
+static char *format_us(char *buf, size_t len, long long us)
+{
+	if (us < 1000)
+		snprintf(buf, len, "%lldus", us);
+	else if (us < 1000000)
+		snprintf(buf, len, "%.1fms", (double) us / 1000);
+	else
+		snprintf(buf, len, "%.1fs", (double) us / 1000000);
+	return buf;
+}
+
+void timing_print(FILE *f)
+{
+	char a[32], b[32], c[32], d[32];
+
+	fprintf(f, "%-10s %8s %10s %10s %10s %10s\n", "PHASE", "COUNT", "P50",
+		"P95", "MAX", "TOTAL");
+	for (size_t i = 0; i < phase_count_; i++) {
+		const struct histogram *h = &histograms[i];
+		const long long count =
+				atomic_load_explicit(&h->count,
+						     memory_order_relaxed);
+		if (count == 0)
+			continue;
+		fprintf(f, "%-10s %8lld %10s %10s %10s %10s\n", names[i], count,
+			format_us(a, sizeof(a), timing_percentile(i, 0.5)),
+			format_us(b, sizeof(b), timing_percentile(i, 0.95)),
+			format_us(c, sizeof(c), atomic_load(&h->max)),
+			format_us(d, sizeof(d), atomic_load(&h->total)));
+	}
+
+	pthread_mutex_lock(&slowest_lock);
+	if (slowest_len > 0)
+		fprintf(f, "Slowest repos:\n");
+	for (size_t i = 0; i < slowest_len; i++)
+		fprintf(f, "  %-40s %10s\n", slowest[i].repo,
+			format_us(a, sizeof(a), slowest[i].us));
+	pthread_mutex_unlock(&slowest_lock);
+}
+
+/// Writes a string as a JSON string literal
+static void write_json_string(FILE *f, const char *s)
+{
+	fputc('"', f);
+	for (; *s; s++) {
+		const unsigned char ch = *s;
+		if (ch == '"' || ch == '\\')
+			fprintf(f, "\\%c", ch);
+		else if (ch < 0x20)
+			fprintf(f, "\\u%04x", ch);
+		else
+			fputc(ch, f);
+	}
+	fputc('"', f);
+}
+
+int timing_write_json(const char *path)
+{
+	char tmp[4096];
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+
+	FILE *f = fopen(tmp, "w");
+	if (!f) {
+		perror("fopen");
+		return -1;
+	}
+
+	// Every phase is written, so that dashboards see a stable shape
+	fprintf(f, "{\"phases\":{");
+	for (size_t i = 0; i < phase_count_; i++) {
+		const struct histogram *h = &histograms[i];
+		fprintf(f,
+			"%s\"%s\":{\"count\":%lld,\"p50\":%.6f,\"p95\":%.6f,"
+			"\"max\":%.6f,\"total\":%.6f}",
+			i ? "," : "", names[i], atomic_load(&h->count),
+			(double) timing_percentile(i, 0.5) / 1e6,
+			(double) timing_percentile(i, 0.95) / 1e6,
+			(double) atomic_load(&h->max) / 1e6,
+			(double) atomic_load(&h->total) / 1e6);
+	}
+	fprintf(f, "},\"slowest\":[");
+	pthread_mutex_lock(&slowest_lock);
+	for (size_t i = 0; i < slowest_len; i++) {
+		fprintf(f, "%s{\"repo\":", i ? "," : "");
+		write_json_string(f, slowest[i].repo);
+		fprintf(f, ",\"seconds\":%.6f}", (double) slowest[i].us / 1e6);
+	}
+	pthread_mutex_unlock(&slowest_lock);
+	fprintf(f, "]}\n");
+
+	if (fclose(f) != 0) {
+		perror("fclose");
+		remove(tmp);
+		return -1;
+	}
+	if (rename(tmp, path) < 0) {
+		perror("rename");
+		remove(tmp);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,80 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#ifndef TIMING_H
+#define TIMING_H
+
+#include <stdio.h>
+
+/// Phases of a run that are timed
+enum phase {
+	phase_config,
+	phase_precheck,
+	phase_identity,
+	/// Request of one page of a listing
+	phase_page,
+	/// Decoding of one page of a listing
+	phase_decode,
+	/// Check whether a mirror exists
+	phase_exists,
+	/// Update of the remote URL of an existing mirror
+	phase_url,
+	phase_clone,
+	phase_fetch,
+	/// Download of the missing LFS objects of a mirror
+	phase_lfs,
+	phase_count_,
+};
+
+/// Repositories listed in the slowest-repo report
+#define TIMING_TOP 10
+
+/**
+ * Reads the monotonic clock.
+ * @return Microseconds since an arbitrary point
+ */
+long long timing_now(void);
+
+/**
+ * Records one run of a phase in its histogram. Thread-safe.
+ * @param p Phase
+ * @param start Time the phase started, from timing_now()
+ */
+void timing_since(enum phase p, long long start);
+
+/**
+ * Records how long a mirror job took for the slowest-repo report. A repo
+ * tried several times keeps its slowest attempt. Thread-safe.
+ * @param owner Owner of the repository
+ * @param name Name of the repository
+ * @param us Duration of the job, in microseconds
+ */
+void timing_repo(const char *owner, const char *name, long long us);
+
+/**
+ * Estimates a percentile of the durations of a phase. Estimates are the upper
+ * bound of a histogram bucket, within 1/8 of the real value, and never above
+ * the slowest run.
+ * @param p Phase
+ * @param q Percentile, between 0 and 1
+ * @return Duration in microseconds, 0 if the phase never ran
+ */
+long long timing_percentile(enum phase p, double q);
+
+/**
+ * Prints the phases that ran, with their count, p50, p95, maximum and total
+ * duration, followed by the slowest repositories.
+ * @param f Stream to print to
+ */
+void timing_print(FILE *f);
+
+/**
+ * Writes the same report as JSON, for dashboards. Durations are in seconds.
+ * The file is replaced atomically.
+ * @param path Path of the file to write
+ * @return 0 on success, -1 on error
+ */
+int timing_write_json(const char *path);
+
+#endif // TIMING_H
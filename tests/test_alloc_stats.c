@@ -0,0 +1,136 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/alloc_stats.h"
+
+/// Counters of one subsystem, as written to the metrics
+struct counters {
+	long long calls, total, bytes, peak;
+};
+
+/**
+ * Reads one series of the metrics.
+ * @param text Metrics in the Prometheus text format
+ * @param name Name of the metric
+ * @param sub Name of the subsystem
+ * @return Value of the series
+ */
+static long long series(const char *text, const char *name, const char *sub)
+{
+	char key[128];
+	snprintf(key, sizeof(key), "\n%s{subsystem=\"%s\"} ", name, sub);
+	const char *line = strstr(text, key);
+	assert_non_null(line);
+	return strtoll(line + strlen(key), NULL, 10);
+}
+
+/// Reads the counters of a subsystem
+static struct counters get(const char *sub)
+{
+	char *text = NULL;
+	size_t len = 0;
+	FILE *f = open_memstream(&text, &len);
+	assert_non_null(f);
+	alloc_stats_write_metrics(f);
+	assert_int_equal(fclose(f), 0);
+
+	struct counters c = {
+		.calls = series(text, "github_mirror_alloc_calls_total", sub),
+		.total = series(text, "github_mirror_alloc_bytes_total", sub),
+		.bytes = series(text, "github_mirror_alloc_bytes", sub),
+		.peak = series(text, "github_mirror_alloc_peak_bytes", sub),
+	};
+	free(text);
+	return c;
+}
+
+static void cross_free_test(void **state)
+{
+	(void) state;
+	const struct counters dec0 = get("decoder"), cli0 = get("client");
+
+	char *p = alloc_stats_malloc(alloc_decoder, 100);
+	assert_non_null(p);
+	memset(p, 'x', 100);
+	const struct counters dec1 = get("decoder");
+	assert_int_equal(dec1.calls, dec0.calls + 1);
+	assert_in_range(dec1.bytes - dec0.bytes, 100, 200);
+	assert_true(dec1.total > dec0.total);
+	assert_true(dec1.peak >= dec1.bytes);
+
+	// Freeing elsewhere gives the memory back to the decoder
+	alloc_stats_free(alloc_client, p);
+	const struct counters dec2 = get("decoder"), cli2 = get("client");
+	assert_int_equal(dec2.bytes, dec0.bytes);
+	assert_int_equal(dec2.peak, dec1.peak);
+	assert_int_equal(cli2.calls, cli0.calls);
+	assert_int_equal(cli2.bytes, cli0.bytes);
+	assert_int_equal(cli2.total, cli0.total);
+	assert_int_equal(cli2.peak, cli0.peak);
+}
+
+static void cross_realloc_test(void **state)
+{
+	(void) state;
+	const struct counters git0 = get("git"), buf0 = get("buffer");
+
+	char *p = alloc_stats_calloc(alloc_git, 4, 8);
+	assert_non_null(p);
+	for (size_t i = 0; i < 32; i++)
+		assert_int_equal(p[i], 0);
+
+	// The block grows for the git subsystem, the call counts for buffers
+	p = alloc_stats_realloc(alloc_buffer, p, 4096);
+	assert_non_null(p);
+	memset(p, 'x', 4096);
+	const struct counters git1 = get("git"), buf1 = get("buffer");
+	assert_int_equal(git1.calls, git0.calls + 1);
+	assert_int_equal(buf1.calls, buf0.calls + 1);
+	assert_in_range(git1.bytes - git0.bytes, 4096, 8192);
+	assert_int_equal(buf1.bytes, buf0.bytes);
+	assert_int_equal(buf1.total, buf0.total);
+
+	alloc_stats_free(alloc_other, p);
+	const struct counters git2 = get("git"), buf2 = get("buffer");
+	assert_int_equal(git2.bytes, git0.bytes);
+	assert_true(git2.peak >= git0.bytes + 4096);
+	assert_int_equal(buf2.bytes, buf0.bytes);
+	assert_int_equal(buf2.peak, buf0.peak);
+}
+
+static void overflow_test(void **state)
+{
+	(void) state;
+	const struct counters cfg0 = get("config");
+
+	assert_null(alloc_stats_malloc(alloc_config, SIZE_MAX));
+	assert_null(alloc_stats_calloc(alloc_config, SIZE_MAX / 2, 4));
+	alloc_stats_free(alloc_config, NULL);
+
+	const struct counters cfg1 = get("config");
+	assert_int_equal(cfg1.calls, cfg0.calls + 2);
+	assert_int_equal(cfg1.bytes, cfg0.bytes);
+	assert_int_equal(cfg1.total, cfg0.total);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(cross_free_test),
+		cmocka_unit_test(cross_realloc_test),
+		cmocka_unit_test(overflow_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,89 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <time.h>
+
+#include "../src/bwlimit.h"
+
+static const struct bandwidth_cfg cfg = {
+		.rate = 1000,
+		.windows =
+				{
+						{9 * 60, 18 * 60, 200},
+						{22 * 60, 6 * 60, 0},
+						{0, 24 * 60, 5},
+				},
+		.windows_len = 3,
+};
+
+static double now_sec(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (double) ts.tv_sec + (double) ts.tv_nsec / 1e9;
+}
+
+static void rate_at_test(void **state)
+{
+	(void) state;
+	assert_int_equal(bwlimit_rate_at(&cfg, 9 * 60), 200);
+	assert_int_equal(bwlimit_rate_at(&cfg, 18 * 60 - 1), 200);
+	// Windows wrapping past midnight
+	assert_int_equal(bwlimit_rate_at(&cfg, 23 * 60), 0);
+	assert_int_equal(bwlimit_rate_at(&cfg, 3 * 60), 0);
+	// First matching window wins
+	assert_int_equal(bwlimit_rate_at(&cfg, 20 * 60), 5);
+
+	const struct bandwidth_cfg plain = {.rate = 1000};
+	assert_int_equal(bwlimit_rate_at(&plain, 12 * 60), 1000);
+}
+
+static void unlimited_test(void **state)
+{
+	(void) state;
+	const struct bandwidth_cfg unlimited = {0};
+	assert_int_equal(bwlimit_init(&unlimited), 0);
+
+	const double start = now_sec();
+	bwlimit_take(1 << 30);
+	assert_true(now_sec() - start < 0.1);
+	assert_int_equal(bwlimit_chunk(), 64 * 1024);
+}
+
+static void limit_test(void **state)
+{
+	(void) state;
+	const struct bandwidth_cfg limited = {.rate = 256 << 10};
+	assert_int_equal(bwlimit_init(&limited), 1);
+
+	// Chunks shrink as transfers are added
+	bwlimit_flow_begin();
+	assert_int_equal(bwlimit_chunk(), (256 << 10) / 8);
+	bwlimit_flow_begin();
+	assert_int_equal(bwlimit_chunk(), (256 << 10) / 16);
+	bwlimit_flow_end();
+	bwlimit_flow_end();
+
+	const double start = now_sec();
+	for (int i = 0; i < 4; i++)
+		bwlimit_take(32 << 10);
+	const double elapsed = now_sec() - start;
+	assert_true(elapsed > 0.4 && elapsed < 1.0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(rate_at_test),
+		cmocka_unit_test(unlimited_test),
+		cmocka_unit_test(limit_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,178 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+#include <unistd.h>
+
+#include "../src/changes.h"
+
+#define OID_A "1111111111111111111111111111111111111111"
+#define OID_B "2222222222222222222222222222222222222222"
+#define OID_C "3333333333333333333333333333333333333333"
+#define ZERO "0000000000000000000000000000000000000000"
+#define OID_256 OID_A "aaaaaaaaaaaaaaaaaaaaaaaa"
+
+static buffer_t from_str(const char *str)
+{
+	buffer_t buf = buffer_new(0);
+	buffer_append(&buf, str, strlen(str));
+	return buf;
+}
+
+static void assert_lines(buffer_t *lines, const char *expected)
+{
+	buffer_append(lines, "", 1);
+	assert_string_equal((const char *) lines->data, expected);
+}
+
+static void parse_porcelain_test(void **state)
+{
+	(void) state;
+	const char *out = "  " OID_A " " OID_B " refs/heads/main\n"
+			  "= " OID_C " " OID_C " refs/heads/stable\n"
+			  "* " ZERO " " OID_C " refs/tags/v1.0\n"
+			  "! " OID_A " " OID_B " refs/heads/locked\n"
+			  "- " OID_B " " ZERO " refs/heads/gone\n"
+			  "+ " OID_B " " OID_A " refs/heads/forced";
+	buffer_t lines = buffer_new(0);
+	changes_parse_porcelain(out, strlen(out), &lines);
+	assert_lines(&lines, OID_A " " OID_B " refs/heads/main\n" ZERO
+				   " " OID_C " refs/tags/v1.0\n" OID_B
+				   " " ZERO " refs/heads/gone\n" OID_B
+				   " " OID_A " refs/heads/forced\n");
+	buffer_free(lines);
+
+	// Progress or garbage is ignored
+	lines = buffer_new(0);
+	out = "From https://github.com/owner/repo\n\n*\n  " OID_A "\n";
+	changes_parse_porcelain(out, strlen(out), &lines);
+	assert_int_equal(lines.len, 0);
+	buffer_free(lines);
+}
+
+static void diff_test(void **state)
+{
+	(void) state;
+	buffer_t before = from_str(OID_A " refs/heads/a\n"
+					 OID_B " refs/heads/b\n"
+					 OID_C " refs/heads/c\n"
+					 OID_A " refs/tags/v1\n");
+	buffer_t after = from_str(OID_B " refs/heads/a\n"
+					OID_C " refs/heads/c\n"
+					OID_C " refs/heads/d\n"
+					OID_A " refs/tags/v1\n"
+					OID_B " refs/tags/v2\n");
+	buffer_t lines = buffer_new(0);
+	changes_diff(&before, &after, &lines);
+	assert_lines(&lines, OID_A " " OID_B " refs/heads/a\n" OID_B
+				   " " ZERO " refs/heads/b\n" ZERO
+				   " " OID_C " refs/heads/d\n" ZERO
+				   " " OID_B " refs/tags/v2\n");
+	buffer_free(lines);
+
+	// Nothing changed
+	lines = buffer_new(0);
+	changes_diff(&after, &after, &lines);
+	assert_int_equal(lines.len, 0);
+	buffer_free(lines);
+
+	// New mirror, the zero ID matches the length of the other ID
+	buffer_t empty = buffer_new(0);
+	buffer_t sha256 = from_str(OID_256 " refs/heads/main");
+	lines = buffer_new(0);
+	changes_diff(&empty, &sha256, &lines);
+	assert_lines(&lines,
+		     ZERO "000000000000000000000000 " OID_256 " refs/heads/main\n");
+	buffer_free(lines);
+
+	buffer_free(sha256);
+	buffer_free(empty);
+	buffer_free(after);
+	buffer_free(before);
+}
+
+/// Records a change of the mirror me/name in the git base directory
+static void record(const char *dir, const char *name, const char *change)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/me/%s.git", dir, name);
+	buffer_t lines = from_str(change);
+	assert_int_equal(changes_record("me", name, path, &lines), 0);
+	buffer_free(lines);
+}
+
+static void replay_test(void **state)
+{
+	(void) state;
+	char dir[] = "/tmp/changes-test-XXXXXX";
+	assert_non_null(mkdtemp(dir));
+	char out[64], command[128];
+	snprintf(out, sizeof(out), "%s/out", dir);
+	// The journal lines, then the paths
+	snprintf(command, sizeof(command),
+		 "cat >>%s/out; printf '%%s\\n' \"$@\" >>%s/out", dir, dir);
+	const struct hooks_cfg hooks = {
+			.commands = {command},
+			.commands_len = 1,
+			.batch = 10,
+			.jobs = 1,
+	};
+
+	// An interrupted run doesn't run the hooks
+	assert_int_equal(changes_open(dir), 0);
+	record(dir, "a", OID_A " " OID_B " refs/heads/main\n");
+	changes_close();
+
+	// The next one passes them its changes too, merged by mirror
+	assert_int_equal(changes_open(dir), 0);
+	record(dir, "b", ZERO " " OID_C " refs/tags/v1\n");
+	record(dir, "a", OID_B " " OID_C " refs/heads/main\n");
+	assert_int_equal(changes_run_hooks(&hooks, 1), 0);
+	changes_close();
+
+	// And the one after that has nothing left to pass on
+	assert_int_equal(changes_open(dir), 0);
+	assert_int_equal(changes_run_hooks(&hooks, 1), 0);
+	changes_close();
+
+	char expected[1024], actual[1024] = {0};
+	snprintf(expected, sizeof(expected),
+		 "me/a " OID_A " " OID_B " refs/heads/main\n"
+		 "me/a " OID_B " " OID_C " refs/heads/main\n"
+		 "me/b " ZERO " " OID_C " refs/tags/v1\n"
+		 "%s/me/a.git\n%s/me/b.git\n",
+		 dir, dir);
+	FILE *f = fopen(out, "r");
+	assert_non_null(f);
+	const size_t n = fread(actual, 1, sizeof(actual) - 1, f);
+	fclose(f);
+	actual[n] = '\0';
+	assert_string_equal(actual, expected);
+
+	const char *files[] = {"out", CHANGES_FILE, CHANGES_HOOKED_FILE};
+	for (size_t i = 0; i < sizeof(files) / sizeof(*files); i++) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+		unlink(path);
+	}
+	rmdir(dir);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(parse_porcelain_test),
+		cmocka_unit_test(diff_test),
+		cmocka_unit_test(replay_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
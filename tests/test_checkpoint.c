@@ -0,0 +1,112 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/checkpoint.h"
+
+static int setup(void **state)
+{
+	char tmpl[] = "/tmp/checkpoint-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	*state = strdup(tmpl);
+	return *state ? 0 : -1;
+}
+
+static int teardown(void **state)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", (char *) *state,
+		 CHECKPOINT_FILE);
+	unlink(path);
+	rmdir(*state);
+	free(*state);
+	return 0;
+}
+
+/// Lists two pages of two repositories each
+static void list_remote(void)
+{
+	assert_int_equal(checkpoint_page("github:me", NULL), 0);
+	assert_int_equal(checkpoint_queue("github:me", "me", "a"), 0);
+	assert_int_equal(checkpoint_queue("github:me", "me", "b"), 0);
+	assert_int_equal(checkpoint_page("github:me", "page2"), 0);
+	assert_int_equal(checkpoint_queue("github:me", "me", "c"), 0);
+	assert_int_equal(checkpoint_queue("github:me", "me", "d"), 0);
+	checkpoint_listed("github:me");
+}
+
+static void checkpoint_resume_test(void **state)
+{
+	const char *base = *state;
+	const char *cursor;
+
+	assert_int_equal(checkpoint_open(base, 0, 1), 0);
+	assert_int_equal(checkpoint_resume("github:me", &cursor), 0);
+	assert_null(cursor);
+	list_remote();
+	checkpoint_done("me", "b");
+	checkpoint_done("me", "a");
+	checkpoint_done("me", "d");
+	assert_int_equal(checkpoint_close(base, 0), 0);
+
+	// The first page is done, so listing resumes from the second
+	assert_int_equal(checkpoint_open(base, 0, 1), 1);
+	assert_int_equal(checkpoint_resume("github:me", &cursor), 0);
+	assert_non_null(cursor);
+	assert_string_equal(cursor, "page2");
+	assert_int_equal(checkpoint_is_done("me", "d"), 1);
+	assert_int_equal(checkpoint_is_done("me", "c"), 0);
+	assert_int_equal(checkpoint_page("github:me", cursor), 0);
+	assert_int_equal(checkpoint_queue("github:me", "me", "c"), 0);
+	checkpoint_listed("github:me");
+	checkpoint_done("me", "c");
+	assert_int_equal(checkpoint_close(base, 0), 0);
+
+	// Every repository is done
+	assert_int_equal(checkpoint_open(base, 0, 1), 1);
+	assert_int_equal(checkpoint_resume("github:me", &cursor), 1);
+	assert_int_equal(checkpoint_close(base, 1), 0);
+
+	// A completed sweep removes the journal
+	assert_int_equal(checkpoint_open(base, 0, 1), 0);
+	assert_int_equal(checkpoint_is_done("me", "a"), 0);
+	assert_int_equal(checkpoint_close(base, 1), 0);
+}
+
+static void checkpoint_shard_test(void **state)
+{
+	const char *base = *state;
+
+	assert_int_equal(checkpoint_open(base, 0, 2), 0);
+	list_remote();
+	checkpoint_done("me", "a");
+	assert_int_equal(checkpoint_close(base, 0), 0);
+
+	// A journal of another shard is not resumed
+	assert_int_equal(checkpoint_open(base, 1, 2), 0);
+	assert_int_equal(checkpoint_is_done("me", "a"), 0);
+	assert_int_equal(checkpoint_close(base, 1), 0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(checkpoint_resume_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(checkpoint_shard_test, setup,
+						teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,188 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/alloc.h"
+#include "../src/client.h"
+#include "../src/json.h"
+#include "queries/github/gh_identity.h"
+#include "queries/github/gh_list_repos.h"
+
+static void assert_body(const buffer_t *body, const char *expected)
+{
+	assert_int_equal(body->len, strlen(expected));
+	assert_memory_equal(body->data, expected, body->len);
+}
+
+static void body_layout_test(void **state)
+{
+	(void) state;
+	buffer_t body = buffer_new(64);
+
+	gql_build_body(&body, "{\"query\":\"q\",\"variables\":", NULL, 0);
+	assert_body(&body, "{\"query\":\"q\",\"variables\":{}}");
+
+	// Null values, and the buffer is cleared on reuse
+	const struct gql_var vars[] = {{"a", "1"}, {"b", NULL}, {"c", ""}};
+	gql_build_body(&body, "P", vars, 3);
+	assert_body(&body, "P{\"a\":\"1\",\"b\":null,\"c\":\"\"}}");
+
+	buffer_free(body);
+}
+
+static void body_escape_test(void **state)
+{
+	(void) state;
+	buffer_t body = buffer_new(64);
+
+	const struct gql_var vars[] = {
+			{"q\"k", "say \"hi\""},
+			{"path", "C:\\dir\\"},
+			{"ctl", "\x01\x1f\n\t\x7f"},
+			// Passed through as UTF-8, as is invalid input
+			{"utf8", "h\xc3\xa9 \xe2\x82\xac \xff"},
+	};
+	gql_build_body(&body, "", vars, 4);
+	assert_body(&body, "{\"q\\\"k\":\"say \\\"hi\\\"\","
+			   "\"path\":\"C:\\\\dir\\\\\","
+			   "\"ctl\":\"\\u0001\\u001f\\u000a\\u0009\x7f\","
+			   "\"utf8\":\"h\xc3\xa9 \xe2\x82\xac \xff\"}}");
+
+	// Every escape is read back as the original value
+	buffer_append(&body, "\0", 1);
+	struct json_reader r;
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	json_reader_init(&r, (const char *) body.data, body.len - 1);
+	assert_int_equal(json_object_begin(&r), 1);
+	for (size_t i = 0; i < 4; i++) {
+		char *value;
+		assert_int_equal(json_object_next(&r, &key, &key_len, &hash),
+				 1);
+		assert_int_equal(json_read_string(&r, &value), 1);
+		assert_string_equal(value, vars[i].value);
+		gfree(value);
+	}
+	buffer_free(body);
+}
+
+static void minify_test(void **state)
+{
+	(void) state;
+	buffer_t body = buffer_new(1024);
+
+	gql_build_body(&body, gh_identity, NULL, 0);
+	assert_body(&body,
+		    "{\"query\":\"query{viewer{login}}\",\"variables\":{}}");
+
+	// Only names are separated, by a single space
+	const struct gql_var vars[] = {{"username", "me"}, {"after", NULL}};
+	gql_build_body(&body, gh_list_repos, vars, 2);
+	struct json_reader r;
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	char *query;
+	json_reader_init(&r, (const char *) body.data, body.len);
+	assert_int_equal(json_object_begin(&r), 1);
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 1);
+	assert_memory_equal(key, "query", key_len);
+	assert_int_equal(json_read_string(&r, &query), 1);
+	const char *start = "query GetUserRepos($username:String!"
+			    "$after:String){repositoryOwner(login:$username)"
+			    "{repositories(first:100 after:$after ";
+	assert_true(strncmp(query, start, strlen(start)) == 0);
+	assert_null(strpbrk(query, "\n\t,#"));
+	assert_null(strstr(query, "  "));
+	assert_null(strstr(query, " {"));
+	assert_null(strstr(query, "{ "));
+	gfree(query);
+
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 1);
+	assert_memory_equal(key, "variables", key_len);
+	assert_int_equal(json_skip(&r), 0);
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 0);
+	buffer_free(body);
+}
+
+/// Reads one header line into the headers
+static void read_line(struct rest_headers *h, const char *line)
+{
+	rest_read_header(line, strlen(line), h);
+}
+
+static void link_test(void **state)
+{
+	(void) state;
+	struct rest_headers h = {0};
+
+	read_line(&h, "Link: <https://api.github.com/user/repos?page=2>; "
+		      "rel=\"next\", <https://api.github.com/user/repos?"
+		      "page=5>; rel=\"last\"\r\n");
+	assert_string_equal(h.next, "https://api.github.com/user/repos?page=2");
+
+	// The next page isn't always first, and names are case-insensitive
+	read_line(&h, "link: <https://x/r?page=1>; rel=\"prev\", "
+		      "<https://x/r?page=3>; rel=\"next\", "
+		      "<https://x/r?page=5>; rel=\"last\"\r\n");
+	assert_string_equal(h.next, "https://x/r?page=3");
+	read_line(&h, "LINK:\t<https://x/r?page=4>; rel=\"next\"\r\n");
+	assert_string_equal(h.next, "https://x/r?page=4");
+
+	// The last page only links back
+	read_line(&h, "Link: <https://x/r?page=1>; rel=\"first\", "
+		      "<https://x/r?page=4>; rel=\"prev\"\r\n");
+	assert_string_equal(h.next, "");
+
+	// A malformed link has no next page
+	strcpy(h.next, "https://x/r?page=2");
+	read_line(&h, "Link: <https://x/r?page=2; rel=\"next\"\r\n");
+	assert_string_equal(h.next, "");
+
+	// Other headers leave it alone
+	strcpy(h.next, "https://x/r?page=2");
+	read_line(&h, "Content-Type: application/json\r\n");
+	read_line(&h, "X-Link: <https://x/r?page=9>; rel=\"next\"\r\n");
+	read_line(&h, "\r\n");
+	assert_string_equal(h.next, "https://x/r?page=2");
+	assert_string_equal(h.etag, "");
+}
+
+static void etag_test(void **state)
+{
+	(void) state;
+	struct rest_headers h = {0};
+
+	read_line(&h, "ETag: W/\"0123abcd\"  \r\n");
+	assert_string_equal(h.etag, "W/\"0123abcd\"");
+	read_line(&h, "etag: \"ef\"\n");
+	assert_string_equal(h.etag, "\"ef\"");
+
+	// Values too long to keep are ignored rather than truncated
+	char line[512] = "ETag: \"";
+	memset(line + strlen(line), 'a', 300);
+	strcat(line, "\"\r\n");
+	read_line(&h, line);
+	assert_string_equal(h.etag, "\"ef\"");
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(body_layout_test),
+		cmocka_unit_test(body_escape_test),
+		cmocka_unit_test(minify_test),
+		cmocka_unit_test(link_test),
+		cmocka_unit_test(etag_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -26,6 +26,25 @@ static void config_read_normal(void **state)
 	struct config *cfg = config_read(path);
 	assert_non_null(cfg);
 	assert_string_equal(cfg->git_base, "/srv/git");
+	assert_int_equal(cfg->jobs, 1);
+	assert_int_equal(cfg->jobs_min, 1);
+	assert_int_equal(cfg->shutdown_timeout, 60);
+	assert_int_equal(cfg->retries, 2);
+	assert_int_equal(cfg->ssh_multiplex, 1);
+	assert_int_equal(cfg->ssh_masters, 0);
+	assert_int_equal(cfg->lfs.enabled, 0);
+	assert_int_equal(cfg->lfs.jobs, 16);
+	assert_int_equal(cfg->bandwidth.rate, 0);
+	assert_int_equal(cfg->bandwidth.windows_len, 0);
+	assert_int_equal(cfg->hooks.commands_len, 0);
+	assert_int_equal(cfg->hooks.batch, 100);
+	assert_int_equal(cfg->hooks.jobs, 1);
+	assert_int_equal(cfg->profile.nice, 10);
+	assert_int_equal(cfg->profile.io_class, io_class_best_effort);
+	assert_int_equal(cfg->profile.memory, 0);
+	assert_int_equal(cfg->profile.pack_threads, 0);
+	assert_null(cfg->profile.cgroup);
+	assert_string_equal(cfg->profile.negotiation, "skipping");
 
 	assert_non_null(cfg->head);
 	assert_int_equal(cfg->head->type, remote_type_github);
@@ -35,6 +54,20 @@ static void config_read_normal(void **state)
 	assert_string_equal(cfg->head->gh.token, "ghp_1234567890abcdef");
 	assert_string_equal(cfg->head->gh.user_agent, "user-agent");
 	assert_string_equal(cfg->head->gh.owner, "my-org");
+	assert_int_equal(cfg->head->gh.partial_size, 10LL << 30);
+	assert_int_equal(cfg->head->gh.partial_mode, partial_mode_refs);
+	assert_int_equal(cfg->head->gh.refs, ref_policy_all);
+	assert_int_equal(cfg->head->gh.listing, gh_listing_graphql);
+	assert_string_equal(cfg->head->gh.rest_endpoint,
+			    "https://api.github.com");
+	assert_string_equal(cfg->head->gh.partial_filter, "blob:limit=1m");
+	assert_string_equal(cfg->head->gh.partial_repos, "assets, datasets");
+	assert_non_null(cfg->head->gh.filter.head);
+	assert_int_equal(cfg->head->gh.filter.has_includes, 1);
+
+	assert_string_equal(cfg->bundle.dir, "/srv/bundles");
+	assert_string_equal(cfg->bundle.uri,
+			    "https://bundles.example.com/{owner}/{repo}.bundle");
 	config_free(cfg);
 }
 
@@ -53,14 +86,158 @@ static void config_read_srht(void **state)
 	assert_string_equal(cfg->head->srht.token, "ABC123XYZ");
 	assert_string_equal(cfg->head->srht.user_agent, "user-agent");
 	assert_string_equal(cfg->head->srht.owner, "my-org");
+	assert_int_equal(cfg->jobs_min, 2);
+	assert_int_equal(cfg->jobs, 8);
+
+	assert_null(cfg->bundle.dir);
+	assert_null(cfg->bundle.uri);
+	config_free(cfg);
+}
+
+static void config_read_maintenance(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/maintenance.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->maint.enabled, 1);
+	assert_int_equal(cfg->maint.pack_threshold, 8);
+	assert_int_equal(cfg->maint.loose_threshold, 5000);
+	assert_int_equal(cfg->maint.cpu_budget, 600);
+	assert_int_equal(cfg->maint.io_budget, 2LL << 30);
+	config_free(cfg);
+}
+
+static void config_read_bandwidth(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/bandwidth.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->bandwidth.rate, 4LL << 20);
+	assert_int_equal(cfg->bandwidth.windows_len, 2);
+	assert_int_equal(cfg->bandwidth.windows[0].start, 9 * 60);
+	assert_int_equal(cfg->bandwidth.windows[0].end, 18 * 60);
+	assert_int_equal(cfg->bandwidth.windows[0].rate, 512LL << 10);
+	assert_int_equal(cfg->bandwidth.windows[1].start, 22 * 60 + 30);
+	assert_int_equal(cfg->bandwidth.windows[1].end, 6 * 60);
+	assert_int_equal(cfg->bandwidth.windows[1].rate, 0);
+	config_free(cfg);
+}
+
+static void config_read_retries(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/retries.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->jobs, 4);
+	assert_int_equal(cfg->jobs_min, 4);
+	assert_int_equal(cfg->shutdown_timeout, 30);
+	assert_int_equal(cfg->retries, 4);
+	assert_int_equal(cfg->backend, git_backend_cli);
+	config_free(cfg);
+}
+
+static void config_read_sshmux(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/sshmux.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->ssh_multiplex, 0);
+	assert_int_equal(cfg->ssh_masters, 3);
 	config_free(cfg);
 }
 
+static void config_read_lfs(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/lfs.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->lfs.enabled, 1);
+	assert_int_equal(cfg->lfs.jobs, 32);
+	config_free(cfg);
+}
+
+static void config_read_hooks(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/hooks.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->hooks.commands_len, 2);
+	assert_string_equal(cfg->hooks.commands[0], "git-notify \"$@\"");
+	assert_string_equal(cfg->hooks.commands[1], "reindex");
+	assert_int_equal(cfg->hooks.batch, 50);
+	assert_int_equal(cfg->hooks.jobs, 2);
+	config_free(cfg);
+}
+
+static void config_read_profile(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/profile.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->profile.nice, 15);
+	assert_int_equal(cfg->profile.io_class, io_class_idle);
+	assert_int_equal(cfg->profile.memory, 3LL << 29);
+	assert_int_equal(cfg->profile.pack_threads, 2);
+	assert_string_equal(cfg->profile.cgroup,
+			    "/sys/fs/cgroup/github-mirror.slice/git");
+	assert_null(cfg->profile.negotiation);
+	config_free(cfg);
+}
+
+static void config_read_refs(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/refs.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->head->gh.refs, ref_policy_no_pull);
+	config_free(cfg);
+}
+
+static void config_read_listing(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/listing.ini";
+	struct config *cfg = config_read(path);
+	assert_non_null(cfg);
+	assert_int_equal(cfg->head->gh.listing, gh_listing_rest);
+	assert_string_equal(cfg->head->gh.rest_endpoint,
+			    "https://ghe.example.com/api/v3");
+	config_free(cfg);
+}
+
+static void config_read_invalid_filter(void **state)
+{
+	(void) state;
+	const char *path = "../tests/fixtures/invalid_filter.ini";
+	struct config *cfg = config_read(path);
+	assert_null(cfg);
+}
+
 int main(void)
 {
-	const struct CMUnitTest tests[] = {cmocka_unit_test(config_read_empty),
-					   cmocka_unit_test(config_read_normal),
-					   cmocka_unit_test(config_read_srht)};
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(config_read_empty),
+		cmocka_unit_test(config_read_normal),
+		cmocka_unit_test(config_read_srht),
+		cmocka_unit_test(config_read_maintenance),
+		cmocka_unit_test(config_read_bandwidth),
+		cmocka_unit_test(config_read_retries),
+		cmocka_unit_test(config_read_sshmux),
+		cmocka_unit_test(config_read_lfs),
+		cmocka_unit_test(config_read_hooks),
+		cmocka_unit_test(config_read_profile),
+		cmocka_unit_test(config_read_refs),
+		cmocka_unit_test(config_read_listing),
+		cmocka_unit_test(config_read_invalid_filter),
+	};
 
 	return cmocka_run_group_tests(tests, NULL, NULL);
 }
@@ -0,0 +1,117 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/filter.h"
+
+#define NOW 1700000000
+#define DAY (24 * 60 * 60)
+
+static void filter_empty_test(void **state)
+{
+	(void) state;
+	struct repo_filter filter = {0};
+	const struct repo_attrs repo = {.name = "repo"};
+	const char *reason;
+	assert_int_equal(filter_eval(&filter, &repo, NOW, &reason), 1);
+	assert_null(reason);
+}
+
+static void filter_invalid_test(void **state)
+{
+	(void) state;
+	struct repo_filter filter = {0};
+	assert_int_equal(filter_add(&filter, "owner:foo", 0), -1);
+	assert_int_equal(filter_add(&filter, "name<foo", 0), -1);
+	assert_int_equal(filter_add(&filter, "size>10X", 0), -1);
+	assert_int_equal(filter_add(&filter, "name~(", 0), -1);
+	assert_int_equal(filter_add(&filter, "archived:maybe", 0), -1);
+	assert_int_equal(filter_add(&filter, "   ", 0), -1);
+	assert_null(filter.head);
+	filter_free(&filter);
+}
+
+static void filter_include_exclude_test(void **state)
+{
+	(void) state;
+	struct repo_filter filter = {0};
+	const char *reason;
+	assert_int_equal(filter_add(&filter, "name:api-*", 0), 0);
+	assert_int_equal(filter_add(&filter, "topic~^infra", 0), 0);
+	assert_int_equal(filter_add(&filter, "name:*-old archived:true", 1), 0);
+
+	char *topics[] = {"docs", "infrastructure"};
+	const struct repo_attrs api = {.name = "api-server"};
+	const struct repo_attrs infra = {
+			.name = "deploy", .topics = topics, .topics_len = 2};
+	const struct repo_attrs other = {.name = "website"};
+	const struct repo_attrs old = {.name = "api-old", .archived = 1};
+	const struct repo_attrs old_active = {.name = "api-old"};
+
+	assert_int_equal(filter_eval(&filter, &api, NOW, &reason), 1);
+	assert_string_equal(reason, "name:api-*");
+	assert_int_equal(filter_eval(&filter, &infra, NOW, &reason), 1);
+	assert_string_equal(reason, "topic~^infra");
+	assert_int_equal(filter_eval(&filter, &other, NOW, &reason), 0);
+	assert_null(reason);
+	assert_int_equal(filter_eval(&filter, &old, NOW, &reason), 0);
+	assert_string_equal(reason, "name:*-old archived:true");
+	assert_int_equal(filter_eval(&filter, &old_active, NOW, &reason), 1);
+	filter_free(&filter);
+}
+
+static void filter_size_pushed_test(void **state)
+{
+	(void) state;
+	struct repo_filter filter = {0};
+	const char *reason;
+	assert_int_equal(filter_add(&filter, "size>1G", 1), 0);
+	assert_int_equal(filter_add(&filter, "pushed>1y", 1), 0);
+	assert_int_equal(filter_add(&filter, "language:C*", 1), 0);
+
+	const struct repo_attrs small = {
+			.name = "small",
+			.disk_usage = 1024,
+			.pushed_at = NOW - 30 * DAY,
+	};
+	const struct repo_attrs huge = {
+			.name = "huge",
+			.disk_usage = 2 * 1024 * 1024,
+			.pushed_at = NOW - DAY,
+	};
+	const struct repo_attrs stale = {
+			.name = "stale",
+			.pushed_at = NOW - 400 * DAY,
+	};
+	const struct repo_attrs unknown = {.name = "unknown"};
+	const struct repo_attrs cpp = {.name = "cpp", .language = "C++"};
+
+	assert_int_equal(filter_eval(&filter, &small, NOW, &reason), 1);
+	assert_int_equal(filter_eval(&filter, &huge, NOW, &reason), 0);
+	assert_string_equal(reason, "size>1G");
+	assert_int_equal(filter_eval(&filter, &stale, NOW, &reason), 0);
+	assert_string_equal(reason, "pushed>1y");
+	assert_int_equal(filter_eval(&filter, &unknown, NOW, &reason), 1);
+	assert_int_equal(filter_eval(&filter, &cpp, NOW, &reason), 0);
+	assert_string_equal(reason, "language:C*");
+	filter_free(&filter);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(filter_empty_test),
+		cmocka_unit_test(filter_invalid_test),
+		cmocka_unit_test(filter_include_exclude_test),
+		cmocka_unit_test(filter_size_pushed_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
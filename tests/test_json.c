@@ -0,0 +1,320 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/alloc.h"
+#include "../src/json.h"
+#include "../src/github/types.h"
+#include "queries/github/gh_list_repos.h"
+
+static char *read_fixture(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	assert_non_null(f);
+	fseek(f, 0, SEEK_END);
+	*len = (size_t) ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *data = test_malloc(*len);
+	assert_int_equal(fread(data, 1, *len, f), *len);
+	fclose(f);
+	return data;
+}
+
+static void reader_test(void **state)
+{
+	(void) state;
+	const char *json = "{\"a\": [1, -2.5e1, true, null], \"b\\\"\": "
+			   "{\"x\": {}}, \"c\": \"h\\u00e9\\n\"}";
+	struct json_reader r;
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	long long i;
+	double d;
+	int b;
+	char *s;
+
+	json_reader_init(&r, json, strlen(json));
+	assert_int_equal(json_object_begin(&r), 1);
+
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 1);
+	assert_int_equal(key_len, 1);
+	assert_memory_equal(key, "a", 1);
+	assert_int_equal(hash, (JSON_HASH_BASIS ^ 'a') * JSON_HASH_PRIME);
+	assert_int_equal(json_array_begin(&r), 1);
+	assert_int_equal(json_array_next(&r), 1);
+	assert_int_equal(json_read_int(&r, &i), 1);
+	assert_int_equal(i, 1);
+	assert_int_equal(json_array_next(&r), 1);
+	assert_int_equal(json_read_double(&r, &d), 1);
+	assert_true(d == -25.0);
+	assert_int_equal(json_array_next(&r), 1);
+	assert_int_equal(json_read_bool(&r, &b), 1);
+	assert_int_equal(b, 1);
+	assert_int_equal(json_array_next(&r), 1);
+	assert_int_equal(json_read_string(&r, &s), 0);
+	assert_null(s);
+	assert_int_equal(json_array_next(&r), 0);
+
+	// Keys are returned raw
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 1);
+	assert_int_equal(key_len, 3);
+	assert_memory_equal(key, "b\\\"", 3);
+	assert_int_equal(json_skip(&r), 0);
+
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 1);
+	assert_int_equal(json_read_string(&r, &s), 1);
+	assert_string_equal(s, "h\xc3\xa9\n");
+	test_free(s);
+
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), 0);
+}
+
+static void reader_invalid_test(void **state)
+{
+	(void) state;
+	const char *invalid[] = {
+			"", "{", "]", ",", "[1}", "{\"a\": tru}", "\"unterminated",
+			"[[[[", "[-]", "{\"a\": [}]",
+	};
+	for (size_t i = 0; i < sizeof(invalid) / sizeof(*invalid); i++) {
+		struct json_reader r;
+		json_reader_init(&r, invalid[i], strlen(invalid[i]));
+		assert_int_equal(json_skip(&r), -1);
+	}
+
+	// Separators are checked by the member and element readers
+	struct json_reader r;
+	const char *key;
+	size_t key_len;
+	uint32_t hash;
+	json_reader_init(&r, "{\"a\" 1}", 8);
+	assert_int_equal(json_object_begin(&r), 1);
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), -1);
+	json_reader_init(&r, "{,}", 3);
+	assert_int_equal(json_object_begin(&r), 1);
+	assert_int_equal(json_object_next(&r, &key, &key_len, &hash), -1);
+	json_reader_init(&r, "[1 2]", 5);
+	assert_int_equal(json_array_begin(&r), 1);
+	assert_int_equal(json_array_next(&r), 1);
+	assert_int_equal(json_skip(&r), 0);
+	assert_int_equal(json_array_next(&r), -1);
+
+	// Type mismatches
+	char *s;
+	int b;
+	json_reader_init(&r, "1", 1);
+	assert_int_equal(json_read_string(&r, &s), -1);
+	json_reader_init(&r, "\"true\"", 6);
+	assert_int_equal(json_read_bool(&r, &b), -1);
+	json_reader_init(&r, "[]", 2);
+	assert_int_equal(json_object_begin(&r), -1);
+
+	// Integers are neither truncated nor clamped
+	const char *not_int[] = {"1.5", "1e-1", "1e400", "-0.25",
+				 "99999999999999999999", "9223372036854775808.0"};
+	long long i;
+	for (size_t k = 0; k < sizeof(not_int) / sizeof(*not_int); k++) {
+		json_reader_init(&r, not_int[k], strlen(not_int[k]));
+		assert_int_equal(json_read_int(&r, &i), -1);
+	}
+	json_reader_init(&r, "1e3", 3);
+	assert_int_equal(json_read_int(&r, &i), 1);
+	assert_int_equal(i, 1000);
+	json_reader_init(&r, "-2.0", 4);
+	assert_int_equal(json_read_int(&r, &i), 1);
+	assert_int_equal(i, -2);
+
+	// Lone surrogates become U+FFFD
+	const char *lone[][2] = {
+			{"\"\\ud800x\"", "\xef\xbf\xbdx"},
+			{"\"\\udc00\"", "\xef\xbf\xbd"},
+			{"\"\\ud800\\u0041\"", "\xef\xbf\xbd" "A"},
+			{"\"\\udbff\\udbff\"", "\xef\xbf\xbd\xef\xbf\xbd"},
+	};
+	for (size_t k = 0; k < sizeof(lone) / sizeof(*lone); k++) {
+		json_reader_init(&r, lone[k][0], strlen(lone[k][0]));
+		assert_int_equal(json_read_string(&r, &s), 1);
+		assert_string_equal(s, lone[k][1]);
+		test_free(s);
+	}
+}
+
+static void decode_test(void **state)
+{
+	(void) state;
+	size_t len;
+	char *json = read_fixture("../tests/fixtures/gh_list_repos.json", &len);
+
+	struct gh_list_repos_data data;
+	assert_int_equal(gh_list_repos_decode(json, len, &data), 0);
+	test_free(json);
+
+	assert_non_null(data.repository_owner);
+	struct gh_list_repos_repositories *repos =
+			&data.repository_owner->repositories;
+	assert_int_equal(repos->page_info.has_next_page, 1);
+	assert_string_equal(repos->page_info.end_cursor, "Y3Vyc29yOjI=");
+
+	// Null nodes are dropped
+	assert_int_equal(repos->nodes_len, 2);
+
+	const struct gh_list_repos_repositories_nodes *repo = &repos->nodes[0];
+	assert_string_equal(repo->name, "github-mirror");
+	assert_string_equal(repo->ssh_url,
+			    "git@github.com:ansg191/github-mirror.git");
+	assert_int_equal(repo->is_fork, 0);
+	assert_int_equal(repo->disk_usage, 412);
+	assert_string_equal(repo->pushed_at, "2025-06-10T18:04:11Z");
+	assert_non_null(repo->primary_language);
+	assert_string_equal(repo->primary_language->name, "C");
+	assert_int_equal(repo->repository_topics.nodes_len, 2);
+	assert_string_equal(repo->repository_topics.nodes[1].topic.name,
+			    "mirror");
+	assert_null(repo->parent);
+
+	// Keys in any order, nulls and escapes
+	repo = &repos->nodes[1];
+	assert_string_equal(repo->name,
+			    "linux \xc3\xa9\xf0\x9f\x98\x80\t\"q\"");
+	assert_int_equal(repo->is_fork, 1);
+	assert_int_equal(repo->is_archived, 1);
+	assert_int_equal(repo->disk_usage, 0);
+	assert_null(repo->pushed_at);
+	assert_null(repo->primary_language);
+	assert_int_equal(repo->repository_topics.nodes_len, 0);
+	assert_non_null(repo->parent);
+	assert_string_equal(repo->parent->name_with_owner, "torvalds/linux");
+
+	gh_list_repos_data_free(&data);
+}
+
+static void decode_errors_test(void **state)
+{
+	(void) state;
+	const char *responses[] = {
+			// GraphQL errors
+			"{\"data\": {\"repositoryOwner\": null}, \"errors\": "
+			"[{\"message\": \"Could not resolve\"}]}",
+			// Missing required field
+			"{\"data\": {\"repositoryOwner\": {\"repositories\": "
+			"{\"nodes\": [{\"name\": \"a\"}], \"pageInfo\": "
+			"{\"hasNextPage\": false}}}}}",
+			// Required field is null
+			"{\"data\": {\"repositoryOwner\": {\"repositories\": "
+			"{\"nodes\": [], \"pageInfo\": {\"hasNextPage\": "
+			"null}}}}}",
+			// Wrong type
+			"{\"data\": {\"repositoryOwner\": {\"repositories\": "
+			"{\"nodes\": {}, \"pageInfo\": {\"hasNextPage\": "
+			"false}}}}}",
+			// No data
+			"{}",
+			// Truncated
+			"{\"data\": {\"repositoryOwner\": {\"repositories\": "
+			"{\"nodes\": [{\"name\": \"a\"",
+	};
+	for (size_t i = 0; i < sizeof(responses) / sizeof(*responses); i++) {
+		struct gh_list_repos_data data;
+		assert_int_equal(gh_list_repos_decode(responses[i],
+						      strlen(responses[i]),
+						      &data),
+				 -1);
+		assert_null(data.repository_owner);
+	}
+}
+
+static void rest_decode_test(void **state)
+{
+	(void) state;
+	size_t len;
+	char *json = read_fixture("../tests/fixtures/gh_rest_repos.json", &len);
+
+	struct gh_list_repos_res res;
+	assert_int_equal(gh_rest_repos_decode(json, len, &res), 0);
+	test_free(json);
+
+	// Paging comes from the Link header
+	assert_int_equal(res.has_next_page, 0);
+	assert_null(res.end_cursor);
+	assert_int_equal(res.repos_len, 2);
+
+	assert_string_equal(res.repos[0].name, "github-mirror");
+	assert_string_equal(res.repos[0].url,
+			    "https://github.com/ansg191/github-mirror");
+	assert_string_equal(res.repos[0].ssh_url,
+			    "ssh://git@github.com/ansg191/github-mirror.git");
+	assert_int_equal(res.repos[0].is_fork, 0);
+	assert_int_equal(res.repos[0].disk_usage, 412);
+	assert_int_equal(res.repos[0].pushed_at, 1749578651);
+	assert_string_equal(res.repos[0].language, "C");
+	assert_int_equal(res.repos[0].topics_len, 2);
+	assert_string_equal(res.repos[0].topics[1], "mirror");
+	assert_null(res.repos[0].parent);
+
+	assert_string_equal(res.repos[1].name, "linux");
+	assert_int_equal(res.repos[1].is_fork, 1);
+	assert_int_equal(res.repos[1].is_private, 1);
+	assert_int_equal(res.repos[1].is_archived, 1);
+	assert_int_equal(res.repos[1].pushed_at, 0);
+	assert_null(res.repos[1].language);
+	assert_int_equal(res.repos[1].topics_len, 0);
+
+	gh_list_repos_res_free(res);
+}
+
+static void rest_decode_errors_test(void **state)
+{
+	(void) state;
+	const char *responses[] = {
+			// Error object instead of a listing
+			"{\"message\": \"Not Found\"}",
+			// Missing ssh_url
+			"[{\"name\": \"a\", \"html_url\": \"u\"}]",
+			// Truncated
+			"[{\"name\": \"a\", \"topics\": [\"x\"",
+	};
+	for (size_t i = 0; i < sizeof(responses) / sizeof(*responses); i++) {
+		struct gh_list_repos_res res;
+		assert_int_equal(gh_rest_repos_decode(responses[i],
+						      strlen(responses[i]),
+						      &res),
+				 -1);
+		assert_int_equal(res.repos_len, 0);
+	}
+
+	const char *fork = "{\"name\": \"linux\", \"parent\": {\"id\": 2, "
+			   "\"full_name\": \"torvalds/linux\"}}";
+	char *parent = gh_rest_parent_decode(fork, strlen(fork));
+	assert_string_equal(parent, "torvalds/linux");
+	test_free(parent);
+	assert_null(gh_rest_parent_decode("{\"name\": \"a\"}", 13));
+
+	const char *org = "{\"login\": \"my-org\", \"type\": \"Organization\"}";
+	assert_int_equal(gh_rest_is_org_decode(org, strlen(org)), 1);
+	const char *user = "{\"login\": \"me\", \"type\": \"User\"}";
+	assert_int_equal(gh_rest_is_org_decode(user, strlen(user)), 0);
+	assert_int_equal(gh_rest_is_org_decode("[]", 2), -1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(reader_test),
+		cmocka_unit_test(reader_invalid_test),
+		cmocka_unit_test(decode_test),
+		cmocka_unit_test(decode_errors_test),
+		cmocka_unit_test(rest_decode_test),
+		cmocka_unit_test(rest_decode_errors_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,311 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/alloc.h"
+#include "../src/lfs_parse.h"
+
+#define VERSION "version https://git-lfs.github.com/spec/v1\n"
+#define OID "4d7a214614ab2935c943f9e0ff69d22eadbb8f32b1258daaa5e2ca24d17e2393"
+
+static char *read_fixture(const char *path, size_t *len)
+{
+	FILE *f = fopen(path, "rb");
+	assert_non_null(f);
+	fseek(f, 0, SEEK_END);
+	*len = (size_t) ftell(f);
+	fseek(f, 0, SEEK_SET);
+	char *data = test_malloc(*len);
+	assert_int_equal(fread(data, 1, *len, f), *len);
+	fclose(f);
+	return data;
+}
+
+/// Reads a NUL-terminated pointer file
+static int pointer(const char *text, struct lfs_object *obj)
+{
+	return lfs_parse_pointer(text, strlen(text), obj);
+}
+
+static void pointer_test(void **state)
+{
+	(void) state;
+	size_t len;
+	char *data = read_fixture("../tests/fixtures/lfs_pointer.txt", &len);
+	struct lfs_object obj = {0};
+
+	assert_int_equal(lfs_parse_pointer(data, len, &obj), 1);
+	assert_string_equal(obj.oid, OID);
+	assert_int_equal(obj.size, 12345);
+
+	// The same pointer checked out with CRLF line endings
+	char crlf[LFS_POINTER_MAX];
+	size_t crlf_len = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (data[i] == '\n')
+			crlf[crlf_len++] = '\r';
+		crlf[crlf_len++] = data[i];
+	}
+	assert_int_equal(lfs_parse_pointer(crlf, crlf_len, &obj), 0);
+
+	// Cut short of the final line feed
+	assert_int_equal(lfs_parse_pointer(data, len - 1, &obj), 0);
+	test_free(data);
+
+	// Extensions come between the version and the oid
+	assert_int_equal(pointer(VERSION "ext-0-foo sha256:" OID "\n"
+					 "oid sha256:" OID "\nsize 0\n",
+				 &obj),
+			 1);
+	assert_int_equal(obj.size, 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID
+					 "\nsize 9223372036854775807\n",
+				 &obj),
+			 1);
+	assert_int_equal(obj.size, 9223372036854775807LL);
+}
+
+static void pointer_invalid_test(void **state)
+{
+	(void) state;
+	struct lfs_object obj = {0};
+
+	// Wrong version line
+	assert_int_equal(pointer("version https://git-lfs.github.com/spec/v2\n"
+				 "oid sha256:" OID "\nsize 12\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer("version https://hawser.github.com/spec/v1\n"
+				 "oid sha256:" OID "\nsize 12\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer("oid sha256:" OID "\nsize 12\n" VERSION,
+				 &obj),
+			 0);
+	assert_int_equal(pointer("", &obj), 0);
+
+	// Bad oids
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "0\nsize 12\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:4d7a\nsize 12\n", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:4D7A214614AB2935C943F9E0F"
+					 "F69D22EADBB8F32B1258DAAA5E2CA24D17E"
+					 "2393\nsize 12\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha1:" OID "\nsize 12\n", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "size 12\n", &obj), 0);
+
+	// Negative, garbled, empty and overflowing sizes
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize -1\n", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize +1\n", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize  1\n", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize 12ab\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize 0x10\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize \n", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\nsize 12", &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID
+					 "\nsize 9223372036854775808\n",
+				 &obj),
+			 0);
+	assert_int_equal(pointer(VERSION "oid sha256:" OID "\n", &obj), 0);
+
+	// Too large to be a pointer
+	char big[LFS_POINTER_MAX + 64];
+	const int n = snprintf(big, sizeof(big),
+			       VERSION "oid sha256:" OID "\nsize 12\n");
+	memset(big + n, 'x', sizeof(big) - n - 1);
+	big[sizeof(big) - 1] = '\0';
+	assert_int_equal(pointer(big, &obj), 0);
+}
+
+static void batch_url_test(void **state)
+{
+	(void) state;
+	char url[256];
+
+	assert_int_equal(lfs_batch_url(NULL, "https://github.com/o/r", url,
+				       sizeof(url)),
+			 0);
+	assert_string_equal(url,
+			    "https://github.com/o/r.git/info/lfs/objects/batch");
+	assert_int_equal(lfs_batch_url("", "https://github.com/o/r.git/", url,
+				       sizeof(url)),
+			 0);
+	assert_string_equal(url,
+			    "https://github.com/o/r.git/info/lfs/objects/batch");
+	assert_int_equal(lfs_batch_url(NULL, "https://u:t@git.example.com/r.git",
+				       url, sizeof(url)),
+			 0);
+	assert_string_equal(
+			url,
+			"https://u:t@git.example.com/r.git/info/lfs/objects/batch");
+
+	// ssh upstreams are served over HTTPS, on the default port
+	assert_int_equal(lfs_batch_url(NULL, "ssh://git@github.com:2222/o/r.git",
+				       url, sizeof(url)),
+			 0);
+	assert_string_equal(url,
+			    "https://github.com/o/r.git/info/lfs/objects/batch");
+	assert_int_equal(lfs_batch_url(NULL, "ssh://host/o/r", url,
+				       sizeof(url)),
+			 0);
+	assert_string_equal(url, "https://host/o/r.git/info/lfs/objects/batch");
+	assert_int_equal(lfs_batch_url(NULL, "ssh://git@host", url,
+				       sizeof(url)),
+			 -1);
+
+	// lfs.url is used as is, whatever the upstream
+	assert_int_equal(lfs_batch_url("https://lfs.example.com/o/r",
+				       "git@github.com:o/r.git", url,
+				       sizeof(url)),
+			 0);
+	assert_string_equal(url, "https://lfs.example.com/o/r/objects/batch");
+	assert_int_equal(lfs_batch_url("http://127.0.0.1:8080/lfs/",
+				       "https://github.com/o/r", url,
+				       sizeof(url)),
+			 0);
+	assert_string_equal(url, "http://127.0.0.1:8080/lfs/objects/batch");
+
+	// Other upstreams have no endpoint
+	assert_int_equal(lfs_batch_url(NULL, "git@github.com:o/r.git", url,
+				       sizeof(url)),
+			 -1);
+	assert_int_equal(lfs_batch_url(NULL, "http://github.com/o/r", url,
+				       sizeof(url)),
+			 -1);
+	assert_int_equal(lfs_batch_url(NULL, "/srv/git/r.git", url,
+				       sizeof(url)),
+			 -1);
+
+	// Nor do endpoints that don't fit
+	char small[32];
+	assert_int_equal(lfs_batch_url(NULL, "https://github.com/o/r", small,
+				       sizeof(small)),
+			 -1);
+	assert_int_equal(lfs_batch_url("https://lfs.example.com/o/r",
+				       "https://github.com/o/r", small,
+				       sizeof(small)),
+			 -1);
+}
+
+static void batch_test(void **state)
+{
+	(void) state;
+	size_t len;
+	char *json = read_fixture("../tests/fixtures/lfs_batch.json", &len);
+	buffer_t resp = buffer_new(len + 1);
+	buffer_append(&resp, json, len);
+	buffer_append(&resp, "\0", 1);
+	test_free(json);
+
+	struct lfs_action *acts = NULL;
+	size_t acts_len = 0, missing = 0;
+	assert_int_equal(lfs_parse_batch(&resp, &acts, &acts_len, &missing), 0);
+	buffer_free(resp);
+
+	// 404 and 410 are missing, the 422 is left for the next run
+	assert_int_equal(missing, 2);
+	// Without an href, or with an uppercase, long or short oid, too
+	assert_int_equal(acts_len, 2);
+
+	char a[SHA256_HEX_LEN + 1], f[SHA256_HEX_LEN + 1];
+	memset(a, 'a', SHA256_HEX_LEN);
+	a[SHA256_HEX_LEN] = '\0';
+	memset(f, 'f', SHA256_HEX_LEN);
+	f[SHA256_HEX_LEN] = '\0';
+	char href[128];
+
+	assert_string_equal(acts[0].obj.oid, a);
+	assert_int_equal(acts[0].obj.size, 12);
+	snprintf(href, sizeof(href), "https://lfs.example.com/o/r/%s", a);
+	assert_string_equal(acts[0].href, href);
+	assert_non_null(acts[0].headers);
+	assert_string_equal(acts[0].headers->data,
+			    "Authorization: RemoteAuth abc123");
+	assert_null(acts[0].headers->next);
+
+	assert_string_equal(acts[1].obj.oid, f);
+	assert_int_equal(acts[1].obj.size, 4000000000LL);
+	snprintf(href, sizeof(href), "https://lfs.example.com/o/r/%s", f);
+	assert_string_equal(acts[1].href, href);
+	assert_null(acts[1].headers);
+
+	for (size_t i = 0; i < acts_len; i++)
+		lfs_action_free(&acts[i]);
+	test_free(acts);
+}
+
+static void batch_invalid_test(void **state)
+{
+	(void) state;
+	const char *cases[] = {
+			"",
+			"[]",
+			"{\"objects\": {}}",
+			"{\"objects\": [{\"oid\": 1}]}",
+			"{\"objects\": [{\"size\": \"12\"}]}",
+			"{\"objects\": [{\"error\": {\"code\": \"404\"}}]}",
+			"{\"objects\": [{\"actions\": {\"download\": []}}]}",
+			"{\"objects\": [{\"actions\": {\"download\": "
+			"{\"header\": {\"a\": 1}}}}]}",
+			"{\"objects\": [",
+	};
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(*cases); i++) {
+		buffer_t resp = buffer_new(64);
+		buffer_append(&resp, cases[i], strlen(cases[i]) + 1);
+		struct lfs_action *acts = NULL;
+		size_t acts_len = 0, missing = 0;
+		assert_int_equal(lfs_parse_batch(&resp, &acts, &acts_len,
+						 &missing),
+				 -1);
+		assert_null(acts);
+		buffer_free(resp);
+	}
+
+	// A response without objects has nothing to download
+	buffer_t resp = buffer_new(64);
+	const char *empty = "{\"transfer\": \"basic\", \"objects\": []}";
+	buffer_append(&resp, empty, strlen(empty) + 1);
+	struct lfs_action *acts = NULL;
+	size_t acts_len = 1, missing = 1;
+	assert_int_equal(lfs_parse_batch(&resp, &acts, &acts_len, &missing), 0);
+	assert_int_equal(acts_len, 0);
+	assert_int_equal(missing, 0);
+	assert_null(acts);
+	buffer_free(resp);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(pointer_test),
+		cmocka_unit_test(pointer_invalid_test),
+		cmocka_unit_test(batch_url_test),
+		cmocka_unit_test(batch_test),
+		cmocka_unit_test(batch_invalid_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,234 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/maintenance.h"
+
+/// Files and directories created by a test, removed in reverse order
+static char created[32][256];
+static size_t created_len;
+/// PATH of the test, restored after each test
+static char *saved_path;
+
+static void make_path(const char *base, const char *rel, const char *data)
+{
+	char *path = created[created_len++];
+	snprintf(path, sizeof(created[0]), "%s/%s", base, rel);
+	if (!data) {
+		assert_int_equal(mkdir(path, 0755), 0);
+		return;
+	}
+	FILE *f = fopen(path, "w");
+	assert_non_null(f);
+	fputs(data, f);
+	fclose(f);
+}
+
+static int setup(void **state)
+{
+	char tmpl[] = "/tmp/maintenance-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	*state = strdup(tmpl);
+	if (!*state)
+		return -1;
+	created_len = 0;
+
+	// A git that writes its arguments to a file, and fails the subcommand
+	// named by GIT_FAIL
+	char path[256];
+	snprintf(path, sizeof(path), "%s/git", tmpl);
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "#!/bin/sh\n"
+		   "echo \"$*\" >> %s/out\n"
+		   "[ \"$3\" != \"$GIT_FAIL\" ]\n",
+		tmpl);
+	fclose(f);
+	if (chmod(path, 0755) == -1)
+		return -1;
+
+	saved_path = strdup(getenv("PATH"));
+	if (!saved_path)
+		return -1;
+	setenv("PATH", tmpl, 1);
+	unsetenv("GIT_FAIL");
+
+	make_path(tmpl, "repo.git", NULL);
+	make_path(tmpl, "repo.git/objects", NULL);
+	make_path(tmpl, "repo.git/objects/pack", NULL);
+	make_path(tmpl, "repo.git/objects/17", NULL);
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	while (created_len > 0) {
+		const char *path = created[--created_len];
+		if (unlink(path) == -1)
+			rmdir(path);
+	}
+	char path[256];
+	snprintf(path, sizeof(path), "%s/git", (char *) *state);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/out", (char *) *state);
+	unlink(path);
+	rmdir(*state);
+	free(*state);
+	setenv("PATH", saved_path, 1);
+	free(saved_path);
+	return 0;
+}
+
+/// Reads the arguments of the git commands run, or "" if none were
+static void read_out(const char *dir, char *out, size_t len)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/out", dir);
+	out[0] = '\0';
+	FILE *f = fopen(path, "r");
+	if (!f)
+		return;
+	const size_t n = fread(out, 1, len - 1, f);
+	out[n] = '\0';
+	fclose(f);
+}
+
+/// Adds packs to the mirror, each with its index
+static void add_packs(const char *dir, int n)
+{
+	for (int i = 0; i < n; i++) {
+		char rel[64];
+		snprintf(rel, sizeof(rel), "repo.git/objects/pack/pack-%d.pack",
+			 i);
+		make_path(dir, rel, "");
+		snprintf(rel, sizeof(rel), "repo.git/objects/pack/pack-%d.idx",
+			 i);
+		make_path(dir, rel, "");
+	}
+}
+
+static void maintenance_skip_test(void **state)
+{
+	const char *dir = *state;
+	char repo[256], out[1024];
+	snprintf(repo, sizeof(repo), "%s/repo.git", dir);
+	add_packs(dir, 3);
+
+	// Disabled, whatever the mirror looks like
+	struct maintenance_cfg cfg = {.pack_threshold = 2};
+	assert_int_equal(maintenance_run(repo, NULL, 1), 0);
+	assert_int_equal(maintenance_run(repo, &cfg, 1), 0);
+
+	// Under both thresholds, and without any
+	cfg.enabled = 1;
+	cfg.pack_threshold = 4;
+	cfg.loose_threshold = 256;
+	assert_int_equal(maintenance_run(repo, &cfg, 1), 0);
+	cfg.pack_threshold = 0;
+	cfg.loose_threshold = 0;
+	assert_int_equal(maintenance_run(repo, &cfg, 1), 0);
+
+	read_out(dir, out, sizeof(out));
+	assert_string_equal(out, "");
+}
+
+static void maintenance_packs_test(void **state)
+{
+	const char *dir = *state;
+	char repo[256], out[1024], expected[1024];
+	snprintf(repo, sizeof(repo), "%s/repo.git", dir);
+	add_packs(dir, 4);
+
+	// Only packs count, not their indexes
+	const struct maintenance_cfg cfg = {
+			.enabled = 1,
+			.pack_threshold = 4,
+	};
+	assert_int_equal(maintenance_run(repo, &cfg, 1), 0);
+
+	read_out(dir, out, sizeof(out));
+	snprintf(expected, sizeof(expected),
+		 "--git-dir %s repack -d -l --geometric=2 --write-midx "
+		 "--write-bitmap-index --quiet\n"
+		 "--git-dir %s commit-graph write --reachable --split "
+		 "--no-progress\n",
+		 repo, repo);
+	assert_string_equal(out, expected);
+}
+
+static void maintenance_loose_test(void **state)
+{
+	const char *dir = *state;
+	char repo[256], out[1024], expected[1024];
+	snprintf(repo, sizeof(repo), "%s/repo.git", dir);
+
+	// Two objects in one fan-out directory make about 512 in all
+	make_path(dir, "repo.git/objects/17/aa", "");
+	make_path(dir, "repo.git/objects/17/bb", "");
+	const struct maintenance_cfg cfg = {
+			.enabled = 1,
+			.loose_threshold = 512,
+	};
+	assert_int_equal(maintenance_run(repo, &cfg, 0), 0);
+
+	read_out(dir, out, sizeof(out));
+	snprintf(expected, sizeof(expected),
+		 "--git-dir %s repack -d -l --geometric=2 --write-midx "
+		 "--write-bitmap-index\n"
+		 "--git-dir %s commit-graph write --reachable --split\n",
+		 repo, repo);
+	assert_string_equal(out, expected);
+}
+
+static void maintenance_failure_test(void **state)
+{
+	const char *dir = *state;
+	char repo[256], out[1024];
+	snprintf(repo, sizeof(repo), "%s/repo.git", dir);
+	add_packs(dir, 1);
+	const struct maintenance_cfg cfg = {
+			.enabled = 1,
+			.pack_threshold = 1,
+	};
+
+	// The commit-graph isn't written after a failed repack
+	setenv("GIT_FAIL", "repack", 1);
+	assert_int_equal(maintenance_run(repo, &cfg, 1), -1);
+	read_out(dir, out, sizeof(out));
+	assert_non_null(strstr(out, " repack "));
+	assert_null(strstr(out, "commit-graph"));
+
+	setenv("GIT_FAIL", "commit-graph", 1);
+	assert_int_equal(maintenance_run(repo, &cfg, 1), -1);
+	read_out(dir, out, sizeof(out));
+	assert_non_null(strstr(out, "commit-graph"));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test_setup_teardown(maintenance_skip_test,
+							setup, teardown),
+			cmocka_unit_test_setup_teardown(maintenance_packs_test,
+							setup, teardown),
+			cmocka_unit_test_setup_teardown(maintenance_loose_test,
+							setup, teardown),
+			cmocka_unit_test_setup_teardown(maintenance_failure_test,
+							setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,63 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/metrics.h"
+
+static void write_test(void **state)
+{
+	(void) state;
+	const char *path = "test_metrics.prom";
+
+	metrics_add(metric_jobs_ok, 3);
+	metrics_add(metric_jobs_ok, 2);
+	metrics_add(metric_jobs_failed, 1);
+	metrics_set(metric_concurrency_limit, 6);
+	metrics_set(metric_concurrency_limit, 4);
+	assert_int_equal(metrics_get(metric_jobs_ok), 5);
+	assert_int_equal(metrics_write(path), 0);
+
+	char buf[4096];
+	FILE *f = fopen(path, "r");
+	assert_non_null(f);
+	const size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+	remove(path);
+
+	const char *ok = "github_mirror_jobs_total{result=\"ok\"} 5\n";
+	const char *failed = "github_mirror_jobs_total{result=\"failed\"} 1\n";
+	assert_non_null(strstr(buf, ok));
+	assert_non_null(strstr(buf, failed));
+	assert_non_null(strstr(buf, "github_mirror_concurrency_limit 4\n"));
+
+	// Series of one metric share a single header
+	const char *type = "# TYPE github_mirror_jobs_total counter\n";
+	const char *first = strstr(buf, type);
+	assert_non_null(first);
+	assert_null(strstr(first + 1, type));
+}
+
+static void write_error_test(void **state)
+{
+	(void) state;
+	assert_int_equal(metrics_write("/nonexistent/metrics.prom"), -1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(write_test),
+		cmocka_unit_test(write_error_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
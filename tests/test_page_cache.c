@@ -0,0 +1,129 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../src/page_cache.h"
+
+static int setup(void **state)
+{
+	char tmpl[] = "/tmp/page-cache-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	char *dir = malloc(strlen(tmpl) + sizeof("/cache"));
+	if (!dir)
+		return -1;
+	sprintf(dir, "%s/cache", tmpl);
+	*state = dir;
+	return 0;
+}
+
+static int teardown(void **state)
+{
+	char *dir = *state;
+	DIR *d = opendir(dir);
+	if (d) {
+		const struct dirent *ent;
+		char path[4096];
+		while ((ent = readdir(d))) {
+			snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+			unlink(path);
+		}
+		closedir(d);
+		rmdir(dir);
+	}
+	*strrchr(dir, '/') = '\0';
+	rmdir(dir);
+	free(dir);
+	return 0;
+}
+
+/// Counts the files in a directory
+static int count_files(const char *dir)
+{
+	DIR *d = opendir(dir);
+	assert_non_null(d);
+	int n = 0;
+	const struct dirent *ent;
+	while ((ent = readdir(d)))
+		n += ent->d_name[0] != '.';
+	closedir(d);
+	return n;
+}
+
+static void roundtrip_test(void **state)
+{
+	const char *dir = *state;
+	const char *key = "me https://api.github.com/user/repos?page=2";
+	struct cached_page page;
+
+	// Nothing cached yet, not even the directory
+	assert_int_equal(page_cache_read(dir, key, &page), 0);
+	buffer_free(page.body);
+
+	const char *body = "[{\"name\": \"a\"}]";
+	assert_int_equal(page_cache_write(dir, key, "W/\"abc\"",
+					  "https://api.github.com/x?page=3",
+					  body, strlen(body)),
+			 0);
+	assert_int_equal(page_cache_read(dir, key, &page), 1);
+	assert_string_equal(page.etag, "W/\"abc\"");
+	assert_string_equal(page.next, "https://api.github.com/x?page=3");
+	assert_int_equal(page.body.len, strlen(body) + 1);
+	assert_string_equal((const char *) page.body.data, body);
+	buffer_free(page.body);
+
+	// Other keys, such as the same URL for another login, are apart
+	const char *other = "you https://api.github.com/user/repos?page=2";
+	assert_int_equal(page_cache_read(dir, other, &page), 0);
+	buffer_free(page.body);
+
+	// Replaced, and the last page has no next page
+	assert_int_equal(page_cache_write(dir, key, "\"def\"", "", "[]", 2), 0);
+	assert_int_equal(page_cache_read(dir, key, &page), 1);
+	assert_string_equal(page.etag, "\"def\"");
+	assert_string_equal(page.next, "");
+	assert_string_equal((const char *) page.body.data, "[]");
+	buffer_free(page.body);
+
+	// No temporary files are left behind
+	assert_int_equal(count_files(dir), 1);
+}
+
+static void invalid_test(void **state)
+{
+	const char *dir = *state;
+	struct cached_page page;
+
+	// Headers can't span lines
+	assert_int_equal(page_cache_write(dir, "k", "a\nb", "", "[]", 2), -1);
+	assert_int_equal(page_cache_read(dir, "k", &page), 0);
+	buffer_free(page.body);
+
+	// Responses without an ETag are never hits
+	assert_int_equal(page_cache_write(dir, "k", "", "", "[]", 2), 0);
+	assert_int_equal(page_cache_read(dir, "k", &page), 0);
+	buffer_free(page.body);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test_setup_teardown(roundtrip_test, setup,
+							teardown),
+			cmocka_unit_test_setup_teardown(invalid_test, setup,
+							teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,172 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "../src/profile.h"
+
+static int setup(void **state)
+{
+	char tmpl[] = "/tmp/profile-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	*state = strdup(tmpl);
+	if (!*state)
+		return -1;
+
+	// A git that writes its arguments and address space limit to a file,
+	// with a proxy for one URL in its config
+	char path[256];
+	snprintf(path, sizeof(path), "%s/git", tmpl);
+	FILE *f = fopen(path, "w");
+	if (!f)
+		return -1;
+	fprintf(f, "#!/bin/sh\n"
+		   "if [ \"$1\" = config ]; then\n"
+		   "\techo 'http.https://example.com/.proxy http://proxy:3128'\n"
+		   "\texit\n"
+		   "fi\n"
+		   "printf '%%s\\n' \"$@\" > %s/out\n"
+		   "ulimit -v >> %s/out\n",
+		tmpl, tmpl);
+	fclose(f);
+	return chmod(path, 0755);
+}
+
+static int teardown(void **state)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/git", (char *) *state);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/out", (char *) *state);
+	unlink(path);
+	rmdir(*state);
+	free(*state);
+	return 0;
+}
+
+/// Runs the fake git through the profile and reads what it was given
+static void run(const char *dir, char *out, size_t len)
+{
+	const pid_t pid = fork();
+	assert_true(pid >= 0);
+	if (pid == 0) {
+		setenv("PATH", dir, 1);
+		char *args[] = {"git", "fetch", "origin", NULL};
+		profile_exec(args);
+	}
+	int status;
+	assert_int_equal(waitpid(pid, &status, 0), pid);
+	assert_true(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s/out", dir);
+	FILE *f = fopen(path, "r");
+	assert_non_null(f);
+	const size_t n = fread(out, 1, len - 1, f);
+	out[n] = '\0';
+	fclose(f);
+}
+
+static void profile_options_test(void **state)
+{
+	const struct profile_cfg cfg = {
+			.io_class = io_class_none,
+			.pack_threads = 3,
+			.negotiation = "skipping",
+	};
+	assert_int_equal(profile_init(&cfg, 4), 0);
+
+	char out[1024];
+	run(*state, out, sizeof(out));
+	// The delta base cache depends on the RAM of the host
+	assert_non_null(strstr(out, "-c\ncore.deltaBaseCacheLimit="));
+	char *p = strstr(out, "-c\nfetch.negotiationAlgorithm");
+	assert_non_null(p);
+	assert_string_equal(p, "-c\nfetch.negotiationAlgorithm=skipping\n"
+			       "-c\nprotocol.version=2\n"
+			       "fetch\norigin\nunlimited\n");
+	assert_memory_equal(out, "-c\npack.threads=3\n", 17);
+}
+
+static void profile_memory_test(void **state)
+{
+	const struct profile_cfg cfg = {
+			.io_class = io_class_best_effort,
+			.memory = 1LL << 30,
+			.pack_threads = 2,
+	};
+	assert_int_equal(profile_init(&cfg, 2), 0);
+
+	char out[1024];
+	run(*state, out, sizeof(out));
+	assert_string_equal(out, "-c\npack.threads=2\n"
+				 "-c\ncore.deltaBaseCacheLimit=100663296\n"
+				 "-c\ncore.packedGitWindowSize=134217728\n"
+				 "-c\ncore.packedGitLimit=268435456\n"
+				 "-c\npack.windowMemory=134217728\n"
+				 "-c\nprotocol.version=2\n"
+				 "fetch\norigin\n1048576\n");
+
+	// Without a usable cgroup, each child is limited on its own
+	const struct profile_cfg cgroup = {
+			.memory = 1LL << 30,
+			.pack_threads = 1,
+			.cgroup = "/nonexistent/github-mirror",
+	};
+	assert_int_equal(profile_init(&cgroup, 2), -1);
+	run(*state, out, sizeof(out));
+	assert_non_null(strstr(out, "fetch\norigin\n1048576\n"));
+}
+
+static void profile_proxy_test(void **state)
+{
+	const struct profile_cfg cfg = {
+			.io_class = io_class_none,
+			.pack_threads = 1,
+	};
+	assert_int_equal(profile_init(&cfg, 1), 0);
+
+	// The proxies of the git config are read with the fake git
+	char *path = strdup(getenv("PATH"));
+	assert_non_null(path);
+	setenv("PATH", *state, 1);
+	profile_proxy("http://u:p@127.0.0.1:8080");
+	setenv("PATH", path, 1);
+	free(path);
+
+	char out[1024];
+	run(*state, out, sizeof(out));
+	char *p = strstr(out, "-c\nprotocol.version=2\n");
+	assert_non_null(p);
+	assert_string_equal(p, "-c\nprotocol.version=2\n"
+			       "-c\nhttp.proxy=http://u:p@127.0.0.1:8080\n"
+			       "-c\nhttp.https://example.com/.proxy="
+			       "http://u:p@127.0.0.1:8080\n"
+			       "fetch\norigin\nunlimited\n");
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test_setup_teardown(profile_options_test,
+							setup, teardown),
+			cmocka_unit_test_setup_teardown(profile_memory_test,
+							setup, teardown),
+			cmocka_unit_test_setup_teardown(profile_proxy_test,
+							setup, teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
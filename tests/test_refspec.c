@@ -0,0 +1,76 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include "../src/refspec.h"
+
+static void refspec_all_test(void **state)
+{
+	(void) state;
+	const char *const *specs = refspec_policy(ref_policy_all);
+	assert_string_equal(specs[0], "+refs/*:refs/*");
+	assert_null(specs[1]);
+	assert_true(refspec_wants(specs, "refs/heads/main"));
+	assert_true(refspec_wants(specs, "refs/pull/1/head"));
+	assert_true(refspec_wants(specs, "refs/notes/commits"));
+}
+
+static void refspec_no_pull_test(void **state)
+{
+	(void) state;
+	const char *const *specs = refspec_policy(ref_policy_no_pull);
+	assert_true(refspec_wants(specs, "refs/heads/main"));
+	assert_true(refspec_wants(specs, "refs/heads/pull/1"));
+	assert_true(refspec_wants(specs, "refs/tags/v1.0"));
+	assert_true(refspec_wants(specs, "refs/notes/commits"));
+	assert_false(refspec_wants(specs, "refs/pull/1/head"));
+	assert_false(refspec_wants(specs, "refs/pull/12345/merge"));
+}
+
+static void refspec_heads_tags_test(void **state)
+{
+	(void) state;
+	const char *const *specs = refspec_policy(ref_policy_heads_tags);
+	assert_true(refspec_wants(specs, "refs/heads/main"));
+	assert_true(refspec_wants(specs, "refs/heads/feature/x"));
+	assert_true(refspec_wants(specs, "refs/tags/v1.0"));
+	assert_false(refspec_wants(specs, "refs/pull/1/head"));
+	assert_false(refspec_wants(specs, "refs/notes/commits"));
+	assert_false(refspec_wants(specs, "refs/heads"));
+}
+
+static void refspec_pattern_test(void **state)
+{
+	(void) state;
+	const char *const specs[] = {
+			"+refs/heads/main:refs/heads/main",
+			"+refs/changes/*/meta:refs/changes/*/meta",
+			"^refs/changes/00/*",
+			NULL,
+	};
+	assert_true(refspec_wants(specs, "refs/heads/main"));
+	assert_false(refspec_wants(specs, "refs/heads/mainline"));
+	assert_true(refspec_wants(specs, "refs/changes/42/meta"));
+	assert_false(refspec_wants(specs, "refs/changes/42/1"));
+	assert_false(refspec_wants(specs, "refs/changes/00/meta"));
+	// Fetched with --tags regardless of the refspecs
+	assert_true(refspec_wants(specs, "refs/tags/v1.0"));
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+			cmocka_unit_test(refspec_all_test),
+			cmocka_unit_test(refspec_no_pull_test),
+			cmocka_unit_test(refspec_heads_tags_test),
+			cmocka_unit_test(refspec_pattern_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,150 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+
+#include "../src/retry.h"
+
+static void host_test(void **state)
+{
+	(void) state;
+	char host[RETRY_HOST_MAX];
+
+	assert_int_equal(retry_host("https://github.com/owner/repo.git", host,
+				    sizeof(host)),
+			 0);
+	assert_string_equal(host, "github.com");
+	assert_int_equal(retry_host("https://u:p@git.sr.ht:443/~u/r", host,
+				    sizeof(host)),
+			 0);
+	assert_string_equal(host, "git.sr.ht");
+	assert_int_equal(retry_host("ssh://git@[::1]:22/repo", host,
+				    sizeof(host)),
+			 0);
+	assert_string_equal(host, "[::1]");
+	assert_int_equal(retry_host("git@github.com:owner/repo.git", host,
+				    sizeof(host)),
+			 0);
+	assert_string_equal(host, "github.com");
+	assert_int_equal(retry_host("https://api.github.com", host,
+				    sizeof(host)),
+			 0);
+	assert_string_equal(host, "api.github.com");
+
+	assert_int_equal(retry_host("/srv/git/repo", host, sizeof(host)), -1);
+	assert_int_equal(retry_host("https:///path", host, sizeof(host)), -1);
+	assert_int_equal(retry_host("https://github.com/", host, 4), -1);
+}
+
+static void delay_test(void **state)
+{
+	(void) state;
+	for (int i = 0; i < 1000; i++) {
+		assert_in_range(retry_delay_ms(1, 100, 1000), 0, 100);
+		assert_in_range(retry_delay_ms(3, 100, 1000), 0, 400);
+		assert_in_range(retry_delay_ms(20, 100, 1000), 0, 1000);
+	}
+	assert_int_equal(retry_delay_ms(1, 0, 1000), 0);
+
+	// Jitter spreads retries out
+	long min = 1000, max = 0;
+	for (int i = 0; i < 1000; i++) {
+		const long d = retry_delay_ms(4, 100, 1000);
+		if (d < min)
+			min = d;
+		if (d > max)
+			max = d;
+	}
+	assert_true(min < 200);
+	assert_true(max > 600);
+}
+
+static void breaker_test(void **state)
+{
+	(void) state;
+
+	// Unknown hosts may always be contacted
+	assert_int_equal(breaker_check("a.example"), 0);
+
+	for (int i = 0; i < 4; i++)
+		breaker_report("a.example", 0);
+	assert_int_equal(breaker_check("a.example"), 0);
+	breaker_report("a.example", 0);
+	assert_true(breaker_check("a.example") > 0);
+
+	// Other hosts are unaffected
+	assert_int_equal(breaker_check("b.example"), 0);
+
+	// A success closes the breaker
+	breaker_report("a.example", 1);
+	assert_int_equal(breaker_check("a.example"), 0);
+
+	// Successes in between reset the count
+	for (int i = 0; i < 10; i++) {
+		breaker_report("b.example", 0);
+		breaker_report("b.example", i % 2);
+	}
+	assert_int_equal(breaker_check("b.example"), 0);
+}
+
+static void git_transient_test(void **state)
+{
+	(void) state;
+	const char *transient[] = {
+			"fatal: unable to access 'https://github.com/o/r/': "
+			"Could not resolve host: github.com\n",
+			"fatal: unable to access 'https://github.com/o/r/': "
+			"Failed to connect to github.com port 443 after 130 "
+			"ms: Connection timed out\n",
+			"error: RPC failed; curl 18 transfer closed with "
+			"outstanding read data remaining\n"
+			"fatal: early EOF\n",
+			"error: RPC failed; HTTP 502 curl 22 The requested URL "
+			"returned error: 502\n",
+			"fatal: unable to access 'https://github.com/o/r/': The "
+			"requested URL returned error: 429\n",
+			"ssh: connect to host github.com port 22: Connection "
+			"refused\nfatal: Could not read from remote "
+			"repository.\n",
+			"fatal: the remote end hung up unexpectedly\n",
+	};
+	for (size_t i = 0; i < sizeof(transient) / sizeof(*transient); i++)
+		assert_int_equal(retry_git_transient(transient[i]), 1);
+
+	const char *permanent[] = {
+			"remote: Repository not found.\nfatal: repository "
+			"'https://github.com/o/gone/' not found\n",
+			"remote: Invalid username or password.\nfatal: "
+			"Authentication failed for 'https://github.com/o/r/'\n",
+			"git@github.com: Permission denied (publickey).\nfatal: "
+			"Could not read from remote repository.\n",
+			"fatal: unable to access 'https://github.com/o/r/': The "
+			"requested URL returned error: 403\n",
+			"ERROR: Repository not found.\nfatal: the remote end "
+			"hung up unexpectedly\n",
+			"error: object file objects/ab/cdef is empty\nfatal: "
+			"loose object abcdef is corrupt\n",
+			"fatal: could not read Username for "
+			"'https://github.com': terminal prompts disabled\n",
+			"",
+	};
+	for (size_t i = 0; i < sizeof(permanent) / sizeof(*permanent); i++)
+		assert_int_equal(retry_git_transient(permanent[i]), 0);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(host_test),
+		cmocka_unit_test(delay_test),
+		cmocka_unit_test(breaker_test),
+		cmocka_unit_test(git_transient_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
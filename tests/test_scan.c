@@ -0,0 +1,180 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/scan.h"
+
+/// Files and directories created by a test, removed in reverse order
+static char created[32][256];
+static size_t created_len;
+
+static void make_path(const char *base, const char *rel, const char *data)
+{
+	char *path = created[created_len++];
+	snprintf(path, sizeof(created[0]), "%s/%s", base, rel);
+	if (!data) {
+		assert_int_equal(mkdir(path, 0755), 0);
+		return;
+	}
+	FILE *f = fopen(path, "w");
+	assert_non_null(f);
+	fputs(data, f);
+	fclose(f);
+}
+
+static int setup(void **state)
+{
+	char tmpl[] = "/tmp/scan-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	*state = strdup(tmpl);
+	created_len = 0;
+	return *state ? 0 : -1;
+}
+
+static int teardown(void **state)
+{
+	while (created_len > 0) {
+		const char *path = created[--created_len];
+		if (unlink(path) == -1)
+			rmdir(path);
+	}
+	rmdir(*state);
+	free(*state);
+	scan_free();
+	return 0;
+}
+
+static void lookup(const char *base, const char *rel, enum scan_entry entry)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", base, rel);
+	assert_int_equal(scan_lookup(path), entry);
+}
+
+static void scan_test(void **state)
+{
+	const char *base = *state;
+	make_path(base, "me", NULL);
+	make_path(base, "me/a.git", NULL);
+	make_path(base, "me/a.git/config",
+		  "[core]\n"
+		  "\tbare = true\n"
+		  "[remote \"origin\"]\n"
+		  "\turl = https://github.com/me/a.git\n"
+		  "\tfetch = +refs/*:refs/*\n"
+		  "\tmirror = true\n");
+	make_path(base, "me/b.git", NULL);
+	make_path(base, "me/b.git/config",
+		  "[remote \"origin\"]\n"
+		  "\turl = https://github.com/me/b.git\n"
+		  "[remote \"upstream\"]\n"
+		  "\tmirror = true\n");
+	make_path(base, "me/c.git", NULL);
+	make_path(base, "me/c.git/config", "[Remote \"origin\"]\n\tMirror\n");
+	make_path(base, "me/d.git", NULL);
+	make_path(base, "me/d.git/config",
+		  "[remote \"origin\"]\n\tmirror = true\n\tmirror = false\n");
+	make_path(base, "me/notes", NULL);
+	make_path(base, "other", NULL);
+	make_path(base, "other/e.git", NULL);
+	make_path(base, "other/e.git/config",
+		  "[remote \"origin\"]\n  mirror = yes ; set by clone\n");
+	make_path(base, "other/e.git.lock", "");
+	make_path(base, ".github-mirror-state", "");
+
+	assert_int_equal(scan_git_base(base, 4), 3);
+	lookup(base, "me", scan_dir);
+	lookup(base, "other", scan_dir);
+	lookup(base, "me/a.git", scan_mirror);
+	lookup(base, "me/b.git", scan_dir);
+	lookup(base, "me/c.git", scan_mirror);
+	lookup(base, "me/d.git", scan_dir);
+	lookup(base, "other/e.git", scan_mirror);
+	lookup(base, "me/x.git", scan_none);
+	lookup(base, "nobody", scan_none);
+	assert_int_equal(scan_lookup("/elsewhere/me/a.git"), scan_unknown);
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s/me/a.git", base);
+	assert_int_equal(scan_check_mirror(path), 1);
+	snprintf(path, sizeof(path), "%s/me/d.git", base);
+	assert_int_equal(scan_check_mirror(path), 0);
+	snprintf(path, sizeof(path), "%s/me/x.git", base);
+	assert_int_equal(scan_check_mirror(path), 0);
+	// Present but not a repository the scan indexed, so git has to tell
+	snprintf(path, sizeof(path), "%s/me/notes", base);
+	assert_int_equal(scan_check_mirror(path), -1);
+
+	// Mirrors cloned during the run
+	snprintf(path, sizeof(path), "%s/me/x.git", base);
+	scan_set(path, scan_mirror);
+	assert_int_equal(scan_check_mirror(path), 1);
+
+	scan_free();
+	lookup(base, "me/a.git", scan_unknown);
+	scan_set(path, scan_mirror);
+	assert_int_equal(scan_lookup(path), scan_unknown);
+}
+
+static void scan_refspecs_test(void **state)
+{
+	const char *base = *state;
+	make_path(base, "a.git", NULL);
+	make_path(base, "a.git/config",
+		  "[remote \"origin\"]\n"
+		  "\turl = https://github.com/me/a.git\n"
+		  "\tfetch = +refs/*:refs/*\n"
+		  "\tmirror = true\n"
+		  "\tfetch = ^refs/pull/*\n"
+		  "[remote \"upstream\"]\n"
+		  "\tfetch = +refs/heads/*:refs/heads/*\n");
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s/a.git", base);
+	const char *const no_pull[] = {"+refs/*:refs/*", "^refs/pull/*", NULL};
+	const char *const all[] = {"+refs/*:refs/*", NULL};
+	const char *const reversed[] = {"^refs/pull/*", "+refs/*:refs/*", NULL};
+	assert_int_equal(scan_has_refspecs(path, no_pull), 1);
+	assert_int_equal(scan_has_refspecs(path, all), 0);
+	assert_int_equal(scan_has_refspecs(path, reversed), 0);
+
+	snprintf(path, sizeof(path), "%s/missing.git", base);
+	assert_int_equal(scan_has_refspecs(path, all), 0);
+}
+
+static void scan_empty_test(void **state)
+{
+	const char *base = *state;
+	assert_int_equal(scan_git_base(base, 4), 0);
+	lookup(base, "me", scan_none);
+
+	char path[256];
+	snprintf(path, sizeof(path), "%s/missing", base);
+	assert_int_equal(scan_git_base(path, 4), -1);
+	lookup(base, "me", scan_unknown);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(scan_test, setup, teardown),
+		cmocka_unit_test_setup_teardown(scan_refspecs_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(scan_empty_test, setup,
+						teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,353 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/git.h"
+#include "../src/metrics.h"
+#include "../src/retry.h"
+#include "../src/sched.h"
+#include "../src/state.h"
+#include "../src/summary.h"
+
+/// Result every mirror job returns
+static int result;
+/// Jobs of the repositories numbered below this one succeed whatever result is
+static long succeed_below;
+/// Time every mirror job takes, in milliseconds
+static long job_ms;
+/// Names of the jobs in the order they ran
+static char ran[16][64];
+static _Atomic size_t ran_len;
+
+int git_mirror_repo(const struct repo_ctx *ctx, int quiet)
+{
+	(void) quiet;
+	const size_t i = atomic_fetch_add(&ran_len, 1);
+	if (i < sizeof(ran) / sizeof(*ran))
+		snprintf(ran[i], sizeof(ran[i]), "%s", ctx->name);
+	const struct timespec ts = {job_ms / 1000, job_ms % 1000 * 1000000};
+	nanosleep(&ts, NULL);
+	return atol(ctx->name) < succeed_below ? 0 : result;
+}
+
+static int setup(void **state)
+{
+	(void) state;
+	ran_len = 0;
+	job_ms = 0;
+	succeed_below = 0;
+	return 0;
+}
+
+/// Opens a state database in a new directory
+static int setup_state(void **state)
+{
+	char tmpl[] = "/tmp/sched-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	*state = strdup(tmpl);
+	if (!*state || state_open(tmpl, 0) != 0)
+		return -1;
+	return setup(state);
+}
+
+static int teardown_state(void **state)
+{
+	char *dir = *state;
+	state_close();
+	DIR *d = opendir(dir);
+	if (d) {
+		const struct dirent *ent;
+		char path[4096];
+		while ((ent = readdir(d))) {
+			snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name);
+			unlink(path);
+		}
+		closedir(d);
+	}
+	rmdir(dir);
+	free(dir);
+	return 0;
+}
+
+/**
+ * Queues jobs for the repositories me/0 to me/n-1 on a host.
+ */
+static struct sched *queue(const char *host, size_t n)
+{
+	struct sched *sched = sched_new();
+	assert_non_null(sched);
+	for (size_t i = 0; i < n; i++) {
+		char name[32], url[128];
+		snprintf(name, sizeof(name), "%zu", i);
+		snprintf(url, sizeof(url), "https://%s/me/%s", host, name);
+		const struct repo_ctx ctx = {
+				.owner = "me",
+				.name = name,
+				.url = url,
+		};
+		assert_int_equal(sched_add(sched, &ctx, 0, 0), 0);
+	}
+	return sched;
+}
+
+/**
+ * Queues a job for the repository me/name.
+ * @param sched Job queue
+ * @param name Name of the repository
+ * @param disk_usage Size of the repository in kilobytes
+ * @param pushed_at Time of the upstream's last push
+ */
+static void add(struct sched *sched, const char *name, long long disk_usage,
+		time_t pushed_at)
+{
+	char url[128];
+	snprintf(url, sizeof(url), "https://budget.example/me/%s", name);
+	const struct repo_ctx ctx = {
+			.owner = "me",
+			.name = name,
+			.url = url,
+			.pushed_at = pushed_at,
+	};
+	assert_int_equal(sched_add(sched, &ctx, disk_usage, 0), 0);
+}
+
+static void parse_budget_test(void **state)
+{
+	(void) state;
+	long long ms = -1;
+
+	assert_int_equal(sched_parse_budget("30m", &ms), 0);
+	assert_int_equal(ms, 30 * 60 * 1000);
+	assert_int_equal(sched_parse_budget("2h", &ms), 0);
+	assert_int_equal(ms, 2 * 60 * 60 * 1000);
+	assert_int_equal(sched_parse_budget("45", &ms), 0);
+	assert_int_equal(ms, 45 * 1000);
+	assert_int_equal(sched_parse_budget("90s", &ms), 0);
+	assert_int_equal(ms, 90 * 1000);
+	assert_int_equal(sched_parse_budget("168h", &ms), 0);
+	assert_int_equal(ms, 7LL * 24 * 60 * 60 * 1000);
+
+	ms = -1;
+	assert_int_equal(sched_parse_budget("0", &ms), -1);
+	assert_int_equal(sched_parse_budget("0m", &ms), -1);
+	assert_int_equal(sched_parse_budget("5x", &ms), -1);
+	assert_int_equal(sched_parse_budget("1mm", &ms), -1);
+	assert_int_equal(sched_parse_budget("m", &ms), -1);
+	assert_int_equal(sched_parse_budget("", &ms), -1);
+	assert_int_equal(sched_parse_budget("-5m", &ms), -1);
+	assert_int_equal(sched_parse_budget("+5m", &ms), -1);
+	assert_int_equal(sched_parse_budget(" 5m", &ms), -1);
+	assert_int_equal(sched_parse_budget("1.5h", &ms), -1);
+	// Longer than a week, or than a long long holds
+	assert_int_equal(sched_parse_budget("169h", &ms), -1);
+	assert_int_equal(sched_parse_budget("10081m", &ms), -1);
+	assert_int_equal(sched_parse_budget("604801", &ms), -1);
+	assert_int_equal(sched_parse_budget("9223372036854775807h", &ms), -1);
+	assert_int_equal(sched_parse_budget("99999999999999999999", &ms), -1);
+	assert_int_equal(ms, -1);
+}
+
+static void budget_order_test(void **state)
+{
+	(void) state;
+	const time_t now = time(NULL);
+
+	// Mirrored before and pushed to since, the stalest or else the
+	// cheapest first
+	state_update("me", "stale-cheap", 0, 5000, 0, NULL);
+	state_update("me", "stale-dear", 0, 20000, 0, NULL);
+	// Mirrored after its last push, and cheaper than any other
+	state_update("me", "fresh", 0, 10, 0, NULL);
+
+	struct sched *sched = sched_new();
+	assert_non_null(sched);
+	add(sched, "fresh", 0, 1);
+	add(sched, "clone-big", 102400, 0);
+	add(sched, "stale-cheap", 0, now + 3600);
+	add(sched, "clone-small", 0, 0);
+	add(sched, "stale-dear", 0, now + 3600);
+	add(sched, "clone-mid", 10240, 0);
+
+	result = 0;
+	sched_budget(sched, 60 * 60 * 1000);
+	assert_int_equal(sched_run(sched, 1, 1, 0, 1), 0);
+	sched_free(sched);
+
+	// Stale mirrors first, then clones cheapest first, current ones last
+	const char *const order[] = {
+			"stale-cheap", "stale-dear",  "clone-small",
+			"clone-mid",   "clone-big",   "fresh",
+	};
+	assert_int_equal(ran_len, 6);
+	for (size_t i = 0; i < ran_len; i++)
+		assert_string_equal(ran[i], order[i]);
+}
+
+static void budget_defer_test(void **state)
+{
+	(void) state;
+	const long long deferred = metrics_get(metric_jobs_deferred);
+	struct sched *sched = sched_new();
+	assert_non_null(sched);
+	// Expected to take 1s, 11s and 2s
+	add(sched, "small", 0, 0);
+	add(sched, "huge", 102400, 0);
+	add(sched, "medium", 10240, 0);
+
+	// Jobs take 0.2s of a 2.1s budget
+	result = 0;
+	job_ms = 200;
+	sched_budget(sched, 2100);
+	assert_int_equal(sched_run(sched, 1, 1, 0, 1), 0);
+	sched_free(sched);
+
+	// The 2s job fits the budget, but no longer once the first job ran,
+	// and the 11s job never would
+	assert_int_equal(ran_len, 1);
+	assert_string_equal(ran[0], "small");
+	assert_int_equal(metrics_get(metric_jobs_deferred), deferred + 2);
+	assert_int_equal(summary_print(), 0);
+}
+
+static void budget_overdue_test(void **state)
+{
+	(void) state;
+	struct state_record rec;
+	result = 0;
+
+	for (unsigned run = 1; run <= 4; run++) {
+		struct sched *sched = sched_new();
+		assert_non_null(sched);
+		// Expected to take 1s and 11s, of a 2s budget
+		add(sched, "small", 0, 0);
+		add(sched, "huge", 102400, 0);
+		ran_len = 0;
+		sched_budget(sched, 2000);
+		assert_int_equal(sched_run(sched, 1, 1, 0, 1), 0);
+		sched_free(sched);
+		assert_int_equal(summary_print(), 0);
+		assert_true(state_get("me", "huge", &rec));
+
+		if (run <= 3) {
+			// Deferred, but counted
+			assert_int_equal(ran_len, 1);
+			assert_string_equal(ran[0], "small");
+			assert_int_equal(rec.deferrals, run);
+			assert_int_equal(rec.last_success, 0);
+		} else {
+			// Overdue, so it starts first regardless of the budget
+			assert_int_equal(ran_len, 2);
+			assert_string_equal(ran[0], "huge");
+			assert_string_equal(ran[1], "small");
+			assert_int_equal(rec.deferrals, 0);
+			assert_true(rec.last_success > 0);
+		}
+	}
+}
+
+static void budget_retry_test(void **state)
+{
+	(void) state;
+	const long long retried = metrics_get(metric_jobs_retried);
+	const long long deferred = metrics_get(metric_jobs_deferred);
+	struct sched *sched = sched_new();
+	assert_non_null(sched);
+	add(sched, "flaky", 0, 0);
+
+	// Expected to take 1s, but fails after 0.3s of a 1.2s budget, so no
+	// retry can finish in time
+	result = -2;
+	job_ms = 300;
+	sched_budget(sched, 1200);
+	assert_int_equal(sched_run(sched, 1, 1, 3, 1), -1);
+	sched_free(sched);
+
+	assert_int_equal(ran_len, 1);
+	assert_int_equal(metrics_get(metric_jobs_retried), retried);
+	assert_int_equal(metrics_get(metric_jobs_deferred), deferred);
+	assert_int_equal(summary_print(), 1);
+}
+
+static void permanent_failure_test(void **state)
+{
+	(void) state;
+	// More jobs than it takes to open a breaker
+	struct sched *sched = queue("gone.example", 8);
+	const long long retried = metrics_get(metric_jobs_retried);
+
+	result = -1;
+	assert_int_equal(sched_run(sched, 1, 1, 3, 1), -1);
+	sched_free(sched);
+
+	// Every job ran once, without retries, and the host stays usable
+	assert_int_equal(ran_len, 8);
+	assert_int_equal(metrics_get(metric_jobs_retried), retried);
+	assert_int_equal(breaker_check("gone.example"), 0);
+	assert_int_equal(summary_print(), 8);
+}
+
+static void transient_failure_test(void **state)
+{
+	(void) state;
+	struct sched *sched = queue("down.example", 5);
+
+	result = -2;
+	assert_int_equal(sched_run(sched, 1, 1, 0, 1), -1);
+	sched_free(sched);
+
+	assert_int_equal(ran_len, 5);
+	assert_true(breaker_check("down.example") > 0);
+	assert_int_equal(summary_print(), 5);
+}
+
+static void permanent_failure_limit_test(void **state)
+{
+	(void) state;
+	struct sched *sched = queue("limit.example", 12);
+	const long long decreases =
+			metrics_get(metric_concurrency_decreases_failure);
+
+	// The first 4 grow the limit to the maximum, the rest fail for good
+	succeed_below = 4;
+	result = -1;
+	assert_int_equal(sched_run(sched, 1, 4, 0, 1), -1);
+	sched_free(sched);
+
+	assert_int_equal(ran_len, 12);
+	assert_int_equal(metrics_get(metric_concurrency_decreases_failure),
+			 decreases);
+	assert_int_equal(metrics_get(metric_concurrency_limit), 4);
+	assert_int_equal(summary_print(), 8);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup(permanent_failure_test, setup),
+		cmocka_unit_test_setup(transient_failure_test, setup),
+		cmocka_unit_test_setup(permanent_failure_limit_test, setup),
+		cmocka_unit_test(parse_budget_test),
+		cmocka_unit_test_setup_teardown(budget_order_test, setup_state,
+						teardown_state),
+		cmocka_unit_test_setup(budget_defer_test, setup),
+		cmocka_unit_test_setup(budget_retry_test, setup),
+		cmocka_unit_test_setup_teardown(budget_overdue_test, setup_state,
+						teardown_state),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
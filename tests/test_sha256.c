@@ -0,0 +1,64 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <string.h>
+
+#include "../src/sha256.h"
+
+static void digest(const char *input, char hex[SHA256_HEX_LEN + 1])
+{
+	struct sha256 ctx;
+	sha256_init(&ctx);
+	sha256_update(&ctx, input, strlen(input));
+	sha256_final(&ctx, hex);
+}
+
+static void vectors_test(void **state)
+{
+	(void) state;
+	char hex[SHA256_HEX_LEN + 1];
+
+	digest("", hex);
+	assert_string_equal(hex, "e3b0c44298fc1c149afbf4c8996fb924"
+				 "27ae41e4649b934ca495991b7852b855");
+	digest("abc", hex);
+	assert_string_equal(hex, "ba7816bf8f01cfea414140de5dae2223"
+				 "b00361a396177a9cb410ff61f20015ad");
+	// Padding spills into a second block
+	digest("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+	       hex);
+	assert_string_equal(hex, "248d6a61d20638b8e5c026930c3e6039"
+				 "a33ce45964ff2167f6ecedd419db06c1");
+}
+
+static void incremental_test(void **state)
+{
+	(void) state;
+	char a[1000], hex[SHA256_HEX_LEN + 1];
+	memset(a, 'a', sizeof(a));
+
+	// A million a's, fed in pieces that straddle block boundaries
+	struct sha256 ctx;
+	sha256_init(&ctx);
+	for (size_t done = 0, n = 1; done < 1000000; done += n, n = n % 997 + 1)
+		sha256_update(&ctx, a, n < 1000000 - done ? n : 1000000 - done);
+	sha256_final(&ctx, hex);
+	assert_string_equal(hex, "cdc76e5c9914fb9281a1c7e284d73e67"
+				 "f1809a48a497200e046d39ccc7112cd0");
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(vectors_test),
+		cmocka_unit_test(incremental_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
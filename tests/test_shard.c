@@ -0,0 +1,81 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+
+#include "../src/shard.h"
+
+#define KEYS 10000
+
+static uint64_t test_key(int i)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "repo-%d", i);
+	return shard_key("owner", name);
+}
+
+static void shard_key_case_test(void **state)
+{
+	(void) state;
+	assert_true(shard_key("Owner", "Repo") == shard_key("owner", "repo"));
+	assert_false(shard_key("owner", "repo") == shard_key("owner", "rep"));
+	assert_false(shard_key("own", "er/repo") == shard_key("owne", "r/repo"));
+}
+
+static void shard_single_test(void **state)
+{
+	(void) state;
+	for (int i = 0; i < 100; i++)
+		assert_int_equal(shard_of(test_key(i), 1), 0);
+}
+
+static void shard_balance_test(void **state)
+{
+	(void) state;
+	unsigned counts[4] = {0};
+	for (int i = 0; i < KEYS; i++) {
+		const unsigned shard = shard_of(test_key(i), 4);
+		assert_true(shard < 4);
+		counts[shard]++;
+	}
+	for (int i = 0; i < 4; i++) {
+		assert_true(counts[i] > KEYS / 4 * 9 / 10);
+		assert_true(counts[i] < KEYS / 4 * 11 / 10);
+	}
+}
+
+static void shard_grow_test(void **state)
+{
+	(void) state;
+	// Growing from 4 to 5 shards only moves keys onto the new shard, and
+	// about a fifth of them
+	int moved = 0;
+	for (int i = 0; i < KEYS; i++) {
+		const unsigned before = shard_of(test_key(i), 4);
+		const unsigned after = shard_of(test_key(i), 5);
+		if (before != after) {
+			assert_int_equal(after, 4);
+			moved++;
+		}
+	}
+	assert_true(moved > KEYS / 5 * 9 / 10);
+	assert_true(moved < KEYS / 5 * 11 / 10);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(shard_key_case_test),
+		cmocka_unit_test(shard_single_test),
+		cmocka_unit_test(shard_balance_test),
+		cmocka_unit_test(shard_grow_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
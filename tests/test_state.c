@@ -0,0 +1,246 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/state.h"
+
+#define OID "0123456789abcdef0123456789abcdef01234567"
+
+static int setup(void **state)
+{
+	char tmpl[] = "/tmp/state-test-XXXXXX";
+	if (!mkdtemp(tmpl))
+		return -1;
+	*state = strdup(tmpl);
+	return *state ? 0 : -1;
+}
+
+static void write_file(const char *base, const char *file, const char *data)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", base, file);
+	FILE *f = fopen(path, "w");
+	assert_non_null(f);
+	fputs(data, f);
+	fclose(f);
+}
+
+static void remove_file(const char *base, const char *file)
+{
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", base, file);
+	unlink(path);
+}
+
+static int teardown(void **state)
+{
+	const char *base = *state;
+	remove_file(base, "me/a.git/refs/heads/main");
+	remove_file(base, "me/a.git/HEAD");
+	remove_file(base, "me/b.git/packed-refs");
+	remove_file(base, "me/b.git/HEAD");
+	remove_file(base, ".github-mirror-history");
+	remove_file(base, STATE_FILE);
+	const char *dirs[] = {"me/a.git/refs/heads", "me/a.git/refs",
+			      "me/a.git", "me/b.git", "me"};
+	for (size_t i = 0; i < sizeof(dirs) / sizeof(*dirs); i++) {
+		char path[256];
+		snprintf(path, sizeof(path), "%s/%s", base, dirs[i]);
+		rmdir(path);
+	}
+	rmdir(base);
+	free(*state);
+	return 0;
+}
+
+static int find_key(const struct state_record *rec, void *arg)
+{
+	const struct state_record **found = arg;
+	if (!strcmp(rec->key, (*found)->key)) {
+		*found = rec;
+		return 1;
+	}
+	return 0;
+}
+
+/// Copies the record of a key, or returns 0 if there is none
+static int lookup(const char *key, struct state_record *out)
+{
+	struct state_record want;
+	snprintf(want.key, sizeof(want.key), "%s", key);
+	const struct state_record *found = &want;
+	state_each(find_key, &found);
+	if (found == &want)
+		return 0;
+	*out = *found;
+	return 1;
+}
+
+static void state_update_test(void **state)
+{
+	const char *base = *state;
+	char path[256];
+	const char *dirs[] = {"me", "me/a.git", "me/a.git/refs",
+			      "me/a.git/refs/heads", "me/b.git"};
+	for (size_t i = 0; i < sizeof(dirs) / sizeof(*dirs); i++) {
+		snprintf(path, sizeof(path), "%s/%s", base, dirs[i]);
+		assert_int_equal(mkdir(path, 0755), 0);
+	}
+	// Loose and packed refs
+	write_file(base, "me/a.git/HEAD", "ref: refs/heads/main\n");
+	write_file(base, "me/a.git/refs/heads/main", OID "\n");
+	write_file(base, "me/b.git/HEAD", "ref: refs/heads/trunk\n");
+	write_file(base, "me/b.git/packed-refs",
+		   "# pack-refs with: peeled fully-peeled sorted\n"
+		   "1111111111111111111111111111111111111111 refs/heads/main\n"
+		   OID " refs/heads/trunk\n");
+
+	assert_int_equal(state_open(base, 0), 0);
+	assert_int_equal(state_duration("me", "a"), -1);
+	state_update("me", "a", 0, 1500, 1000, NULL);
+	state_update("me", "b", 0, 200, 0, NULL);
+	state_update("me", "b", -2, 300, 0, "transfer failed");
+	state_update("me", "c", -1, 10, 0, "error");
+	assert_int_equal(state_duration("me", "a"), 1500);
+	assert_int_equal(state_duration("me", "b"), 200);
+	assert_int_equal(state_duration("me", "c"), -1);
+	state_close();
+
+	// Read back, as status does
+	struct state_record rec;
+	assert_int_equal(state_open(base, 1), 0);
+	assert_int_equal(lookup("me/a", &rec), 1);
+	assert_string_equal(rec.tip, OID);
+	assert_int_equal(rec.pushed_at, 1000);
+	assert_int_equal(rec.failures, 0);
+	assert_string_equal(rec.error, "");
+	assert_true(rec.last_success > 0);
+
+	assert_int_equal(lookup("me/b", &rec), 1);
+	assert_string_equal(rec.tip, OID);
+	assert_int_equal(rec.status, -2);
+	assert_int_equal(rec.failures, 1);
+	assert_string_equal(rec.error, "transfer failed");
+	assert_int_equal(rec.duration_ms, 200);
+
+	assert_int_equal(lookup("me/c", &rec), 1);
+	assert_int_equal(rec.last_success, 0);
+	assert_string_equal(rec.tip, "");
+	assert_int_equal(lookup("me/d", &rec), 0);
+
+	assert_int_equal(state_get("me", "b", &rec), 1);
+	assert_string_equal(rec.key, "me/b");
+	assert_int_equal(rec.failures, 1);
+	assert_int_equal(state_get("me", "d", &rec), 0);
+
+	// Read-only opens don't record anything
+	state_update("me", "d", 0, 10, 0, NULL);
+	assert_int_equal(lookup("me/d", &rec), 0);
+	state_close();
+}
+
+static void state_grow_test(void **state)
+{
+	const char *base = *state;
+	assert_int_equal(state_open(base, 0), 0);
+	char name[32];
+	for (int i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "repo%d", i);
+		state_update("me", name, 0, i, 0, NULL);
+	}
+	state_close();
+
+	assert_int_equal(state_open(base, 0), 0);
+	for (int i = 0; i < 1000; i++) {
+		snprintf(name, sizeof(name), "repo%d", i);
+		assert_int_equal(state_duration("me", name), i);
+	}
+	state_close();
+}
+
+static void state_torn_test(void **state)
+{
+	const char *base = *state;
+	assert_int_equal(state_open(base, 0), 0);
+	state_update("me", "a", 0, 100, 0, NULL);
+	state_update("me", "b", 0, 200, 0, NULL);
+	state_close();
+
+	// Corrupt the record of me/a as a crash in the middle of a write would
+	char path[256];
+	snprintf(path, sizeof(path), "%s/%s", base, STATE_FILE);
+	FILE *f = fopen(path, "r+b");
+	assert_non_null(f);
+	struct state_record rec;
+	long off = (long) sizeof(rec);
+	for (;;) {
+		assert_int_equal(fseek(f, off, SEEK_SET), 0);
+		assert_int_equal(fread(&rec, sizeof(rec), 1, f), 1);
+		if (!strcmp(rec.key, "me/a"))
+			break;
+		off += (long) sizeof(rec);
+	}
+	rec.duration_ms = 999;
+	fseek(f, off, SEEK_SET);
+	fwrite(&rec, sizeof(rec), 1, f);
+	fclose(f);
+
+	assert_int_equal(state_open(base, 0), 0);
+	assert_int_equal(state_duration("me", "a"), -1);
+	assert_int_equal(state_duration("me", "b"), 200);
+	// The record is rewritten on the next update
+	state_update("me", "a", 0, 300, 0, NULL);
+	assert_int_equal(state_duration("me", "a"), 300);
+	state_close();
+
+	// Anything but a database is replaced
+	write_file(base, STATE_FILE, "garbage");
+	assert_int_equal(state_open(base, 1), -1);
+	assert_int_equal(state_open(base, 0), 0);
+	assert_int_equal(state_duration("me", "b"), -1);
+	state_close();
+}
+
+static void state_import_test(void **state)
+{
+	const char *base = *state;
+	write_file(base, ".github-mirror-history", "me/a\t1234\nme/b\t5\n");
+
+	assert_int_equal(state_open(base, 1), 1);
+	assert_int_equal(state_open(base, 0), 0);
+	assert_int_equal(state_duration("me", "a"), 1234);
+	assert_int_equal(state_duration("me", "b"), 5);
+	state_close();
+
+	// The history is imported only once
+	char path[256];
+	snprintf(path, sizeof(path), "%s/.github-mirror-history", base);
+	assert_int_equal(access(path, F_OK), -1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test_setup_teardown(state_update_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(state_grow_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(state_torn_test, setup,
+						teardown),
+		cmocka_unit_test_setup_teardown(state_import_test, setup,
+						teardown),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,96 @@
+//
+// Created by Anshul Gupta on 10/19/26.
+//
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <setjmp.h>
+#include <stdint.h>
+#include <cmocka.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../src/timing.h"
+
+/// Records a run of a phase that took the given time
+static void record(enum phase p, long long us)
+{
+	timing_since(p, timing_now() - us);
+}
+
+static void percentile_test(void **state)
+{
+	(void) state;
+	assert_int_equal(timing_percentile(phase_url, 0.5), 0);
+
+	// 1ms to 100ms
+	for (long long i = 1; i <= 100; i++)
+		record(phase_fetch, i * 1000);
+	const long long p50 = timing_percentile(phase_fetch, 0.5);
+	const long long p95 = timing_percentile(phase_fetch, 0.95);
+	assert_in_range(p50, 50000, 50000 + 50000 / 8);
+	assert_in_range(p95, 95000, 95000 + 95000 / 8);
+	// Estimates never exceed the slowest run
+	const long long max = timing_percentile(phase_fetch, 1);
+	assert_in_range(max, 100000, 100100);
+
+	// Short runs are exact
+	record(phase_exists, 5);
+	record(phase_exists, 5);
+	assert_in_range(timing_percentile(phase_exists, 0.5), 5, 6);
+}
+
+static void slowest_test(void **state)
+{
+	(void) state;
+	for (int i = 0; i < TIMING_TOP + 5; i++) {
+		char name[16];
+		snprintf(name, sizeof(name), "repo%d", i);
+		timing_repo("me", name, (long long) (i + 1) * 1000000);
+	}
+	// A retry only replaces a faster attempt
+	timing_repo("me", "repo3", 60000000);
+	timing_repo("me", "repo3", 1000000);
+
+	const char *path = "test_timing.json";
+	assert_int_equal(timing_write_json(path), 0);
+	char buf[8192];
+	FILE *f = fopen(path, "r");
+	assert_non_null(f);
+	const size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+	buf[n] = '\0';
+	fclose(f);
+	remove(path);
+
+	const char *slowest = strstr(buf, "\"slowest\":[");
+	assert_non_null(slowest);
+	assert_non_null(strstr(slowest, "{\"repo\":\"me/repo3\","
+					"\"seconds\":60.000000},"
+					"{\"repo\":\"me/repo14\","
+					"\"seconds\":15.000000},"));
+	assert_null(strstr(slowest, "\"me/repo4\""));
+	size_t repos = 0;
+	for (const char *p = slowest; (p = strstr(p, "\"repo\"")); p++)
+		repos++;
+	assert_int_equal(repos, TIMING_TOP);
+
+	// Every phase is written, including those that never ran
+	assert_non_null(strstr(buf, "\"precheck\":{\"count\":0,"));
+}
+
+static void write_error_test(void **state)
+{
+	(void) state;
+	assert_int_equal(timing_write_json("/nonexistent/timings.json"), -1);
+}
+
+int main(void)
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(percentile_test),
+		cmocka_unit_test(slowest_test),
+		cmocka_unit_test(write_error_test),
+	};
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}